@@ -0,0 +1,802 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Benchmarks for the common operations of libbson, modeled on the BSON
+ * micro-benchmarks of the MongoDB driver benchmarking specification.
+ *
+ * Three corpora are generated deterministically, so that results from
+ * different builds and releases of libbson are comparable:
+ *
+ *   flat: one level of strings, numbers and booleans
+ *   deep: a tree of embedded documents
+ *   full: every BSON type that extended JSON can represent
+ *
+ * and each is encoded, decoded, iterated, validated and converted to and
+ * from extended JSON. ObjectID generation is measured too.
+ *
+ * Each benchmark runs iterations of a fixed number of operations, until
+ * it has run for at least --min-time seconds and at least 5 iterations,
+ * or for --max-iterations iterations. The median iteration is reported as
+ * a JSON document on stdout, for instance:
+ *
+ *   bson-bench flat deep_decode
+ *
+ * runs every benchmark whose name starts with "flat" or "deep_decode".
+ */
+
+
+#include <bson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+#define MIN_ITERATIONS 5
+#define DOCS_PER_ITERATION 1000
+#define OIDS_PER_ITERATION 1000000
+#define OIDS_PER_BATCH 1000
+
+
+typedef struct {
+   const char *name;
+   bson_t bson;
+   char *json;
+   size_t json_len;
+} corpus_t;
+
+
+typedef struct {
+   const char *name;
+   const char *description;
+   corpus_t *corpus;
+   void (*run) (corpus_t *corpus);
+   /* per iteration */
+   int64_t ops;
+   int64_t bytes;
+} bench_t;
+
+
+/* results are summed here so that no work can be optimized away */
+static volatile uint64_t gSink;
+static uint64_t gRandom = 0x853c49e6748fea9bull;
+
+
+static uint32_t
+random_uint32 (void)
+{
+   /* xorshift64*, the same on every platform */
+   gRandom ^= gRandom >> 12;
+   gRandom ^= gRandom << 25;
+   gRandom ^= gRandom >> 27;
+
+   return (uint32_t) ((gRandom * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+
+static void
+random_string (char *buf, int min_len, int max_len)
+{
+   int len;
+   int i;
+
+   len = min_len + (int) (random_uint32 () % (uint32_t) (max_len - min_len));
+
+   for (i = 0; i < len; i++) {
+      buf[i] = (char) ('a' + random_uint32 () % 26);
+   }
+
+   buf[len] = '\0';
+}
+
+
+static void
+build_flat (bson_t *bson)
+{
+   char key[32];
+   char value[64];
+   int i;
+
+   for (i = 0; i < 400; i++) {
+      random_string (key, 6, 20);
+
+      switch (random_uint32 () % 8) {
+      case 0:
+      case 1:
+      case 2:
+         random_string (value, 1, 60);
+         BSON_APPEND_UTF8 (bson, key, value);
+         break;
+      case 3:
+      case 4:
+         BSON_APPEND_INT32 (bson, key, (int32_t) random_uint32 ());
+         break;
+      case 5:
+         BSON_APPEND_INT64 (
+            bson, key, (int64_t) random_uint32 () << 32 | random_uint32 ());
+         break;
+      case 6:
+         BSON_APPEND_DOUBLE (
+            bson, key, (double) random_uint32 () / (random_uint32 () | 1));
+         break;
+      default:
+         BSON_APPEND_BOOL (bson, key, random_uint32 () & 1);
+         break;
+      }
+   }
+}
+
+
+static void
+build_deep (bson_t *bson, int depth)
+{
+   char value[64];
+   bson_t child;
+
+   random_string (value, 5, 40);
+   BSON_APPEND_UTF8 (bson, "name", value);
+   random_string (value, 5, 40);
+   BSON_APPEND_UTF8 (bson, "path", value);
+
+   if (depth == 0) {
+      return;
+   }
+
+   BSON_APPEND_DOCUMENT_BEGIN (bson, "left", &child);
+   build_deep (&child, depth - 1);
+   bson_append_document_end (bson, &child);
+
+   BSON_APPEND_DOCUMENT_BEGIN (bson, "right", &child);
+   build_deep (&child, depth - 1);
+   bson_append_document_end (bson, &child);
+}
+
+
+static void
+build_full (bson_t *bson)
+{
+   const char *key;
+   char value[64];
+   char buf[16];
+   uint8_t binary[32];
+   bson_decimal128_t dec;
+   bson_oid_t oid;
+   bson_t *scope;
+   bson_t child;
+   bson_t array;
+   uint32_t i;
+   uint32_t j;
+
+   scope = BCON_NEW ("x", BCON_INT32 (1), "y", BCON_UTF8 ("z"));
+
+   for (i = 0; i < 50; i++) {
+      bson_uint32_to_string (i, &key, buf, sizeof buf);
+      bson_append_document_begin (bson, key, -1, &child);
+
+      random_string (value, 5, 40);
+      BSON_APPEND_UTF8 (&child, "string", value);
+      BSON_APPEND_INT32 (&child, "int32", (int32_t) random_uint32 ());
+      BSON_APPEND_INT64 (&child,
+                         "int64",
+                         (int64_t) random_uint32 () << 32 | random_uint32 ());
+      BSON_APPEND_DOUBLE (
+         &child, "double", (double) random_uint32 () / (random_uint32 () | 1));
+      bson_decimal128_from_string ("1234.5678E-90", &dec);
+      BSON_APPEND_DECIMAL128 (&child, "decimal128", &dec);
+      BSON_APPEND_BOOL (&child, "bool", random_uint32 () & 1);
+      BSON_APPEND_NULL (&child, "null");
+      bson_oid_init_from_string (&oid, "5a1b2c3d4e5f60718293a4b5");
+      BSON_APPEND_OID (&child, "oid", &oid);
+      BSON_APPEND_DATE_TIME (
+         &child, "date", 1500000000000ll + random_uint32 ());
+      BSON_APPEND_TIMESTAMP (&child, "timestamp", random_uint32 (), i);
+
+      for (j = 0; j < sizeof binary; j++) {
+         binary[j] = (uint8_t) random_uint32 ();
+      }
+
+      BSON_APPEND_BINARY (
+         &child, "binary", BSON_SUBTYPE_BINARY, binary, sizeof binary);
+      BSON_APPEND_REGEX (&child, "regex", "^[a-z]+\\d*$", "im");
+      BSON_APPEND_CODE (&child, "code", "function () { return 1; }");
+      BSON_APPEND_CODE_WITH_SCOPE (
+         &child, "code_w_scope", "function () { return x; }", scope);
+      BSON_APPEND_MINKEY (&child, "minkey");
+      BSON_APPEND_MAXKEY (&child, "maxkey");
+
+      BSON_APPEND_ARRAY_BEGIN (&child, "array", &array);
+      for (j = 0; j < 10; j++) {
+         bson_uint32_to_string (j, &key, buf, sizeof buf);
+         bson_append_int32 (&array, key, -1, (int32_t) random_uint32 ());
+      }
+      bson_append_array_end (&child, &array);
+
+      bson_append_document_end (bson, &child);
+   }
+
+   bson_destroy (scope);
+}
+
+
+static void
+corpus_init (corpus_t *corpus, const char *name)
+{
+   corpus->name = name;
+   bson_init (&corpus->bson);
+
+   if (!strcmp (name, "flat")) {
+      build_flat (&corpus->bson);
+   } else if (!strcmp (name, "deep")) {
+      build_deep (&corpus->bson, 8);
+   } else {
+      build_full (&corpus->bson);
+   }
+
+   corpus->json =
+      bson_as_canonical_extended_json (&corpus->bson, &corpus->json_len);
+   BSON_ASSERT (corpus->json);
+}
+
+
+static void
+corpus_destroy (corpus_t *corpus)
+{
+   bson_destroy (&corpus->bson);
+   bson_free (corpus->json);
+}
+
+
+/* append each value to @dst with the bson_append function for its type */
+static void
+encode (bson_t *dst, bson_iter_t *iter)
+{
+   bson_decimal128_t dec;
+   const uint8_t *data;
+   const char *options;
+   const char *str;
+   bson_subtype_t subtype;
+   bson_iter_t child;
+   bson_t child_dst;
+   bson_t scope;
+   uint32_t len;
+   uint32_t scope_len;
+   uint32_t timestamp;
+   uint32_t increment;
+   const char *key;
+
+   while (bson_iter_next (iter)) {
+      key = bson_iter_key (iter);
+
+      switch (bson_iter_type (iter)) {
+      case BSON_TYPE_DOUBLE:
+         bson_append_double (dst, key, -1, bson_iter_double (iter));
+         break;
+      case BSON_TYPE_UTF8:
+         str = bson_iter_utf8 (iter, &len);
+         bson_append_utf8 (dst, key, -1, str, (int) len);
+         break;
+      case BSON_TYPE_DOCUMENT:
+         bson_iter_recurse (iter, &child);
+         bson_append_document_begin (dst, key, -1, &child_dst);
+         encode (&child_dst, &child);
+         bson_append_document_end (dst, &child_dst);
+         break;
+      case BSON_TYPE_ARRAY:
+         bson_iter_recurse (iter, &child);
+         bson_append_array_begin (dst, key, -1, &child_dst);
+         encode (&child_dst, &child);
+         bson_append_array_end (dst, &child_dst);
+         break;
+      case BSON_TYPE_BINARY:
+         bson_iter_binary (iter, &subtype, &len, &data);
+         bson_append_binary (dst, key, -1, subtype, data, len);
+         break;
+      case BSON_TYPE_OID:
+         bson_append_oid (dst, key, -1, bson_iter_oid (iter));
+         break;
+      case BSON_TYPE_BOOL:
+         bson_append_bool (dst, key, -1, bson_iter_bool (iter));
+         break;
+      case BSON_TYPE_DATE_TIME:
+         bson_append_date_time (dst, key, -1, bson_iter_date_time (iter));
+         break;
+      case BSON_TYPE_NULL:
+         bson_append_null (dst, key, -1);
+         break;
+      case BSON_TYPE_REGEX:
+         str = bson_iter_regex (iter, &options);
+         bson_append_regex (dst, key, -1, str, options);
+         break;
+      case BSON_TYPE_CODE:
+         str = bson_iter_code (iter, &len);
+         bson_append_code (dst, key, -1, str);
+         break;
+      case BSON_TYPE_CODEWSCOPE:
+         str = bson_iter_codewscope (iter, &len, &scope_len, &data);
+         BSON_ASSERT (bson_init_static (&scope, data, scope_len));
+         bson_append_code_with_scope (dst, key, -1, str, &scope);
+         break;
+      case BSON_TYPE_INT32:
+         bson_append_int32 (dst, key, -1, bson_iter_int32 (iter));
+         break;
+      case BSON_TYPE_TIMESTAMP:
+         bson_iter_timestamp (iter, &timestamp, &increment);
+         bson_append_timestamp (dst, key, -1, timestamp, increment);
+         break;
+      case BSON_TYPE_INT64:
+         bson_append_int64 (dst, key, -1, bson_iter_int64 (iter));
+         break;
+      case BSON_TYPE_DECIMAL128:
+         bson_iter_decimal128 (iter, &dec);
+         bson_append_decimal128 (dst, key, -1, &dec);
+         break;
+      case BSON_TYPE_MINKEY:
+         bson_append_minkey (dst, key, -1);
+         break;
+      case BSON_TYPE_MAXKEY:
+         bson_append_maxkey (dst, key, -1);
+         break;
+      case BSON_TYPE_EOD:
+      case BSON_TYPE_UNDEFINED:
+      case BSON_TYPE_DBPOINTER:
+      case BSON_TYPE_SYMBOL:
+      default:
+         bson_append_iter (dst, key, -1, iter);
+         break;
+      }
+   }
+}
+
+
+/* read every key and value */
+static uint64_t
+decode (bson_iter_t *iter)
+{
+   bson_decimal128_t dec;
+   const uint8_t *data;
+   const char *options;
+   bson_subtype_t subtype;
+   bson_iter_t child;
+   uint32_t len;
+   uint32_t scope_len;
+   uint32_t timestamp;
+   uint32_t increment;
+   uint64_t sum = 0;
+
+   while (bson_iter_next (iter)) {
+      sum += (uint64_t) strlen (bson_iter_key (iter));
+
+      switch (bson_iter_type (iter)) {
+      case BSON_TYPE_DOUBLE:
+         sum += (uint64_t) (int64_t) bson_iter_double (iter);
+         break;
+      case BSON_TYPE_UTF8:
+         sum += (uint64_t) (uintptr_t) bson_iter_utf8 (iter, &len) + len;
+         break;
+      case BSON_TYPE_DOCUMENT:
+      case BSON_TYPE_ARRAY:
+         bson_iter_recurse (iter, &child);
+         sum += decode (&child);
+         break;
+      case BSON_TYPE_BINARY:
+         bson_iter_binary (iter, &subtype, &len, &data);
+         sum += len + data[0];
+         break;
+      case BSON_TYPE_OID:
+         sum += bson_iter_oid (iter)->bytes[11];
+         break;
+      case BSON_TYPE_BOOL:
+         sum += bson_iter_bool (iter);
+         break;
+      case BSON_TYPE_DATE_TIME:
+         sum += (uint64_t) bson_iter_date_time (iter);
+         break;
+      case BSON_TYPE_REGEX:
+         sum += (uint64_t) (uintptr_t) bson_iter_regex (iter, &options);
+         break;
+      case BSON_TYPE_CODE:
+         sum += (uint64_t) (uintptr_t) bson_iter_code (iter, &len) + len;
+         break;
+      case BSON_TYPE_CODEWSCOPE:
+         sum += (uint64_t) (uintptr_t) bson_iter_codewscope (
+                   iter, &len, &scope_len, &data) +
+                scope_len;
+         break;
+      case BSON_TYPE_INT32:
+         sum += (uint64_t) bson_iter_int32 (iter);
+         break;
+      case BSON_TYPE_TIMESTAMP:
+         bson_iter_timestamp (iter, &timestamp, &increment);
+         sum += timestamp + increment;
+         break;
+      case BSON_TYPE_INT64:
+         sum += (uint64_t) bson_iter_int64 (iter);
+         break;
+      case BSON_TYPE_DECIMAL128:
+         bson_iter_decimal128 (iter, &dec);
+         sum += dec.low;
+         break;
+      case BSON_TYPE_EOD:
+      case BSON_TYPE_UNDEFINED:
+      case BSON_TYPE_NULL:
+      case BSON_TYPE_DBPOINTER:
+      case BSON_TYPE_SYMBOL:
+      case BSON_TYPE_MAXKEY:
+      case BSON_TYPE_MINKEY:
+      default:
+         sum++;
+         break;
+      }
+   }
+
+   return sum;
+}
+
+
+/* visit every element, without reading values */
+static uint64_t
+iterate (bson_iter_t *iter)
+{
+   bson_iter_t child;
+   uint64_t n = 0;
+
+   while (bson_iter_next (iter)) {
+      n++;
+
+      if (BSON_ITER_HOLDS_DOCUMENT (iter) || BSON_ITER_HOLDS_ARRAY (iter)) {
+         bson_iter_recurse (iter, &child);
+         n += iterate (&child);
+      }
+   }
+
+   return n;
+}
+
+
+static void
+run_encode (corpus_t *corpus)
+{
+   bson_iter_t iter;
+   bson_t dst;
+   int i;
+
+   bson_init (&dst);
+
+   for (i = 0; i < DOCS_PER_ITERATION; i++) {
+      bson_reinit (&dst);
+      BSON_ASSERT (bson_iter_init (&iter, &corpus->bson));
+      encode (&dst, &iter);
+      gSink += dst.len;
+   }
+
+   bson_destroy (&dst);
+}
+
+
+static void
+run_decode (corpus_t *corpus)
+{
+   bson_iter_t iter;
+   int i;
+
+   for (i = 0; i < DOCS_PER_ITERATION; i++) {
+      BSON_ASSERT (bson_iter_init (&iter, &corpus->bson));
+      gSink += decode (&iter);
+   }
+}
+
+
+static void
+run_iterate (corpus_t *corpus)
+{
+   bson_iter_t iter;
+   int i;
+
+   for (i = 0; i < DOCS_PER_ITERATION; i++) {
+      BSON_ASSERT (bson_iter_init (&iter, &corpus->bson));
+      gSink += iterate (&iter);
+   }
+}
+
+
+static void
+run_validate (corpus_t *corpus)
+{
+   size_t offset;
+   int i;
+
+   for (i = 0; i < DOCS_PER_ITERATION; i++) {
+      BSON_ASSERT (bson_validate (&corpus->bson, BSON_VALIDATE_UTF8, &offset));
+   }
+}
+
+
+static void
+run_to_json (corpus_t *corpus)
+{
+   size_t len;
+   char *json;
+   int i;
+
+   for (i = 0; i < DOCS_PER_ITERATION; i++) {
+      json = bson_as_canonical_extended_json (&corpus->bson, &len);
+      gSink += len;
+      bson_free (json);
+   }
+}
+
+
+static void
+run_from_json (corpus_t *corpus)
+{
+   bson_error_t error;
+   bson_t dst;
+   int i;
+
+   for (i = 0; i < DOCS_PER_ITERATION; i++) {
+      if (!bson_init_from_json (
+             &dst, corpus->json, (ssize_t) corpus->json_len, &error)) {
+         fprintf (stderr, "bson_init_from_json: %s\n", error.message);
+         abort ();
+      }
+
+      gSink += dst.len;
+      bson_destroy (&dst);
+   }
+}
+
+
+static void
+run_oid_init (corpus_t *corpus)
+{
+   bson_oid_t oid;
+   int i;
+
+   for (i = 0; i < OIDS_PER_ITERATION; i++) {
+      bson_oid_init (&oid, NULL);
+      gSink += oid.bytes[11];
+   }
+}
+
+
+static void
+run_oid_init_many (corpus_t *corpus)
+{
+   bson_oid_t oids[OIDS_PER_BATCH];
+   int i;
+
+   for (i = 0; i < OIDS_PER_ITERATION / OIDS_PER_BATCH; i++) {
+      bson_oid_init_many (oids, OIDS_PER_BATCH, NULL);
+      gSink += oids[OIDS_PER_BATCH - 1].bytes[11];
+   }
+}
+
+
+static int
+compare_int64 (const void *a, const void *b)
+{
+   int64_t x = *(const int64_t *) a;
+   int64_t y = *(const int64_t *) b;
+
+   return (x > y) - (x < y);
+}
+
+
+static void
+run_bench (bench_t *bench,
+           double min_time,
+           int max_iterations,
+           bson_t *results,
+           uint32_t index)
+{
+   int64_t *times;
+   int64_t start;
+   int64_t total = 0;
+   double seconds;
+   const char *key;
+   char buf[16];
+   bson_t result;
+   int n = 0;
+
+   fprintf (stderr, "%s\n", bench->name);
+
+   times = bson_malloc ((size_t) max_iterations * sizeof (int64_t));
+
+   /* warm up */
+   bench->run (bench->corpus);
+
+   while (n < max_iterations &&
+          (n < MIN_ITERATIONS || (double) total < min_time * 1e6)) {
+      start = bson_get_monotonic_time ();
+      bench->run (bench->corpus);
+      times[n] = bson_get_monotonic_time () - start;
+      total += times[n];
+      n++;
+   }
+
+   qsort (times, (size_t) n, sizeof (int64_t), compare_int64);
+   seconds = (double) BSON_MAX (times[n / 2], 1) / 1e6;
+
+   bson_uint32_to_string (index, &key, buf, sizeof buf);
+   bson_append_document_begin (results, key, -1, &result);
+   BSON_APPEND_UTF8 (&result, "name", bench->name);
+   BSON_APPEND_INT32 (&result, "iterations", n);
+   BSON_APPEND_INT64 (&result, "ops", bench->ops);
+   BSON_APPEND_INT64 (&result, "bytes", bench->bytes);
+   BSON_APPEND_DOUBLE (&result, "median_sec", seconds);
+   BSON_APPEND_DOUBLE (&result, "ops_per_sec", (double) bench->ops / seconds);
+   BSON_APPEND_DOUBLE (
+      &result, "mb_per_sec", (double) bench->bytes / seconds / 1e6);
+   bson_append_document_end (results, &result);
+
+   bson_free (times);
+}
+
+
+static void
+usage (FILE *out)
+{
+   fprintf (out,
+            "usage: bson-bench [--min-time SECONDS] [--max-iterations N]\n"
+            "                  [--list] [BENCHMARK...]\n"
+            "\n"
+            "Runs the benchmarks whose names start with any of the\n"
+            "BENCHMARK arguments, or all benchmarks, and prints the\n"
+            "results as JSON.\n");
+}
+
+
+int
+main (int argc, char *argv[])
+{
+   corpus_t corpora[3];
+   bench_t benches[32];
+   bson_t doc;
+   bson_t results;
+   bool list = false;
+   double min_time = 1.0;
+   int max_iterations = 100;
+   int n_benches = 0;
+   int n_filters = 0;
+   uint32_t n_results = 0;
+   const char *filters[32];
+   char *json;
+   int i;
+   int j;
+   static const struct {
+      const char *suffix;
+      const char *description;
+      void (*run) (corpus_t *corpus);
+      bool json_input;
+   } ops[] = {
+      {"encode", "append each value with bson_append_*", run_encode, false},
+      {"decode", "read each value with bson_iter_*", run_decode, false},
+      {"iterate", "visit each element with bson_iter_next", run_iterate, false},
+      {"validate",
+       "bson_validate with BSON_VALIDATE_UTF8",
+       run_validate,
+       false},
+      {"to_json", "bson_as_canonical_extended_json", run_to_json, false},
+      {"from_json", "bson_init_from_json", run_from_json, true},
+   };
+
+   for (i = 1; i < argc; i++) {
+      if (!strcmp (argv[i], "--min-time") && i + 1 < argc) {
+         min_time = atof (argv[++i]);
+      } else if (!strcmp (argv[i], "--max-iterations") && i + 1 < argc) {
+         max_iterations = atoi (argv[++i]);
+      } else if (!strcmp (argv[i], "--list")) {
+         list = true;
+      } else if (!strcmp (argv[i], "--help") || !strcmp (argv[i], "-h")) {
+         usage (stdout);
+         return EXIT_SUCCESS;
+      } else if (argv[i][0] == '-' ||
+                 n_filters == (int) (sizeof filters / sizeof filters[0])) {
+         usage (stderr);
+         return EXIT_FAILURE;
+      } else {
+         filters[n_filters++] = argv[i];
+      }
+   }
+
+   if (max_iterations < 1) {
+      usage (stderr);
+      return EXIT_FAILURE;
+   }
+
+   corpus_init (&corpora[0], "flat");
+   corpus_init (&corpora[1], "deep");
+   corpus_init (&corpora[2], "full");
+
+   for (i = 0; i < 3; i++) {
+      for (j = 0; j < (int) (sizeof ops / sizeof ops[0]); j++) {
+         bench_t *bench = &benches[n_benches++];
+
+         bench->name =
+            bson_strdup_printf ("%s_%s", corpora[i].name, ops[j].suffix);
+         bench->description = ops[j].description;
+         bench->corpus = &corpora[i];
+         bench->run = ops[j].run;
+         bench->ops = DOCS_PER_ITERATION;
+         bench->bytes = DOCS_PER_ITERATION *
+                        (int64_t) (ops[j].json_input ? corpora[i].json_len
+                                                     : corpora[i].bson.len);
+      }
+   }
+
+   benches[n_benches].name = bson_strdup ("oid_init");
+   benches[n_benches].description = "bson_oid_init with the default context";
+   benches[n_benches].run = run_oid_init;
+   n_benches++;
+
+   benches[n_benches].name = bson_strdup ("oid_init_many");
+   benches[n_benches].description =
+      "bson_oid_init_many in batches of 1000 with the default context";
+   benches[n_benches].run = run_oid_init_many;
+   n_benches++;
+
+   for (i = n_benches - 2; i < n_benches; i++) {
+      benches[i].corpus = NULL;
+      benches[i].ops = OIDS_PER_ITERATION;
+      benches[i].bytes = OIDS_PER_ITERATION * (int64_t) sizeof (bson_oid_t);
+   }
+
+   bson_init (&doc);
+   BSON_APPEND_UTF8 (&doc, "libbson", bson_get_version ());
+   BSON_APPEND_DOUBLE (&doc, "min_time", min_time);
+   BSON_APPEND_INT32 (&doc, "max_iterations", max_iterations);
+   BSON_APPEND_ARRAY_BEGIN (&doc, "results", &results);
+
+   for (i = 0; i < n_benches; i++) {
+      bool selected = n_filters == 0;
+
+      for (j = 0; j < n_filters; j++) {
+         if (!strncmp (benches[i].name, filters[j], strlen (filters[j]))) {
+            selected = true;
+         }
+      }
+
+      if (!selected) {
+         continue;
+      } else if (list) {
+         printf ("%-20s %s\n", benches[i].name, benches[i].description);
+      } else {
+         run_bench (
+            &benches[i], min_time, max_iterations, &results, n_results++);
+      }
+   }
+
+   bson_append_array_end (&doc, &results);
+
+   if (!list) {
+      json = bson_as_relaxed_extended_json (&doc, NULL);
+      printf ("%s\n", json);
+      bson_free (json);
+   }
+
+   bson_destroy (&doc);
+
+   for (i = 0; i < n_benches; i++) {
+      bson_free ((char *) benches[i].name);
+   }
+
+   for (i = 0; i < 3; i++) {
+      corpus_destroy (&corpora[i]);
+   }
+
+   return EXIT_SUCCESS;
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * This program writes a sidecar index FILE.idx for a file of sequential
+ * BSON documents, with the offset of every document and, with -k, a sorted
+ * table of the values of one field. Given a document number or a value of
+ * the indexed field as well, it prints that document as JSON using the
+ * index.
+ *
+ * Try running it with:
+ *
+ * ./bson-file-index tests/binary/stream.bson
+ * ./bson-file-index tests/binary/stream.bson 999
+ * ./bson-file-index -k _id dump.bson
+ * ./bson-file-index -k _id dump.bson '{"$oid": "5a1e9d4b2e8b6b0f0c8c6a3e"}'
+ */
+
+
+#include <bson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+
+int
+main (int argc, char *argv[])
+{
+   bson_file_index_t *index;
+   const char *filename;
+   const char *key = NULL;
+   const char *lookup = NULL;
+   char *index_path;
+   char *json;
+   bson_error_t error;
+   bson_iter_t iter;
+   bson_t doc;
+   bson_t *wrapper;
+   bool found;
+   int i = 1;
+
+   if (argc > 2 && !strcmp (argv[1], "-k")) {
+      key = argv[2];
+      i = 3;
+   }
+
+   if (argc - i < 1 || argc - i > 2) {
+      fprintf (stderr, "usage: %s [-k KEY] FILE [N | VALUE]\n", argv[0]);
+      return 1;
+   }
+
+   filename = argv[i];
+   lookup = argv[i + 1];
+   index_path = bson_strdup_printf ("%s.idx", filename);
+
+   if (!lookup) {
+      if (!bson_file_index_build (filename, index_path, key, &error)) {
+         fprintf (stderr,
+                  "Failed to index \"%s\": %s\n",
+                  filename,
+                  error.message);
+         bson_free (index_path);
+         return 1;
+      }
+
+      bson_free (index_path);
+      return 0;
+   }
+
+   index = bson_file_index_open (filename, index_path, &error);
+   bson_free (index_path);
+   if (!index) {
+      fprintf (
+         stderr, "Failed to open \"%s\": %s\n", filename, error.message);
+      return 1;
+   }
+
+   if (key) {
+      /* parse the value as the JSON of {"v": VALUE} */
+      json = bson_strdup_printf ("{\"v\": %s}", lookup);
+      wrapper = bson_new_from_json ((const uint8_t *) json, -1, &error);
+      bson_free (json);
+      if (!wrapper || !bson_iter_init_find (&iter, wrapper, "v")) {
+         fprintf (stderr, "Invalid value: %s\n", lookup);
+         bson_file_index_destroy (index);
+         return 1;
+      }
+
+      found = bson_file_index_find (index, bson_iter_value (&iter), &doc, NULL);
+      bson_destroy (wrapper);
+   } else {
+      found = bson_file_index_get (
+         index, (uint64_t) strtoull (lookup, NULL, 10), &doc, NULL);
+   }
+
+   if (found) {
+      json = bson_as_canonical_extended_json (&doc, NULL);
+      printf ("%s\n", json);
+      bson_free (json);
+   } else {
+      fprintf (stderr, "Not found: %s\n", lookup);
+   }
+
+   bson_file_index_destroy (index);
+
+   return found ? 0 : 1;
+}
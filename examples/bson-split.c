@@ -0,0 +1,221 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * This program divides a file of sequential BSON documents into shards that
+ * start and end on document boundaries, and validates the shards in
+ * parallel, one thread per shard. It prints the byte range, the number of
+ * documents and the number of bytes of documents of each shard.
+ *
+ * Try running it with:
+ *
+ * ./bson-split tests/binary/stream.bson
+ * ./bson-split -n 16 dump.bson
+ */
+
+
+#include <bson.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <pthread.h>
+#include <unistd.h>
+#endif
+
+
+typedef struct {
+   const bson_splitter_t *splitter;
+   uint32_t shard;
+   uint64_t n_docs;
+   uint64_t n_bytes;
+   bool valid;
+   size_t err_offset;
+   uint64_t err_doc;
+} shard_scan_t;
+
+
+static void
+scan_shard (shard_scan_t *scan)
+{
+   bson_reader_t *reader;
+   const bson_t *b;
+   bool reached_eof = false;
+
+   reader = bson_splitter_reader_new (scan->splitter, scan->shard);
+   scan->valid = true;
+
+   while ((b = bson_reader_read (reader, &reached_eof))) {
+      if (!bson_validate (b,
+                          BSON_VALIDATE_UTF8 | BSON_VALIDATE_UTF8_ALLOW_NULL,
+                          &scan->err_offset)) {
+         scan->valid = false;
+         scan->err_doc = scan->n_docs;
+         break;
+      }
+
+      scan->n_docs++;
+      scan->n_bytes += b->len;
+   }
+
+   if (scan->valid && !reached_eof) {
+      /* a corrupt length, or a document cut short */
+      scan->valid = false;
+      scan->err_doc = scan->n_docs;
+      scan->err_offset = 0;
+   }
+
+   bson_reader_destroy (reader);
+}
+
+
+#ifdef _WIN32
+static DWORD WINAPI
+scan_thread (LPVOID data)
+{
+   scan_shard ((shard_scan_t *) data);
+   return 0;
+}
+#else
+static void *
+scan_thread (void *data)
+{
+   scan_shard ((shard_scan_t *) data);
+   return NULL;
+}
+#endif
+
+
+static uint32_t
+default_n_shards (void)
+{
+#ifdef _WIN32
+   SYSTEM_INFO info;
+
+   GetSystemInfo (&info);
+   return (uint32_t) info.dwNumberOfProcessors;
+#elif defined(_SC_NPROCESSORS_ONLN)
+   long n = sysconf (_SC_NPROCESSORS_ONLN);
+
+   return n > 0 ? (uint32_t) n : 1;
+#else
+   return 4;
+#endif
+}
+
+
+int
+main (int argc, char *argv[])
+{
+   bson_splitter_t *splitter;
+   shard_scan_t *scans;
+   bson_error_t error;
+   const char *filename;
+   uint64_t offset;
+   uint64_t length;
+   uint32_t n_shards;
+   uint32_t i;
+   int ret = 0;
+#ifdef _WIN32
+   HANDLE *threads;
+#else
+   pthread_t *threads;
+#endif
+
+   n_shards = default_n_shards ();
+
+   if (argc == 4 && !strcmp (argv[1], "-n")) {
+      n_shards = (uint32_t) strtoul (argv[2], NULL, 10);
+      filename = argv[3];
+   } else if (argc == 2) {
+      filename = argv[1];
+   } else {
+      fprintf (stderr, "usage: %s [-n SHARDS] FILE\n", argv[0]);
+      return 1;
+   }
+
+   if (n_shards == 0) {
+      fprintf (stderr, "The number of shards must be at least 1.\n");
+      return 1;
+   }
+
+   splitter = bson_splitter_new_from_mmap (
+      filename, BSON_READER_MMAP_NONE, n_shards, &error);
+   if (!splitter) {
+      fprintf (
+         stderr, "Failed to open \"%s\": %s\n", filename, error.message);
+      return 1;
+   }
+
+   n_shards = bson_splitter_get_n_shards (splitter);
+   scans = bson_malloc0 (n_shards * sizeof *scans);
+   threads = bson_malloc0 (n_shards * sizeof *threads);
+
+   for (i = 0; i < n_shards; i++) {
+      scans[i].splitter = splitter;
+      scans[i].shard = i;
+#ifdef _WIN32
+      threads[i] = CreateThread (NULL, 0, scan_thread, &scans[i], 0, NULL);
+      BSON_ASSERT (threads[i]);
+#else
+      BSON_ASSERT (
+         !pthread_create (&threads[i], NULL, scan_thread, &scans[i]));
+#endif
+   }
+
+   for (i = 0; i < n_shards; i++) {
+#ifdef _WIN32
+      WaitForSingleObject (threads[i], INFINITE);
+      CloseHandle (threads[i]);
+#else
+      pthread_join (threads[i], NULL);
+#endif
+   }
+
+   printf ("shard\toffset\tlength\tdocs\tbytes\n");
+
+   for (i = 0; i < n_shards; i++) {
+      bson_splitter_get_shard (splitter, i, &offset, &length);
+      printf ("%" PRIu32 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64 "\t%" PRIu64
+              "\n",
+              i,
+              offset,
+              length,
+              scans[i].n_docs,
+              scans[i].n_bytes);
+
+      if (!scans[i].valid) {
+         fprintf (stderr,
+                  "Document %" PRIu64 " of shard %" PRIu32
+                  " in \"%s\" is invalid at offset %u.\n",
+                  scans[i].err_doc,
+                  i,
+                  filename,
+                  (unsigned) scans[i].err_offset);
+         ret = 1;
+      }
+   }
+
+   bson_free (threads);
+   bson_free (scans);
+   bson_splitter_destroy (splitter);
+
+   return ret;
+}
@@ -0,0 +1,362 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson-arena.h"
+#include "bson-memory.h"
+
+
+#define BSON_ARENA_DEFAULT_CHUNK_SIZE (64 * 1024)
+#define BSON_ARENA_MIN_CHUNK_SIZE 256
+
+/*
+ * Every block handed out by the arena is aligned to, and prefixed with, a
+ * header of BSON_ARENA_ALIGN bytes holding the capacity of the block. The
+ * capacity is needed so that bson_arena_realloc() knows how many bytes to
+ * copy when a block cannot be extended in place.
+ */
+#define BSON_ARENA_ALIGN 16
+#define BSON_ARENA_ROUND(_n) \
+   (((_n) + (BSON_ARENA_ALIGN - 1)) & ~((size_t) BSON_ARENA_ALIGN - 1))
+
+
+typedef struct _bson_arena_chunk_t {
+   struct _bson_arena_chunk_t *next;
+   size_t size; /* bytes usable after the chunk header */
+   size_t off;  /* bytes consumed so far */
+} bson_arena_chunk_t;
+
+
+#define BSON_ARENA_CHUNK_HEADER BSON_ARENA_ROUND (sizeof (bson_arena_chunk_t))
+#define BSON_ARENA_CHUNK_DATA(_c) \
+   (((uint8_t *) (_c)) + BSON_ARENA_CHUNK_HEADER)
+
+
+struct _bson_arena_t {
+   size_t chunk_size;              /* usable bytes in a regular chunk */
+   bson_arena_chunk_t *chunks;     /* regular chunks, kept across resets */
+   bson_arena_chunk_t *current;    /* regular chunk we are bumping within */
+   bson_arena_chunk_t *large;      /* oversized chunks, freed on reset */
+   uint8_t *last;                  /* most recent block */
+   bson_arena_chunk_t *last_chunk; /* chunk containing @last */
+   size_t size;                    /* bytes consumed since the last reset */
+};
+
+
+static bson_arena_chunk_t *
+_bson_arena_chunk_new (size_t size) /* IN */
+{
+   bson_arena_chunk_t *chunk;
+
+   chunk = bson_malloc (BSON_ARENA_CHUNK_HEADER + size);
+   chunk->next = NULL;
+   chunk->size = size;
+   chunk->off = 0;
+
+   return chunk;
+}
+
+
+static void
+_bson_arena_chunks_free (bson_arena_chunk_t *chunk) /* IN */
+{
+   bson_arena_chunk_t *next;
+
+   while (chunk) {
+      next = chunk->next;
+      bson_free (chunk);
+      chunk = next;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_arena_new --
+ *
+ *       Creates a new arena that allocates memory from the system in
+ *       chunks of @chunk_size bytes. If @chunk_size is zero, a default
+ *       of 64KiB is used.
+ *
+ * Returns:
+ *       A newly allocated bson_arena_t that should be freed with
+ *       bson_arena_destroy().
+ *
+ * Side effects:
+ *       The first chunk is allocated.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_arena_t *
+bson_arena_new (size_t chunk_size) /* IN */
+{
+   bson_arena_t *arena;
+
+   if (!chunk_size) {
+      chunk_size = BSON_ARENA_DEFAULT_CHUNK_SIZE;
+   }
+
+   chunk_size = BSON_MAX (chunk_size, BSON_ARENA_MIN_CHUNK_SIZE);
+   chunk_size = BSON_ARENA_ROUND (chunk_size);
+
+   arena = bson_malloc0 (sizeof *arena);
+   arena->chunk_size = chunk_size;
+   arena->chunks = _bson_arena_chunk_new (chunk_size);
+   arena->current = arena->chunks;
+
+   return arena;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_arena_destroy --
+ *
+ *       Releases @arena and all memory that was allocated from it. Any
+ *       bson_t initialized with bson_init_in_arena() becomes invalid.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_arena_destroy (bson_arena_t *arena) /* IN */
+{
+   if (arena) {
+      _bson_arena_chunks_free (arena->chunks);
+      _bson_arena_chunks_free (arena->large);
+      bson_free (arena);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_arena_reset --
+ *
+ *       Releases every allocation made from @arena at once. Regular chunks
+ *       are kept so that they may be reused without going back to the
+ *       system allocator; oversized chunks are freed.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       All memory previously returned from @arena is invalid.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_arena_reset (bson_arena_t *arena) /* IN */
+{
+   bson_arena_chunk_t *chunk;
+
+   BSON_ASSERT (arena);
+
+   for (chunk = arena->chunks; chunk; chunk = chunk->next) {
+      if (!chunk->off) {
+         /* chunks after the first untouched one were never used */
+         break;
+      }
+      chunk->off = 0;
+   }
+
+   _bson_arena_chunks_free (arena->large);
+
+   arena->large = NULL;
+   arena->current = arena->chunks;
+   arena->last = NULL;
+   arena->last_chunk = NULL;
+   arena->size = 0;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_arena_alloc --
+ *
+ *       Allocates @num_bytes from @arena. The memory is aligned to 16
+ *       bytes and must not be passed to bson_free(). It remains valid
+ *       until bson_arena_reset() or bson_arena_destroy() is called.
+ *
+ * Returns:
+ *       A pointer to the memory, or NULL if @num_bytes is zero.
+ *
+ * Side effects:
+ *       A new chunk may be allocated.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void *
+bson_arena_alloc (bson_arena_t *arena, /* IN */
+                  size_t num_bytes)    /* IN */
+{
+   bson_arena_chunk_t *chunk;
+   size_t capacity;
+   size_t needed;
+   uint8_t *block;
+
+   BSON_ASSERT (arena);
+
+   if (BSON_UNLIKELY (!num_bytes)) {
+      return NULL;
+   }
+
+   capacity = BSON_ARENA_ROUND (num_bytes);
+   needed = BSON_ARENA_ALIGN + capacity;
+
+   if (needed > arena->chunk_size) {
+      chunk = _bson_arena_chunk_new (needed);
+      chunk->next = arena->large;
+      arena->large = chunk;
+   } else {
+      chunk = arena->current;
+
+      while ((chunk->size - chunk->off) < needed) {
+         if (!chunk->next) {
+            chunk->next = _bson_arena_chunk_new (arena->chunk_size);
+         }
+         chunk = chunk->next;
+      }
+
+      arena->current = chunk;
+   }
+
+   block = BSON_ARENA_CHUNK_DATA (chunk) + chunk->off + BSON_ARENA_ALIGN;
+   memcpy (block - BSON_ARENA_ALIGN, &capacity, sizeof capacity);
+
+   chunk->off += needed;
+   arena->size += needed;
+   arena->last = block;
+   arena->last_chunk = chunk;
+
+   return block;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_arena_realloc --
+ *
+ *       A bson_realloc_func that allocates from the bson_arena_t passed as
+ *       @ctx. The most recent allocation is grown in place when the chunk
+ *       has room, otherwise a new block is allocated and the contents are
+ *       copied. The previous block is not reclaimed until the arena is
+ *       reset.
+ *
+ * Returns:
+ *       The new allocation, or NULL if @num_bytes is zero.
+ *
+ * Side effects:
+ *       @mem may be invalid after calling this function.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void *
+bson_arena_realloc (void *mem,        /* IN */
+                    size_t num_bytes, /* IN */
+                    void *ctx)        /* IN */
+{
+   bson_arena_t *arena = ctx;
+   bson_arena_chunk_t *chunk;
+   size_t capacity;
+   size_t grow;
+   void *block;
+
+   BSON_ASSERT (arena);
+
+   if (!mem) {
+      return bson_arena_alloc (arena, num_bytes);
+   }
+
+   chunk = arena->last_chunk;
+   memcpy (&capacity, (uint8_t *) mem - BSON_ARENA_ALIGN, sizeof capacity);
+
+   if (!num_bytes) {
+      if (mem == (void *) arena->last) {
+         /* give the most recent block back to its chunk */
+         chunk->off -= (BSON_ARENA_ALIGN + capacity);
+         arena->size -= (BSON_ARENA_ALIGN + capacity);
+         arena->last = NULL;
+         arena->last_chunk = NULL;
+      }
+      return NULL;
+   }
+
+   if (num_bytes <= capacity) {
+      return mem;
+   }
+
+   if (mem == (void *) arena->last) {
+      grow = BSON_ARENA_ROUND (num_bytes) - capacity;
+
+      if ((chunk->size - chunk->off) >= grow) {
+         capacity += grow;
+         memcpy (
+            (uint8_t *) mem - BSON_ARENA_ALIGN, &capacity, sizeof capacity);
+         chunk->off += grow;
+         arena->size += grow;
+         return mem;
+      }
+   }
+
+   block = bson_arena_alloc (arena, num_bytes);
+   memcpy (block, mem, capacity);
+
+   return block;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_arena_get_size --
+ *
+ *       Fetches the number of bytes consumed from @arena since it was
+ *       created or last reset, including per-allocation overhead.
+ *
+ * Returns:
+ *       A size in bytes.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+bson_arena_get_size (const bson_arena_t *arena) /* IN */
+{
+   BSON_ASSERT (arena);
+
+   return arena->size;
+}
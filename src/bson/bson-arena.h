@@ -0,0 +1,65 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_ARENA_H
+#define BSON_ARENA_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-macros.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/**
+ * bson_arena_t:
+ *
+ * A bson_arena_t is a region allocator. Memory is handed out by bumping a
+ * pointer within large chunks and is only released all at once with
+ * bson_arena_reset() or bson_arena_destroy(). Documents initialized with
+ * bson_init_in_arena() take all of their buffers from the arena, which
+ * makes building many short-lived documents cheap.
+ *
+ * A bson_arena_t is not thread-safe.
+ */
+typedef struct _bson_arena_t bson_arena_t;
+
+
+BSON_EXPORT (bson_arena_t *)
+bson_arena_new (size_t chunk_size);
+BSON_EXPORT (void)
+bson_arena_destroy (bson_arena_t *arena);
+BSON_EXPORT (void)
+bson_arena_reset (bson_arena_t *arena);
+BSON_EXPORT (void *)
+bson_arena_alloc (bson_arena_t *arena, size_t num_bytes);
+BSON_EXPORT (void *)
+bson_arena_realloc (void *mem, size_t num_bytes, void *ctx);
+BSON_EXPORT (size_t)
+bson_arena_get_size (const bson_arena_t *arena);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_ARENA_H */
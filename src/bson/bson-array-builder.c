@@ -0,0 +1,609 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson.h"
+#include "bson-array-builder.h"
+#include "bson-keys-private.h"
+#include "bson-private.h"
+
+
+struct _bson_array_builder_t {
+   /* the index of the next element, and its key in decimal */
+   uint32_t index;
+   char key[BSON_UINT32_STR_SIZE];
+   uint32_t key_len;
+   bson_t bson;
+};
+
+
+static void
+_bson_array_builder_reset (bson_array_builder_t *bab) /* IN */
+{
+   bab->index = 0;
+   bab->key[0] = '0';
+   bab->key[1] = '\0';
+   bab->key_len = 1;
+}
+
+
+/*
+ * Advance the key to the next index by incrementing its digits in place,
+ * like an odometer. Only a carry out of the first digit moves the key.
+ */
+static BSON_INLINE void
+_bson_array_builder_next_key (bson_array_builder_t *bab) /* IN */
+{
+   char *p = bab->key + bab->key_len;
+
+   bab->index++;
+
+   while (p > bab->key) {
+      p--;
+      if (*p != '9') {
+         (*p)++;
+         return;
+      }
+
+      *p = '0';
+   }
+
+   memmove (bab->key + 1, bab->key, bab->key_len + 1);
+   bab->key[0] = '1';
+   bab->key_len++;
+}
+
+
+static BSON_INLINE bool
+_bson_array_builder_appended (bson_array_builder_t *bab, /* IN */
+                              bool ok)                   /* IN */
+{
+   if (ok) {
+      _bson_array_builder_next_key (bab);
+   }
+
+   return ok;
+}
+
+
+/*
+ * The total length of the keys of @n_values elements from index @first.
+ */
+static uint64_t
+_bson_array_builder_keys_len (uint32_t first, /* IN */
+                              size_t n_values) /* IN */
+{
+   uint64_t end = (uint64_t) first + n_values;
+   uint64_t bound = 10;
+   uint64_t total = 0;
+   uint64_t i = first;
+   uint64_t next;
+   uint64_t digits = 1;
+
+   while (bound <= i) {
+      bound *= 10;
+      digits++;
+   }
+
+   while (i < end) {
+      next = BSON_MIN (end, bound);
+      total += (next - i) * digits;
+      i = next;
+      bound *= 10;
+      digits++;
+   }
+
+   return total;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_array_builder_reserve --
+ *
+ *       Grow the array by @n_values elements of @value_size bytes each in
+ *       one step.
+ *
+ * Returns:
+ *       Where the elements go, or NULL if the array would be too large.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static uint8_t *
+_bson_array_builder_reserve (bson_array_builder_t *bab, /* IN */
+                             size_t value_size,         /* IN */
+                             size_t n_values)           /* IN */
+{
+   uint64_t n_bytes;
+
+   if (n_values > BSON_MAX_SIZE) {
+      return NULL;
+   }
+
+   /* a type byte, the key and its NUL, and the value */
+   n_bytes = _bson_array_builder_keys_len (bab->index, n_values) +
+             (uint64_t) n_values * (2 + value_size);
+
+   if (n_bytes > BSON_MAX_SIZE) {
+      return NULL;
+   }
+
+   return _bson_append_raw (&bab->bson, (uint32_t) n_bytes);
+}
+
+
+static BSON_INLINE uint8_t *
+_bson_array_builder_put_key (bson_array_builder_t *bab, /* IN */
+                             uint8_t *p,                /* IN */
+                             bson_type_t type)          /* IN */
+{
+   *p++ = (uint8_t) type;
+   memcpy (p, bab->key, bab->key_len + 1);
+
+   return p + bab->key_len + 1;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_array_builder_new --
+ *
+ *       Create a builder for a top-level array. Build the array with
+ *       bson_array_builder_build().
+ *
+ * Returns:
+ *       A newly allocated bson_array_builder_t that should be freed with
+ *       bson_array_builder_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_array_builder_t *
+bson_array_builder_new (void)
+{
+   bson_array_builder_t *bab;
+
+   bab = bson_malloc0 (sizeof *bab);
+   _bson_array_builder_reset (bab);
+   bson_init (&bab->bson);
+
+   return bab;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_array_builder_build --
+ *
+ *       Move the array built so far into @out, which must not be
+ *       initialized, and empty the builder so it can build another array.
+ *       @out should be freed with bson_destroy().
+ *
+ * Returns:
+ *       true if successful, false if @bab is not a top-level builder.
+ *
+ * Side effects:
+ *       @out is initialized, the builder is reset.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_array_builder_build (bson_array_builder_t *bab, /* IN */
+                          bson_t *out)               /* OUT */
+{
+   BSON_ASSERT (bab);
+   BSON_ASSERT (out);
+
+   if (!bson_steal (out, &bab->bson)) {
+      return false;
+   }
+
+   _bson_array_builder_reset (bab);
+   bson_init (&bab->bson);
+
+   return true;
+}
+
+
+void
+bson_array_builder_destroy (bson_array_builder_t *bab) /* IN */
+{
+   if (bab) {
+      bson_destroy (&bab->bson);
+      bson_free (bab);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_append_array_builder_begin --
+ *
+ *       Begin appending an array field @key to @bson, and create @child to
+ *       append its elements. No other fields may be appended to @bson
+ *       until bson_append_array_builder_end() is called.
+ *
+ * Returns:
+ *       true if successful, false if @bson would be too large. @child is
+ *       set to NULL on failure.
+ *
+ * Side effects:
+ *       @child is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_append_array_builder_begin (bson_t *bson,                 /* IN */
+                                 const char *key,              /* IN */
+                                 int key_length,               /* IN */
+                                 bson_array_builder_t **child) /* OUT */
+{
+   bson_array_builder_t *bab;
+
+   BSON_ASSERT (bson);
+   BSON_ASSERT (key);
+   BSON_ASSERT (child);
+
+   bab = bson_malloc0 (sizeof *bab);
+   _bson_array_builder_reset (bab);
+
+   if (!bson_append_array_begin (bson, key, key_length, &bab->bson)) {
+      bson_free (bab);
+      *child = NULL;
+      return false;
+   }
+
+   *child = bab;
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_append_array_builder_end --
+ *
+ *       Finish the array field begun with
+ *       bson_append_array_builder_begin() and free @child.
+ *
+ * Returns:
+ *       true if successful.
+ *
+ * Side effects:
+ *       @child is freed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_append_array_builder_end (bson_t *bson,                /* IN */
+                               bson_array_builder_t *child) /* IN */
+{
+   bool ret;
+
+   BSON_ASSERT (bson);
+   BSON_ASSERT (child);
+
+   ret = bson_append_array_end (bson, &child->bson);
+   bson_free (child);
+
+   return ret;
+}
+
+
+uint32_t
+bson_array_builder_length (const bson_array_builder_t *bab) /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return bab->index;
+}
+
+
+bool
+bson_array_builder_append_value (bson_array_builder_t *bab, /* IN */
+                                 const bson_value_t *value) /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab,
+      bson_append_value (&bab->bson, bab->key, (int) bab->key_len, value));
+}
+
+
+bool
+bson_array_builder_append_iter (bson_array_builder_t *bab, /* IN */
+                                const bson_iter_t *iter)   /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab, bson_append_iter (&bab->bson, bab->key, (int) bab->key_len, iter));
+}
+
+
+bool
+bson_array_builder_append_document (bson_array_builder_t *bab, /* IN */
+                                    const bson_t *value)       /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab,
+      bson_append_document (&bab->bson, bab->key, (int) bab->key_len, value));
+}
+
+
+bool
+bson_array_builder_append_array (bson_array_builder_t *bab, /* IN */
+                                 const bson_t *value)       /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab,
+      bson_append_array (&bab->bson, bab->key, (int) bab->key_len, value));
+}
+
+
+bool
+bson_array_builder_append_utf8 (bson_array_builder_t *bab, /* IN */
+                                const char *value,         /* IN */
+                                int length)                /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab,
+      bson_append_utf8 (
+         &bab->bson, bab->key, (int) bab->key_len, value, length));
+}
+
+
+bool
+bson_array_builder_append_int32 (bson_array_builder_t *bab, /* IN */
+                                 int32_t value)             /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab,
+      bson_append_int32 (&bab->bson, bab->key, (int) bab->key_len, value));
+}
+
+
+bool
+bson_array_builder_append_int64 (bson_array_builder_t *bab, /* IN */
+                                 int64_t value)             /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab,
+      bson_append_int64 (&bab->bson, bab->key, (int) bab->key_len, value));
+}
+
+
+bool
+bson_array_builder_append_double (bson_array_builder_t *bab, /* IN */
+                                  double value)              /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab,
+      bson_append_double (&bab->bson, bab->key, (int) bab->key_len, value));
+}
+
+
+bool
+bson_array_builder_append_bool (bson_array_builder_t *bab, /* IN */
+                                bool value)                /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab,
+      bson_append_bool (&bab->bson, bab->key, (int) bab->key_len, value));
+}
+
+
+bool
+bson_array_builder_append_null (bson_array_builder_t *bab) /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab, bson_append_null (&bab->bson, bab->key, (int) bab->key_len));
+}
+
+
+bool
+bson_array_builder_append_oid (bson_array_builder_t *bab, /* IN */
+                               const bson_oid_t *value)   /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab, bson_append_oid (&bab->bson, bab->key, (int) bab->key_len, value));
+}
+
+
+bool
+bson_array_builder_append_date_time (bson_array_builder_t *bab, /* IN */
+                                     int64_t value)             /* IN */
+{
+   BSON_ASSERT (bab);
+
+   return _bson_array_builder_appended (
+      bab,
+      bson_append_date_time (&bab->bson, bab->key, (int) bab->key_len, value));
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_array_builder_append_int32_many --
+ *
+ *       Append the @n_values integers in @values as int32 elements. The
+ *       array grows once for all of them, and the elements are encoded
+ *       directly into it.
+ *
+ * Returns:
+ *       true if successful, false if the array would be too large. Nothing
+ *       is appended on failure.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_array_builder_append_int32_many (bson_array_builder_t *bab, /* IN */
+                                      const int32_t *values,     /* IN */
+                                      size_t n_values)           /* IN */
+{
+   uint32_t value_le;
+   uint8_t *p;
+   size_t i;
+
+   BSON_ASSERT (bab);
+   BSON_ASSERT (values || !n_values);
+
+   if (!n_values) {
+      return true;
+   }
+
+   p = _bson_array_builder_reserve (bab, sizeof value_le, n_values);
+   if (!p) {
+      return false;
+   }
+
+   for (i = 0; i < n_values; i++) {
+      p = _bson_array_builder_put_key (bab, p, BSON_TYPE_INT32);
+      value_le = BSON_UINT32_TO_LE ((uint32_t) values[i]);
+      memcpy (p, &value_le, sizeof value_le);
+      p += sizeof value_le;
+      _bson_array_builder_next_key (bab);
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_array_builder_append_int64_many --
+ *
+ *       Like bson_array_builder_append_int32_many(), for int64 elements.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_array_builder_append_int64_many (bson_array_builder_t *bab, /* IN */
+                                      const int64_t *values,     /* IN */
+                                      size_t n_values)           /* IN */
+{
+   uint64_t value_le;
+   uint8_t *p;
+   size_t i;
+
+   BSON_ASSERT (bab);
+   BSON_ASSERT (values || !n_values);
+
+   if (!n_values) {
+      return true;
+   }
+
+   p = _bson_array_builder_reserve (bab, sizeof value_le, n_values);
+   if (!p) {
+      return false;
+   }
+
+   for (i = 0; i < n_values; i++) {
+      p = _bson_array_builder_put_key (bab, p, BSON_TYPE_INT64);
+      value_le = BSON_UINT64_TO_LE ((uint64_t) values[i]);
+      memcpy (p, &value_le, sizeof value_le);
+      p += sizeof value_le;
+      _bson_array_builder_next_key (bab);
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_array_builder_append_double_many --
+ *
+ *       Like bson_array_builder_append_int32_many(), for double elements.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_array_builder_append_double_many (bson_array_builder_t *bab, /* IN */
+                                       const double *values,      /* IN */
+                                       size_t n_values)           /* IN */
+{
+   double value_le;
+   uint8_t *p;
+   size_t i;
+
+   BSON_ASSERT (bab);
+   BSON_ASSERT (values || !n_values);
+
+   if (!n_values) {
+      return true;
+   }
+
+   p = _bson_array_builder_reserve (bab, sizeof value_le, n_values);
+   if (!p) {
+      return false;
+   }
+
+   for (i = 0; i < n_values; i++) {
+      p = _bson_array_builder_put_key (bab, p, BSON_TYPE_DOUBLE);
+      value_le = BSON_DOUBLE_TO_LE (values[i]);
+      memcpy (p, &value_le, sizeof value_le);
+      p += sizeof value_le;
+      _bson_array_builder_next_key (bab);
+   }
+
+   return true;
+}
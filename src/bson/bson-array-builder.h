@@ -0,0 +1,114 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_ARRAY_BUILDER_H
+#define BSON_ARRAY_BUILDER_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-macros.h"
+#include "bson-oid.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/**
+ * bson_array_builder_t:
+ *
+ * A bson_array_builder_t appends elements to an array with their index
+ * keys, "0", "1", "2" and so on, generated for them. The key is kept as a
+ * decimal string and incremented in place, so keys cost neither a table
+ * lookup nor a formatting call, at any index.
+ *
+ * A builder either builds a top-level array, from bson_array_builder_new(),
+ * or appends to an array embedded in a bson_t, from
+ * bson_append_array_builder_begin().
+ */
+typedef struct _bson_array_builder_t bson_array_builder_t;
+
+
+BSON_EXPORT (bson_array_builder_t *)
+bson_array_builder_new (void);
+BSON_EXPORT (bool)
+bson_array_builder_build (bson_array_builder_t *bab, bson_t *out);
+BSON_EXPORT (void)
+bson_array_builder_destroy (bson_array_builder_t *bab);
+BSON_EXPORT (bool)
+bson_append_array_builder_begin (bson_t *bson,
+                                 const char *key,
+                                 int key_length,
+                                 bson_array_builder_t **child);
+BSON_EXPORT (bool)
+bson_append_array_builder_end (bson_t *bson, bson_array_builder_t *child);
+BSON_EXPORT (uint32_t)
+bson_array_builder_length (const bson_array_builder_t *bab);
+BSON_EXPORT (bool)
+bson_array_builder_append_value (bson_array_builder_t *bab,
+                                 const bson_value_t *value);
+BSON_EXPORT (bool)
+bson_array_builder_append_iter (bson_array_builder_t *bab,
+                                const bson_iter_t *iter);
+BSON_EXPORT (bool)
+bson_array_builder_append_document (bson_array_builder_t *bab,
+                                    const bson_t *value);
+BSON_EXPORT (bool)
+bson_array_builder_append_array (bson_array_builder_t *bab,
+                                 const bson_t *value);
+BSON_EXPORT (bool)
+bson_array_builder_append_utf8 (bson_array_builder_t *bab,
+                                const char *value,
+                                int length);
+BSON_EXPORT (bool)
+bson_array_builder_append_int32 (bson_array_builder_t *bab, int32_t value);
+BSON_EXPORT (bool)
+bson_array_builder_append_int64 (bson_array_builder_t *bab, int64_t value);
+BSON_EXPORT (bool)
+bson_array_builder_append_double (bson_array_builder_t *bab, double value);
+BSON_EXPORT (bool)
+bson_array_builder_append_bool (bson_array_builder_t *bab, bool value);
+BSON_EXPORT (bool)
+bson_array_builder_append_null (bson_array_builder_t *bab);
+BSON_EXPORT (bool)
+bson_array_builder_append_oid (bson_array_builder_t *bab,
+                               const bson_oid_t *value);
+BSON_EXPORT (bool)
+bson_array_builder_append_date_time (bson_array_builder_t *bab,
+                                     int64_t value);
+BSON_EXPORT (bool)
+bson_array_builder_append_int32_many (bson_array_builder_t *bab,
+                                      const int32_t *values,
+                                      size_t n_values);
+BSON_EXPORT (bool)
+bson_array_builder_append_int64_many (bson_array_builder_t *bab,
+                                      const int64_t *values,
+                                      size_t n_values);
+BSON_EXPORT (bool)
+bson_array_builder_append_double_many (bson_array_builder_t *bab,
+                                       const double *values,
+                                       size_t n_values);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_ARRAY_BUILDER_H */
@@ -0,0 +1,1300 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson.h"
+#include "bson-arrow.h"
+#include "bson-private.h"
+
+
+#define BSON_ARROW_MIN_BUFFER 64
+
+
+typedef struct {
+   uint8_t *data;
+   size_t len;
+   size_t alloc;
+} bson_arrow_buffer_t;
+
+
+/*
+ * A field of the schema, and the builder for its column in the current
+ * batch. The type is one of the BSON types that map to an Arrow type:
+ * BSON_TYPE_DOCUMENT for a struct, BSON_TYPE_ARRAY for a list whose only
+ * child is the item field, or BSON_TYPE_EOD while inferring a field whose
+ * type is not known yet.
+ */
+typedef struct _bson_arrow_field_t bson_arrow_field_t;
+
+struct _bson_arrow_field_t {
+   char *name;
+   size_t name_len;
+   bson_type_t type;
+
+   bson_arrow_field_t *children;
+   size_t n_children;
+
+   /* struct rows: where the next key is expected, and the keys seen */
+   size_t next_child;
+   bool seen;
+
+   int64_t length;
+   int64_t null_count;
+   bson_arrow_buffer_t validity;
+   bson_arrow_buffer_t values; /* values, bits, or int32 offsets */
+   bson_arrow_buffer_t data;   /* bytes of strings and binaries */
+};
+
+
+struct _bson_arrow_converter_t {
+   bson_reader_t *reader;
+   size_t batch_size;
+   bool eof;
+
+   bson_arrow_field_t root;
+   bool has_schema;
+
+   /* documents read to infer the schema, not yet converted */
+   bson_t **pending;
+   size_t n_pending;
+   size_t pending_pos;
+};
+
+
+typedef struct {
+   const void *buffers[3];
+   uint8_t *owned[3];
+} bson_arrow_array_private_t;
+
+
+static const struct {
+   const char *name;
+   bson_type_t type;
+} gBsonArrowTypes[] = {
+   {"double", BSON_TYPE_DOUBLE},
+   {"string", BSON_TYPE_UTF8},
+   {"binData", BSON_TYPE_BINARY},
+   {"objectId", BSON_TYPE_OID},
+   {"bool", BSON_TYPE_BOOL},
+   {"date", BSON_TYPE_DATE_TIME},
+   {"int", BSON_TYPE_INT32},
+   {"long", BSON_TYPE_INT64},
+};
+
+
+static void
+_bson_arrow_buffer_reserve (bson_arrow_buffer_t *buf, /* IN */
+                            size_t n)                 /* IN */
+{
+   if (buf->len + n > buf->alloc) {
+      buf->alloc = bson_next_power_of_two (
+         BSON_MAX (buf->len + n, BSON_ARROW_MIN_BUFFER));
+      buf->data = bson_realloc (buf->data, buf->alloc);
+   }
+}
+
+
+static void
+_bson_arrow_buffer_append (bson_arrow_buffer_t *buf, /* IN */
+                           const void *data,         /* IN */
+                           size_t n)                 /* IN */
+{
+   _bson_arrow_buffer_reserve (buf, n);
+   memcpy (buf->data + buf->len, data, n);
+   buf->len += n;
+}
+
+
+static void
+_bson_arrow_buffer_append_zeros (bson_arrow_buffer_t *buf, /* IN */
+                                 size_t n)                 /* IN */
+{
+   _bson_arrow_buffer_reserve (buf, n);
+   memset (buf->data + buf->len, 0, n);
+   buf->len += n;
+}
+
+
+/* set bit @i of a bitmap that grows a byte at a time */
+static void
+_bson_arrow_bitmap_append (bson_arrow_buffer_t *buf, /* IN */
+                           int64_t i,                /* IN */
+                           bool bit)                 /* IN */
+{
+   if (i % 8 == 0) {
+      _bson_arrow_buffer_append_zeros (buf, 1);
+   }
+
+   if (bit) {
+      buf->data[i / 8] |= (uint8_t) (1u << (i % 8));
+   }
+}
+
+
+static bool
+_bson_arrow_has_offsets (bson_type_t type) /* IN */
+{
+   return type == BSON_TYPE_UTF8 || type == BSON_TYPE_BINARY ||
+          type == BSON_TYPE_ARRAY;
+}
+
+
+static void
+_bson_arrow_field_destroy (bson_arrow_field_t *field) /* IN */
+{
+   size_t i;
+
+   for (i = 0; i < field->n_children; i++) {
+      _bson_arrow_field_destroy (&field->children[i]);
+   }
+
+   bson_free (field->children);
+   bson_free (field->name);
+   bson_free (field->validity.data);
+   bson_free (field->values.data);
+   bson_free (field->data.data);
+}
+
+
+static bson_arrow_field_t *
+_bson_arrow_field_add_child (bson_arrow_field_t *field, /* IN */
+                             const char *name,          /* IN */
+                             size_t name_len,           /* IN */
+                             bson_type_t type)          /* IN */
+{
+   bson_arrow_field_t *child;
+
+   field->children = bson_realloc (
+      field->children, (field->n_children + 1) * sizeof *field->children);
+   child = &field->children[field->n_children++];
+   memset (child, 0, sizeof *child);
+   child->name = bson_strndup (name, name_len);
+   child->name_len = name_len;
+   child->type = type;
+
+   return child;
+}
+
+
+static bson_arrow_field_t *
+_bson_arrow_field_find_child (bson_arrow_field_t *field, /* IN */
+                              const char *name,          /* IN */
+                              size_t name_len)           /* IN */
+{
+   bson_arrow_field_t *child;
+   size_t i;
+   size_t j;
+
+   /* documents usually have their keys in the same order, try the next */
+   for (i = 0; i < field->n_children; i++) {
+      j = (field->next_child + i) % field->n_children;
+      child = &field->children[j];
+      if (child->name_len == name_len &&
+          !memcmp (child->name, name, name_len)) {
+         field->next_child = j + 1;
+         return child;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ * Start a new batch: offsets arrays begin with a zero.
+ */
+static void
+_bson_arrow_field_begin (bson_arrow_field_t *field) /* IN */
+{
+   int32_t zero = 0;
+   size_t i;
+
+   field->length = 0;
+   field->null_count = 0;
+   field->next_child = 0;
+
+   if (_bson_arrow_has_offsets (field->type)) {
+      _bson_arrow_buffer_append (&field->values, &zero, sizeof zero);
+   }
+
+   for (i = 0; i < field->n_children; i++) {
+      _bson_arrow_field_begin (&field->children[i]);
+   }
+}
+
+
+static bool
+_bson_arrow_append (bson_arrow_field_t *field, /* IN */
+                    const bson_iter_t *iter,   /* IN */
+                    bson_error_t *error);      /* OUT */
+
+
+static bool
+_bson_arrow_append_offset (bson_arrow_field_t *field, /* IN */
+                           size_t offset,             /* IN */
+                           bson_error_t *error)       /* OUT */
+{
+   int32_t offset32;
+
+   if (offset > INT32_MAX) {
+      bson_set_error (error,
+                      BSON_ERROR_ARROW,
+                      BSON_ARROW_ERROR_OVERFLOW,
+                      "field \"%s\" is too large for one batch",
+                      field->name);
+      return false;
+   }
+
+   offset32 = (int32_t) offset;
+   _bson_arrow_buffer_append (&field->values, &offset32, sizeof offset32);
+
+   return true;
+}
+
+
+static bool
+_bson_arrow_corrupt (const bson_arrow_field_t *field, /* IN */
+                     bson_error_t *error)             /* OUT */
+{
+   bson_set_error (error,
+                   BSON_ERROR_ARROW,
+                   BSON_ARROW_ERROR_CORRUPT_BSON,
+                   "corrupt BSON in field \"%s\"",
+                   field->name);
+   return false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_arrow_append_struct --
+ *
+ *       Append the fields of the document under @iter, which has not been
+ *       advanced yet, as a row of the struct @field. Each key is looked
+ *       up once; children without a matching key get a null row.
+ *
+ * Returns:
+ *       true if successful, otherwise false and @error is set.
+ *
+ * Side effects:
+ *       @iter is advanced to its end.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_arrow_append_struct (bson_arrow_field_t *field, /* IN */
+                           bson_iter_t *iter,         /* IN */
+                           bson_error_t *error)       /* OUT */
+{
+   bson_arrow_field_t *child;
+   uint32_t len = iter->len;
+   size_t i;
+
+   for (i = 0; i < field->n_children; i++) {
+      field->children[i].seen = false;
+   }
+
+   while (bson_iter_next (iter)) {
+      child = _bson_arrow_field_find_child (
+         field, bson_iter_key_unsafe (iter), _bson_iter_key_len (iter));
+      if (!child || child->seen) {
+         continue;
+      }
+
+      child->seen = true;
+      if (!_bson_arrow_append (child, iter, error)) {
+         return false;
+      }
+   }
+
+   if (iter->err_off || iter->off + 1 != len) {
+      return _bson_arrow_corrupt (field, error);
+   }
+
+   for (i = 0; i < field->n_children; i++) {
+      if (!field->children[i].seen &&
+          !_bson_arrow_append (&field->children[i], NULL, error)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+
+static bool
+_bson_arrow_append_list (bson_arrow_field_t *field, /* IN */
+                         bson_iter_t *iter,         /* IN */
+                         bson_error_t *error)       /* OUT */
+{
+   bson_arrow_field_t *item = &field->children[0];
+   uint32_t len = iter->len;
+
+   while (bson_iter_next (iter)) {
+      if (!_bson_arrow_append (item, iter, error)) {
+         return false;
+      }
+   }
+
+   if (iter->err_off || iter->off + 1 != len) {
+      return _bson_arrow_corrupt (field, error);
+   }
+
+   return _bson_arrow_append_offset (field, (size_t) item->length, error);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_arrow_append --
+ *
+ *       Append the value under @iter to the column of @field, or a null if
+ *       @iter is NULL or its value does not have the field's type. Int32
+ *       and int64 values are widened to int64 and double fields.
+ *
+ * Returns:
+ *       true if successful, otherwise false and @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_arrow_append (bson_arrow_field_t *field, /* IN */
+                    const bson_iter_t *iter,   /* IN */
+                    bson_error_t *error)       /* OUT */
+{
+   bson_type_t type = iter ? bson_iter_type (iter) : BSON_TYPE_EOD;
+   const uint8_t *bytes;
+   bson_subtype_t subtype;
+   bson_iter_t child;
+   uint32_t len;
+   int32_t i32;
+   int64_t i64;
+   double d;
+   bool valid;
+   size_t i;
+
+   if (type != field->type) {
+      if (field->type == BSON_TYPE_DOUBLE &&
+          (type == BSON_TYPE_INT32 || type == BSON_TYPE_INT64)) {
+         type = BSON_TYPE_DOUBLE;
+      } else if (field->type == BSON_TYPE_INT64 && type == BSON_TYPE_INT32) {
+         type = BSON_TYPE_INT64;
+      } else {
+         type = BSON_TYPE_EOD;
+      }
+   }
+
+   valid = type != BSON_TYPE_EOD;
+   _bson_arrow_bitmap_append (&field->validity, field->length, valid);
+   field->length++;
+
+   if (!valid) {
+      field->null_count++;
+   }
+
+   switch (field->type) {
+   case BSON_TYPE_DOUBLE:
+      d = valid ? bson_iter_as_double (iter) : 0.0;
+      _bson_arrow_buffer_append (&field->values, &d, sizeof d);
+      return true;
+   case BSON_TYPE_INT32:
+      i32 = valid ? bson_iter_int32 (iter) : 0;
+      _bson_arrow_buffer_append (&field->values, &i32, sizeof i32);
+      return true;
+   case BSON_TYPE_INT64:
+      i64 = valid ? bson_iter_as_int64 (iter) : 0;
+      _bson_arrow_buffer_append (&field->values, &i64, sizeof i64);
+      return true;
+   case BSON_TYPE_DATE_TIME:
+      i64 = valid ? bson_iter_date_time (iter) : 0;
+      _bson_arrow_buffer_append (&field->values, &i64, sizeof i64);
+      return true;
+   case BSON_TYPE_BOOL:
+      _bson_arrow_bitmap_append (
+         &field->values, field->length - 1, valid && bson_iter_bool (iter));
+      return true;
+   case BSON_TYPE_OID:
+      if (valid) {
+         _bson_arrow_buffer_append (
+            &field->values, bson_iter_oid (iter), sizeof (bson_oid_t));
+      } else {
+         _bson_arrow_buffer_append_zeros (&field->values, sizeof (bson_oid_t));
+      }
+      return true;
+   case BSON_TYPE_UTF8:
+   case BSON_TYPE_BINARY:
+      if (type == BSON_TYPE_UTF8) {
+         bytes = (const uint8_t *) bson_iter_utf8 (iter, &len);
+         _bson_arrow_buffer_append (&field->data, bytes, len);
+      } else if (type == BSON_TYPE_BINARY) {
+         bson_iter_binary (iter, &subtype, &len, &bytes);
+         _bson_arrow_buffer_append (&field->data, bytes, len);
+      }
+      return _bson_arrow_append_offset (field, field->data.len, error);
+   case BSON_TYPE_DOCUMENT:
+      if (valid && bson_iter_recurse (iter, &child)) {
+         return _bson_arrow_append_struct (field, &child, error);
+      }
+
+      /* a null struct still has a row in each of its children */
+      for (i = 0; i < field->n_children; i++) {
+         if (!_bson_arrow_append (&field->children[i], NULL, error)) {
+            return false;
+         }
+      }
+      return valid ? _bson_arrow_corrupt (field, error) : true;
+   case BSON_TYPE_ARRAY:
+      if (valid && bson_iter_recurse (iter, &child)) {
+         return _bson_arrow_append_list (field, &child, error);
+      } else if (valid) {
+         return _bson_arrow_corrupt (field, error);
+      }
+      return _bson_arrow_append_offset (
+         field, (size_t) field->children[0].length, error);
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_REGEX:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_SYMBOL:
+   case BSON_TYPE_CODEWSCOPE:
+   case BSON_TYPE_TIMESTAMP:
+   case BSON_TYPE_DECIMAL128:
+   case BSON_TYPE_MAXKEY:
+   case BSON_TYPE_MINKEY:
+   default:
+      BSON_ASSERT (false);
+      return false;
+   }
+}
+
+
+static void
+_bson_arrow_infer_fields (bson_arrow_field_t *field, /* IN */
+                          bson_iter_t *iter);        /* IN */
+
+
+static bool
+_bson_arrow_is_supported (bson_type_t type) /* IN */
+{
+   switch (type) {
+   case BSON_TYPE_DOUBLE:
+   case BSON_TYPE_UTF8:
+   case BSON_TYPE_DOCUMENT:
+   case BSON_TYPE_ARRAY:
+   case BSON_TYPE_BINARY:
+   case BSON_TYPE_OID:
+   case BSON_TYPE_BOOL:
+   case BSON_TYPE_DATE_TIME:
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_INT64:
+      return true;
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_REGEX:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_SYMBOL:
+   case BSON_TYPE_CODEWSCOPE:
+   case BSON_TYPE_TIMESTAMP:
+   case BSON_TYPE_DECIMAL128:
+   case BSON_TYPE_MAXKEY:
+   case BSON_TYPE_MINKEY:
+   default:
+      return false;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_arrow_infer_value --
+ *
+ *       Merge the type of the value under @iter into @field. The first
+ *       supported type seen is kept, except that int32 widens to int64
+ *       and both widen to double. Fields of embedded documents and items
+ *       of arrays are merged recursively.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Children may be added to @field.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_bson_arrow_infer_value (bson_arrow_field_t *field, /* IN */
+                         const bson_iter_t *iter)   /* IN */
+{
+   bson_type_t type = bson_iter_type (iter);
+   bson_iter_t child;
+
+   if (!_bson_arrow_is_supported (type)) {
+      return;
+   }
+
+   if (field->type == BSON_TYPE_EOD) {
+      field->type = type;
+      if (type == BSON_TYPE_ARRAY) {
+         _bson_arrow_field_add_child (field, "item", 4, BSON_TYPE_EOD);
+      }
+   } else if (field->type != type) {
+      if ((field->type == BSON_TYPE_INT32 && type == BSON_TYPE_INT64) ||
+          ((field->type == BSON_TYPE_INT32 || field->type == BSON_TYPE_INT64) &&
+           type == BSON_TYPE_DOUBLE)) {
+         field->type = type;
+      }
+
+      return;
+   }
+
+   if (type == BSON_TYPE_DOCUMENT && bson_iter_recurse (iter, &child)) {
+      _bson_arrow_infer_fields (field, &child);
+   } else if (type == BSON_TYPE_ARRAY && bson_iter_recurse (iter, &child)) {
+      while (bson_iter_next (&child)) {
+         _bson_arrow_infer_value (&field->children[0], &child);
+      }
+   }
+}
+
+
+static void
+_bson_arrow_infer_fields (bson_arrow_field_t *field, /* IN */
+                          bson_iter_t *iter)         /* IN */
+{
+   bson_arrow_field_t *child;
+   const char *key;
+   uint32_t key_len;
+
+   while (bson_iter_next (iter)) {
+      key = bson_iter_key_unsafe (iter);
+      key_len = _bson_iter_key_len (iter);
+
+      if (!(child = _bson_arrow_field_find_child (field, key, key_len))) {
+         if (!_bson_arrow_is_supported (bson_iter_type (iter))) {
+            continue;
+         }
+
+         child =
+            _bson_arrow_field_add_child (field, key, key_len, BSON_TYPE_EOD);
+      }
+
+      _bson_arrow_infer_value (child, iter);
+   }
+}
+
+
+/*
+ * Remove the fields whose type could not be inferred: those only ever
+ * seen empty or null, and lists whose items are all such fields.
+ */
+static void
+_bson_arrow_prune (bson_arrow_field_t *field) /* IN */
+{
+   bson_arrow_field_t *child;
+   size_t n = 0;
+   size_t i;
+
+   for (i = 0; i < field->n_children; i++) {
+      child = &field->children[i];
+      _bson_arrow_prune (child);
+
+      if (child->type == BSON_TYPE_EOD ||
+          (child->type == BSON_TYPE_ARRAY && !child->n_children)) {
+         _bson_arrow_field_destroy (child);
+      } else {
+         field->children[n++] = *child;
+      }
+   }
+
+   field->n_children = n;
+}
+
+
+static bool
+_bson_arrow_parse_fields (bson_arrow_field_t *field, /* IN */
+                          bson_iter_t *iter,         /* IN */
+                          bson_error_t *error);      /* OUT */
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_arrow_parse_type --
+ *
+ *       Set the type of @field from the schema value under @iter: a type
+ *       name, a document of fields for a struct, or an array with the
+ *       type of the items of a list.
+ *
+ * Returns:
+ *       true if successful, otherwise false and @error is set.
+ *
+ * Side effects:
+ *       Children may be added to @field.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_arrow_parse_type (bson_arrow_field_t *field, /* IN */
+                        const bson_iter_t *iter,   /* IN */
+                        bson_error_t *error)       /* OUT */
+{
+   bson_arrow_field_t *item;
+   bson_iter_t child;
+   const char *name;
+   size_t i;
+
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_UTF8:
+      name = bson_iter_utf8 (iter, NULL);
+      for (i = 0; i < sizeof gBsonArrowTypes / sizeof gBsonArrowTypes[0];
+           i++) {
+         if (!strcmp (name, gBsonArrowTypes[i].name)) {
+            field->type = gBsonArrowTypes[i].type;
+            return true;
+         }
+      }
+
+      bson_set_error (error,
+                      BSON_ERROR_ARROW,
+                      BSON_ARROW_ERROR_INVALID_SCHEMA,
+                      "unknown type \"%s\" for field \"%s\"",
+                      name,
+                      field->name);
+      return false;
+   case BSON_TYPE_DOCUMENT:
+      field->type = BSON_TYPE_DOCUMENT;
+      return bson_iter_recurse (iter, &child) &&
+             _bson_arrow_parse_fields (field, &child, error);
+   case BSON_TYPE_ARRAY:
+      field->type = BSON_TYPE_ARRAY;
+      item = _bson_arrow_field_add_child (field, "item", 4, BSON_TYPE_EOD);
+      if (bson_iter_recurse (iter, &child) && bson_iter_next (&child)) {
+         if (!_bson_arrow_parse_type (item, &child, error)) {
+            return false;
+         }
+
+         if (!bson_iter_next (&child)) {
+            return true;
+         }
+      }
+
+      bson_set_error (error,
+                      BSON_ERROR_ARROW,
+                      BSON_ARROW_ERROR_INVALID_SCHEMA,
+                      "the list field \"%s\" must have one item type",
+                      field->name);
+      return false;
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_DOUBLE:
+   case BSON_TYPE_BINARY:
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_OID:
+   case BSON_TYPE_BOOL:
+   case BSON_TYPE_DATE_TIME:
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_REGEX:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_SYMBOL:
+   case BSON_TYPE_CODEWSCOPE:
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_TIMESTAMP:
+   case BSON_TYPE_INT64:
+   case BSON_TYPE_DECIMAL128:
+   case BSON_TYPE_MAXKEY:
+   case BSON_TYPE_MINKEY:
+   default:
+      bson_set_error (error,
+                      BSON_ERROR_ARROW,
+                      BSON_ARROW_ERROR_INVALID_SCHEMA,
+                      "invalid type for field \"%s\"",
+                      field->name);
+      return false;
+   }
+}
+
+
+static bool
+_bson_arrow_parse_fields (bson_arrow_field_t *field, /* IN */
+                          bson_iter_t *iter,         /* IN */
+                          bson_error_t *error)       /* OUT */
+{
+   bson_arrow_field_t *child;
+   const char *key;
+   uint32_t key_len;
+
+   while (bson_iter_next (iter)) {
+      key = bson_iter_key_unsafe (iter);
+      key_len = _bson_iter_key_len (iter);
+
+      if (_bson_arrow_field_find_child (field, key, key_len)) {
+         bson_set_error (error,
+                         BSON_ERROR_ARROW,
+                         BSON_ARROW_ERROR_INVALID_SCHEMA,
+                         "duplicate field \"%s\"",
+                         key);
+         return false;
+      }
+
+      child = _bson_arrow_field_add_child (field, key, key_len, BSON_TYPE_EOD);
+      if (!_bson_arrow_parse_type (child, iter, error)) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+
+static const char *
+_bson_arrow_format (bson_type_t type) /* IN */
+{
+   switch (type) {
+   case BSON_TYPE_DOUBLE:
+      return "g";
+   case BSON_TYPE_UTF8:
+      return "u";
+   case BSON_TYPE_DOCUMENT:
+      return "+s";
+   case BSON_TYPE_ARRAY:
+      return "+l";
+   case BSON_TYPE_BINARY:
+      return "z";
+   case BSON_TYPE_OID:
+      return "w:12";
+   case BSON_TYPE_BOOL:
+      return "b";
+   case BSON_TYPE_DATE_TIME:
+      return "tsm:UTC";
+   case BSON_TYPE_INT32:
+      return "i";
+   case BSON_TYPE_INT64:
+      return "l";
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_REGEX:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_SYMBOL:
+   case BSON_TYPE_CODEWSCOPE:
+   case BSON_TYPE_TIMESTAMP:
+   case BSON_TYPE_DECIMAL128:
+   case BSON_TYPE_MAXKEY:
+   case BSON_TYPE_MINKEY:
+   default:
+      BSON_ASSERT (false);
+      return NULL;
+   }
+}
+
+
+static void
+_bson_arrow_schema_release (struct ArrowSchema *schema) /* IN */
+{
+   int64_t i;
+
+   for (i = 0; i < schema->n_children; i++) {
+      if (schema->children[i]->release) {
+         schema->children[i]->release (schema->children[i]);
+      }
+
+      bson_free (schema->children[i]);
+   }
+
+   bson_free (schema->children);
+   bson_free ((char *) schema->format);
+   bson_free ((char *) schema->name);
+   schema->release = NULL;
+}
+
+
+static void
+_bson_arrow_export_schema (const bson_arrow_field_t *field, /* IN */
+                           struct ArrowSchema *schema)      /* OUT */
+{
+   size_t i;
+
+   memset (schema, 0, sizeof *schema);
+   schema->format = bson_strdup (_bson_arrow_format (field->type));
+   schema->name = bson_strdup (field->name);
+   schema->flags = ARROW_FLAG_NULLABLE;
+   schema->n_children = (int64_t) field->n_children;
+   schema->release = _bson_arrow_schema_release;
+
+   if (field->n_children) {
+      schema->children =
+         bson_malloc (field->n_children * sizeof *schema->children);
+   }
+
+   for (i = 0; i < field->n_children; i++) {
+      schema->children[i] = bson_malloc (sizeof (struct ArrowSchema));
+      _bson_arrow_export_schema (&field->children[i], schema->children[i]);
+   }
+}
+
+
+static void
+_bson_arrow_array_release (struct ArrowArray *array) /* IN */
+{
+   bson_arrow_array_private_t *priv = array->private_data;
+   int64_t i;
+
+   for (i = 0; i < array->n_children; i++) {
+      if (array->children[i]->release) {
+         array->children[i]->release (array->children[i]);
+      }
+
+      bson_free (array->children[i]);
+   }
+
+   for (i = 0; i < 3; i++) {
+      bson_free (priv->owned[i]);
+   }
+
+   bson_free (array->children);
+   bson_free (priv);
+   array->release = NULL;
+}
+
+
+/* take the contents of @buf, which is left empty */
+static uint8_t *
+_bson_arrow_buffer_steal (bson_arrow_buffer_t *buf) /* IN */
+{
+   uint8_t *data;
+
+   /* the C data interface wants a pointer even for empty buffers */
+   _bson_arrow_buffer_reserve (buf, 1);
+   data = buf->data;
+   memset (buf, 0, sizeof *buf);
+
+   return data;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_arrow_export_array --
+ *
+ *       Move the columns built for @field and its children into @array.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       The buffers of @field and its children are emptied.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_bson_arrow_export_array (bson_arrow_field_t *field, /* IN */
+                          struct ArrowArray *array)  /* OUT */
+{
+   bson_arrow_array_private_t *priv;
+   size_t i;
+
+   priv = bson_malloc0 (sizeof *priv);
+   priv->owned[0] = _bson_arrow_buffer_steal (&field->validity);
+
+   memset (array, 0, sizeof *array);
+   array->length = field->length;
+   array->null_count = field->null_count;
+   array->n_buffers = 1;
+
+   if (field->type != BSON_TYPE_DOCUMENT) {
+      priv->owned[array->n_buffers++] =
+         _bson_arrow_buffer_steal (&field->values);
+   }
+
+   if (field->type == BSON_TYPE_UTF8 || field->type == BSON_TYPE_BINARY) {
+      priv->owned[array->n_buffers++] = _bson_arrow_buffer_steal (&field->data);
+   }
+
+   for (i = 0; i < 3; i++) {
+      priv->buffers[i] = priv->owned[i];
+   }
+
+   array->buffers = priv->buffers;
+   array->n_children = (int64_t) field->n_children;
+   array->release = _bson_arrow_array_release;
+   array->private_data = priv;
+
+   if (field->n_children) {
+      array->children =
+         bson_malloc (field->n_children * sizeof *array->children);
+   }
+
+   for (i = 0; i < field->n_children; i++) {
+      array->children[i] = bson_malloc (sizeof (struct ArrowArray));
+      _bson_arrow_export_array (&field->children[i], array->children[i]);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_arrow_converter_new --
+ *
+ *       Create a converter of the documents read from @reader into
+ *       batches of up to @batch_size rows. @reader must outlive the
+ *       converter, and is not destroyed with it.
+ *
+ * Returns:
+ *       A newly allocated bson_arrow_converter_t that should be freed
+ *       with bson_arrow_converter_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_arrow_converter_t *
+bson_arrow_converter_new (bson_reader_t *reader, /* IN */
+                          size_t batch_size)     /* IN */
+{
+   bson_arrow_converter_t *converter;
+
+   BSON_ASSERT (reader);
+   BSON_ASSERT (batch_size > 0);
+
+   converter = bson_malloc0 (sizeof *converter);
+   converter->reader = reader;
+   converter->batch_size = batch_size;
+   converter->root.name = bson_strdup ("");
+   converter->root.type = BSON_TYPE_DOCUMENT;
+
+   return converter;
+}
+
+
+void
+bson_arrow_converter_destroy (bson_arrow_converter_t *converter) /* IN */
+{
+   size_t i;
+
+   if (converter) {
+      for (i = converter->pending_pos; i < converter->n_pending; i++) {
+         bson_destroy (converter->pending[i]);
+      }
+
+      bson_free (converter->pending);
+      _bson_arrow_field_destroy (&converter->root);
+      bson_free (converter);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_arrow_converter_set_schema --
+ *
+ *       Set the schema of the batches. Each field of @schema is a type
+ *       name ("double", "string", "binData", "objectId", "bool", "date",
+ *       "int" or "long"), a document of the fields of a struct, or an
+ *       array of one element, the type of the items of a list.
+ *
+ *       This must be called before the first batch is converted.
+ *
+ * Returns:
+ *       true if successful, otherwise false and @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_arrow_converter_set_schema (bson_arrow_converter_t *converter, /* IN */
+                                 const bson_t *schema,              /* IN */
+                                 bson_error_t *error)               /* OUT */
+{
+   bson_arrow_field_t *root;
+   bson_iter_t iter;
+   size_t i;
+
+   BSON_ASSERT (converter);
+   BSON_ASSERT (schema);
+
+   root = &converter->root;
+
+   if (converter->has_schema) {
+      bson_set_error (error,
+                      BSON_ERROR_ARROW,
+                      BSON_ARROW_ERROR_INVALID_SCHEMA,
+                      "the schema must be set before the first batch");
+      return false;
+   }
+
+   if (!bson_iter_init (&iter, schema)) {
+      bson_set_error (error,
+                      BSON_ERROR_ARROW,
+                      BSON_ARROW_ERROR_INVALID_SCHEMA,
+                      "corrupt BSON in the schema");
+      return false;
+   }
+
+   if (!_bson_arrow_parse_fields (root, &iter, error)) {
+      for (i = 0; i < root->n_children; i++) {
+         _bson_arrow_field_destroy (&root->children[i]);
+      }
+
+      root->n_children = 0;
+      return false;
+   }
+
+   converter->has_schema = true;
+   _bson_arrow_field_begin (root);
+
+   return true;
+}
+
+
+static bool
+_bson_arrow_converter_read (bson_arrow_converter_t *converter, /* IN */
+                            const bson_t **doc,                /* OUT */
+                            bson_error_t *error)               /* OUT */
+{
+   bool reached_eof = false;
+
+   if (converter->eof) {
+      *doc = NULL;
+      return true;
+   }
+
+   if (!(*doc = bson_reader_read (converter->reader, &reached_eof))) {
+      converter->eof = true;
+
+      if (!reached_eof) {
+         bson_set_error (error,
+                         BSON_ERROR_ARROW,
+                         BSON_ARROW_ERROR_CORRUPT_BSON,
+                         "corrupt BSON in the input");
+         return false;
+      }
+   }
+
+   return true;
+}
+
+
+/*
+ * Read the first batch and infer the schema from it. The documents are
+ * copied, to be converted by the next call to
+ * bson_arrow_converter_next().
+ */
+static bool
+_bson_arrow_converter_infer (bson_arrow_converter_t *converter, /* IN */
+                             bson_error_t *error)               /* OUT */
+{
+   const bson_t *doc;
+   bson_iter_t iter;
+   size_t i;
+
+   converter->pending =
+      bson_malloc (converter->batch_size * sizeof *converter->pending);
+
+   while (converter->n_pending < converter->batch_size) {
+      if (!_bson_arrow_converter_read (converter, &doc, error)) {
+         /* a later call must not leak or reuse the documents read */
+         for (i = 0; i < converter->n_pending; i++) {
+            bson_destroy (converter->pending[i]);
+         }
+
+         bson_free (converter->pending);
+         converter->pending = NULL;
+         converter->n_pending = 0;
+         return false;
+      }
+
+      if (!doc) {
+         break;
+      }
+
+      converter->pending[converter->n_pending++] = bson_copy (doc);
+   }
+
+   for (i = 0; i < converter->n_pending; i++) {
+      if (bson_iter_init (&iter, converter->pending[i])) {
+         _bson_arrow_infer_fields (&converter->root, &iter);
+      }
+   }
+
+   _bson_arrow_prune (&converter->root);
+   converter->has_schema = true;
+   _bson_arrow_field_begin (&converter->root);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_arrow_converter_get_schema --
+ *
+ *       Export the schema of the batches to @schema. If no schema was set,
+ *       it is inferred from the first batch of documents, which are read
+ *       now and converted by the next call to bson_arrow_converter_next().
+ *
+ * Returns:
+ *       true if successful, otherwise false and @error is set.
+ *
+ * Side effects:
+ *       @schema is initialized and must be released by calling its
+ *       release callback.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_arrow_converter_get_schema (bson_arrow_converter_t *converter, /* IN */
+                                 struct ArrowSchema *schema,        /* OUT */
+                                 bson_error_t *error)               /* OUT */
+{
+   BSON_ASSERT (converter);
+   BSON_ASSERT (schema);
+
+   if (!converter->has_schema &&
+       !_bson_arrow_converter_infer (converter, error)) {
+      return false;
+   }
+
+   _bson_arrow_export_schema (&converter->root, schema);
+
+   return true;
+}
+
+
+static bool
+_bson_arrow_converter_append (bson_arrow_converter_t *converter, /* IN */
+                              const bson_t *doc,                 /* IN */
+                              bson_error_t *error)               /* OUT */
+{
+   bson_arrow_field_t *root = &converter->root;
+   bson_iter_t iter;
+
+   if (!bson_iter_init (&iter, doc)) {
+      return _bson_arrow_corrupt (root, error);
+   }
+
+   _bson_arrow_bitmap_append (&root->validity, root->length, true);
+   root->length++;
+
+   return _bson_arrow_append_struct (root, &iter, error);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_arrow_converter_next --
+ *
+ *       Convert the next batch of up to batch_size documents into @array,
+ *       a struct array with one child for each top-level field of the
+ *       schema. Documents are walked once; each value is appended to its
+ *       column as it is found.
+ *
+ *       After an error, the converter may only be destroyed.
+ *
+ * Returns:
+ *       1 if a batch was converted, 0 at the end of the input, or -1 on
+ *       error and @error is set.
+ *
+ * Side effects:
+ *       On success, @array is initialized and must be released by calling
+ *       its release callback.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+int
+bson_arrow_converter_next (bson_arrow_converter_t *converter, /* IN */
+                           struct ArrowArray *array,          /* OUT */
+                           bson_error_t *error)               /* OUT */
+{
+   const bson_t *doc;
+   bson_t *pending;
+   size_t n = 0;
+
+   BSON_ASSERT (converter);
+   BSON_ASSERT (array);
+
+   if (!converter->has_schema &&
+       !_bson_arrow_converter_infer (converter, error)) {
+      return -1;
+   }
+
+   while (converter->pending_pos < converter->n_pending &&
+          n < converter->batch_size) {
+      pending = converter->pending[converter->pending_pos++];
+      n++;
+
+      if (!_bson_arrow_converter_append (converter, pending, error)) {
+         bson_destroy (pending);
+         return -1;
+      }
+
+      bson_destroy (pending);
+   }
+
+   while (n < converter->batch_size) {
+      if (!_bson_arrow_converter_read (converter, &doc, error)) {
+         return -1;
+      }
+
+      if (!doc) {
+         break;
+      }
+
+      n++;
+
+      if (!_bson_arrow_converter_append (converter, doc, error)) {
+         return -1;
+      }
+   }
+
+   if (!n) {
+      return 0;
+   }
+
+   _bson_arrow_export_array (&converter->root, array);
+   _bson_arrow_field_begin (&converter->root);
+
+   return 1;
+}
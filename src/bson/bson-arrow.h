@@ -0,0 +1,128 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_ARROW_H
+#define BSON_ARROW_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-macros.h"
+#include "bson-reader.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/*
+ * The structures of the Apache Arrow C data interface. Their layout is
+ * fixed by the Arrow specification, which asks that they be copied
+ * verbatim behind this guard rather than taken from an Arrow library.
+ */
+#ifndef ARROW_C_DATA_INTERFACE
+#define ARROW_C_DATA_INTERFACE
+
+#define ARROW_FLAG_DICTIONARY_ORDERED 1
+#define ARROW_FLAG_NULLABLE 2
+#define ARROW_FLAG_MAP_KEYS_SORTED 4
+
+struct ArrowSchema {
+   /* array type description */
+   const char *format;
+   const char *name;
+   const char *metadata;
+   int64_t flags;
+   int64_t n_children;
+   struct ArrowSchema **children;
+   struct ArrowSchema *dictionary;
+
+   /* release callback */
+   void (*release) (struct ArrowSchema *);
+   /* opaque producer-specific data */
+   void *private_data;
+};
+
+struct ArrowArray {
+   /* array data description */
+   int64_t length;
+   int64_t null_count;
+   int64_t offset;
+   int64_t n_buffers;
+   int64_t n_children;
+   const void **buffers;
+   struct ArrowArray **children;
+   struct ArrowArray *dictionary;
+
+   /* release callback */
+   void (*release) (struct ArrowArray *);
+   /* opaque producer-specific data */
+   void *private_data;
+};
+
+#endif /* ARROW_C_DATA_INTERFACE */
+
+
+typedef enum {
+   BSON_ARROW_ERROR_INVALID_SCHEMA = 1,
+   BSON_ARROW_ERROR_CORRUPT_BSON,
+   BSON_ARROW_ERROR_OVERFLOW,
+} bson_arrow_error_code_t;
+
+
+/**
+ * bson_arrow_converter_t:
+ *
+ * A bson_arrow_converter_t reads documents from a bson_reader_t and
+ * converts them into batches in the Apache Arrow columnar format,
+ * exported through the Arrow C data interface. Each batch is a struct
+ * array with one child per top-level field; embedded documents become
+ * struct arrays and arrays become list arrays.
+ *
+ * The schema is given with bson_arrow_converter_set_schema(), or else
+ * inferred from the first batch of documents.
+ *
+ * A bson_arrow_converter_t is not thread-safe.
+ */
+typedef struct _bson_arrow_converter_t bson_arrow_converter_t;
+
+
+BSON_EXPORT (bson_arrow_converter_t *)
+bson_arrow_converter_new (bson_reader_t *reader, size_t batch_size);
+BSON_EXPORT (void)
+bson_arrow_converter_destroy (bson_arrow_converter_t *converter);
+BSON_EXPORT (bool)
+bson_arrow_converter_set_schema (bson_arrow_converter_t *converter,
+                                 const bson_t *schema,
+                                 bson_error_t *error);
+BSON_EXPORT (bool)
+bson_arrow_converter_get_schema (bson_arrow_converter_t *converter,
+                                 struct ArrowSchema *schema,
+                                 bson_error_t *error);
+BSON_EXPORT (int)
+bson_arrow_converter_next (bson_arrow_converter_t *converter,
+                           struct ArrowArray *array,
+                           bson_error_t *error);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_ARROW_H */
@@ -0,0 +1,641 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson.h"
+#include "bson-chain.h"
+#include "bson-private.h"
+
+
+/*
+ * Values shorter than this are copied into the chain's buffer, where they
+ * cost less than an iovec of their own.
+ */
+#define BSON_CHAIN_MIN_REF 256
+
+
+typedef struct {
+   /* the referenced bytes, or NULL for bytes of the chain's buffer */
+   const uint8_t *data;
+   size_t off;
+   size_t len;
+} bson_chain_segment_t;
+
+
+/* an embedded document or array that has been begun but not ended */
+typedef struct {
+   size_t header_off;
+   uint32_t start;
+   bson_type_t type;
+} bson_chain_open_t;
+
+
+struct _bson_chain_t {
+   uint8_t *buf;
+   size_t buf_len;
+   size_t buf_alloc;
+
+   bson_chain_segment_t *segments;
+   size_t n_segments;
+   size_t segments_alloc;
+
+   bson_chain_open_t *open;
+   size_t depth;
+   size_t open_alloc;
+
+   /* the length of the document so far, without its trailing NUL */
+   uint32_t len;
+
+   bson_iovec_t *iovecs;
+   size_t iovecs_alloc;
+
+   bson_t scratch;
+};
+
+
+static const uint8_t gZero;
+
+
+/*
+ * Check that @n more bytes fit in the document, leaving room for the
+ * trailing NUL of each open document and of the root.
+ */
+static bool
+_bson_chain_has_room (const bson_chain_t *chain, /* IN */
+                      size_t n)                  /* IN */
+{
+   return n <= BSON_MAX_SIZE - 1 - chain->depth - chain->len;
+}
+
+
+static void
+_bson_chain_copy (bson_chain_t *chain, /* IN */
+                  const void *data,    /* IN */
+                  size_t n)            /* IN */
+{
+   bson_chain_segment_t *segment;
+
+   if (chain->buf_len + n > chain->buf_alloc) {
+      chain->buf_alloc = bson_next_power_of_two (
+         BSON_MAX (chain->buf_len + n, (size_t) BSON_CHAIN_MIN_REF));
+      chain->buf = bson_realloc (chain->buf, chain->buf_alloc);
+   }
+
+   memcpy (chain->buf + chain->buf_len, data, n);
+
+   segment = chain->n_segments ? &chain->segments[chain->n_segments - 1] : NULL;
+   if (segment && !segment->data &&
+       segment->off + segment->len == chain->buf_len) {
+      segment->len += n;
+   } else {
+      if (chain->n_segments == chain->segments_alloc) {
+         chain->segments_alloc = BSON_MAX (8, chain->segments_alloc * 2);
+         chain->segments = bson_realloc (
+            chain->segments, chain->segments_alloc * sizeof *chain->segments);
+      }
+
+      segment = &chain->segments[chain->n_segments++];
+      segment->data = NULL;
+      segment->off = chain->buf_len;
+      segment->len = n;
+   }
+
+   chain->buf_len += n;
+   chain->len += (uint32_t) n;
+}
+
+
+static void
+_bson_chain_ref (bson_chain_t *chain, /* IN */
+                 const uint8_t *data, /* IN */
+                 size_t n)            /* IN */
+{
+   bson_chain_segment_t *segment;
+
+   if (n < BSON_CHAIN_MIN_REF) {
+      _bson_chain_copy (chain, data, n);
+      return;
+   }
+
+   if (chain->n_segments == chain->segments_alloc) {
+      chain->segments_alloc = BSON_MAX (8, chain->segments_alloc * 2);
+      chain->segments = bson_realloc (
+         chain->segments, chain->segments_alloc * sizeof *chain->segments);
+   }
+
+   segment = &chain->segments[chain->n_segments++];
+   segment->data = data;
+   segment->off = 0;
+   segment->len = n;
+
+   chain->len += (uint32_t) n;
+}
+
+
+/*
+ * Append the type and key of an element whose value is @value_len bytes,
+ * if the element fits in the document.
+ */
+static bool
+_bson_chain_append_header (bson_chain_t *chain, /* IN */
+                           bson_type_t type,    /* IN */
+                           const char *key,     /* IN */
+                           int key_length,      /* IN */
+                           size_t value_len)    /* IN */
+{
+   uint8_t type_byte = (uint8_t) type;
+
+   BSON_ASSERT (key);
+
+   if (key_length < 0) {
+      key_length = (int) strlen (key);
+   }
+
+   if (!_bson_chain_has_room (chain, 2 + (size_t) key_length + value_len)) {
+      return false;
+   }
+
+   _bson_chain_copy (chain, &type_byte, 1);
+   _bson_chain_copy (chain, key, (size_t) key_length);
+   _bson_chain_copy (chain, &gZero, 1);
+
+   return true;
+}
+
+
+bson_chain_t *
+bson_chain_new (void)
+{
+   bson_chain_t *chain;
+
+   chain = bson_malloc0 (sizeof *chain);
+   bson_init (&chain->scratch);
+   bson_chain_reinit (chain);
+
+   return chain;
+}
+
+
+void
+bson_chain_destroy (bson_chain_t *chain) /* IN */
+{
+   if (chain) {
+      bson_destroy (&chain->scratch);
+      bson_free (chain->buf);
+      bson_free (chain->segments);
+      bson_free (chain->open);
+      bson_free (chain->iovecs);
+      bson_free (chain);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_chain_reinit --
+ *
+ *       Empty @chain to build a new document, keeping its buffers. The
+ *       documents and iterators appended to it may then be freed.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Iovecs returned by bson_chain_iovecs() are invalidated.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_chain_reinit (bson_chain_t *chain) /* IN */
+{
+   static const uint8_t header[4] = {0};
+
+   BSON_ASSERT (chain);
+
+   chain->buf_len = 0;
+   chain->n_segments = 0;
+   chain->depth = 0;
+   chain->len = 0;
+
+   _bson_chain_copy (chain, header, sizeof header);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_chain_append_value --
+ *
+ *       Append an element with @value, which is copied into @chain's
+ *       buffer. Use bson_chain_append_iter() to refer to a large value
+ *       instead.
+ *
+ * Returns:
+ *       true if successful; false if the document would be too large.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_chain_append_value (bson_chain_t *chain,       /* IN */
+                         const char *key,           /* IN */
+                         int key_length,            /* IN */
+                         const bson_value_t *value) /* IN */
+{
+   BSON_ASSERT (chain);
+   BSON_ASSERT (value);
+
+   bson_reinit (&chain->scratch);
+   if (!bson_append_value (&chain->scratch, key, key_length, value) ||
+       !_bson_chain_has_room (chain, chain->scratch.len - 5)) {
+      return false;
+   }
+
+   /* the element, without the scratch document's header and NUL */
+   _bson_chain_copy (
+      chain, bson_get_data (&chain->scratch) + 4, chain->scratch.len - 5);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_chain_append_document --
+ *
+ *       Append an embedded document. If @value is large, @chain refers
+ *       to its data rather than copying it, so it must outlive @chain.
+ *
+ * Returns:
+ *       true if successful; false if the document would be too large.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_chain_append_document (bson_chain_t *chain, /* IN */
+                            const char *key,     /* IN */
+                            int key_length,      /* IN */
+                            const bson_t *value) /* IN */
+{
+   BSON_ASSERT (chain);
+   BSON_ASSERT (value);
+
+   if (!_bson_chain_append_header (
+          chain, BSON_TYPE_DOCUMENT, key, key_length, value->len)) {
+      return false;
+   }
+
+   _bson_chain_ref (chain, bson_get_data (value), value->len);
+
+   return true;
+}
+
+
+bool
+bson_chain_append_array (bson_chain_t *chain, /* IN */
+                         const char *key,     /* IN */
+                         int key_length,      /* IN */
+                         const bson_t *value) /* IN */
+{
+   BSON_ASSERT (chain);
+   BSON_ASSERT (value);
+
+   if (!_bson_chain_append_header (
+          chain, BSON_TYPE_ARRAY, key, key_length, value->len)) {
+      return false;
+   }
+
+   _bson_chain_ref (chain, bson_get_data (value), value->len);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_chain_append_iter --
+ *
+ *       Append the element under @iter, with @key or, if @key is NULL,
+ *       the element's own key. If the value is large, @chain refers to
+ *       the iterated document's data rather than copying it, so the
+ *       document must outlive @chain.
+ *
+ * Returns:
+ *       true if successful; false if @iter is not on an element or the
+ *       document would be too large.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_chain_append_iter (bson_chain_t *chain,     /* IN */
+                        const char *key,         /* IN */
+                        int key_length,          /* IN */
+                        const bson_iter_t *iter) /* IN */
+{
+   uint32_t value_off;
+   bson_type_t type;
+
+   BSON_ASSERT (chain);
+   BSON_ASSERT (iter);
+
+   type = bson_iter_type (iter);
+   if (type == BSON_TYPE_EOD) {
+      return false;
+   }
+
+   if (!key) {
+      key = bson_iter_key (iter);
+      key_length = (int) _bson_iter_key_len (iter);
+   }
+
+   value_off = iter->key + _bson_iter_key_len (iter) + 1;
+
+   if (!_bson_chain_append_header (
+          chain, type, key, key_length, iter->next_off - value_off)) {
+      return false;
+   }
+
+   _bson_chain_ref (chain, iter->raw + value_off, iter->next_off - value_off);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_chain_concat --
+ *
+ *       Append the elements of @src. If @src is large, @chain refers to
+ *       its data rather than copying it, so it must outlive @chain.
+ *
+ * Returns:
+ *       true if successful; false if the document would be too large.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_chain_concat (bson_chain_t *chain, /* IN */
+                   const bson_t *src)   /* IN */
+{
+   BSON_ASSERT (chain);
+   BSON_ASSERT (src);
+
+   if (!_bson_chain_has_room (chain, src->len - 5)) {
+      return false;
+   }
+
+   _bson_chain_ref (chain, bson_get_data (src) + 4, src->len - 5);
+
+   return true;
+}
+
+
+static bool
+_bson_chain_begin (bson_chain_t *chain, /* IN */
+                   bson_type_t type,    /* IN */
+                   const char *key,     /* IN */
+                   int key_length)      /* IN */
+{
+   static const uint8_t header[4] = {0};
+   bson_chain_open_t *open;
+
+   BSON_ASSERT (chain);
+
+   if (!_bson_chain_append_header (chain, type, key, key_length, 5)) {
+      return false;
+   }
+
+   if (chain->depth == chain->open_alloc) {
+      chain->open_alloc = BSON_MAX (4, chain->open_alloc * 2);
+      chain->open =
+         bson_realloc (chain->open, chain->open_alloc * sizeof *chain->open);
+   }
+
+   open = &chain->open[chain->depth++];
+   open->header_off = chain->buf_len;
+   open->start = chain->len;
+   open->type = type;
+
+   _bson_chain_copy (chain, header, sizeof header);
+
+   return true;
+}
+
+
+static void
+_bson_chain_end (bson_chain_t *chain, /* IN */
+                 bson_type_t type)    /* IN */
+{
+   bson_chain_open_t *open;
+   uint32_t len_le;
+
+   BSON_ASSERT (chain);
+   BSON_ASSERT (chain->depth > 0);
+
+   open = &chain->open[--chain->depth];
+   BSON_ASSERT (open->type == type);
+
+   _bson_chain_copy (chain, &gZero, 1);
+
+   len_le = BSON_UINT32_TO_LE (chain->len - open->start);
+   memcpy (chain->buf + open->header_off, &len_le, sizeof len_le);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_chain_append_document_begin --
+ *
+ *       Begin an embedded document, whose elements are appended to
+ *       @chain until bson_chain_append_document_end() is called.
+ *
+ * Returns:
+ *       true if successful; false if the document would be too large.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_chain_append_document_begin (bson_chain_t *chain, /* IN */
+                                  const char *key,     /* IN */
+                                  int key_length)      /* IN */
+{
+   return _bson_chain_begin (chain, BSON_TYPE_DOCUMENT, key, key_length);
+}
+
+
+void
+bson_chain_append_document_end (bson_chain_t *chain) /* IN */
+{
+   _bson_chain_end (chain, BSON_TYPE_DOCUMENT);
+}
+
+
+bool
+bson_chain_append_array_begin (bson_chain_t *chain, /* IN */
+                               const char *key,     /* IN */
+                               int key_length)      /* IN */
+{
+   return _bson_chain_begin (chain, BSON_TYPE_ARRAY, key, key_length);
+}
+
+
+void
+bson_chain_append_array_end (bson_chain_t *chain) /* IN */
+{
+   _bson_chain_end (chain, BSON_TYPE_ARRAY);
+}
+
+
+uint32_t
+bson_chain_len (const bson_chain_t *chain) /* IN */
+{
+   BSON_ASSERT (chain);
+   BSON_ASSERT (!chain->depth);
+
+   return chain->len + 1;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_chain_iovecs --
+ *
+ *       Get the document built in @chain as a list of buffers, without
+ *       copying it, to be written with writev() or WSASend(). There is
+ *       one iovec for each large referenced value, and one for each run
+ *       of other bytes.
+ *
+ * Returns:
+ *       The iovecs, which are valid until @chain is changed or destroyed.
+ *
+ * Side effects:
+ *       @n_iovecs is set to the number of iovecs.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+const bson_iovec_t *
+bson_chain_iovecs (bson_chain_t *chain, /* IN */
+                   size_t *n_iovecs)    /* OUT */
+{
+   const bson_chain_segment_t *segment;
+   const uint8_t *base;
+   uint32_t len_le;
+   size_t i;
+
+   BSON_ASSERT (chain);
+   BSON_ASSERT (n_iovecs);
+   BSON_ASSERT (!chain->depth);
+
+   len_le = BSON_UINT32_TO_LE (chain->len + 1);
+   memcpy (chain->buf, &len_le, sizeof len_le);
+
+   if (chain->n_segments + 1 > chain->iovecs_alloc) {
+      chain->iovecs_alloc = chain->segments_alloc + 1;
+      chain->iovecs = bson_realloc (
+         chain->iovecs, chain->iovecs_alloc * sizeof *chain->iovecs);
+   }
+
+   for (i = 0; i < chain->n_segments; i++) {
+      segment = &chain->segments[i];
+      base = segment->data ? segment->data : chain->buf + segment->off;
+      chain->iovecs[i].iov_base = (char *) base;
+      chain->iovecs[i].iov_len = segment->len;
+   }
+
+   chain->iovecs[i].iov_base = (char *) &gZero;
+   chain->iovecs[i].iov_len = 1;
+
+   *n_iovecs = chain->n_segments + 1;
+
+   return chain->iovecs;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_chain_to_bson --
+ *
+ *       Copy the document built in @chain into @dst, which is allocated
+ *       once, at the size of the document.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       @dst is initialized and must be freed with bson_destroy().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_chain_to_bson (bson_chain_t *chain, /* IN */
+                    bson_t *dst)         /* OUT */
+{
+   const bson_chain_segment_t *segment;
+   uint32_t len_le;
+   uint8_t *data;
+   uint8_t *out;
+   size_t i;
+
+   BSON_ASSERT (chain);
+   BSON_ASSERT (dst);
+   BSON_ASSERT (!chain->depth);
+
+   data = out = _bson_init_with_len (dst, chain->len + 1);
+
+   for (i = 0; i < chain->n_segments; i++) {
+      segment = &chain->segments[i];
+      memcpy (out,
+              segment->data ? segment->data : chain->buf + segment->off,
+              segment->len);
+      out += segment->len;
+   }
+
+   *out = 0;
+
+   len_le = BSON_UINT32_TO_LE (chain->len + 1);
+   memcpy (data, &len_le, sizeof len_le);
+}
@@ -0,0 +1,121 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_CHAIN_H
+#define BSON_CHAIN_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-compat.h"
+#include "bson-macros.h"
+#include "bson-types.h"
+
+#ifndef _WIN32
+#include <sys/uio.h>
+#endif
+
+
+BSON_BEGIN_DECLS
+
+
+/**
+ * bson_iovec_t:
+ *
+ * A buffer of a scatter/gather list. It is a struct iovec on POSIX, to be
+ * passed to writev(), and has the layout of a WSABUF on Windows, to be
+ * passed to WSASend().
+ */
+#ifdef _WIN32
+typedef struct {
+   u_long iov_len;
+   char *iov_base;
+} bson_iovec_t;
+#else
+typedef struct iovec bson_iovec_t;
+#endif
+
+
+/**
+ * bson_chain_t:
+ *
+ * A bson_chain_t builds a document that refers to the buffers of large
+ * embedded documents and values instead of copying them. Small elements
+ * are encoded into a buffer owned by the chain. The document is only made
+ * contiguous on request, otherwise it is handed out as a list of iovecs.
+ *
+ * The documents and iterators appended to a chain must outlive it, or
+ * its next call to bson_chain_reinit().
+ */
+typedef struct _bson_chain_t bson_chain_t;
+
+
+BSON_EXPORT (bson_chain_t *)
+bson_chain_new (void);
+BSON_EXPORT (void)
+bson_chain_destroy (bson_chain_t *chain);
+BSON_EXPORT (void)
+bson_chain_reinit (bson_chain_t *chain);
+BSON_EXPORT (bool)
+bson_chain_append_value (bson_chain_t *chain,
+                         const char *key,
+                         int key_length,
+                         const bson_value_t *value);
+BSON_EXPORT (bool)
+bson_chain_append_document (bson_chain_t *chain,
+                            const char *key,
+                            int key_length,
+                            const bson_t *value);
+BSON_EXPORT (bool)
+bson_chain_append_array (bson_chain_t *chain,
+                         const char *key,
+                         int key_length,
+                         const bson_t *value);
+BSON_EXPORT (bool)
+bson_chain_append_iter (bson_chain_t *chain,
+                        const char *key,
+                        int key_length,
+                        const bson_iter_t *iter);
+BSON_EXPORT (bool)
+bson_chain_concat (bson_chain_t *chain, const bson_t *src);
+BSON_EXPORT (bool)
+bson_chain_append_document_begin (bson_chain_t *chain,
+                                  const char *key,
+                                  int key_length);
+BSON_EXPORT (void)
+bson_chain_append_document_end (bson_chain_t *chain);
+BSON_EXPORT (bool)
+bson_chain_append_array_begin (bson_chain_t *chain,
+                               const char *key,
+                               int key_length);
+BSON_EXPORT (void)
+bson_chain_append_array_end (bson_chain_t *chain);
+BSON_EXPORT (uint32_t)
+bson_chain_len (const bson_chain_t *chain);
+BSON_EXPORT (const bson_iovec_t *)
+bson_chain_iovecs (bson_chain_t *chain, size_t *n_iovecs);
+BSON_EXPORT (void)
+bson_chain_to_bson (bson_chain_t *chain, bson_t *dst);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_CHAIN_H */
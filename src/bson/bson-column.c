@@ -0,0 +1,601 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson.h"
+#include "bson-column.h"
+
+
+#define BSON_COLUMN_MIN_ROWS 64
+
+
+struct _bson_column_t {
+   bson_path_t *path; /* NULL to take array elements themselves */
+   bson_type_t type;
+   bool coerce;
+   size_t value_size;
+
+   uint8_t *values;
+   uint8_t *validity; /* one bit per row, least significant bit first */
+   size_t length;
+   size_t null_count;
+   size_t alloc;
+};
+
+
+static void
+_bson_column_reserve (bson_column_t *column, /* IN */
+                      size_t n_rows)         /* IN */
+{
+   size_t validity_len;
+   size_t alloc;
+
+   if (column->length + n_rows <= column->alloc) {
+      return;
+   }
+
+   alloc = BSON_MAX (column->alloc, BSON_COLUMN_MIN_ROWS);
+   while (alloc < column->length + n_rows) {
+      alloc *= 2;
+   }
+
+   validity_len = (column->alloc + 7) / 8;
+
+   column->values = bson_realloc (column->values, alloc * column->value_size);
+   column->validity = bson_realloc (column->validity, (alloc + 7) / 8);
+   memset (column->validity + validity_len, 0, (alloc + 7) / 8 - validity_len);
+   column->alloc = alloc;
+}
+
+
+/*
+ * Convert a double to an integer in [@min, @max], failing for NaN and for
+ * values out of range rather than invoking undefined behavior.
+ */
+static bool
+_bson_column_double_to_int (double d,     /* IN */
+                            double min,   /* IN */
+                            double max,   /* IN */
+                            int64_t *out) /* OUT */
+{
+   if (!(d >= min && d < max)) {
+      return false;
+   }
+
+   *out = (int64_t) d;
+   return true;
+}
+
+
+static bool
+_bson_column_as_int (const bson_iter_t *iter, /* IN */
+                     int64_t min,             /* IN */
+                     int64_t max,             /* IN */
+                     int64_t *out)            /* OUT */
+{
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_BOOL:
+      *out = bson_iter_bool (iter);
+      return true;
+   case BSON_TYPE_DOUBLE:
+      /* (double) max + 1 is 2^31 or 2^63, the first value out of range */
+      return _bson_column_double_to_int (
+         bson_iter_double (iter), (double) min, (double) max + 1.0, out);
+   case BSON_TYPE_INT32:
+      *out = bson_iter_int32 (iter);
+      break;
+   case BSON_TYPE_INT64:
+      *out = bson_iter_int64 (iter);
+      break;
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_UTF8:
+   case BSON_TYPE_DOCUMENT:
+   case BSON_TYPE_ARRAY:
+   case BSON_TYPE_BINARY:
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_OID:
+   case BSON_TYPE_DATE_TIME:
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_REGEX:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_SYMBOL:
+   case BSON_TYPE_CODEWSCOPE:
+   case BSON_TYPE_TIMESTAMP:
+   case BSON_TYPE_DECIMAL128:
+   case BSON_TYPE_MAXKEY:
+   case BSON_TYPE_MINKEY:
+   default:
+      return false;
+   }
+
+   return *out >= min && *out <= max;
+}
+
+
+static bool
+_bson_column_is_number (const bson_iter_t *iter) /* IN */
+{
+   switch (bson_iter_type (iter)) {
+   case BSON_TYPE_BOOL:
+   case BSON_TYPE_DOUBLE:
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_INT64:
+      return true;
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_UTF8:
+   case BSON_TYPE_DOCUMENT:
+   case BSON_TYPE_ARRAY:
+   case BSON_TYPE_BINARY:
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_OID:
+   case BSON_TYPE_DATE_TIME:
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_REGEX:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_SYMBOL:
+   case BSON_TYPE_CODEWSCOPE:
+   case BSON_TYPE_TIMESTAMP:
+   case BSON_TYPE_DECIMAL128:
+   case BSON_TYPE_MAXKEY:
+   case BSON_TYPE_MINKEY:
+   default:
+      return false;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_column_convert --
+ *
+ *       Store the value under @iter in @value as the column's C type.
+ *       Without BSON_COLUMN_FLAG_COERCE only values of the column's type
+ *       are accepted.
+ *
+ * Returns:
+ *       true if @value was set, false if the value has another type or
+ *       can't be represented.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_column_convert (const bson_column_t *column, /* IN */
+                      const bson_iter_t *iter,     /* IN */
+                      uint8_t *value)              /* OUT */
+{
+   bson_column_utf8_t *utf8;
+   int64_t i;
+
+   if (bson_iter_type (iter) != column->type &&
+       !(column->coerce && _bson_column_is_number (iter))) {
+      return false;
+   }
+
+   switch (column->type) {
+   case BSON_TYPE_DOUBLE:
+      *(double *) value = bson_iter_as_double (iter);
+      return true;
+   case BSON_TYPE_INT32:
+      if (!_bson_column_as_int (iter, INT32_MIN, INT32_MAX, &i)) {
+         return false;
+      }
+      *(int32_t *) value = (int32_t) i;
+      return true;
+   case BSON_TYPE_INT64:
+      if (!_bson_column_as_int (iter, INT64_MIN, INT64_MAX, &i)) {
+         return false;
+      }
+      *(int64_t *) value = i;
+      return true;
+   case BSON_TYPE_BOOL:
+      *(bool *) value = bson_iter_as_bool (iter);
+      return true;
+   case BSON_TYPE_DATE_TIME:
+      if (!BSON_ITER_HOLDS_DATE_TIME (iter)) {
+         return false;
+      }
+      *(int64_t *) value = bson_iter_date_time (iter);
+      return true;
+   case BSON_TYPE_OID:
+      if (!BSON_ITER_HOLDS_OID (iter)) {
+         return false;
+      }
+      bson_oid_copy (bson_iter_oid (iter), (bson_oid_t *) value);
+      return true;
+   case BSON_TYPE_UTF8:
+      if (!BSON_ITER_HOLDS_UTF8 (iter)) {
+         return false;
+      }
+      utf8 = (bson_column_utf8_t *) value;
+      utf8->str = bson_iter_utf8 (iter, &utf8->len);
+      return true;
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_DOCUMENT:
+   case BSON_TYPE_ARRAY:
+   case BSON_TYPE_BINARY:
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_REGEX:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_SYMBOL:
+   case BSON_TYPE_CODEWSCOPE:
+   case BSON_TYPE_TIMESTAMP:
+   case BSON_TYPE_DECIMAL128:
+   case BSON_TYPE_MAXKEY:
+   case BSON_TYPE_MINKEY:
+   default:
+      BSON_ASSERT (false);
+      return false;
+   }
+}
+
+
+/*
+ * Append a row for the value under @iter, or a null row if @iter is NULL
+ * or its value does not convert. Space must have been reserved.
+ */
+static void
+_bson_column_append (bson_column_t *column,   /* IN */
+                     const bson_iter_t *iter) /* IN */
+{
+   uint8_t *value;
+   size_t row;
+
+   row = column->length++;
+   value = column->values + row * column->value_size;
+
+   if (iter && _bson_column_convert (column, iter, value)) {
+      column->validity[row / 8] |= (uint8_t) (1u << (row % 8));
+   } else {
+      memset (value, 0, column->value_size);
+      column->null_count++;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_column_new --
+ *
+ *       Create an empty column of the values at @path, a dotted path as
+ *       accepted by bson_path_new(), converted to @type. If @path is NULL,
+ *       bson_column_append_array() takes the array elements themselves.
+ *
+ *       @type is one of BSON_TYPE_DOUBLE, BSON_TYPE_INT32,
+ *       BSON_TYPE_INT64, BSON_TYPE_BOOL, BSON_TYPE_DATE_TIME,
+ *       BSON_TYPE_OID or BSON_TYPE_UTF8, stored as double, int32_t,
+ *       int64_t, bool, int64_t, bson_oid_t and bson_column_utf8_t.
+ *
+ *       With BSON_COLUMN_FLAG_COERCE, boolean and numeric values are
+ *       converted to a numeric or boolean @type like bson_iter_as_double()
+ *       and friends. Values that don't fit an integer type are null.
+ *
+ * Returns:
+ *       A newly allocated bson_column_t that should be freed with
+ *       bson_column_destroy(), or NULL if @type is not supported.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_column_t *
+bson_column_new (const char *path,          /* IN */
+                 bson_type_t type,          /* IN */
+                 bson_column_flags_t flags) /* IN */
+{
+   bson_column_t *column;
+   size_t value_size;
+
+   switch (type) {
+   case BSON_TYPE_DOUBLE:
+      value_size = sizeof (double);
+      break;
+   case BSON_TYPE_INT32:
+      value_size = sizeof (int32_t);
+      break;
+   case BSON_TYPE_INT64:
+   case BSON_TYPE_DATE_TIME:
+      value_size = sizeof (int64_t);
+      break;
+   case BSON_TYPE_BOOL:
+      value_size = sizeof (bool);
+      break;
+   case BSON_TYPE_OID:
+      value_size = sizeof (bson_oid_t);
+      break;
+   case BSON_TYPE_UTF8:
+      value_size = sizeof (bson_column_utf8_t);
+      break;
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_DOCUMENT:
+   case BSON_TYPE_ARRAY:
+   case BSON_TYPE_BINARY:
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_REGEX:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_SYMBOL:
+   case BSON_TYPE_CODEWSCOPE:
+   case BSON_TYPE_TIMESTAMP:
+   case BSON_TYPE_DECIMAL128:
+   case BSON_TYPE_MAXKEY:
+   case BSON_TYPE_MINKEY:
+   default:
+      return NULL;
+   }
+
+   column = bson_malloc0 (sizeof *column);
+   column->path = path ? bson_path_new (path) : NULL;
+   column->type = type;
+   column->coerce = !!(flags & BSON_COLUMN_FLAG_COERCE);
+   column->value_size = value_size;
+
+   return column;
+}
+
+
+void
+bson_column_destroy (bson_column_t *column) /* IN */
+{
+   if (column) {
+      bson_path_destroy (column->path);
+      bson_free (column->values);
+      bson_free (column->validity);
+      bson_free (column);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_column_reset --
+ *
+ *       Remove all rows from @column, keeping its buffers for reuse.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Pointers returned by bson_column_values() and
+ *       bson_column_validity() refer to the emptied buffers.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_column_reset (bson_column_t *column) /* IN */
+{
+   BSON_ASSERT (column);
+
+   if (column->validity) {
+      memset (column->validity, 0, (column->length + 7) / 8);
+   }
+
+   column->length = 0;
+   column->null_count = 0;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_column_append_array --
+ *
+ *       Append one row for each element of the array under @array. The
+ *       row's value is taken from the element's field at the column's
+ *       path, or from the element itself if the column has no path.
+ *
+ * Returns:
+ *       true if successful. false if @array is not on an array or the
+ *       array is corrupt, and @error is set; rows for the elements before
+ *       the corrupt one have been appended.
+ *
+ * Side effects:
+ *       Pointers returned by bson_column_values() and
+ *       bson_column_validity() are invalidated.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_column_append_array (bson_column_t *column,    /* IN */
+                          const bson_iter_t *array, /* IN */
+                          bson_error_t *error)      /* OUT */
+{
+   bson_iter_t iter;
+   bson_iter_t child;
+   bson_iter_t found;
+   uint32_t len;
+
+   BSON_ASSERT (column);
+   BSON_ASSERT (array);
+
+   if (!BSON_ITER_HOLDS_ARRAY (array)) {
+      bson_set_error (error,
+                      BSON_ERROR_COLUMN,
+                      BSON_COLUMN_ERROR_NOT_ARRAY,
+                      "\"%s\" is not an array",
+                      bson_iter_key (array));
+      return false;
+   }
+
+   if (!bson_iter_recurse (array, &iter)) {
+      goto corrupt;
+   }
+
+   len = iter.len;
+
+   while (bson_iter_next (&iter)) {
+      _bson_column_reserve (column, 1);
+
+      if (!column->path) {
+         _bson_column_append (column, &iter);
+      } else if (BSON_ITER_HOLDS_DOCUMENT (&iter) &&
+                 bson_iter_recurse (&iter, &child) &&
+                 bson_iter_find_path (&child, column->path, &found)) {
+         _bson_column_append (column, &found);
+      } else {
+         _bson_column_append (column, NULL);
+      }
+   }
+
+   /* a complete walk stops on the array's terminating NUL */
+   if (iter.err_off || iter.off + 1 != len) {
+      goto corrupt;
+   }
+
+   return true;
+
+corrupt:
+   bson_set_error (error,
+                   BSON_ERROR_COLUMN,
+                   BSON_COLUMN_ERROR_CORRUPT_BSON,
+                   "corrupt BSON in array \"%s\"",
+                   bson_iter_key (array));
+   return false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_column_append_documents --
+ *
+ *       Append one row for each of the @n_documents documents, with the
+ *       value of its field at the column's path. The column must have a
+ *       path.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Pointers returned by bson_column_values() and
+ *       bson_column_validity() are invalidated.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_column_append_documents (bson_column_t *column,          /* IN */
+                              const bson_t *const *documents, /* IN */
+                              size_t n_documents)             /* IN */
+{
+   bson_iter_t iter;
+   bson_iter_t found;
+   size_t i;
+
+   BSON_ASSERT (column);
+   BSON_ASSERT (column->path);
+   BSON_ASSERT (documents || !n_documents);
+
+   _bson_column_reserve (column, n_documents);
+
+   for (i = 0; i < n_documents; i++) {
+      if (bson_iter_init (&iter, documents[i]) &&
+          bson_iter_find_path (&iter, column->path, &found)) {
+         _bson_column_append (column, &found);
+      } else {
+         _bson_column_append (column, NULL);
+      }
+   }
+}
+
+
+size_t
+bson_column_length (const bson_column_t *column) /* IN */
+{
+   BSON_ASSERT (column);
+
+   return column->length;
+}
+
+
+size_t
+bson_column_null_count (const bson_column_t *column) /* IN */
+{
+   BSON_ASSERT (column);
+
+   return column->null_count;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_column_values --
+ *
+ *       The values of @column, an array of bson_column_length() elements
+ *       of the C type for the column's BSON type. Null rows are zeroed.
+ *
+ * Returns:
+ *       A pointer that is valid until @column is next appended to or
+ *       destroyed, or NULL if nothing has been appended yet.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+const void *
+bson_column_values (const bson_column_t *column) /* IN */
+{
+   BSON_ASSERT (column);
+
+   return column->values;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_column_validity --
+ *
+ *       The validity bitmap of @column. Bit (row % 8) of byte (row / 8) is
+ *       set if the row has a value and clear if it is null.
+ *
+ * Returns:
+ *       A pointer that is valid until @column is next appended to or
+ *       destroyed, or NULL if nothing has been appended yet.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+const uint8_t *
+bson_column_validity (const bson_column_t *column) /* IN */
+{
+   BSON_ASSERT (column);
+
+   return column->validity;
+}
@@ -0,0 +1,99 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_COLUMN_H
+#define BSON_COLUMN_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-iter.h"
+#include "bson-macros.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+typedef enum {
+   BSON_COLUMN_ERROR_NOT_ARRAY = 1,
+   BSON_COLUMN_ERROR_CORRUPT_BSON,
+} bson_column_error_code_t;
+
+
+typedef enum {
+   BSON_COLUMN_FLAG_NONE = 0,
+   BSON_COLUMN_FLAG_COERCE = 1 << 0,
+} bson_column_flags_t;
+
+
+/**
+ * bson_column_utf8_t:
+ *
+ * A string in a BSON_TYPE_UTF8 column. @str points into the document it
+ * was read from and is NUL-terminated; @len does not include the NUL.
+ */
+typedef struct {
+   const char *str;
+   uint32_t len;
+} bson_column_utf8_t;
+
+
+/**
+ * bson_column_t:
+ *
+ * A bson_column_t gathers the values of one field from many documents
+ * into a contiguous array of a single C type, with a bitmap recording
+ * which rows have a value. Rows whose field is missing, null, or of
+ * another type are marked as null.
+ *
+ * A bson_column_t is not thread-safe.
+ */
+typedef struct _bson_column_t bson_column_t;
+
+
+BSON_EXPORT (bson_column_t *)
+bson_column_new (const char *path, bson_type_t type, bson_column_flags_t flags);
+BSON_EXPORT (void)
+bson_column_destroy (bson_column_t *column);
+BSON_EXPORT (void)
+bson_column_reset (bson_column_t *column);
+BSON_EXPORT (bool)
+bson_column_append_array (bson_column_t *column,
+                          const bson_iter_t *array,
+                          bson_error_t *error);
+BSON_EXPORT (void)
+bson_column_append_documents (bson_column_t *column,
+                              const bson_t *const *documents,
+                              size_t n_documents);
+BSON_EXPORT (size_t)
+bson_column_length (const bson_column_t *column);
+BSON_EXPORT (size_t)
+bson_column_null_count (const bson_column_t *column);
+BSON_EXPORT (const void *)
+bson_column_values (const bson_column_t *column);
+BSON_EXPORT (const uint8_t *)
+bson_column_validity (const bson_column_t *column);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_COLUMN_H */
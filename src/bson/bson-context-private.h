@@ -34,6 +34,8 @@ struct _bson_context_t {
    uint8_t md5[3];
    int32_t seq32;
    int64_t seq64;
+   /* identifies the context in per-thread sequence blocks */
+   int32_t id;
 
    void (*oid_get_host) (bson_context_t *context, bson_oid_t *oid);
    void (*oid_get_pid) (bson_context_t *context, bson_oid_t *oid);
@@ -42,6 +44,12 @@ struct _bson_context_t {
 };
 
 
+uint32_t
+_bson_context_get_oid_seq32_many (bson_context_t *context,
+                                  bson_oid_t *oid,
+                                  uint32_t n);
+
+
 BSON_END_DECLS
 
 
@@ -40,10 +40,43 @@
 #endif
 
 
+/*
+ * The most sequence numbers a thread takes at a time from a context created
+ * with BSON_CONTEXT_THREAD_LOCAL_SEQ. A thread's first block from a context
+ * holds one, and each block after it twice as many as the one before, so
+ * the numbers a thread leaves unused when it exits or moves to another
+ * context are fewer than those it used. The context's counter then advances
+ * by less than two per ObjectID, and only wraps within a second beyond 8
+ * million ObjectIDs per second.
+ */
+#define BSON_CONTEXT_SEQ_BLOCK_SIZE 1024
+
+
 /*
  * Globals.
  */
 static bson_context_t gContextDefault;
+static int32_t gContextId;
+
+
+#ifdef BSON_THREAD_LOCAL
+/*
+ * A thread's block of sequence numbers from the context it last used, with
+ * copies of the context's host and pid bytes. These are read here rather
+ * than from the context, since the context's cache line is written by other
+ * threads whenever they take a block.
+ */
+typedef struct {
+   int32_t context_id;
+   uint32_t seq;
+   uint32_t remaining;
+   uint32_t next_size;
+   uint8_t pidbe[2];
+   uint8_t md5[3];
+} bson_context_seq_block_t;
+
+static BSON_THREAD_LOCAL bson_context_seq_block_t gSeqBlock;
+#endif
 
 
 #ifdef BSON_HAVE_SYSCALL_TID
@@ -260,6 +293,106 @@ _bson_context_get_oid_seq32_threadsafe (bson_context_t *context, /* IN */
 }
 
 
+#ifdef BSON_THREAD_LOCAL
+static BSON_INLINE bson_context_seq_block_t *
+_bson_context_get_seq_block (bson_context_t *context) /* IN */
+{
+   bson_context_seq_block_t *block = &gSeqBlock;
+
+   if (BSON_UNLIKELY (block->context_id != context->id)) {
+      /* the rest of a block from another context is abandoned, and
+       * blocks from this one start small again */
+      block->context_id = context->id;
+      block->seq = 0;
+      block->remaining = 0;
+      block->next_size = 1;
+      memcpy (block->pidbe, context->pidbe, sizeof block->pidbe);
+      memcpy (block->md5, context->md5, sizeof block->md5);
+   }
+
+   return block;
+}
+
+
+/* the host and pid bytes are written with the sequence number instead */
+static void
+_bson_context_get_oid_thread_local_noop (bson_context_t *context, /* IN */
+                                         bson_oid_t *oid)         /* OUT */
+{
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_context_get_oid_seq32_block --
+ *
+ *       Thread-safe 32-bit sequence generator that takes a block of up to
+ *       BSON_CONTEXT_SEQ_BLOCK_SIZE sequence numbers from the context with
+ *       one atomic add, and hands them out to the calling thread alone.
+ *       Sequence numbers still increase within each thread.
+ *
+ *       When @with_host_pid is true, the host and pid bytes are copied
+ *       from the thread's block too, so that only one thread-local
+ *       variable is looked up per OID.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       @oid is modified.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static BSON_INLINE void
+_bson_context_get_oid_seq32_block (bson_context_t *context, /* IN */
+                                   bson_oid_t *oid,         /* OUT */
+                                   bool with_host_pid)      /* IN */
+{
+   bson_context_seq_block_t *block = _bson_context_get_seq_block (context);
+   uint32_t seq;
+
+   if (BSON_UNLIKELY (!block->remaining)) {
+      block->remaining = block->next_size;
+      block->seq = (uint32_t) bson_atomic_int_add (
+                      &context->seq32, (int32_t) block->remaining) -
+                   block->remaining;
+      block->next_size =
+         BSON_MIN (block->next_size * 2, BSON_CONTEXT_SEQ_BLOCK_SIZE);
+   }
+
+   seq = block->seq++;
+   block->remaining--;
+
+   if (with_host_pid) {
+      memcpy (&oid->bytes[4], block->md5, sizeof block->md5);
+      memcpy (&oid->bytes[7], block->pidbe, sizeof block->pidbe);
+   }
+
+   seq = BSON_UINT32_TO_BE (seq);
+   memcpy (&oid->bytes[9], ((uint8_t *) &seq) + 1, 3);
+}
+
+
+static void
+_bson_context_get_oid_seq32_thread_local (bson_context_t *context, /* IN */
+                                          bson_oid_t *oid)         /* OUT */
+{
+   _bson_context_get_oid_seq32_block (context, oid, false);
+}
+
+
+static void
+_bson_context_get_oid_seq32_host_pid_thread_local (
+   bson_context_t *context, /* IN */
+   bson_oid_t *oid)         /* OUT */
+{
+   _bson_context_get_oid_seq32_block (context, oid, true);
+}
+#endif /* BSON_THREAD_LOCAL */
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -317,6 +450,78 @@ _bson_context_get_oid_seq64_threadsafe (bson_context_t *context, /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_context_get_oid_seq32_many --
+ *
+ *       Initialize the host and pid fields of @oid, and reserve @n
+ *       consecutive sequence numbers, with a single atomic add for
+ *       thread-safe contexts.
+ *
+ * Returns:
+ *       The first of the sequence numbers.
+ *
+ * Side effects:
+ *       @oid is modified.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+uint32_t
+_bson_context_get_oid_seq32_many (bson_context_t *context, /* IN */
+                                  bson_oid_t *oid,         /* OUT */
+                                  uint32_t n)              /* IN */
+{
+   uint32_t seq;
+
+   BSON_ASSERT (n <= INT32_MAX);
+
+   if ((context->flags & BSON_CONTEXT_DISABLE_HOST_CACHE)) {
+      _bson_context_get_oid_host (context, oid);
+   } else {
+      _bson_context_get_oid_host_cached (context, oid);
+   }
+
+   if ((context->flags & BSON_CONTEXT_DISABLE_PID_CACHE)) {
+      _bson_context_get_oid_pid (context, oid);
+   } else {
+      _bson_context_get_oid_pid_cached (context, oid);
+   }
+
+#ifdef BSON_THREAD_LOCAL
+   if ((context->flags & BSON_CONTEXT_THREAD_LOCAL_SEQ)) {
+      bson_context_seq_block_t *block = _bson_context_get_seq_block (context);
+
+      if (n <= block->remaining) {
+         seq = block->seq;
+         block->seq += n;
+         block->remaining -= n;
+         return seq;
+      }
+
+      /* abandon the block so that this thread's sequence still increases */
+      block->remaining = 0;
+
+      return (uint32_t) bson_atomic_int_add (&context->seq32, (int32_t) n) - n;
+   }
+#endif
+
+   if ((context->flags &
+        (BSON_CONTEXT_THREAD_SAFE | BSON_CONTEXT_THREAD_LOCAL_SEQ))) {
+      /* like _bson_context_get_oid_seq32_threadsafe, the values after each
+       * increment are used */
+      return (uint32_t) bson_atomic_int_add (&context->seq32, (int32_t) n) -
+             n + 1;
+   }
+
+   seq = (uint32_t) context->seq32;
+   context->seq32 = (int32_t) (seq + n);
+
+   return seq;
+}
+
+
 static void
 _bson_context_init (bson_context_t *context,    /* IN */
                     bson_context_flags_t flags) /* IN */
@@ -328,6 +533,7 @@ _bson_context_init (bson_context_t *context,    /* IN */
    bson_oid_t oid;
 
    context->flags = (int) flags;
+   context->id = bson_atomic_int_add (&gContextId, 1);
    context->oid_get_host = _bson_context_get_oid_host_cached;
    context->oid_get_pid = _bson_context_get_oid_pid_cached;
    context->oid_get_seq32 = _bson_context_get_oid_seq32;
@@ -392,6 +598,24 @@ _bson_context_init (bson_context_t *context,    /* IN */
 
       memcpy (&context->pidbe[0], &pid, 2);
    }
+
+   if ((flags & BSON_CONTEXT_THREAD_LOCAL_SEQ)) {
+      context->oid_get_seq64 = _bson_context_get_oid_seq64_threadsafe;
+#ifdef BSON_THREAD_LOCAL
+      if ((flags & (BSON_CONTEXT_DISABLE_HOST_CACHE |
+                    BSON_CONTEXT_DISABLE_PID_CACHE))) {
+         context->oid_get_seq32 = _bson_context_get_oid_seq32_thread_local;
+      } else {
+         /* bson_oid_init gets the sequence number last */
+         context->oid_get_host = _bson_context_get_oid_thread_local_noop;
+         context->oid_get_pid = _bson_context_get_oid_thread_local_noop;
+         context->oid_get_seq32 =
+            _bson_context_get_oid_seq32_host_pid_thread_local;
+      }
+#else
+      context->oid_get_seq32 = _bson_context_get_oid_seq32_threadsafe;
+#endif
+   }
 }
 
 
@@ -411,7 +635,8 @@ _bson_context_init (bson_context_t *context,    /* IN */
  *       If you absolutely must have a single context for your application
  *       and use more than one thread, then %BSON_CONTEXT_THREAD_SAFE should
  *       be bitwise-or'd with your flags. This requires synchronization
- *       between threads.
+ *       between threads. %BSON_CONTEXT_THREAD_LOCAL_SEQ instead synchronizes
+ *       only once per block of sequence numbers taken by each thread.
  *
  *       If you expect your hostname to change often, you may consider
  *       specifying %BSON_CONTEXT_DISABLE_HOST_CACHE so that gethostname()
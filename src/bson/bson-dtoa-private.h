@@ -0,0 +1,78 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_DTOA_PRIVATE_H
+#define BSON_DTOA_PRIVATE_H
+
+
+#include "bson-compat.h"
+#include "bson-macros.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/* enough for "-1.2345678901234567e-308" or a 20-digit integer, and '\0' */
+#define BSON_DTOA_BUFFER_SIZE 32
+
+/* enough for "-9223372036854775808" and '\0' */
+#define BSON_ITOA_BUFFER_SIZE 21
+
+
+/**
+ * _bson_dtoa:
+ * @value: A double.
+ * @buf: A buffer of at least BSON_DTOA_BUFFER_SIZE bytes.
+ *
+ * Formats @value like printf's "%g" with the fewest significant digits that
+ * read back as @value, independent of the locale. Integers below 1e20 are
+ * written with all of their digits, like "%.20g" does.
+ *
+ * Returns: The length of the NULL-terminated string written to @buf.
+ */
+size_t
+_bson_dtoa (double value, char *buf);
+
+/**
+ * _bson_i64toa:
+ * @value: An int64_t.
+ * @buf: A buffer of at least BSON_ITOA_BUFFER_SIZE bytes.
+ *
+ * Formats @value in decimal, like printf's "%" PRId64.
+ *
+ * Returns: The length of the NULL-terminated string written to @buf.
+ */
+size_t
+_bson_i64toa (int64_t value, char *buf);
+
+/**
+ * _bson_u64toa:
+ * @value: A uint64_t.
+ * @buf: A buffer of at least BSON_ITOA_BUFFER_SIZE bytes.
+ *
+ * Formats @value in decimal, like printf's "%" PRIu64.
+ *
+ * Returns: The length of the NULL-terminated string written to @buf.
+ */
+size_t
+_bson_u64toa (uint64_t value, char *buf);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_DTOA_PRIVATE_H */
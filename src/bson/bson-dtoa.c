@@ -0,0 +1,535 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+/*
+ * Shortest round-trip formatting of doubles with the Grisu2 algorithm from
+ * "Printing Floating-Point Numbers Quickly and Accurately with Integers",
+ * Loitsch, 2010, following the implementation in RapidJSON. The digits it
+ * produces always read back as the same double, and are the shortest such
+ * digits for all but a tiny fraction of doubles.
+ */
+
+
+#include <string.h>
+
+#include "bson-dtoa-private.h"
+
+
+#define BSON_DTOA_SIGNIFICAND_MASK 0x000FFFFFFFFFFFFFull
+#define BSON_DTOA_EXPONENT_MASK 0x7FF0000000000000ull
+#define BSON_DTOA_HIDDEN_BIT 0x0010000000000000ull
+#define BSON_DTOA_EXPONENT_BIAS (0x3FF + 52)
+
+
+/* a floating point number f * 2^e with a 64-bit significand */
+typedef struct {
+   uint64_t f;
+   int e;
+} bson_dtoa_fp_t;
+
+
+/* normalized 10^k for k = -348, -340, ..., 340 */
+static const struct {
+   uint64_t f;
+   int16_t e;
+} gCachedPowers[] = {
+   {0xfa8fd5a0081c0288ull, -1220}, {0xbaaee17fa23ebf76ull, -1193},
+   {0x8b16fb203055ac76ull, -1166}, {0xcf42894a5dce35eaull, -1140},
+   {0x9a6bb0aa55653b2dull, -1113}, {0xe61acf033d1a45dfull, -1087},
+   {0xab70fe17c79ac6caull, -1060}, {0xff77b1fcbebcdc4full, -1034},
+   {0xbe5691ef416bd60cull, -1007}, {0x8dd01fad907ffc3cull, -980},
+   {0xd3515c2831559a83ull, -954}, {0x9d71ac8fada6c9b5ull, -927},
+   {0xea9c227723ee8bcbull, -901}, {0xaecc49914078536dull, -874},
+   {0x823c12795db6ce57ull, -847}, {0xc21094364dfb5637ull, -821},
+   {0x9096ea6f3848984full, -794}, {0xd77485cb25823ac7ull, -768},
+   {0xa086cfcd97bf97f4ull, -741}, {0xef340a98172aace5ull, -715},
+   {0xb23867fb2a35b28eull, -688}, {0x84c8d4dfd2c63f3bull, -661},
+   {0xc5dd44271ad3cdbaull, -635}, {0x936b9fcebb25c996ull, -608},
+   {0xdbac6c247d62a584ull, -582}, {0xa3ab66580d5fdaf6ull, -555},
+   {0xf3e2f893dec3f126ull, -529}, {0xb5b5ada8aaff80b8ull, -502},
+   {0x87625f056c7c4a8bull, -475}, {0xc9bcff6034c13053ull, -449},
+   {0x964e858c91ba2655ull, -422}, {0xdff9772470297ebdull, -396},
+   {0xa6dfbd9fb8e5b88full, -369}, {0xf8a95fcf88747d94ull, -343},
+   {0xb94470938fa89bcfull, -316}, {0x8a08f0f8bf0f156bull, -289},
+   {0xcdb02555653131b6ull, -263}, {0x993fe2c6d07b7facull, -236},
+   {0xe45c10c42a2b3b06ull, -210}, {0xaa242499697392d3ull, -183},
+   {0xfd87b5f28300ca0eull, -157}, {0xbce5086492111aebull, -130},
+   {0x8cbccc096f5088ccull, -103}, {0xd1b71758e219652cull, -77},
+   {0x9c40000000000000ull, -50}, {0xe8d4a51000000000ull, -24},
+   {0xad78ebc5ac620000ull, 3}, {0x813f3978f8940984ull, 30},
+   {0xc097ce7bc90715b3ull, 56}, {0x8f7e32ce7bea5c70ull, 83},
+   {0xd5d238a4abe98068ull, 109}, {0x9f4f2726179a2245ull, 136},
+   {0xed63a231d4c4fb27ull, 162}, {0xb0de65388cc8ada8ull, 189},
+   {0x83c7088e1aab65dbull, 216}, {0xc45d1df942711d9aull, 242},
+   {0x924d692ca61be758ull, 269}, {0xda01ee641a708deaull, 295},
+   {0xa26da3999aef774aull, 322}, {0xf209787bb47d6b85ull, 348},
+   {0xb454e4a179dd1877ull, 375}, {0x865b86925b9bc5c2ull, 402},
+   {0xc83553c5c8965d3dull, 428}, {0x952ab45cfa97a0b3ull, 455},
+   {0xde469fbd99a05fe3ull, 481}, {0xa59bc234db398c25ull, 508},
+   {0xf6c69a72a3989f5cull, 534}, {0xb7dcbf5354e9beceull, 561},
+   {0x88fcf317f22241e2ull, 588}, {0xcc20ce9bd35c78a5ull, 614},
+   {0x98165af37b2153dfull, 641}, {0xe2a0b5dc971f303aull, 667},
+   {0xa8d9d1535ce3b396ull, 694}, {0xfb9b7cd9a4a7443cull, 720},
+   {0xbb764c4ca7a44410ull, 747}, {0x8bab8eefb6409c1aull, 774},
+   {0xd01fef10a657842cull, 800}, {0x9b10a4e5e9913129ull, 827},
+   {0xe7109bfba19c0c9dull, 853}, {0xac2820d9623bf429ull, 880},
+   {0x80444b5e7aa7cf85ull, 907}, {0xbf21e44003acdd2dull, 933},
+   {0x8e679c2f5e44ff8full, 960}, {0xd433179d9c8cb841ull, 986},
+   {0x9e19db92b4e31ba9ull, 1013}, {0xeb96bf6ebadf77d9ull, 1039},
+   {0xaf87023b9bf0ee6bull, 1066},};
+
+
+static const uint64_t gPow10[] = {1ull,
+                                  10ull,
+                                  100ull,
+                                  1000ull,
+                                  10000ull,
+                                  100000ull,
+                                  1000000ull,
+                                  10000000ull,
+                                  100000000ull,
+                                  1000000000ull,
+                                  10000000000ull,
+                                  100000000000ull,
+                                  1000000000000ull,
+                                  10000000000000ull,
+                                  100000000000000ull,
+                                  1000000000000000ull,
+                                  10000000000000000ull,
+                                  100000000000000000ull,
+                                  1000000000000000000ull,
+                                  10000000000000000000ull};
+
+
+static const char gDigitPairs[] =
+   "000102030405060708091011121314151617181920212223242526272829"
+   "303132333435363738394041424344454647484950515253545556575859"
+   "606162636465666768697071727374757677787980818283848586878889"
+   "90919293949596979899";
+
+
+static BSON_INLINE int
+_bson_dtoa_clz (uint64_t bits)
+{
+#if BSON_GNUC_CHECK_VERSION(3, 4) || defined(__clang__)
+   return __builtin_clzll (bits);
+#else
+   int r = 0;
+
+   while (!(bits & 0x8000000000000000ull)) {
+      bits <<= 1;
+      r++;
+   }
+
+   return r;
+#endif
+}
+
+
+static BSON_INLINE void
+_bson_dtoa_normalize (bson_dtoa_fp_t *x)
+{
+   int s = _bson_dtoa_clz (x->f);
+
+   x->f <<= s;
+   x->e -= s;
+}
+
+
+/* the upper 64 bits of the 128-bit product, rounded, @r may be @x */
+static BSON_INLINE void
+_bson_dtoa_mul (const bson_dtoa_fp_t *x,
+                const bson_dtoa_fp_t *y,
+                bson_dtoa_fp_t *r)
+{
+   const uint64_t mask32 = 0xFFFFFFFFull;
+   uint64_t a = x->f >> 32;
+   uint64_t b = x->f & mask32;
+   uint64_t c = y->f >> 32;
+   uint64_t d = y->f & mask32;
+   uint64_t ac = a * c;
+   uint64_t bc = b * c;
+   uint64_t ad = a * d;
+   uint64_t bd = b * d;
+   uint64_t tmp;
+
+   tmp = (bd >> 32) + (ad & mask32) + (bc & mask32);
+   tmp += 1ull << 31;
+
+   r->e = x->e + y->e + 64;
+   r->f = ac + (ad >> 32) + (bc >> 32) + (tmp >> 32);
+}
+
+
+/* a cached power of ten c = 10^-K, such that e + c.e is in [-60, -32] */
+static BSON_INLINE void
+_bson_dtoa_cached_power (int e, bson_dtoa_fp_t *c, int *K)
+{
+   double dk;
+   int index;
+   int k;
+
+   dk = (-61 - e) * 0.30102999566398114 + 347;
+   k = (int) dk;
+   if (dk - k > 0.0) {
+      k++;
+   }
+
+   index = (k >> 3) + 1;
+   *K = -(-348 + index * 8);
+
+   c->f = gCachedPowers[index].f;
+   c->e = gCachedPowers[index].e;
+}
+
+
+/* move the last digit towards w while it stays in the rounding interval */
+static void
+_bson_dtoa_round (char *digits,
+                  int len,
+                  uint64_t delta,
+                  uint64_t rest,
+                  uint64_t ten_kappa,
+                  uint64_t wp_w)
+{
+   while (rest < wp_w && delta - rest >= ten_kappa &&
+          (rest + ten_kappa < wp_w ||
+           wp_w - rest > rest + ten_kappa - wp_w)) {
+      digits[len - 1]--;
+      rest += ten_kappa;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_dtoa_digit_gen --
+ *
+ *       Generate the shortest digits of a number in the interval
+ *       (@mp - @delta, @mp), as close as possible to @w.
+ *
+ * Returns:
+ *       The number of digits written to @digits.
+ *
+ * Side effects:
+ *       The decimal exponent of the last digit is added to @K.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int
+_bson_dtoa_digit_gen (bson_dtoa_fp_t w,  /* IN */
+                      bson_dtoa_fp_t mp, /* IN */
+                      uint64_t delta,    /* IN */
+                      char *digits,      /* OUT */
+                      int *K)            /* IN/OUT */
+{
+   const int shift = -mp.e;
+   const uint64_t one = 1ull << shift;
+   const uint64_t wp_w = mp.f - w.f;
+   uint32_t p1 = (uint32_t) (mp.f >> shift);
+   uint64_t p2 = mp.f & (one - 1);
+   uint64_t rest;
+   uint32_t d;
+   int kappa;
+   int len = 0;
+
+   for (kappa = 1; kappa < 10 && p1 >= gPow10[kappa]; kappa++) {
+   }
+
+   /* the integral part */
+   while (kappa > 0) {
+      kappa--;
+      d = (uint32_t) (p1 / gPow10[kappa]);
+      p1 = (uint32_t) (p1 % gPow10[kappa]);
+
+      if (d || len) {
+         digits[len++] = (char) ('0' + d);
+      }
+
+      rest = ((uint64_t) p1 << shift) + p2;
+      if (rest <= delta) {
+         *K += kappa;
+         _bson_dtoa_round (
+            digits, len, delta, rest, gPow10[kappa] << shift, wp_w);
+         return len;
+      }
+   }
+
+   /* the fractional part */
+   for (;;) {
+      p2 *= 10;
+      delta *= 10;
+      d = (uint32_t) (p2 >> shift);
+
+      if (d || len) {
+         digits[len++] = (char) ('0' + d);
+      }
+
+      p2 &= one - 1;
+      kappa--;
+      if (p2 < delta) {
+         *K += kappa;
+         _bson_dtoa_round (digits,
+                           len,
+                           delta,
+                           p2,
+                           one,
+                           -kappa < 20 ? wp_w * gPow10[-kappa] : 0);
+         return len;
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_dtoa_grisu2 --
+ *
+ *       Find the shortest digits of the positive, finite @value.
+ *
+ * Returns:
+ *       The number of digits written to @digits, at most 18.
+ *
+ * Side effects:
+ *       @K is set so that @value is digits * 10^K.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int
+_bson_dtoa_grisu2 (double value, /* IN */
+                   char *digits, /* OUT */
+                   int *K)       /* OUT */
+{
+   bson_dtoa_fp_t v;
+   bson_dtoa_fp_t w;
+   bson_dtoa_fp_t mp;
+   bson_dtoa_fp_t mm;
+   bson_dtoa_fp_t c;
+   uint64_t bits;
+   int biased_e;
+
+   memcpy (&bits, &value, sizeof bits);
+   biased_e = (int) ((bits & BSON_DTOA_EXPONENT_MASK) >> 52);
+
+   if (biased_e) {
+      v.f = (bits & BSON_DTOA_SIGNIFICAND_MASK) + BSON_DTOA_HIDDEN_BIT;
+      v.e = biased_e - BSON_DTOA_EXPONENT_BIAS;
+   } else {
+      /* subnormal */
+      v.f = bits & BSON_DTOA_SIGNIFICAND_MASK;
+      v.e = 1 - BSON_DTOA_EXPONENT_BIAS;
+   }
+
+   /* the boundaries halfway to the neighboring doubles, the lower one is
+    * closer when @value is a power of two */
+   mp.f = (v.f << 1) + 1;
+   mp.e = v.e - 1;
+   _bson_dtoa_normalize (&mp);
+
+   if (v.f == BSON_DTOA_HIDDEN_BIT) {
+      mm.f = (v.f << 2) - 1;
+      mm.e = v.e - 2;
+   } else {
+      mm.f = (v.f << 1) - 1;
+      mm.e = v.e - 1;
+   }
+
+   mm.f <<= mm.e - mp.e;
+   mm.e = mp.e;
+
+   _bson_dtoa_cached_power (mp.e, &c, K);
+   _bson_dtoa_normalize (&v);
+   _bson_dtoa_mul (&v, &c, &w);
+   _bson_dtoa_mul (&mp, &c, &mp);
+   _bson_dtoa_mul (&mm, &c, &mm);
+
+   /* stay inside the interval despite the error of the multiplication */
+   mm.f++;
+   mp.f--;
+
+   return _bson_dtoa_digit_gen (w, mp, mp.f - mm.f, digits, K);
+}
+
+
+/* format @value, an integer in [2^64, 1e20), exactly */
+static size_t
+_bson_dtoa_large_integer (double value, char *buf)
+{
+   const uint64_t ten10 = 10000000000ull;
+   uint64_t hi;
+   uint64_t lo;
+   size_t len;
+   int i;
+
+   /* at least 12 low bits of @value are zero, so it is 16 * hi exactly */
+   hi = (uint64_t) (value / 16.0);
+   lo = (hi % ten10) * 16;
+   hi = (hi / ten10) * 16 + lo / ten10;
+   lo %= ten10;
+
+   len = _bson_u64toa (hi, buf);
+
+   for (i = 9; i >= 0; i--) {
+      buf[len + i] = (char) ('0' + lo % 10);
+      lo /= 10;
+   }
+
+   len += 10;
+   buf[len] = '\0';
+
+   return len;
+}
+
+
+size_t
+_bson_dtoa (double value, /* IN */
+            char *buf)    /* OUT */
+{
+   char digits[20];
+   uint64_t bits;
+   char *p = buf;
+   int len;
+   int K;
+   int X;
+
+   memcpy (&bits, &value, sizeof bits);
+
+   if (bits >> 63) {
+      *p++ = '-';
+      value = -value;
+   }
+
+   if (value != value) {
+      memcpy (p, "nan", 4);
+      return (size_t) (p - buf) + 3;
+   }
+
+   if (value * 0 != 0) {
+      memcpy (p, "inf", 4);
+      return (size_t) (p - buf) + 3;
+   }
+
+   if (value < 1e20) {
+      if (value >= 18446744073709551616.0) {
+         return (size_t) (p - buf) + _bson_dtoa_large_integer (value, p);
+      }
+
+      if ((double) (uint64_t) value == value) {
+         return (size_t) (p - buf) + _bson_u64toa ((uint64_t) value, p);
+      }
+   }
+
+   len = _bson_dtoa_grisu2 (value, digits, &K);
+
+   /* the decimal exponent of the first digit */
+   X = len + K - 1;
+
+   if (X >= 0 && X < 20) {
+      if (len <= X + 1) {
+         memcpy (p, digits, (size_t) len);
+         p += len;
+         memset (p, '0', (size_t) (X + 1 - len));
+         p += X + 1 - len;
+      } else {
+         memcpy (p, digits, (size_t) (X + 1));
+         p += X + 1;
+         *p++ = '.';
+         memcpy (p, digits + X + 1, (size_t) (len - X - 1));
+         p += len - X - 1;
+      }
+   } else if (X < 0 && X >= -4) {
+      *p++ = '0';
+      *p++ = '.';
+      memset (p, '0', (size_t) (-X - 1));
+      p += -X - 1;
+      memcpy (p, digits, (size_t) len);
+      p += len;
+   } else {
+      *p++ = digits[0];
+      if (len > 1) {
+         *p++ = '.';
+         memcpy (p, digits + 1, (size_t) (len - 1));
+         p += len - 1;
+      }
+
+      /* like printf, at least two digits of exponent */
+      *p++ = 'e';
+      if (X < 0) {
+         *p++ = '-';
+         X = -X;
+      } else {
+         *p++ = '+';
+      }
+
+      if (X < 10) {
+         *p++ = '0';
+      }
+
+      p += _bson_u64toa ((uint64_t) X, p);
+   }
+
+   *p = '\0';
+
+   return (size_t) (p - buf);
+}
+
+
+size_t
+_bson_i64toa (int64_t value, /* IN */
+              char *buf)     /* OUT */
+{
+   if (value < 0) {
+      *buf = '-';
+      return 1 + _bson_u64toa ((uint64_t) 0 - (uint64_t) value, buf + 1);
+   }
+
+   return _bson_u64toa ((uint64_t) value, buf);
+}
+
+
+size_t
+_bson_u64toa (uint64_t value, /* IN */
+              char *buf)      /* OUT */
+{
+   char tmp[20];
+   char *p = tmp + sizeof tmp;
+   size_t len;
+
+   /* two digits at a time, from the end */
+   while (value >= 100) {
+      p -= 2;
+      memcpy (p, gDigitPairs + (value % 100) * 2, 2);
+      value /= 100;
+   }
+
+   if (value >= 10) {
+      p -= 2;
+      memcpy (p, gDigitPairs + value * 2, 2);
+   } else {
+      *--p = (char) ('0' + value);
+   }
+
+   len = (size_t) (tmp + sizeof tmp - p);
+   memcpy (buf, p, len);
+   buf[len] = '\0';
+
+   return len;
+}
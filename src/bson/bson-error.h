@@ -30,6 +30,11 @@ BSON_BEGIN_DECLS
 #define BSON_ERROR_JSON 1
 #define BSON_ERROR_READER 2
 #define BSON_ERROR_INVALID 3
+#define BSON_ERROR_PATCH 4
+#define BSON_ERROR_COLUMN 5
+#define BSON_ERROR_ARROW 6
+#define BSON_ERROR_TEMPLATE 7
+#define BSON_ERROR_FILE_INDEX 8
 
 
 BSON_EXPORT (void)
@@ -0,0 +1,1031 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#ifdef BSON_OS_UNIX
+#include <sys/mman.h>
+#endif
+
+#include "bson.h"
+#include "bson-file-index.h"
+#include "bson-private.h"
+#include "bson-reader-private.h"
+
+
+/*
+ * The index file, all integers little-endian:
+ *
+ *    header      "BSONIDX1", uint64 n_docs, uint64 data_length,
+ *                uint64 n_keys, uint32 key_len, uint32 zero
+ *    key         the dotted path of the indexed field, key_len bytes,
+ *                zero-padded to a multiple of 8
+ *    offsets     uint64 offset of each document, n_docs of them
+ *    key table   uint64 position of each key record from the start of
+ *                the records, n_keys of them, in the order of the keys
+ *    records     for each document that has the field: uint64 offset of
+ *                the document, uint8 BSON type, uint32 value length, and
+ *                the value as it is encoded in the document
+ */
+#define BSON_FILE_INDEX_MAGIC "BSONIDX1"
+#define BSON_FILE_INDEX_HEADER_SIZE 40
+#define BSON_FILE_INDEX_RECORD_HEADER_SIZE 13
+
+
+struct _bson_file_index_t {
+   bson_reader_t *data_reader;
+   bson_reader_t *index_reader;
+   const uint8_t *data;
+   size_t data_len;
+
+   char *key;
+   uint64_t n_docs;
+   uint64_t n_keys;
+   const uint8_t *offsets;
+   const uint8_t *key_table;
+   const uint8_t *records;
+   size_t records_len;
+};
+
+
+/* a key record of the index being built */
+typedef struct {
+   uint64_t offset;
+   const uint8_t *value;
+   uint32_t value_len;
+   uint8_t type;
+} bson_file_index_record_t;
+
+
+static uint64_t
+_bson_file_index_get_uint64 (const uint8_t *p) /* IN */
+{
+   uint64_t v;
+
+   memcpy (&v, p, sizeof v);
+
+   return BSON_UINT64_FROM_LE (v);
+}
+
+
+static uint32_t
+_bson_file_index_get_uint32 (const uint8_t *p) /* IN */
+{
+   uint32_t v;
+
+   memcpy (&v, p, sizeof v);
+
+   return BSON_UINT32_FROM_LE (v);
+}
+
+
+/*
+ * The encoded value of the current element of @iter. Types without data,
+ * such as null, leave d1 unset, so the value is found from the key.
+ */
+static void
+_bson_file_index_iter_value (const bson_iter_t *iter, /* IN */
+                             const uint8_t **value,   /* OUT */
+                             uint32_t *value_len)     /* OUT */
+{
+   uint32_t value_off = iter->key + _bson_iter_key_len (iter) + 1;
+
+   *value = iter->raw + value_off;
+   *value_len = iter->next_off - value_off;
+}
+
+
+/*
+ * The rank of each type in the order of keys, which follows the order of
+ * MongoDB's comparisons. Numbers share a rank and compare by value.
+ */
+static int
+_bson_file_index_type_rank (uint8_t type) /* IN */
+{
+   switch ((bson_type_t) type) {
+   case BSON_TYPE_MINKEY:
+      return 1;
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_NULL:
+      return 2;
+   case BSON_TYPE_DOUBLE:
+   case BSON_TYPE_INT32:
+   case BSON_TYPE_INT64:
+      return 3;
+   case BSON_TYPE_UTF8:
+   case BSON_TYPE_SYMBOL:
+      return 4;
+   case BSON_TYPE_DOCUMENT:
+      return 5;
+   case BSON_TYPE_ARRAY:
+      return 6;
+   case BSON_TYPE_BINARY:
+      return 7;
+   case BSON_TYPE_OID:
+      return 8;
+   case BSON_TYPE_BOOL:
+      return 9;
+   case BSON_TYPE_DATE_TIME:
+      return 10;
+   case BSON_TYPE_TIMESTAMP:
+      return 11;
+   case BSON_TYPE_REGEX:
+      return 12;
+   case BSON_TYPE_MAXKEY:
+      return 14;
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_CODEWSCOPE:
+   case BSON_TYPE_DECIMAL128:
+   default:
+      return 13;
+   }
+}
+
+
+static bool
+_bson_file_index_get_number (uint8_t type,     /* IN */
+                             const uint8_t *p, /* IN */
+                             uint32_t len,     /* IN */
+                             int64_t *i,       /* OUT */
+                             double *d,        /* OUT */
+                             bool *is_int)     /* OUT */
+{
+   if (type == BSON_TYPE_INT32 && len == 4) {
+      *i = (int32_t) _bson_file_index_get_uint32 (p);
+      *d = (double) *i;
+      *is_int = true;
+   } else if (type == BSON_TYPE_INT64 && len == 8) {
+      *i = (int64_t) _bson_file_index_get_uint64 (p);
+      *d = (double) *i;
+      *is_int = true;
+   } else if (type == BSON_TYPE_DOUBLE && len == 8) {
+      uint64_t bits = _bson_file_index_get_uint64 (p);
+
+      memcpy (d, &bits, sizeof *d);
+      *is_int = false;
+   } else {
+      return false;
+   }
+
+   return true;
+}
+
+
+static int
+_bson_file_index_compare_bytes (const uint8_t *a, /* IN */
+                                uint32_t a_len,   /* IN */
+                                const uint8_t *b, /* IN */
+                                uint32_t b_len)   /* IN */
+{
+   int r;
+
+   r = memcmp (a, b, BSON_MIN (a_len, b_len));
+   if (r) {
+      return r;
+   }
+
+   return a_len < b_len ? -1 : a_len > b_len;
+}
+
+
+/* doubles in MongoDB's order: NaN is less than every number, and equal
+ * to itself */
+static int
+_bson_file_index_compare_double (double a, /* IN */
+                                 double b) /* IN */
+{
+   bool a_nan = a != a;
+   bool b_nan = b != b;
+
+   if (a_nan || b_nan) {
+      return a_nan == b_nan ? 0 : (a_nan ? -1 : 1);
+   }
+
+   return a < b ? -1 : a > b;
+}
+
+
+/* an int64 and a double compared exactly: converting the integer to a
+ * double would round integers above 2^53 */
+static int
+_bson_file_index_compare_int_double (int64_t i, /* IN */
+                                     double d)  /* IN */
+{
+   int64_t t;
+   double frac;
+
+   if (d != d) {
+      return 1;
+   }
+
+   /* -2^63 is the smallest int64, 2^63 is greater than every int64 */
+   if (d < -9223372036854775808.0) {
+      return 1;
+   }
+
+   if (d >= 9223372036854775808.0) {
+      return -1;
+   }
+
+   /* in range, the integral part of d is an exact int64 */
+   t = (int64_t) d;
+   if (i != t) {
+      return i < t ? -1 : 1;
+   }
+
+   frac = d - (double) t;
+
+   return frac > 0 ? -1 : frac < 0;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_file_index_compare --
+ *
+ *       Compare two encoded values. Values of types of different rank
+ *       compare by rank. Numbers compare exactly by value, with NaN
+ *       below all other numbers; strings by their bytes; dates as signed and
+ *       timestamps as unsigned integers. Other values of the same rank
+ *       compare by their encoded bytes.
+ *
+ * Returns:
+ *       Less than, equal to or greater than zero, like memcmp().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int
+_bson_file_index_compare (uint8_t a_type,   /* IN */
+                          const uint8_t *a, /* IN */
+                          uint32_t a_len,   /* IN */
+                          uint8_t b_type,   /* IN */
+                          const uint8_t *b, /* IN */
+                          uint32_t b_len)   /* IN */
+{
+   int a_rank = _bson_file_index_type_rank (a_type);
+   int b_rank = _bson_file_index_type_rank (b_type);
+   int64_t a_int, b_int;
+   double a_dbl, b_dbl;
+   bool a_is_int, b_is_int;
+
+   if (a_rank != b_rank) {
+      return a_rank < b_rank ? -1 : 1;
+   }
+
+   if (a_rank == 3 &&
+       _bson_file_index_get_number (
+          a_type, a, a_len, &a_int, &a_dbl, &a_is_int) &&
+       _bson_file_index_get_number (
+          b_type, b, b_len, &b_int, &b_dbl, &b_is_int)) {
+      if (a_is_int && b_is_int) {
+         return a_int < b_int ? -1 : a_int > b_int;
+      }
+
+      if (a_is_int) {
+         return _bson_file_index_compare_int_double (a_int, b_dbl);
+      }
+
+      if (b_is_int) {
+         return -_bson_file_index_compare_int_double (b_int, a_dbl);
+      }
+
+      return _bson_file_index_compare_double (a_dbl, b_dbl);
+   }
+
+   /* skip the length prefix and the trailing NUL of strings */
+   if (a_rank == 4 && a_len >= 5 && b_len >= 5) {
+      return _bson_file_index_compare_bytes (
+         a + 4, a_len - 5, b + 4, b_len - 5);
+   }
+
+   if (a_type == b_type && a_len == 8 && b_len == 8) {
+      if (a_type == BSON_TYPE_DATE_TIME) {
+         a_int = (int64_t) _bson_file_index_get_uint64 (a);
+         b_int = (int64_t) _bson_file_index_get_uint64 (b);
+         return a_int < b_int ? -1 : a_int > b_int;
+      }
+
+      if (a_type == BSON_TYPE_TIMESTAMP) {
+         uint64_t a_ts = _bson_file_index_get_uint64 (a);
+         uint64_t b_ts = _bson_file_index_get_uint64 (b);
+         return a_ts < b_ts ? -1 : a_ts > b_ts;
+      }
+   }
+
+   return _bson_file_index_compare_bytes (a, a_len, b, b_len);
+}
+
+
+static int
+_bson_file_index_record_cmp (const void *a, /* IN */
+                             const void *b) /* IN */
+{
+   const bson_file_index_record_t *ra = a;
+   const bson_file_index_record_t *rb = b;
+   int r;
+
+   r = _bson_file_index_compare (
+      ra->type, ra->value, ra->value_len, rb->type, rb->value, rb->value_len);
+   if (r) {
+      return r;
+   }
+
+   /* equal keys stay in the order of their documents */
+   return ra->offset < rb->offset ? -1 : ra->offset > rb->offset;
+}
+
+
+static bool
+_bson_file_index_write (FILE *f,         /* IN */
+                        const void *buf, /* IN */
+                        size_t len)      /* IN */
+{
+   return !len || fwrite (buf, 1, len, f) == len;
+}
+
+
+static bool
+_bson_file_index_write_uint64 (FILE *f,    /* IN */
+                               uint64_t v) /* IN */
+{
+   v = BSON_UINT64_TO_LE (v);
+
+   return _bson_file_index_write (f, &v, sizeof v);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_file_index_write_file --
+ *
+ *       Write the index file, see the format above.
+ *
+ * Returns:
+ *       true if successful, otherwise false and @error is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_file_index_write_file (const char *index_path,                  /* IN */
+                             uint64_t data_len,                       /* IN */
+                             const uint64_t *offsets,                 /* IN */
+                             uint64_t n_docs,                         /* IN */
+                             const char *key,                         /* IN */
+                             const bson_file_index_record_t *records, /* IN */
+                             uint64_t n_keys,                         /* IN */
+                             bson_error_t *error)                     /* OUT */
+{
+   static const uint8_t zeros[8] = {0};
+   uint8_t header[BSON_FILE_INDEX_RECORD_HEADER_SIZE];
+   char errmsg_buf[BSON_ERROR_BUFFER_SIZE];
+   uint32_t key_len = key ? (uint32_t) strlen (key) : 0;
+   uint32_t u32;
+   uint64_t pos = 0;
+   uint64_t i;
+   bool ok;
+   FILE *f;
+
+   f = fopen (index_path, "wb");
+   if (!f) {
+      bson_set_error (error,
+                      BSON_ERROR_FILE_INDEX,
+                      BSON_FILE_INDEX_ERROR_WRITE,
+                      "Failed to open \"%s\": %s",
+                      index_path,
+                      bson_strerror_r (errno, errmsg_buf, sizeof errmsg_buf));
+      return false;
+   }
+
+   u32 = BSON_UINT32_TO_LE (key_len);
+   ok = _bson_file_index_write (f, BSON_FILE_INDEX_MAGIC, 8) &&
+        _bson_file_index_write_uint64 (f, n_docs) &&
+        _bson_file_index_write_uint64 (f, data_len) &&
+        _bson_file_index_write_uint64 (f, n_keys) &&
+        _bson_file_index_write (f, &u32, sizeof u32) &&
+        _bson_file_index_write (f, zeros, 4) &&
+        _bson_file_index_write (f, key, key_len) &&
+        _bson_file_index_write (f, zeros, (8 - key_len % 8) % 8);
+
+   /* the offsets were stored little-endian as they were collected */
+   ok = ok && _bson_file_index_write (f, offsets, n_docs * sizeof *offsets);
+
+   for (i = 0; ok && i < n_keys; i++) {
+      ok = _bson_file_index_write_uint64 (f, pos);
+      pos += BSON_FILE_INDEX_RECORD_HEADER_SIZE + records[i].value_len;
+   }
+
+   for (i = 0; ok && i < n_keys; i++) {
+      uint64_t offset = BSON_UINT64_TO_LE (records[i].offset);
+
+      memcpy (header, &offset, 8);
+      header[8] = records[i].type;
+      u32 = BSON_UINT32_TO_LE (records[i].value_len);
+      memcpy (header + 9, &u32, 4);
+      ok = _bson_file_index_write (f, header, sizeof header) &&
+           _bson_file_index_write (
+              f, records[i].value, records[i].value_len);
+   }
+
+   if (fclose (f) != 0) {
+      ok = false;
+   }
+
+   if (!ok) {
+      bson_set_error (error,
+                      BSON_ERROR_FILE_INDEX,
+                      BSON_FILE_INDEX_ERROR_WRITE,
+                      "Failed to write \"%s\": %s",
+                      index_path,
+                      bson_strerror_r (errno, errmsg_buf, sizeof errmsg_buf));
+   }
+
+   return ok;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_file_index_build --
+ *
+ *       Write an index of the sequential bson documents in the file at
+ *       @data_path to the file at @index_path. The index holds the
+ *       offset of each document. If @key is not NULL, it also holds the
+ *       value of the field at the dotted path @key of each document that
+ *       has it, sorted, for bson_file_index_find().
+ *
+ * Returns:
+ *       true if successful, otherwise false and @error is set.
+ *
+ * Side effects:
+ *       The file at @index_path is replaced.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_file_index_build (const char *data_path,  /* IN */
+                       const char *index_path, /* IN */
+                       const char *key,        /* IN */
+                       bson_error_t *error)    /* OUT */
+{
+   bson_file_index_record_t *records = NULL;
+   bson_file_index_record_t *record;
+   bson_path_t *path = NULL;
+   bson_reader_t *reader;
+   const bson_t *doc;
+   bson_iter_t iter;
+   bson_iter_t child;
+   size_t data_len;
+   uint64_t *offsets = NULL;
+   uint64_t offset;
+   size_t n_docs = 0;
+   size_t n_keys = 0;
+   size_t docs_alloc = 0;
+   size_t keys_alloc = 0;
+   bool reached_eof;
+   bool ret = false;
+
+   BSON_ASSERT (data_path);
+   BSON_ASSERT (index_path);
+
+   reader = bson_reader_new_from_mmap (data_path, BSON_READER_MMAP_NONE, error);
+   if (!reader) {
+      return false;
+   }
+
+   (void) _bson_reader_get_data (reader, &data_len);
+
+   if (key) {
+      path = bson_path_new (key);
+   }
+
+   for (;;) {
+      offset = (uint64_t) bson_reader_tell (reader);
+      doc = bson_reader_read (reader, &reached_eof);
+      if (!doc) {
+         break;
+      }
+
+      if (n_docs == docs_alloc) {
+         docs_alloc = docs_alloc ? docs_alloc * 2 : 1024;
+         offsets = bson_realloc (offsets, docs_alloc * sizeof *offsets);
+      }
+
+      offsets[n_docs++] = BSON_UINT64_TO_LE (offset);
+
+      if (!path || !bson_iter_init (&iter, doc) ||
+          !bson_iter_find_path (&iter, path, &child)) {
+         continue;
+      }
+
+      if (n_keys == keys_alloc) {
+         keys_alloc = keys_alloc ? keys_alloc * 2 : 1024;
+         records = bson_realloc (records, keys_alloc * sizeof *records);
+      }
+
+      /* the value points into the mapping, which outlives the records */
+      record = &records[n_keys++];
+      record->offset = offset;
+      record->type = (uint8_t) bson_iter_type (&child);
+      _bson_file_index_iter_value (
+         &child, &record->value, &record->value_len);
+   }
+
+   if (!reached_eof) {
+      bson_set_error (error,
+                      BSON_ERROR_FILE_INDEX,
+                      BSON_FILE_INDEX_ERROR_CORRUPT_BSON,
+                      "Corrupt document at offset %" PRIu64 " of \"%s\"",
+                      offset,
+                      data_path);
+      goto cleanup;
+   }
+
+   if (n_keys) {
+      qsort (records, n_keys, sizeof *records, _bson_file_index_record_cmp);
+   }
+
+   ret = _bson_file_index_write_file (index_path,
+                                      (uint64_t) data_len,
+                                      offsets,
+                                      n_docs,
+                                      key,
+                                      records,
+                                      n_keys,
+                                      error);
+
+cleanup:
+   bson_free (offsets);
+   bson_free (records);
+   if (path) {
+      bson_path_destroy (path);
+   }
+   bson_reader_destroy (reader);
+
+   return ret;
+}
+
+
+static void
+_bson_file_index_set_invalid (bson_error_t *error,    /* OUT */
+                              const char *index_path) /* IN */
+{
+   bson_set_error (error,
+                   BSON_ERROR_FILE_INDEX,
+                   BSON_FILE_INDEX_ERROR_INVALID_INDEX,
+                   "\"%s\" is not a valid index file",
+                   index_path);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_file_index_open --
+ *
+ *       Map the file of sequential bson documents at @data_path and its
+ *       index file at @index_path, written by bson_file_index_build(),
+ *       into memory. Neither is read until documents are looked up.
+ *
+ * Returns:
+ *       A new bson_file_index_t if successful, otherwise NULL and @error
+ *       is set. Free the non-NULL result with bson_file_index_destroy().
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_file_index_t *
+bson_file_index_open (const char *data_path,  /* IN */
+                      const char *index_path, /* IN */
+                      bson_error_t *error)    /* OUT */
+{
+   bson_file_index_t *index;
+   const uint8_t *p;
+   size_t len;
+   size_t pos;
+   uint64_t data_len;
+   uint32_t key_len;
+
+   BSON_ASSERT (data_path);
+   BSON_ASSERT (index_path);
+
+   index = bson_malloc0 (sizeof *index);
+
+   index->index_reader =
+      bson_reader_new_from_mmap (index_path, BSON_READER_MMAP_NONE, error);
+   if (!index->index_reader) {
+      goto failure;
+   }
+
+   index->data_reader =
+      bson_reader_new_from_mmap (data_path, BSON_READER_MMAP_NONE, error);
+   if (!index->data_reader) {
+      goto failure;
+   }
+
+   index->data = _bson_reader_get_data (index->data_reader, &index->data_len);
+
+   /* documents are looked up at random, not read in order */
+#if defined(BSON_OS_UNIX) && defined(MADV_RANDOM)
+   if (index->data_len) {
+      (void) madvise ((void *) index->data, index->data_len, MADV_RANDOM);
+   }
+#endif
+
+   p = _bson_reader_get_data (index->index_reader, &len);
+
+   if (len < BSON_FILE_INDEX_HEADER_SIZE ||
+       memcmp (p, BSON_FILE_INDEX_MAGIC, 8) != 0) {
+      _bson_file_index_set_invalid (error, index_path);
+      goto failure;
+   }
+
+   index->n_docs = _bson_file_index_get_uint64 (p + 8);
+   data_len = _bson_file_index_get_uint64 (p + 16);
+   index->n_keys = _bson_file_index_get_uint64 (p + 24);
+   key_len = _bson_file_index_get_uint32 (p + 32);
+   pos = BSON_FILE_INDEX_HEADER_SIZE;
+
+   if (data_len != (uint64_t) index->data_len) {
+      bson_set_error (error,
+                      BSON_ERROR_FILE_INDEX,
+                      BSON_FILE_INDEX_ERROR_STALE_INDEX,
+                      "\"%s\" is an index of a file of %" PRIu64
+                      " bytes, \"%s\" has %" PRIu64,
+                      index_path,
+                      data_len,
+                      data_path,
+                      (uint64_t) index->data_len);
+      goto failure;
+   }
+
+   /* check the sizes of the sections without overflowing */
+   if (key_len > len - pos || (key_len + 7) / 8 * 8 > len - pos) {
+      _bson_file_index_set_invalid (error, index_path);
+      goto failure;
+   }
+
+   if (key_len) {
+      index->key = bson_malloc (key_len + 1);
+      memcpy (index->key, p + pos, key_len);
+      index->key[key_len] = '\0';
+   }
+
+   pos += (key_len + 7) / 8 * 8;
+
+   if (index->n_docs > (len - pos) / 8) {
+      _bson_file_index_set_invalid (error, index_path);
+      goto failure;
+   }
+
+   index->offsets = p + pos;
+   pos += (size_t) index->n_docs * 8;
+
+   if (index->n_keys > (len - pos) / 8) {
+      _bson_file_index_set_invalid (error, index_path);
+      goto failure;
+   }
+
+   index->key_table = p + pos;
+   pos += (size_t) index->n_keys * 8;
+   index->records = p + pos;
+   index->records_len = len - pos;
+
+   return index;
+
+failure:
+   bson_file_index_destroy (index);
+
+   return NULL;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_file_index_destroy --
+ *
+ *       Unmap the files of @index and free it. The documents returned by
+ *       it become invalid.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_file_index_destroy (bson_file_index_t *index) /* IN */
+{
+   if (!index) {
+      return;
+   }
+
+   if (index->data_reader) {
+      bson_reader_destroy (index->data_reader);
+   }
+
+   if (index->index_reader) {
+      bson_reader_destroy (index->index_reader);
+   }
+
+   bson_free (index->key);
+   bson_free (index);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_file_index_get_n_docs --
+ *
+ *       Get the number of documents in the indexed file.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+uint64_t
+bson_file_index_get_n_docs (const bson_file_index_t *index) /* IN */
+{
+   BSON_ASSERT (index);
+
+   return index->n_docs;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_file_index_get_key --
+ *
+ *       Get the dotted path of the field the index was built with.
+ *
+ * Returns:
+ *       The path, or NULL if the index has no key table.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+const char *
+bson_file_index_get_key (const bson_file_index_t *index) /* IN */
+{
+   BSON_ASSERT (index);
+
+   return index->key;
+}
+
+
+/*
+ * Initialize @doc to point at the document at @offset of the data file,
+ * checking its length, since the index may not match the data file.
+ */
+static bool
+_bson_file_index_init_doc (const bson_file_index_t *index, /* IN */
+                           uint64_t offset,                /* IN */
+                           bson_t *doc)                    /* OUT */
+{
+   uint32_t blen;
+
+   if (offset > (uint64_t) index->data_len ||
+       index->data_len - (size_t) offset < 5) {
+      return false;
+   }
+
+   blen = _bson_file_index_get_uint32 (index->data + offset);
+   if (blen < 5 || blen > index->data_len - (size_t) offset) {
+      return false;
+   }
+
+   return bson_init_static (doc, index->data + offset, blen);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_file_index_get --
+ *
+ *       Get the @n-th document of the file, counting from zero, in
+ *       constant time.
+ *
+ * Returns:
+ *       true if @doc was initialized to point into the mapped file, false
+ *       if there is no such document or it is corrupt.
+ *
+ * Side effects:
+ *       @doc and @offset, if not NULL, are set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_file_index_get (const bson_file_index_t *index, /* IN */
+                     uint64_t n,                     /* IN */
+                     bson_t *doc,                    /* OUT */
+                     uint64_t *offset)               /* OUT */
+{
+   uint64_t off;
+
+   BSON_ASSERT (index);
+   BSON_ASSERT (doc);
+
+   if (n >= index->n_docs) {
+      return false;
+   }
+
+   off = _bson_file_index_get_uint64 (index->offsets + n * 8);
+
+   if (offset) {
+      *offset = off;
+   }
+
+   return _bson_file_index_init_doc (index, off, doc);
+}
+
+
+/*
+ * Get the key record at position @i of the key table.
+ */
+static bool
+_bson_file_index_get_record (const bson_file_index_t *index, /* IN */
+                             uint64_t i,                     /* IN */
+                             uint64_t *offset,               /* OUT */
+                             uint8_t *type,                  /* OUT */
+                             const uint8_t **value,          /* OUT */
+                             uint32_t *value_len)            /* OUT */
+{
+   const uint8_t *record;
+   uint64_t pos;
+
+   pos = _bson_file_index_get_uint64 (index->key_table + i * 8);
+   if (pos > index->records_len ||
+       index->records_len - pos < BSON_FILE_INDEX_RECORD_HEADER_SIZE) {
+      return false;
+   }
+
+   record = index->records + pos;
+   *offset = _bson_file_index_get_uint64 (record);
+   *type = record[8];
+   *value_len = _bson_file_index_get_uint32 (record + 9);
+   *value = record + BSON_FILE_INDEX_RECORD_HEADER_SIZE;
+
+   return *value_len <= index->records_len - pos -
+                           BSON_FILE_INDEX_RECORD_HEADER_SIZE;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_file_index_find --
+ *
+ *       Find the first document of the file whose value of the indexed
+ *       field equals @value, with a binary search of the key table.
+ *       Numbers are equal if their values are, whatever their types.
+ *
+ * Returns:
+ *       true if @doc was initialized to point into the mapped file, false
+ *       if no document has the value, the index has no key table, or the
+ *       document is corrupt.
+ *
+ * Side effects:
+ *       @doc and @offset, if not NULL, are set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_file_index_find (const bson_file_index_t *index, /* IN */
+                      const bson_value_t *value,      /* IN */
+                      bson_t *doc,                    /* OUT */
+                      uint64_t *offset)               /* OUT */
+{
+   const uint8_t *probe;
+   const uint8_t *rec_value;
+   uint32_t probe_len;
+   uint32_t rec_len;
+   uint8_t probe_type;
+   uint8_t rec_type;
+   uint64_t rec_offset;
+   uint64_t lo = 0;
+   uint64_t hi;
+   uint64_t mid;
+   bson_iter_t iter;
+   bson_t tmp;
+   bool ret = false;
+
+   BSON_ASSERT (index);
+   BSON_ASSERT (value);
+   BSON_ASSERT (doc);
+
+   /* encode @value to compare it with the encoded keys */
+   bson_init (&tmp);
+   if (!bson_append_value (&tmp, "", 0, value) ||
+       !bson_iter_init (&iter, &tmp) || !bson_iter_next (&iter)) {
+      bson_destroy (&tmp);
+      return false;
+   }
+
+   probe_type = (uint8_t) bson_iter_type (&iter);
+   _bson_file_index_iter_value (&iter, &probe, &probe_len);
+
+   /* the first key not less than @value */
+   hi = index->n_keys;
+   while (lo < hi) {
+      mid = lo + (hi - lo) / 2;
+      if (!_bson_file_index_get_record (
+             index, mid, &rec_offset, &rec_type, &rec_value, &rec_len)) {
+         goto done;
+      }
+
+      if (_bson_file_index_compare (
+             rec_type, rec_value, rec_len, probe_type, probe, probe_len) < 0) {
+         lo = mid + 1;
+      } else {
+         hi = mid;
+      }
+   }
+
+   if (lo == index->n_keys ||
+       !_bson_file_index_get_record (
+          index, lo, &rec_offset, &rec_type, &rec_value, &rec_len) ||
+       _bson_file_index_compare (
+          rec_type, rec_value, rec_len, probe_type, probe, probe_len) != 0) {
+      goto done;
+   }
+
+   if (offset) {
+      *offset = rec_offset;
+   }
+
+   ret = _bson_file_index_init_doc (index, rec_offset, doc);
+
+done:
+   bson_destroy (&tmp);
+
+   return ret;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_file_index_reader_new --
+ *
+ *       Create a reader of the documents of the file from the @n-th one
+ *       to the end, for scans of a range of documents. The reader points
+ *       into the mapped file and must be destroyed before @index.
+ *
+ * Returns:
+ *       A new bson_reader_t, or NULL if there is no @n-th document.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_reader_t *
+bson_file_index_reader_new (const bson_file_index_t *index, /* IN */
+                            uint64_t n)                     /* IN */
+{
+   uint64_t off;
+
+   BSON_ASSERT (index);
+
+   if (n > index->n_docs) {
+      return NULL;
+   }
+
+   if (n == index->n_docs) {
+      off = index->data_len;
+   } else {
+      off = _bson_file_index_get_uint64 (index->offsets + n * 8);
+      if (off > (uint64_t) index->data_len) {
+         return NULL;
+      }
+   }
+
+   return bson_reader_new_from_data (index->data + off,
+                                     index->data_len - (size_t) off);
+}
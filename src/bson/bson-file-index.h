@@ -0,0 +1,90 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_FILE_INDEX_H
+#define BSON_FILE_INDEX_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-compat.h"
+#include "bson-macros.h"
+#include "bson-reader.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+typedef enum {
+   BSON_FILE_INDEX_ERROR_CORRUPT_BSON = 1,
+   BSON_FILE_INDEX_ERROR_INVALID_INDEX,
+   BSON_FILE_INDEX_ERROR_STALE_INDEX,
+   BSON_FILE_INDEX_ERROR_WRITE,
+} bson_file_index_error_code_t;
+
+
+/**
+ * bson_file_index_t:
+ *
+ * A bson_file_index_t gives random access to the documents of a file of
+ * sequential BSON documents, through a sidecar index file written by
+ * bson_file_index_build(). The index holds the offset of every document,
+ * and optionally the documents' values of one field, sorted, for lookups
+ * by that field.
+ *
+ * A bson_file_index_t is immutable, it may be used from several threads.
+ */
+typedef struct _bson_file_index_t bson_file_index_t;
+
+
+BSON_EXPORT (bool)
+bson_file_index_build (const char *data_path,
+                       const char *index_path,
+                       const char *key,
+                       bson_error_t *error);
+BSON_EXPORT (bson_file_index_t *)
+bson_file_index_open (const char *data_path,
+                      const char *index_path,
+                      bson_error_t *error);
+BSON_EXPORT (void)
+bson_file_index_destroy (bson_file_index_t *index);
+BSON_EXPORT (uint64_t)
+bson_file_index_get_n_docs (const bson_file_index_t *index);
+BSON_EXPORT (const char *)
+bson_file_index_get_key (const bson_file_index_t *index);
+BSON_EXPORT (bool)
+bson_file_index_get (const bson_file_index_t *index,
+                     uint64_t n,
+                     bson_t *doc,
+                     uint64_t *offset);
+BSON_EXPORT (bool)
+bson_file_index_find (const bson_file_index_t *index,
+                      const bson_value_t *value,
+                      bson_t *doc,
+                      uint64_t *offset);
+BSON_EXPORT (bson_reader_t *)
+bson_file_index_reader_new (const bson_file_index_t *index, uint64_t n);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_FILE_INDEX_H */
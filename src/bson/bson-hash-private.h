@@ -0,0 +1,51 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_HASH_PRIVATE_H
+#define BSON_HASH_PRIVATE_H
+
+
+#include "bson-compat.h"
+#include "bson-macros.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/*
+ * 32-bit FNV-1a, for the hash tables of field names.
+ */
+static BSON_INLINE uint32_t
+_bson_hash_key (const char *key, /* IN */
+                size_t key_len)  /* IN */
+{
+   uint32_t hash = 2166136261u;
+   size_t i;
+
+   for (i = 0; i < key_len; i++) {
+      hash ^= (uint8_t) key[i];
+      hash *= 16777619u;
+   }
+
+   return hash;
+}
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_HASH_PRIVATE_H */
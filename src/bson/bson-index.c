@@ -0,0 +1,601 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson.h"
+#include "bson-hash-private.h"
+#include "bson-index.h"
+#include "bson-memory.h"
+#include "bson-path-private.h"
+#include "bson-private.h"
+
+
+#define BSON_INDEX_MIN_SLOTS 8
+
+
+typedef struct {
+   uint32_t hash;
+   uint32_t key_off;    /* offset of the key in the index's key buffer */
+   uint32_t key_len;    /* length of the key, not including the NUL */
+   uint32_t offset;     /* offset of the element within the document */
+   bson_index_t *child; /* index of an embedded document or array */
+} bson_index_entry_t;
+
+
+struct _bson_index_t {
+   const uint8_t *data;
+   uint32_t len;
+   bool built;
+
+   /* one entry per element, in document order */
+   bson_index_entry_t *entries;
+   uint32_t n_entries;
+   uint32_t entries_alloc;
+
+   /* copies of the keys, so the shape survives a reset */
+   char *keys;
+   size_t keys_len;
+   size_t keys_alloc;
+
+   /* open addressing table of entry numbers plus one, zero if empty */
+   uint32_t *slots;
+   uint32_t n_slots;
+};
+
+
+static bson_index_t *
+_bson_index_new_from_data (const uint8_t *data, /* IN */
+                           uint32_t len)        /* IN */
+{
+   bson_index_t *index;
+
+   index = bson_malloc0 (sizeof *index);
+   index->data = data;
+   index->len = len;
+
+   return index;
+}
+
+
+static void
+_bson_index_truncate (bson_index_t *index, /* IN */
+                      uint32_t n_entries)  /* IN */
+{
+   uint32_t i;
+
+   for (i = n_entries; i < index->n_entries; i++) {
+      bson_index_destroy (index->entries[i].child);
+   }
+
+   if (n_entries < index->n_entries) {
+      index->keys_len = index->entries[n_entries].key_off;
+      index->n_entries = n_entries;
+   }
+}
+
+
+static void
+_bson_index_append (bson_index_t *index, /* IN */
+                    const char *key,     /* IN */
+                    uint32_t key_len,    /* IN */
+                    uint32_t offset)     /* IN */
+{
+   bson_index_entry_t *entry;
+
+   if (index->n_entries == index->entries_alloc) {
+      index->entries_alloc = BSON_MAX (16, index->entries_alloc * 2);
+      index->entries = bson_realloc (
+         index->entries, index->entries_alloc * sizeof *index->entries);
+   }
+
+   if (index->keys_len + key_len + 1 > index->keys_alloc) {
+      index->keys_alloc =
+         bson_next_power_of_two (index->keys_len + key_len + 1);
+      index->keys = bson_realloc (index->keys, index->keys_alloc);
+   }
+
+   entry = &index->entries[index->n_entries++];
+   entry->hash = _bson_hash_key (key, key_len);
+   entry->key_off = (uint32_t) index->keys_len;
+   entry->key_len = key_len;
+   entry->offset = offset;
+   entry->child = NULL;
+
+   memcpy (index->keys + index->keys_len, key, key_len + 1);
+   index->keys_len += key_len + 1;
+}
+
+
+static void
+_bson_index_build_slots (bson_index_t *index) /* IN */
+{
+   bson_index_entry_t *entry;
+   bson_index_entry_t *other;
+   uint32_t n_slots;
+   uint32_t mask;
+   uint32_t pos;
+   uint32_t i;
+
+   n_slots = BSON_INDEX_MIN_SLOTS;
+   while (n_slots < index->n_entries * 2) {
+      n_slots *= 2;
+   }
+
+   if (n_slots != index->n_slots) {
+      bson_free (index->slots);
+      index->slots = bson_malloc (n_slots * sizeof *index->slots);
+      index->n_slots = n_slots;
+   }
+
+   memset (index->slots, 0, n_slots * sizeof *index->slots);
+   mask = n_slots - 1;
+
+   for (i = 0; i < index->n_entries; i++) {
+      entry = &index->entries[i];
+
+      for (pos = entry->hash & mask; index->slots[pos];
+           pos = (pos + 1) & mask) {
+         other = &index->entries[index->slots[pos] - 1];
+         if (other->hash == entry->hash && other->key_len == entry->key_len &&
+             !memcmp (index->keys + other->key_off,
+                      index->keys + entry->key_off,
+                      entry->key_len)) {
+            /* duplicate key, lookups find the first one like bson_iter_find */
+            break;
+         }
+      }
+
+      if (!index->slots[pos]) {
+         index->slots[pos] = i + 1;
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_index_build --
+ *
+ *       Walk the document and record the offset of every element. While
+ *       the keys match those already in the index, only the offsets are
+ *       updated; the hash table is rebuilt only if the shape changed.
+ *
+ *       Indexing stops at the first corrupt element, matching where
+ *       bson_iter_next() would stop.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Indexes of embedded documents must be rebuilt before use.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_bson_index_build (bson_index_t *index) /* IN */
+{
+   bson_index_entry_t *entry;
+   bson_iter_t iter;
+   const char *key;
+   uint32_t key_len;
+   uint32_t n = 0;
+   bool same_shape = true;
+
+   index->built = true;
+
+   if (bson_iter_init_from_data (&iter, index->data, index->len)) {
+      while (bson_iter_next (&iter)) {
+         key = bson_iter_key (&iter);
+         key_len = _bson_iter_key_len (&iter);
+
+         if (same_shape && n < index->n_entries) {
+            entry = &index->entries[n];
+            if (entry->key_len == key_len &&
+                !memcmp (index->keys + entry->key_off, key, key_len)) {
+               entry->offset = iter.off;
+               if (entry->child) {
+                  entry->child->built = false;
+               }
+               n++;
+               continue;
+            }
+         }
+
+         if (same_shape) {
+            same_shape = false;
+            _bson_index_truncate (index, n);
+         }
+
+         _bson_index_append (index, key, key_len, iter.off);
+         n++;
+      }
+   }
+
+   if (n < index->n_entries) {
+      same_shape = false;
+      _bson_index_truncate (index, n);
+   }
+
+   if (!same_shape || !index->slots) {
+      _bson_index_build_slots (index);
+   }
+}
+
+
+static bson_index_entry_t *
+_bson_index_lookup_hashed (bson_index_t *index, /* IN */
+                           const char *key,     /* IN */
+                           size_t key_len,      /* IN */
+                           uint32_t hash)       /* IN */
+{
+   bson_index_entry_t *entry;
+   uint32_t mask;
+   uint32_t pos;
+
+   if (!index->built) {
+      _bson_index_build (index);
+   }
+
+   if (!key_len) {
+      return NULL;
+   }
+
+   mask = index->n_slots - 1;
+
+   for (pos = hash & mask; index->slots[pos]; pos = (pos + 1) & mask) {
+      entry = &index->entries[index->slots[pos] - 1];
+      if (entry->hash == hash && entry->key_len == key_len &&
+          !memcmp (index->keys + entry->key_off, key, key_len)) {
+         return entry;
+      }
+   }
+
+   return NULL;
+}
+
+
+static BSON_INLINE bson_index_entry_t *
+_bson_index_lookup (bson_index_t *index, /* IN */
+                    const char *key,     /* IN */
+                    size_t key_len)      /* IN */
+{
+   return _bson_index_lookup_hashed (
+      index, key, key_len, _bson_hash_key (key, key_len));
+}
+
+
+/*
+ * Point the index of the document or array under @iter, creating it if
+ * needed, at the current contents of that document or array.
+ */
+static bson_index_t *
+_bson_index_child (bson_index_entry_t *entry, /* IN */
+                   const bson_iter_t *iter)   /* IN */
+{
+   bson_iter_t child;
+
+   if (!BSON_ITER_HOLDS_DOCUMENT (iter) && !BSON_ITER_HOLDS_ARRAY (iter)) {
+      return NULL;
+   }
+
+   if (!bson_iter_recurse (iter, &child)) {
+      return NULL;
+   }
+
+   if (!entry->child) {
+      entry->child = _bson_index_new_from_data (child.raw, child.len);
+   } else if (!entry->child->built) {
+      entry->child->data = child.raw;
+      entry->child->len = child.len;
+   }
+
+   return entry->child;
+}
+
+
+static bool
+_bson_index_iter_init_at (bson_iter_t *iter,         /* OUT */
+                          bson_index_t *index,       /* IN */
+                          bson_index_entry_t *entry) /* IN */
+{
+   if (!bson_iter_init_from_data (iter, index->data, index->len)) {
+      return false;
+   }
+
+   iter->next_off = entry->offset;
+
+   return bson_iter_next (iter);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_index_new --
+ *
+ *       Creates an index over the fields of @bson. No work is done until
+ *       the index is first used. @bson must not be modified or destroyed
+ *       while the index refers to it.
+ *
+ * Returns:
+ *       A newly allocated bson_index_t that should be freed with
+ *       bson_index_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_index_t *
+bson_index_new (const bson_t *bson) /* IN */
+{
+   BSON_ASSERT (bson);
+
+   return _bson_index_new_from_data (bson_get_data (bson), bson->len);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_index_reset --
+ *
+ *       Points @index at @bson. Documents with the same keys in the same
+ *       order as the one previously indexed, such as those read from a
+ *       collection with a fixed schema, reuse the existing index and only
+ *       have their offsets refreshed on next use.
+ *
+ *       This must also be called after the indexed document is modified.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Iterators previously returned from @index are still valid, but
+ *       refer to the old document.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_index_reset (bson_index_t *index, /* IN */
+                  const bson_t *bson)  /* IN */
+{
+   BSON_ASSERT (index);
+   BSON_ASSERT (bson);
+
+   index->data = bson_get_data (bson);
+   index->len = bson->len;
+   index->built = false;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_index_destroy --
+ *
+ *       Releases @index and the indexes of any embedded documents.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_index_destroy (bson_index_t *index) /* IN */
+{
+   if (index) {
+      _bson_index_truncate (index, 0);
+      bson_free (index->entries);
+      bson_free (index->keys);
+      bson_free (index->slots);
+      bson_free (index);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_index_iter_init_find --
+ *
+ *       Initializes @iter on the indexed document and positions it on the
+ *       first field named @key, like bson_iter_init_find() but without
+ *       scanning the document.
+ *
+ * Returns:
+ *       true if @key was found, otherwise false.
+ *
+ * Side effects:
+ *       @iter is initialized. The index is built if needed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_index_iter_init_find (bson_iter_t *iter,   /* OUT */
+                           bson_index_t *index, /* IN */
+                           const char *key)     /* IN */
+{
+   bson_index_entry_t *entry;
+
+   BSON_ASSERT (iter);
+   BSON_ASSERT (index);
+   BSON_ASSERT (key);
+
+   if (!(entry = _bson_index_lookup (index, key, strlen (key)))) {
+      return false;
+   }
+
+   return _bson_index_iter_init_at (iter, index, entry);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_index_iter_find_descendant --
+ *
+ *       Locates the field named by the dotted path @dotkey, such as
+ *       "a.b.c", like bson_iter_find_descendant(). Each embedded document
+ *       or array on the path is indexed the first time it is visited.
+ *
+ * Returns:
+ *       true if the field was found and @descendant is set, otherwise
+ *       false.
+ *
+ * Side effects:
+ *       @descendant may be set. Indexes are built if needed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_index_iter_find_descendant (bson_index_t *index,     /* IN */
+                                 const char *dotkey,      /* IN */
+                                 bson_iter_t *descendant) /* OUT */
+{
+   bson_index_entry_t *entry;
+   bson_iter_t iter;
+   const char *dot;
+   size_t sublen;
+
+   BSON_ASSERT (index);
+   BSON_ASSERT (dotkey);
+   BSON_ASSERT (descendant);
+
+   for (;;) {
+      if ((dot = strchr (dotkey, '.'))) {
+         sublen = dot - dotkey;
+      } else {
+         sublen = strlen (dotkey);
+      }
+
+      if (!(entry = _bson_index_lookup (index, dotkey, sublen)) ||
+          !_bson_index_iter_init_at (&iter, index, entry)) {
+         return false;
+      }
+
+      if (!dot) {
+         *descendant = iter;
+         return true;
+      }
+
+      if (!(index = _bson_index_child (entry, &iter))) {
+         return false;
+      }
+
+      dotkey = dot + 1;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_index_iter_find_path --
+ *
+ *       Locates the field named by the compiled @path, like
+ *       bson_index_iter_find_descendant() but using the hashes computed
+ *       by bson_path_new().
+ *
+ * Returns:
+ *       true if the field was found and @descendant is set, otherwise
+ *       false.
+ *
+ * Side effects:
+ *       @descendant may be set. Indexes are built if needed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_index_iter_find_path (bson_index_t *index,     /* IN */
+                           const bson_path_t *path, /* IN */
+                           bson_iter_t *descendant) /* OUT */
+{
+   const bson_path_segment_t *segment;
+   bson_index_entry_t *entry;
+   bson_iter_t iter;
+   uint32_t i;
+
+   BSON_ASSERT (index);
+   BSON_ASSERT (path);
+   BSON_ASSERT (descendant);
+
+   for (i = 0;; i++) {
+      segment = &path->segments[i];
+      entry = _bson_index_lookup_hashed (
+         index, segment->key, segment->key_len, segment->hash);
+
+      if (!entry || !_bson_index_iter_init_at (&iter, index, entry)) {
+         return false;
+      }
+
+      if (i + 1 == path->n_segments) {
+         *descendant = iter;
+         return true;
+      }
+
+      if (!(index = _bson_index_child (entry, &iter))) {
+         return false;
+      }
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_index_has_field --
+ *
+ *       Checks to see if the indexed document contains a field named @key.
+ *       Like bson_has_field(), @key may be a dotted path.
+ *
+ * Returns:
+ *       true if @key was found, otherwise false.
+ *
+ * Side effects:
+ *       Indexes are built if needed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_index_has_field (bson_index_t *index, /* IN */
+                      const char *key)     /* IN */
+{
+   bson_iter_t iter;
+
+   BSON_ASSERT (index);
+   BSON_ASSERT (key);
+
+   if (NULL != strchr (key, '.')) {
+      return bson_index_iter_find_descendant (index, key, &iter);
+   }
+
+   return _bson_index_lookup (index, key, strlen (key)) != NULL;
+}
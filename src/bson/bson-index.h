@@ -0,0 +1,77 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_INDEX_H
+#define BSON_INDEX_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-macros.h"
+#include "bson-path.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/**
+ * bson_index_t:
+ *
+ * A bson_index_t maps the keys of a document to the offsets of their
+ * elements so that fields can be found without scanning the document.
+ * The index is built the first time it is used, and embedded documents
+ * and arrays are indexed the first time a dotted key descends into them.
+ *
+ * bson_index_reset() points the index at another document. If that
+ * document has the same keys in the same order, the existing index is
+ * updated in place rather than rebuilt.
+ *
+ * A bson_index_t is not thread-safe.
+ */
+typedef struct _bson_index_t bson_index_t;
+
+
+BSON_EXPORT (bson_index_t *)
+bson_index_new (const bson_t *bson);
+BSON_EXPORT (void)
+bson_index_reset (bson_index_t *index, const bson_t *bson);
+BSON_EXPORT (void)
+bson_index_destroy (bson_index_t *index);
+BSON_EXPORT (bool)
+bson_index_iter_init_find (bson_iter_t *iter,
+                           bson_index_t *index,
+                           const char *key);
+BSON_EXPORT (bool)
+bson_index_iter_find_descendant (bson_index_t *index,
+                                 const char *dotkey,
+                                 bson_iter_t *descendant);
+BSON_EXPORT (bool)
+bson_index_iter_find_path (bson_index_t *index,
+                           const bson_path_t *path,
+                           bson_iter_t *descendant);
+BSON_EXPORT (bool)
+bson_index_has_field (bson_index_t *index, const char *key);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_INDEX_H */
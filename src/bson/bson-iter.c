@@ -18,6 +18,7 @@
 #include "bson-iter.h"
 #include "bson-config.h"
 #include "bson-decimal128.h"
+#include "bson-private.h"
 
 
 #define ITER_TYPE(i) ((bson_type_t) * ((i)->raw + (i)->type))
@@ -257,8 +258,6 @@ _bson_iter_find_with_len (bson_iter_t *iter, /* INOUT */
                           const char *key,   /* IN */
                           int keylen)        /* IN */
 {
-   const char *ikey;
-
    if (keylen == 0) {
       return false;
    }
@@ -267,10 +266,10 @@ _bson_iter_find_with_len (bson_iter_t *iter, /* INOUT */
       keylen = (int) strlen (key);
    }
 
+   /* the length of each key is known, so compare it first */
    while (bson_iter_next (iter)) {
-      ikey = bson_iter_key (iter);
-
-      if ((0 == strncmp (key, ikey, keylen)) && (ikey[keylen] == '\0')) {
+      if (_bson_iter_key_len (iter) == (uint32_t) keylen &&
+          0 == memcmp (key, bson_iter_key_unsafe (iter), keylen)) {
          return true;
       }
    }
@@ -330,11 +329,17 @@ bool
 bson_iter_find_case (bson_iter_t *iter, /* INOUT */
                      const char *key)   /* IN */
 {
+   size_t keylen;
+
    BSON_ASSERT (iter);
    BSON_ASSERT (key);
 
+   keylen = strlen (key);
+
+   /* keys that differ in length can't match, whatever their case */
    while (bson_iter_next (iter)) {
-      if (!bson_strcasecmp (key, bson_iter_key (iter))) {
+      if (_bson_iter_key_len (iter) == keylen &&
+          !bson_strcasecmp (key, bson_iter_key_unsafe (iter))) {
          return true;
       }
    }
@@ -451,6 +456,47 @@ bson_iter_type (const bson_iter_t *iter) /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_iter_find_nul --
+ *
+ *       Find the NUL byte that ends the key starting at @o, without
+ *       reading at or beyond @len. Eight bytes are tested at a time; a
+ *       word with a zero byte in it is then searched byte by byte.
+ *
+ * Returns:
+ *       The offset of the NUL byte, or @len if there is none.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static BSON_INLINE uint32_t
+_bson_iter_find_nul (const uint8_t *data, /* IN */
+                     uint32_t o,          /* IN */
+                     uint32_t len)        /* IN */
+{
+   uint64_t word;
+
+   while (len - o >= sizeof word) {
+      memcpy (&word, data + o, sizeof word);
+      if ((word - 0x0101010101010101ULL) & ~word & 0x8080808080808080ULL) {
+         break;
+      }
+      o += sizeof word;
+   }
+
+   while (o < len && data[o]) {
+      o++;
+   }
+
+   return o;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -505,17 +551,17 @@ _bson_iter_next_internal (bson_iter_t *iter,   /* INOUT */
    iter->d3 = 0;
    iter->d4 = 0;
 
-   /* iterate from start to end of NULL-terminated key string */
-   for (o = iter->off + 1; o < len; o++) {
-      if (!data[o]) {
-         iter->d1 = ++o;
-         goto fill_data_fields;
-      }
+   if (iter->off + 1 >= len) {
+      goto mark_invalid;
    }
 
-   goto mark_invalid;
+   /* find the end of the NULL-terminated key string */
+   o = _bson_iter_find_nul (data, iter->off + 1, len);
+   if (o == len) {
+      goto mark_invalid;
+   }
 
-fill_data_fields:
+   iter->d1 = ++o;
 
    *key = bson_iter_key_unsafe (iter);
    *bson_type = ITER_TYPE (iter);
@@ -1898,7 +1944,8 @@ bson_iter_visit_all (bson_iter_t *iter,             /* INOUT */
    BSON_ASSERT (visitor);
 
    while (_bson_iter_next_internal (iter, &key, &bson_type, &unsupported)) {
-      if (*key && !bson_utf8_validate (key, strlen (key), false)) {
+      if (*key &&
+          !bson_utf8_validate (key, _bson_iter_key_len (iter), false)) {
          iter->err_off = iter->off;
          break;
       }
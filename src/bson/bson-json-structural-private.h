@@ -0,0 +1,73 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_JSON_STRUCTURAL_PRIVATE_H
+#define BSON_JSON_STRUCTURAL_PRIVATE_H
+
+
+#include "bson-macros.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/*
+ * The structural index of a JSON text: the positions of every brace,
+ * bracket, colon and comma outside of strings, of every unescaped quote
+ * (both the opening and closing quote of each string), and of the first
+ * character of every bare value such as a number or "true".
+ *
+ * Input is classified 64 bytes at a time into bitmasks, using SSE2 or
+ * AVX2 when available, and the masks are combined with carries from the
+ * previous block to find which bytes are inside strings. See "Parsing
+ * Gigabytes of JSON per Second", Langdale and Lemire, 2019.
+ */
+typedef struct {
+   uint32_t *indexes;
+   size_t n_indexes;
+   size_t n_alloc;
+   size_t off;             /* input scanned in complete 64-byte blocks */
+   size_t len;             /* input indexed, including a partial block */
+   uint64_t prev_escaped;  /* carries between complete blocks */
+   uint64_t prev_in_string;
+   uint64_t prev_scalar;
+   size_t ctrl_pos;        /* first forbidden control char in a string */
+} bson_json_structural_t;
+
+
+void
+_bson_json_structural_init (bson_json_structural_t *s);
+
+void
+_bson_json_structural_destroy (bson_json_structural_t *s);
+
+void
+_bson_json_structural_scan (bson_json_structural_t *s,
+                            const uint8_t *buf,
+                            size_t len);
+
+void
+_bson_json_structural_shift (bson_json_structural_t *s,
+                             size_t n_indexes,
+                             size_t n_bytes);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_JSON_STRUCTURAL_PRIVATE_H */
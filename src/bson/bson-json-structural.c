@@ -0,0 +1,493 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson-json-structural-private.h"
+#include "bson-memory.h"
+#include "bson-thread-private.h"
+
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+
+#if (defined(__x86_64__) || defined(__i386__)) && \
+   (BSON_GNUC_CHECK_VERSION(4, 9) || defined(__clang__))
+#define BSON_JSON_HAVE_SIMD
+#include <immintrin.h>
+#define BSON_JSON_SSE2 __attribute__ ((target ("sse2")))
+#define BSON_JSON_AVX2 __attribute__ ((target ("avx2")))
+#endif
+
+
+#define BSON_JSON_BLOCK_SIZE 64
+
+
+/* one bit per input byte */
+typedef struct {
+   uint64_t quote;
+   uint64_t backslash;
+   uint64_t op; /* { } [ ] : , */
+   uint64_t ws; /* the four whitespace characters JSON allows */
+   uint64_t ctrl;
+} bson_json_block_t;
+
+
+typedef void (*bson_json_classify_func_t) (const uint8_t *in,
+                                           bson_json_block_t *block);
+
+
+static BSON_INLINE int
+_bson_json_ctz (uint64_t bits)
+{
+#if BSON_GNUC_CHECK_VERSION(3, 4) || defined(__clang__)
+   return __builtin_ctzll (bits);
+#elif defined(_MSC_VER) && defined(_WIN64)
+   unsigned long r;
+
+   _BitScanForward64 (&r, bits);
+   return (int) r;
+#else
+   int r = 0;
+
+   while (!(bits & 1)) {
+      bits >>= 1;
+      r++;
+   }
+
+   return r;
+#endif
+}
+
+
+/* bit i of the result is the xor of bits 0 through i of @bits */
+static BSON_INLINE uint64_t
+_bson_json_prefix_xor (uint64_t bits)
+{
+   bits ^= bits << 1;
+   bits ^= bits << 2;
+   bits ^= bits << 4;
+   bits ^= bits << 8;
+   bits ^= bits << 16;
+   bits ^= bits << 32;
+
+   return bits;
+}
+
+
+static void
+_bson_json_classify_scalar (const uint8_t *in,        /* IN */
+                            bson_json_block_t *block) /* OUT */
+{
+   uint64_t bit;
+   int i;
+
+   memset (block, 0, sizeof *block);
+
+   for (i = 0; i < BSON_JSON_BLOCK_SIZE; i++) {
+      bit = 1ull << i;
+
+      switch (in[i]) {
+      case '"':
+         block->quote |= bit;
+         break;
+      case '\\':
+         block->backslash |= bit;
+         break;
+      case '{':
+      case '}':
+      case '[':
+      case ']':
+      case ':':
+      case ',':
+         block->op |= bit;
+         break;
+      case ' ':
+      case '\t':
+      case '\n':
+      case '\r':
+         block->ws |= bit;
+         /* \t, \n and \r are also forbidden in strings */
+         if (in[i] != ' ') {
+            block->ctrl |= bit;
+         }
+         break;
+      default:
+         if (in[i] < 0x14) {
+            block->ctrl |= bit;
+         }
+         break;
+      }
+   }
+}
+
+
+#ifdef BSON_JSON_HAVE_SIMD
+static BSON_JSON_SSE2 void
+_bson_json_classify_sse2 (const uint8_t *in,        /* IN */
+                          bson_json_block_t *block) /* OUT */
+{
+   const __m128i quote = _mm_set1_epi8 ('"');
+   const __m128i backslash = _mm_set1_epi8 ('\\');
+   const __m128i open = _mm_set1_epi8 ('{');
+   const __m128i close = _mm_set1_epi8 ('}');
+   const __m128i colon = _mm_set1_epi8 (':');
+   const __m128i comma = _mm_set1_epi8 (',');
+   const __m128i case_bit = _mm_set1_epi8 (0x20);
+   const __m128i space = _mm_set1_epi8 (' ');
+   const __m128i tab = _mm_set1_epi8 ('\t');
+   const __m128i lf = _mm_set1_epi8 ('\n');
+   const __m128i cr = _mm_set1_epi8 ('\r');
+   const __m128i ctrl_max = _mm_set1_epi8 (0x13);
+   __m128i v;
+   __m128i folded;
+   __m128i m;
+   int shift;
+
+   memset (block, 0, sizeof *block);
+
+   for (shift = 0; shift < BSON_JSON_BLOCK_SIZE; shift += 16) {
+      v = _mm_loadu_si128 ((const __m128i *) (in + shift));
+
+      block->quote |=
+         (uint64_t) (uint16_t) _mm_movemask_epi8 (_mm_cmpeq_epi8 (v, quote))
+         << shift;
+      block->backslash |= (uint64_t) (uint16_t) _mm_movemask_epi8 (
+                             _mm_cmpeq_epi8 (v, backslash))
+                          << shift;
+
+      /* '[' and ']' differ from '{' and '}' only in bit 0x20 */
+      folded = _mm_or_si128 (v, case_bit);
+      m = _mm_or_si128 (_mm_cmpeq_epi8 (folded, open),
+                        _mm_cmpeq_epi8 (folded, close));
+      m = _mm_or_si128 (m, _mm_cmpeq_epi8 (v, colon));
+      m = _mm_or_si128 (m, _mm_cmpeq_epi8 (v, comma));
+      block->op |= (uint64_t) (uint16_t) _mm_movemask_epi8 (m) << shift;
+
+      m = _mm_or_si128 (_mm_cmpeq_epi8 (v, tab), _mm_cmpeq_epi8 (v, lf));
+      m = _mm_or_si128 (m, _mm_cmpeq_epi8 (v, cr));
+      block->ws |= (uint64_t) (uint16_t) _mm_movemask_epi8 (
+                      _mm_or_si128 (m, _mm_cmpeq_epi8 (v, space)))
+                   << shift;
+
+      /* unsigned v <= 0x13 */
+      m = _mm_cmpeq_epi8 (_mm_min_epu8 (v, ctrl_max), v);
+      block->ctrl |= (uint64_t) (uint16_t) _mm_movemask_epi8 (m) << shift;
+   }
+}
+
+
+static BSON_JSON_AVX2 void
+_bson_json_classify_avx2 (const uint8_t *in,        /* IN */
+                          bson_json_block_t *block) /* OUT */
+{
+   const __m256i quote = _mm256_set1_epi8 ('"');
+   const __m256i backslash = _mm256_set1_epi8 ('\\');
+   const __m256i open = _mm256_set1_epi8 ('{');
+   const __m256i close = _mm256_set1_epi8 ('}');
+   const __m256i colon = _mm256_set1_epi8 (':');
+   const __m256i comma = _mm256_set1_epi8 (',');
+   const __m256i case_bit = _mm256_set1_epi8 (0x20);
+   const __m256i space = _mm256_set1_epi8 (' ');
+   const __m256i tab = _mm256_set1_epi8 ('\t');
+   const __m256i lf = _mm256_set1_epi8 ('\n');
+   const __m256i cr = _mm256_set1_epi8 ('\r');
+   const __m256i ctrl_max = _mm256_set1_epi8 (0x13);
+   __m256i v;
+   __m256i folded;
+   __m256i m;
+   int shift;
+
+   memset (block, 0, sizeof *block);
+
+   for (shift = 0; shift < BSON_JSON_BLOCK_SIZE; shift += 32) {
+      v = _mm256_loadu_si256 ((const __m256i *) (in + shift));
+
+      block->quote |= (uint64_t) (uint32_t) _mm256_movemask_epi8 (
+                         _mm256_cmpeq_epi8 (v, quote))
+                      << shift;
+      block->backslash |= (uint64_t) (uint32_t) _mm256_movemask_epi8 (
+                             _mm256_cmpeq_epi8 (v, backslash))
+                          << shift;
+
+      folded = _mm256_or_si256 (v, case_bit);
+      m = _mm256_or_si256 (_mm256_cmpeq_epi8 (folded, open),
+                           _mm256_cmpeq_epi8 (folded, close));
+      m = _mm256_or_si256 (m, _mm256_cmpeq_epi8 (v, colon));
+      m = _mm256_or_si256 (m, _mm256_cmpeq_epi8 (v, comma));
+      block->op |= (uint64_t) (uint32_t) _mm256_movemask_epi8 (m) << shift;
+
+      m = _mm256_or_si256 (_mm256_cmpeq_epi8 (v, tab),
+                           _mm256_cmpeq_epi8 (v, lf));
+      m = _mm256_or_si256 (m, _mm256_cmpeq_epi8 (v, cr));
+      block->ws |= (uint64_t) (uint32_t) _mm256_movemask_epi8 (
+                      _mm256_or_si256 (m, _mm256_cmpeq_epi8 (v, space)))
+                   << shift;
+
+      m = _mm256_cmpeq_epi8 (_mm256_min_epu8 (v, ctrl_max), v);
+      block->ctrl |= (uint64_t) (uint32_t) _mm256_movemask_epi8 (m) << shift;
+   }
+}
+
+
+static bson_json_classify_func_t gJsonClassify = _bson_json_classify_scalar;
+static bson_once_t gJsonClassifyOnce = BSON_ONCE_INIT;
+
+
+static BSON_ONCE_FUN (_bson_json_classify_init)
+{
+   if (__builtin_cpu_supports ("avx2")) {
+      gJsonClassify = _bson_json_classify_avx2;
+   } else if (__builtin_cpu_supports ("sse2")) {
+      gJsonClassify = _bson_json_classify_sse2;
+   }
+
+   BSON_ONCE_RETURN;
+}
+#endif /* BSON_JSON_HAVE_SIMD */
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_json_structural_block --
+ *
+ *       Append the structural characters of one classified block of
+ *       @valid bytes starting at input position @base. Positions before
+ *       s->len were indexed by a previous call and are skipped.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       The carries in @s are updated for the next block.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_bson_json_structural_block (bson_json_structural_t *s,       /* IN */
+                             const bson_json_block_t *block, /* IN */
+                             size_t base,                    /* IN */
+                             size_t valid)                   /* IN */
+{
+   const uint64_t even_bits = 0x5555555555555555ull;
+   uint64_t backslash;
+   uint64_t follows_escape;
+   uint64_t odd_starts;
+   uint64_t even_starts;
+   uint64_t escaped;
+   uint64_t quote;
+   uint64_t in_string;
+   uint64_t scalar;
+   uint64_t nonquote_scalar;
+   uint64_t follows_scalar;
+   uint64_t structurals;
+   uint64_t mask;
+   uint64_t ctrl;
+
+   /*
+    * A quote is escaped if it follows an odd-length run of backslashes.
+    * Adding the starts of runs that begin on odd bits to the backslashes
+    * carries each such run out through its end, which flips the parity of
+    * the bit that follows it.
+    */
+   backslash = block->backslash & ~s->prev_escaped;
+   follows_escape = (backslash << 1) | s->prev_escaped;
+   odd_starts = backslash & ~even_bits & ~follows_escape;
+   even_starts = odd_starts + backslash;
+   s->prev_escaped = even_starts < backslash ? 1 : 0;
+   escaped = (even_bits ^ (even_starts << 1)) & follows_escape;
+
+   quote = block->quote & ~escaped;
+
+   /* the opening quote and contents of each string */
+   in_string = _bson_json_prefix_xor (quote) ^ s->prev_in_string;
+   s->prev_in_string = (uint64_t) ((int64_t) in_string >> 63);
+
+   /* the first byte of each bare value, like "true" or "-1.5" */
+   scalar = ~(block->op | block->ws);
+   nonquote_scalar = scalar & ~quote;
+   follows_scalar = (nonquote_scalar << 1) | s->prev_scalar;
+   s->prev_scalar = nonquote_scalar >> 63;
+
+   structurals = (block->op | (scalar & ~follows_scalar)) & ~in_string;
+   structurals |= quote;
+
+   mask = valid < BSON_JSON_BLOCK_SIZE ? (1ull << valid) - 1 : ~0ull;
+   if (s->len >= base + BSON_JSON_BLOCK_SIZE) {
+      mask = 0;
+   } else if (s->len > base) {
+      mask &= ~((1ull << (s->len - base)) - 1);
+   }
+
+   structurals &= mask;
+   ctrl = block->ctrl & in_string & mask;
+
+   if (ctrl && s->ctrl_pos == SIZE_MAX) {
+      s->ctrl_pos = base + (size_t) _bson_json_ctz (ctrl);
+   }
+
+   if (s->n_alloc - s->n_indexes < BSON_JSON_BLOCK_SIZE) {
+      s->n_alloc = BSON_MAX (s->n_alloc * 2, 1024);
+      s->indexes =
+         bson_realloc (s->indexes, s->n_alloc * sizeof (*s->indexes));
+   }
+
+   while (structurals) {
+      s->indexes[s->n_indexes++] =
+         (uint32_t) (base + (size_t) _bson_json_ctz (structurals));
+      structurals &= structurals - 1;
+   }
+}
+
+
+void
+_bson_json_structural_init (bson_json_structural_t *s) /* OUT */
+{
+   memset (s, 0, sizeof *s);
+   s->ctrl_pos = SIZE_MAX;
+}
+
+
+void
+_bson_json_structural_destroy (bson_json_structural_t *s) /* IN */
+{
+   bson_free (s->indexes);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_json_structural_scan --
+ *
+ *       Extend the structural index of @s to cover @len bytes of @buf.
+ *       @buf must begin with the bytes passed to previous calls. A
+ *       trailing partial block is indexed as if padded with whitespace,
+ *       and scanned again once more input is available.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       Positions are appended to s->indexes.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_bson_json_structural_scan (bson_json_structural_t *s, /* IN */
+                            const uint8_t *buf,        /* IN */
+                            size_t len)                /* IN */
+{
+   bson_json_classify_func_t classify = _bson_json_classify_scalar;
+   uint8_t tail[BSON_JSON_BLOCK_SIZE];
+   bson_json_block_t block;
+   uint64_t prev_escaped;
+   uint64_t prev_in_string;
+   uint64_t prev_scalar;
+
+   BSON_ASSERT (len <= UINT32_MAX);
+
+   if (len <= s->len) {
+      return;
+   }
+
+#ifdef BSON_JSON_HAVE_SIMD
+   bson_once (&gJsonClassifyOnce, _bson_json_classify_init);
+   classify = gJsonClassify;
+#endif
+
+   while (s->off + BSON_JSON_BLOCK_SIZE <= len) {
+      classify (buf + s->off, &block);
+      _bson_json_structural_block (s, &block, s->off, BSON_JSON_BLOCK_SIZE);
+      s->off += BSON_JSON_BLOCK_SIZE;
+      s->len = BSON_MAX (s->len, s->off);
+   }
+
+   if (s->off < len) {
+      /* the carries out of a partial block are not final */
+      prev_escaped = s->prev_escaped;
+      prev_in_string = s->prev_in_string;
+      prev_scalar = s->prev_scalar;
+
+      memset (tail, ' ', sizeof tail);
+      memcpy (tail, buf + s->off, len - s->off);
+      classify (tail, &block);
+      _bson_json_structural_block (s, &block, s->off, len - s->off);
+
+      s->prev_escaped = prev_escaped;
+      s->prev_in_string = prev_in_string;
+      s->prev_scalar = prev_scalar;
+   }
+
+   s->len = len;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_json_structural_shift --
+ *
+ *       Discard the first @n_indexes positions and the first @n_bytes of
+ *       input, after the caller has moved its buffer. @n_bytes must be
+ *       at the start of a document or the end of the input, where no
+ *       string or value is open.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       The remaining positions are made relative to the new buffer.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+_bson_json_structural_shift (bson_json_structural_t *s, /* IN */
+                             size_t n_indexes,          /* IN */
+                             size_t n_bytes)            /* IN */
+{
+   size_t i;
+
+   BSON_ASSERT (n_indexes <= s->n_indexes);
+   BSON_ASSERT (n_bytes <= s->len);
+
+   s->n_indexes -= n_indexes;
+   for (i = 0; i < s->n_indexes; i++) {
+      s->indexes[i] = s->indexes[i + n_indexes] - (uint32_t) n_bytes;
+   }
+
+   if (n_bytes <= s->off) {
+      s->off -= n_bytes;
+   } else {
+      /* restart block scanning at the document boundary */
+      s->off = 0;
+      s->prev_escaped = 0;
+      s->prev_in_string = 0;
+      s->prev_scalar = 0;
+   }
+
+   s->len -= n_bytes;
+
+   if (s->ctrl_pos != SIZE_MAX) {
+      s->ctrl_pos = s->ctrl_pos < n_bytes ? SIZE_MAX : s->ctrl_pos - n_bytes;
+   }
+}
@@ -0,0 +1,81 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_JSON_WRITER_PRIVATE_H
+#define BSON_JSON_WRITER_PRIVATE_H
+
+
+#include "bson.h"
+
+
+BSON_BEGIN_DECLS
+
+
+typedef enum {
+   BSON_JSON_WRITER_DATA,
+   BSON_JSON_WRITER_STATIC,
+   BSON_JSON_WRITER_CB,
+} bson_json_writer_type_t;
+
+
+/*
+ * One level of a document being written. The iterators of every level live
+ * here rather than on the stack, so that writing can stop when a static
+ * buffer is full and resume in a later call.
+ */
+typedef struct {
+   bson_iter_t iter;
+   uint32_t count;
+   bool keys;
+   const char *close;
+} bson_json_frame_t;
+
+
+struct _bson_json_writer_t {
+   bson_json_writer_type_t type;
+   /* the output of a data writer, otherwise output not yet delivered */
+   bson_string_t *str;
+
+   /* BSON_JSON_WRITER_STATIC */
+   char *buf;
+   size_t buf_len;
+   size_t buf_pos;
+
+   /* BSON_JSON_WRITER_CB */
+   void *data;
+   bson_json_writer_cb cb;
+   bson_json_destroy_cb dcb;
+   size_t buf_size;
+   bool failed;
+
+   /* the document whose writing was paused by a full static buffer */
+   const bson_t *bson;
+   bson_json_mode_t mode;
+   bool paused;
+   bson_json_frame_t *frames;
+   uint32_t n_frames;
+};
+
+
+bool
+_bson_json_writer_drain (bson_json_writer_t *writer, bool all);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_JSON_WRITER_PRIVATE_H */
@@ -0,0 +1,425 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+
+#include "bson.h"
+#include "bson-json-writer-private.h"
+
+#ifdef _WIN32
+#include <io.h>
+#endif
+
+
+#define BSON_JSON_WRITER_DEFAULT_BUF_SIZE (1 << 14)
+
+
+typedef struct {
+   int fd;
+   bool do_close;
+} bson_json_writer_handle_fd_t;
+
+
+static bson_json_writer_t *
+_bson_json_writer_new (bson_json_writer_type_t type) /* IN */
+{
+   bson_json_writer_t *writer;
+
+   writer = bson_malloc0 (sizeof *writer);
+   writer->type = type;
+   writer->str = bson_string_new (NULL);
+
+   return writer;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_json_writer_new --
+ *
+ *       Create a new JSON writer that delivers its output to @cb whenever
+ *       more than @buf_size bytes are pending, and when
+ *       bson_json_writer_flush() is called.
+ *
+ * Returns:
+ *       A newly allocated bson_json_writer_t.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_json_writer_t *
+bson_json_writer_new (void *data,               /* IN */
+                      bson_json_writer_cb cb,   /* IN */
+                      bson_json_destroy_cb dcb, /* IN */
+                      size_t buf_size)          /* IN */
+{
+   bson_json_writer_t *writer;
+
+   BSON_ASSERT (cb);
+
+   writer = _bson_json_writer_new (BSON_JSON_WRITER_CB);
+   writer->data = data;
+   writer->cb = cb;
+   writer->dcb = dcb;
+   writer->buf_size = buf_size ? buf_size : BSON_JSON_WRITER_DEFAULT_BUF_SIZE;
+
+   return writer;
+}
+
+
+static ssize_t
+_bson_json_writer_handle_fd_write (void *handle,    /* IN */
+                                   const char *buf, /* IN */
+                                   size_t len)      /* IN */
+{
+   bson_json_writer_handle_fd_t *fd = handle;
+   ssize_t ret = -1;
+
+   if (fd && (fd->fd != -1)) {
+   again:
+#ifdef BSON_OS_WIN32
+      ret = _write (fd->fd, buf, (unsigned int) len);
+#else
+      ret = write (fd->fd, buf, len);
+#endif
+      if ((ret == -1) && (errno == EAGAIN || errno == EINTR)) {
+         goto again;
+      }
+   }
+
+   return ret;
+}
+
+
+static void
+_bson_json_writer_handle_fd_destroy (void *handle) /* IN */
+{
+   bson_json_writer_handle_fd_t *fd = handle;
+
+   if (fd) {
+      if ((fd->fd != -1) && fd->do_close) {
+#ifdef _WIN32
+         _close (fd->fd);
+#else
+         close (fd->fd);
+#endif
+      }
+      bson_free (fd);
+   }
+}
+
+
+bson_json_writer_t *
+bson_json_writer_new_from_fd (int fd,                /* IN */
+                              bool close_on_destroy) /* IN */
+{
+   bson_json_writer_handle_fd_t *handle;
+
+   BSON_ASSERT (fd != -1);
+
+   handle = bson_malloc0 (sizeof *handle);
+   handle->fd = fd;
+   handle->do_close = close_on_destroy;
+
+   return bson_json_writer_new (handle,
+                                _bson_json_writer_handle_fd_write,
+                                _bson_json_writer_handle_fd_destroy,
+                                BSON_JSON_WRITER_DEFAULT_BUF_SIZE);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_json_data_writer_new --
+ *
+ *       Create a new JSON writer that appends its output to a buffer that
+ *       grows as needed, starting at @size bytes.
+ *
+ * Returns:
+ *       A newly allocated bson_json_writer_t.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_json_writer_t *
+bson_json_data_writer_new (size_t size) /* IN */
+{
+   bson_json_writer_t *writer;
+
+   writer = _bson_json_writer_new (BSON_JSON_WRITER_DATA);
+
+   if (size > writer->str->alloc && size < INT_MAX) {
+      writer->str->alloc = (uint32_t) bson_next_power_of_two (size);
+      writer->str->str = bson_realloc (writer->str->str, writer->str->alloc);
+   }
+
+   return writer;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_json_data_writer_new_static --
+ *
+ *       Create a new JSON writer that writes into the caller's buffer
+ *       @buf of @len bytes, which must outlive the writer. When it is
+ *       full, bson_as_json_to_writer() returns 0 so that the caller can
+ *       consume the buffer and continue.
+ *
+ * Returns:
+ *       A newly allocated bson_json_writer_t.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_json_writer_t *
+bson_json_data_writer_new_static (char *buf,  /* IN */
+                                  size_t len) /* IN */
+{
+   bson_json_writer_t *writer;
+
+   BSON_ASSERT (buf);
+   BSON_ASSERT (len);
+
+   writer = _bson_json_writer_new (BSON_JSON_WRITER_STATIC);
+   writer->buf = buf;
+   writer->buf_len = len;
+
+   return writer;
+}
+
+
+void
+bson_json_writer_destroy (bson_json_writer_t *writer) /* IN */
+{
+   if (!writer) {
+      return;
+   }
+
+   if (writer->type == BSON_JSON_WRITER_CB) {
+      _bson_json_writer_drain (writer, true);
+
+      if (writer->dcb) {
+         writer->dcb (writer->data);
+      }
+   }
+
+   bson_string_free (writer->str, true);
+   bson_free (writer->frames);
+   bson_free (writer);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_json_writer_get_data --
+ *
+ *       Get the output of a data writer since it was created or last
+ *       reset. The output of a writer created with
+ *       bson_json_data_writer_new() is NULL-terminated.
+ *
+ * Returns:
+ *       The output, or NULL for a writer created with
+ *       bson_json_writer_new() or bson_json_writer_new_from_fd().
+ *
+ * Side effects:
+ *       @len is set to the length of the output, if not NULL.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+const char *
+bson_json_writer_get_data (const bson_json_writer_t *writer, /* IN */
+                           size_t *len)                      /* OUT */
+{
+   BSON_ASSERT (writer);
+
+   switch (writer->type) {
+   case BSON_JSON_WRITER_DATA:
+      if (len) {
+         *len = writer->str->len;
+      }
+      return writer->str->str;
+   case BSON_JSON_WRITER_STATIC:
+      if (len) {
+         *len = writer->buf_pos;
+      }
+      return writer->buf;
+   case BSON_JSON_WRITER_CB:
+   default:
+      if (len) {
+         *len = 0;
+      }
+      return NULL;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_json_writer_reset --
+ *
+ *       Discard the output of a data writer, once the caller has consumed
+ *       it. The next output is written from the start of the buffer.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_json_writer_reset (bson_json_writer_t *writer) /* IN */
+{
+   BSON_ASSERT (writer);
+
+   if (writer->type == BSON_JSON_WRITER_DATA) {
+      writer->str->len = 0;
+      writer->str->str[0] = '\0';
+   } else if (writer->type == BSON_JSON_WRITER_STATIC) {
+      writer->buf_pos = 0;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_json_writer_flush --
+ *
+ *       Deliver all pending output of a writer created with
+ *       bson_json_writer_new() or bson_json_writer_new_from_fd() to its
+ *       callback. Does nothing for data writers.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_json_writer_flush (bson_json_writer_t *writer, /* IN */
+                        bson_error_t *error)        /* OUT */
+{
+   BSON_ASSERT (writer);
+
+   if (writer->type != BSON_JSON_WRITER_CB) {
+      return true;
+   }
+
+   if (!_bson_json_writer_drain (writer, true)) {
+      bson_set_error (error,
+                      BSON_ERROR_JSON,
+                      BSON_JSON_ERROR_WRITE_CB_FAILURE,
+                      "Failed to write JSON output");
+      return false;
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_json_writer_drain --
+ *
+ *       Move pending output from writer->str to the writer's destination.
+ *       A callback writer only writes once more than buf_size bytes are
+ *       pending, unless @all is true. A static writer copies as much as
+ *       fits in its buffer.
+ *
+ * Returns:
+ *       false if a static buffer is full while output is still pending,
+ *       or if the callback failed, in which case writer->failed is set.
+ *       Otherwise true.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+_bson_json_writer_drain (bson_json_writer_t *writer, /* IN */
+                         bool all)                   /* IN */
+{
+   bson_string_t *str = writer->str;
+   size_t pos;
+   size_t n;
+   ssize_t r;
+
+   switch (writer->type) {
+   case BSON_JSON_WRITER_STATIC:
+      n = BSON_MIN (str->len, writer->buf_len - writer->buf_pos);
+      memcpy (writer->buf + writer->buf_pos, str->str, n);
+      writer->buf_pos += n;
+
+      if (n < str->len) {
+         memmove (str->str, str->str + n, str->len - n);
+      }
+
+      str->len -= (uint32_t) n;
+      str->str[str->len] = '\0';
+
+      return str->len == 0;
+   case BSON_JSON_WRITER_CB:
+      if (writer->failed) {
+         return false;
+      }
+
+      if (!all && str->len < writer->buf_size) {
+         return true;
+      }
+
+      for (pos = 0; pos < str->len; pos += (size_t) r) {
+         r = writer->cb (writer->data, str->str + pos, str->len - pos);
+         if (r <= 0) {
+            writer->failed = true;
+            return false;
+         }
+      }
+
+      str->len = 0;
+      str->str[0] = '\0';
+
+      return true;
+   case BSON_JSON_WRITER_DATA:
+   default:
+      return true;
+   }
+}
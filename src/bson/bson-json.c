@@ -15,6 +15,7 @@
  */
 
 
+#include <ctype.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <sys/types.h>
@@ -23,6 +24,7 @@
 #include "bson.h"
 #include "bson-config.h"
 #include "bson-json.h"
+#include "bson-json-structural-private.h"
 #include "bson-iso8601-private.h"
 #include "b64_pton.h"
 
@@ -240,6 +242,11 @@ struct _bson_json_reader_t {
    ssize_t advance;
    bson_json_buf_t tok_accumulator;
    bson_error_t *error;
+   bson_json_parser_t parser;
+   bson_json_structural_t structural;
+   bson_json_buf_t stream;  /* input buffered for the structural parser */
+   size_t stream_pos;       /* start of the next document in stream */
+   size_t stream_index;     /* its first entry in the structural index */
 };
 
 
@@ -1784,7 +1791,7 @@ _bson_json_read_end_array (bson_json_reader_t *reader) /* IN */
  * json_text has length len and it is not null-terminated. */
 static bool
 _bson_json_unescape (bson_json_reader_t *reader,
-                     struct jsonsl_state_st *state,
+                     size_t pos,
                      const char *json_text,
                      ssize_t len)
 {
@@ -1805,7 +1812,7 @@ _bson_json_unescape (bson_json_reader_t *reader,
                       BSON_ERROR_JSON,
                       BSON_JSON_ERROR_READ_CORRUPT_JS,
                       "error near position %d: \"%s\"",
-                      (int) state->pos_begin,
+                      (int) pos,
                       jsonsl_strerror (err));
       return false;
    }
@@ -1902,7 +1909,8 @@ _pop_callback (jsonsl_t json,
       /* remove start/end quotes, replace backslash-escapes, null-terminate */
       /* you'd think it would be faster to check if state->nescapes > 0 first,
        * but tests show no improvement */
-      if (!_bson_json_unescape (reader, state, obj_text + 1, len - 1)) {
+      if (!_bson_json_unescape (
+             reader, state->pos_begin, obj_text + 1, len - 1)) {
          /* reader->error is set */
          jsonsl_stop (json);
          break;
@@ -1976,6 +1984,571 @@ _error_callback (jsonsl_t json,
 }
 
 
+typedef enum {
+   BSON_JSON_EXPECT_VALUE,
+   BSON_JSON_EXPECT_VALUE_OR_END,
+   BSON_JSON_EXPECT_KEY,
+   BSON_JSON_EXPECT_KEY_OR_END,
+   BSON_JSON_EXPECT_COLON,
+   BSON_JSON_EXPECT_COMMA_OR_END,
+} bson_json_expect_t;
+
+
+/* like _error_callback, for the structural parser */
+static void
+_bson_json_structural_error (bson_json_reader_t *reader, /* IN */
+                             size_t pos,                 /* IN */
+                             jsonsl_error_t err)         /* IN */
+{
+   bson_set_error (reader->error,
+                   BSON_ERROR_JSON,
+                   BSON_JSON_ERROR_READ_CORRUPT_JS,
+                   "Got parse error at \"%c\", position %d: \"%s\"",
+                   reader->stream.buf[pos],
+                   (int) (pos - reader->stream_pos),
+                   jsonsl_strerror (err));
+}
+
+
+/* characters that end a number or a literal like "true", as in jsonsl */
+static BSON_INLINE bool
+_bson_json_is_special_end (char c)
+{
+   switch (c) {
+   case ' ':
+   case '\t':
+   case '\n':
+   case '\r':
+   case '"':
+   case ',':
+   case ':':
+   case '[':
+   case ']':
+   case '{':
+   case '}':
+   case '\\':
+      return true;
+   default:
+      return false;
+   }
+}
+
+
+static bool
+_bson_json_is_literal_ci (const char *text, /* IN */
+                          size_t len,       /* IN */
+                          const char *lit)  /* IN */
+{
+   size_t i;
+
+   if (len != strlen (lit)) {
+      return false;
+   }
+
+   for (i = 0; i < len; i++) {
+      if (tolower ((unsigned char) text[i]) != lit[i]) {
+         return false;
+      }
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_json_structural_read_special --
+ *
+ *       Read the number, "true", "false", "null", "NaN", "Infinity" or
+ *       "-Infinity" that begins at @pos in the buffered input. NaN and
+ *       Infinity are matched case-insensitively. A number is an optional
+ *       "-", digits without a leading zero, and at most one "." and one
+ *       exponent, with a sign only after the exponent's "e", ending in a
+ *       digit. This is stricter than jsonsl, which checks less of the
+ *       syntax of numbers.
+ *
+ * Returns:
+ *       1 if the value was read, 0 if the input ends within it, or -1
+ *       if it is invalid.
+ *
+ * Side effects:
+ *       reader->error is set on failure.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int
+_bson_json_structural_read_special (bson_json_reader_t *reader, /* IN */
+                                    size_t pos)                 /* IN */
+{
+   const char *text = (const char *) reader->stream.buf + pos;
+   size_t avail = reader->stream.len - pos;
+   bool negative = false;
+   bool has_dot = false;
+   bool has_exp = false;
+   uint64_t val = 0;
+   char last = '1';
+   size_t len;
+   size_t i = 0;
+   double d;
+
+   for (len = 0; len < avail && !_bson_json_is_special_end (text[len]);
+        len++) {
+   }
+
+   if (len == avail) {
+      return 0;
+   }
+
+   if (text[len] == '\\') {
+      _bson_json_structural_error (
+         reader, pos + len, JSONSL_ERROR_SPECIAL_EXPECTED);
+      return -1;
+   }
+
+   switch (text[0]) {
+   case 't':
+      if (len == 4 && !memcmp (text, "true", 4)) {
+         _bson_json_read_boolean (reader, 1);
+         return 1;
+      }
+      break;
+   case 'f':
+      if (len == 5 && !memcmp (text, "false", 5)) {
+         _bson_json_read_boolean (reader, 0);
+         return 1;
+      }
+      break;
+   case 'n':
+      if (len == 4 && !memcmp (text, "null", 4)) {
+         _bson_json_read_null (reader);
+         return 1;
+      }
+   /* fall through */
+   case 'N':
+      if (_bson_json_is_literal_ci (text, len, "nan")) {
+         goto parse_double;
+      }
+      break;
+   case 'i':
+   case 'I':
+      if (_bson_json_is_literal_ci (text, len, "infinity")) {
+         goto parse_double;
+      }
+      break;
+   case '-':
+      if (len > 1 && (text[1] == 'i' || text[1] == 'I')) {
+         if (_bson_json_is_literal_ci (text, len, "-infinity")) {
+            goto parse_double;
+         }
+         break;
+      }
+
+      negative = true;
+      i = 1;
+   /* fall through */
+   default:
+      /* no leading zeros, as in JSON */
+      if (i == len || !isdigit ((unsigned char) text[i]) ||
+          (text[i] == '0' && i + 1 < len &&
+           isdigit ((unsigned char) text[i + 1]))) {
+         break;
+      }
+
+      for (; i < len; i++) {
+         if (isdigit ((unsigned char) text[i])) {
+            /* wraps around on overflow, like jsonsl */
+            val = val * 10 + (uint64_t) (text[i] - '0');
+            last = '1';
+         } else if (text[i] == '.' && !has_dot) {
+            has_dot = true;
+            last = '.';
+         } else if ((text[i] == 'e' || text[i] == 'E') && !has_exp) {
+            has_exp = true;
+            last = 'e';
+         } else if ((text[i] == '-' || text[i] == '+') && last == 'e') {
+            last = '-';
+         } else {
+            break;
+         }
+      }
+
+      if (i < len || last != '1') {
+         break;
+      }
+
+      if (has_dot || has_exp) {
+         goto parse_double;
+      }
+
+      /* "-0" is read as 0 */
+      _bson_json_read_integer (reader, val, negative && val ? -1 : 1);
+      return 1;
+   }
+
+   _bson_json_structural_error (reader, pos, JSONSL_ERROR_SPECIAL_EXPECTED);
+   return -1;
+
+parse_double:
+   if (_bson_json_parse_double (reader, text, len, &d)) {
+      _bson_json_read_double (reader, d);
+   }
+
+   return 1;
+}
+
+
+/* put the contents of the string between the quotes at @pos and @end in
+ * reader->bson.unescaped, or set reader->error */
+static bool
+_bson_json_structural_unescape (bson_json_reader_t *reader, /* IN */
+                                size_t pos,                 /* IN */
+                                size_t end)                 /* IN */
+{
+   const char *text = (const char *) reader->stream.buf + pos + 1;
+   size_t len = end - pos - 1;
+
+   if (reader->structural.ctrl_pos > pos &&
+       reader->structural.ctrl_pos < end) {
+      _bson_json_structural_error (
+         reader, reader->structural.ctrl_pos, JSONSL_ERROR_WEIRD_WHITESPACE);
+      return false;
+   }
+
+   if (!memchr (text, '\\', len)) {
+      _bson_json_buf_set (&reader->bson.unescaped, text, len);
+      return true;
+   }
+
+   return _bson_json_unescape (
+      reader, pos - reader->stream_pos, text, (ssize_t) len);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_json_structural_parse --
+ *
+ *       Walk the structural index from reader->stream_index, checking the
+ *       JSON grammar and calling the same _bson_json_read_* functions as
+ *       the jsonsl callbacks, until the top-level document is closed.
+ *
+ * Returns:
+ *       1 if the document was read and @next is set to the index entry
+ *       after it, 0 if the input ends within it, or -1 on error.
+ *
+ * Side effects:
+ *       reader->bson.bson is filled in; reader->error is set on failure.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int
+_bson_json_structural_parse (bson_json_reader_t *reader, /* IN */
+                             size_t *next)               /* OUT */
+{
+   const bson_json_structural_t *s = &reader->structural;
+   const uint8_t *buf = reader->stream.buf;
+   bson_json_expect_t expect = BSON_JSON_EXPECT_VALUE;
+   uint8_t stack[STACK_MAX];
+   jsonsl_error_t err;
+   int depth = 0;
+   size_t pos;
+   size_t end;
+   size_t i;
+   int r;
+
+   for (i = reader->stream_index; i < s->n_indexes; i++) {
+      pos = s->indexes[i];
+
+      switch (buf[pos]) {
+      case '{':
+      case '[':
+         if (expect != BSON_JSON_EXPECT_VALUE &&
+             expect != BSON_JSON_EXPECT_VALUE_OR_END) {
+            err = JSONSL_ERROR_CANT_INSERT;
+            goto error;
+         }
+
+         if (depth >= STACK_MAX - 1) {
+            err = JSONSL_ERROR_LEVELS_EXCEEDED;
+            goto error;
+         }
+
+         stack[depth++] = buf[pos];
+
+         if (buf[pos] == '{') {
+            _bson_json_read_start_map (reader);
+            expect = BSON_JSON_EXPECT_KEY_OR_END;
+         } else {
+            _bson_json_read_start_array (reader);
+            expect = BSON_JSON_EXPECT_VALUE_OR_END;
+         }
+         break;
+      case '}':
+      case ']':
+         if (expect == BSON_JSON_EXPECT_KEY ||
+             (expect == BSON_JSON_EXPECT_VALUE && depth &&
+              stack[depth - 1] == '[')) {
+            err = JSONSL_ERROR_TRAILING_COMMA;
+            goto error;
+         }
+
+         if (expect == BSON_JSON_EXPECT_VALUE ||
+             expect == BSON_JSON_EXPECT_COLON) {
+            err = depth ? JSONSL_ERROR_VALUE_EXPECTED
+                        : JSONSL_ERROR_BRACKET_MISMATCH;
+            goto error;
+         }
+
+         if (!depth || stack[depth - 1] != (buf[pos] == '}' ? '{' : '[')) {
+            err = JSONSL_ERROR_BRACKET_MISMATCH;
+            goto error;
+         }
+
+         depth--;
+         expect = BSON_JSON_EXPECT_COMMA_OR_END;
+
+         if (buf[pos] == '}') {
+            _bson_json_read_end_map (reader);
+         } else {
+            _bson_json_read_end_array (reader);
+         }
+
+         if (!depth) {
+            *next = i + 1;
+            return reader->error->domain ? -1 : 1;
+         }
+         break;
+      case ':':
+         if (expect != BSON_JSON_EXPECT_COLON) {
+            err = JSONSL_ERROR_STRAY_TOKEN;
+            goto error;
+         }
+
+         expect = BSON_JSON_EXPECT_VALUE;
+         break;
+      case ',':
+         if (expect != BSON_JSON_EXPECT_COMMA_OR_END) {
+            err = JSONSL_ERROR_STRAY_TOKEN;
+            goto error;
+         }
+
+         expect = stack[depth - 1] == '{' ? BSON_JSON_EXPECT_KEY
+                                          : BSON_JSON_EXPECT_VALUE;
+         break;
+      case '"':
+         if (!depth) {
+            err = JSONSL_ERROR_STRING_OUTSIDE_CONTAINER;
+            goto error;
+         }
+
+         if (expect == BSON_JSON_EXPECT_COLON ||
+             expect == BSON_JSON_EXPECT_COMMA_OR_END) {
+            err = JSONSL_ERROR_STRAY_TOKEN;
+            goto error;
+         }
+
+         if (depth >= STACK_MAX - 1) {
+            err = JSONSL_ERROR_LEVELS_EXCEEDED;
+            goto error;
+         }
+
+         /* the closing quote is always the next entry */
+         if (i + 1 == s->n_indexes) {
+            return 0;
+         }
+
+         end = s->indexes[++i];
+
+         if (!_bson_json_structural_unescape (reader, pos, end)) {
+            return -1;
+         }
+
+         if (expect == BSON_JSON_EXPECT_KEY ||
+             expect == BSON_JSON_EXPECT_KEY_OR_END) {
+            _bson_json_read_map_key (reader,
+                                     reader->bson.unescaped.buf,
+                                     reader->bson.unescaped.len);
+            expect = BSON_JSON_EXPECT_COLON;
+         } else {
+            _bson_json_read_string (reader,
+                                    reader->bson.unescaped.buf,
+                                    reader->bson.unescaped.len);
+            expect = BSON_JSON_EXPECT_COMMA_OR_END;
+         }
+         break;
+      default:
+         if (!depth) {
+            err = JSONSL_ERROR_SPECIAL_EXPECTED;
+            goto error;
+         }
+
+         if (expect != BSON_JSON_EXPECT_VALUE &&
+             expect != BSON_JSON_EXPECT_VALUE_OR_END) {
+            err = JSONSL_ERROR_CANT_INSERT;
+            goto error;
+         }
+
+         if (depth >= STACK_MAX - 1) {
+            err = JSONSL_ERROR_LEVELS_EXCEEDED;
+            goto error;
+         }
+
+         r = _bson_json_structural_read_special (reader, pos);
+         if (r <= 0) {
+            return r;
+         }
+
+         expect = BSON_JSON_EXPECT_COMMA_OR_END;
+         break;
+      }
+
+      if (reader->error->domain) {
+         return -1;
+      }
+   }
+
+   return 0;
+
+error:
+   _bson_json_structural_error (reader, pos, err);
+   return -1;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_json_structural_read --
+ *
+ *       bson_json_reader_read() for BSON_JSON_PARSER_STRUCTURAL. Input is
+ *       buffered and indexed until a whole document and the token after
+ *       it are available, then the document is parsed from the index.
+ *       Like jsonsl, another document must begin with "{".
+ *
+ * Returns:
+ *       1 if a document was read, 0 at the end of the input, or -1 on
+ *       error.
+ *
+ * Side effects:
+ *       reader->error is set on failure.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static int
+_bson_json_structural_read (bson_json_reader_t *reader) /* IN */
+{
+   bson_json_reader_producer_t *p = &reader->producer;
+   bson_json_structural_t *s = &reader->structural;
+   bson_json_buf_t *stream = &reader->stream;
+   bool have_data;
+   bool eof = false;
+   size_t scan = reader->stream_index;
+   size_t next;
+   int depth = 0;
+   ssize_t r;
+   uint8_t c;
+
+   have_data = reader->stream_pos < stream->len;
+
+   for (;;) {
+      _bson_json_structural_scan (s, stream->buf, stream->len);
+
+      /* find the end of the document by counting brackets */
+      while (scan < s->n_indexes &&
+             (depth > 0 || scan == reader->stream_index)) {
+         c = stream->buf[s->indexes[scan++]];
+         if (c == '{' || c == '[') {
+            depth++;
+         } else if (c == '}' || c == ']') {
+            depth--;
+         }
+      }
+
+      if (eof ||
+          (depth <= 0 && scan > reader->stream_index && scan < s->n_indexes)) {
+         break;
+      }
+
+      if (reader->stream_pos) {
+         /* discard the documents already read */
+         memmove (stream->buf,
+                  stream->buf + reader->stream_pos,
+                  stream->len - reader->stream_pos);
+         stream->len -= reader->stream_pos;
+         _bson_json_structural_shift (
+            s, reader->stream_index, reader->stream_pos);
+         scan -= reader->stream_index;
+         reader->stream_pos = 0;
+         reader->stream_index = 0;
+      }
+
+      if (stream->n_bytes < stream->len + p->buf_size) {
+         stream->n_bytes = bson_next_power_of_two (stream->len + p->buf_size);
+         stream->buf = bson_realloc (stream->buf, stream->n_bytes);
+      }
+
+      r = p->cb (p->data, stream->buf + stream->len, p->buf_size);
+
+      if (r < 0) {
+         bson_set_error (reader->error,
+                         BSON_ERROR_JSON,
+                         BSON_JSON_ERROR_READ_CB_FAILURE,
+                         "reader cb failed");
+         return -1;
+      } else if (r == 0) {
+         eof = true;
+      } else if ((size_t) r > UINT32_MAX - stream->len) {
+         _bson_json_read_corrupt (reader, "%s", "JSON document too large");
+         return -1;
+      } else {
+         stream->len += (size_t) r;
+         have_data = true;
+      }
+   }
+
+   if (!have_data) {
+      return 0;
+   }
+
+   switch (_bson_json_structural_parse (reader, &next)) {
+   case 1:
+      break;
+   case 0:
+      _bson_json_read_corrupt (reader, "%s", "Incomplete JSON");
+      return -1;
+   default:
+      return -1;
+   }
+
+   if (reader->bson.read_state != BSON_JSON_DONE) {
+      _bson_json_read_corrupt (reader, "%s", "Incomplete JSON");
+      return -1;
+   }
+
+   if (next < s->n_indexes) {
+      if (stream->buf[s->indexes[next]] != '{') {
+         _bson_json_structural_error (
+            reader, s->indexes[next], JSONSL_ERROR_CANT_INSERT);
+         return -1;
+      }
+
+      reader->stream_pos = s->indexes[next];
+   } else {
+      /* only whitespace remains */
+      reader->stream_pos = stream->len;
+   }
+
+   reader->stream_index = next;
+
+   return 1;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -2024,6 +2597,10 @@ bson_json_reader_read (bson_json_reader_t *reader, /* IN */
    reader->error = error ? error : &error_tmp;
    memset (reader->error, 0, sizeof (bson_error_t));
 
+   if (reader->parser == BSON_JSON_PARSER_STRUCTURAL) {
+      return _bson_json_structural_read (reader);
+   }
+
    for (;;) {
       start_pos = reader->json->pos;
 
@@ -2103,6 +2680,19 @@ bson_json_reader_new (void *data,               /* IN */
                       bson_json_destroy_cb dcb, /* IN */
                       bool allow_multiple,      /* unused */
                       size_t buf_size)          /* IN */
+{
+   return bson_json_reader_new_with_parser (
+      data, cb, dcb, allow_multiple, buf_size, BSON_JSON_PARSER_DEFAULT);
+}
+
+
+bson_json_reader_t *
+bson_json_reader_new_with_parser (void *data,                /* IN */
+                                  bson_json_reader_cb cb,    /* IN */
+                                  bson_json_destroy_cb dcb,  /* IN */
+                                  bool allow_multiple,       /* unused */
+                                  size_t buf_size,           /* IN */
+                                  bson_json_parser_t parser) /* IN */
 {
    bson_json_reader_t *r;
    bson_json_reader_producer_t *p;
@@ -2115,6 +2705,8 @@ bson_json_reader_new (void *data,               /* IN */
    r->json->data = r;
    r->json_text_pos = -1;
    jsonsl_enable_all_callbacks (r->json);
+   r->parser = parser;
+   _bson_json_structural_init (&r->structural);
 
    p = &r->producer;
 
@@ -2122,7 +2714,11 @@ bson_json_reader_new (void *data,               /* IN */
    p->cb = cb;
    p->dcb = dcb;
    p->buf_size = buf_size ? buf_size : BSON_JSON_DEFAULT_BUF_SIZE;
-   p->buf = bson_malloc (p->buf_size);
+
+   if (parser != BSON_JSON_PARSER_STRUCTURAL) {
+      /* the structural parser reads directly into r->stream */
+      p->buf = bson_malloc (p->buf_size);
+   }
 
    return r;
 }
@@ -2151,6 +2747,8 @@ bson_json_reader_destroy (bson_json_reader_t *reader) /* IN */
    _bson_json_code_cleanup (&b->code_data);
 
    jsonsl_destroy (reader->json);
+   _bson_json_structural_destroy (&reader->structural);
+   bson_free (reader->stream.buf);
    bson_free (reader->tok_accumulator.buf);
    bson_free (reader);
 }
@@ -2194,6 +2792,18 @@ bson_json_data_reader_new (bool allow_multiple, /* IN */
 }
 
 
+bson_json_reader_t *
+bson_json_data_reader_new_with_parser (bool allow_multiple,       /* IN */
+                                       size_t size,               /* IN */
+                                       bson_json_parser_t parser) /* IN */
+{
+   bson_json_data_reader_t *dr = bson_malloc0 (sizeof *dr);
+
+   return bson_json_reader_new_with_parser (
+      dr, &_bson_json_data_reader_cb, &bson_free, allow_multiple, size, parser);
+}
+
+
 void
 bson_json_data_reader_ingest (bson_json_reader_t *reader, /* IN */
                               const uint8_t *data,        /* IN */
@@ -31,19 +31,62 @@ BSON_BEGIN_DECLS
 
 
 typedef struct _bson_json_reader_t bson_json_reader_t;
+typedef struct _bson_json_writer_t bson_json_writer_t;
 
 
 typedef enum {
    BSON_JSON_ERROR_READ_CORRUPT_JS = 1,
    BSON_JSON_ERROR_READ_INVALID_PARAM,
    BSON_JSON_ERROR_READ_CB_FAILURE,
+   BSON_JSON_ERROR_WRITE_CORRUPT_BSON,
+   BSON_JSON_ERROR_WRITE_INVALID_PARAM,
+   BSON_JSON_ERROR_WRITE_CB_FAILURE,
 } bson_json_error_code_t;
 
 
+/**
+ * bson_json_mode_t:
+ * @BSON_JSON_MODE_LEGACY: libbson's legacy JSON format, as produced by
+ *    bson_as_json().
+ * @BSON_JSON_MODE_CANONICAL: Canonical extended JSON, as produced by
+ *    bson_as_canonical_extended_json().
+ * @BSON_JSON_MODE_RELAXED: Relaxed extended JSON, as produced by
+ *    bson_as_relaxed_extended_json().
+ *
+ * The JSON format written by bson_as_json_to_writer().
+ */
+typedef enum {
+   BSON_JSON_MODE_LEGACY,
+   BSON_JSON_MODE_CANONICAL,
+   BSON_JSON_MODE_RELAXED,
+} bson_json_mode_t;
+
+
+/**
+ * bson_json_parser_t:
+ * @BSON_JSON_PARSER_DEFAULT: Parse one character at a time, producing each
+ *    document as soon as its closing brace has been read.
+ * @BSON_JSON_PARSER_STRUCTURAL: First index the structural characters of
+ *    each document with SIMD instructions, then build the document from
+ *    the index. Much faster for large inputs; each document is buffered
+ *    in full before it is parsed.
+ *
+ * The parsing backend of a bson_json_reader_t. Both produce the same
+ * documents from the same input.
+ */
+typedef enum {
+   BSON_JSON_PARSER_DEFAULT = 0,
+   BSON_JSON_PARSER_STRUCTURAL,
+} bson_json_parser_t;
+
+
 typedef ssize_t (*bson_json_reader_cb) (void *handle,
                                         uint8_t *buf,
                                         size_t count);
 typedef void (*bson_json_destroy_cb) (void *handle);
+typedef ssize_t (*bson_json_writer_cb) (void *handle,
+                                        const char *buf,
+                                        size_t count);
 
 
 BSON_EXPORT (bson_json_reader_t *)
@@ -53,6 +96,13 @@ bson_json_reader_new (void *data,
                       bool allow_multiple,
                       size_t buf_size);
 BSON_EXPORT (bson_json_reader_t *)
+bson_json_reader_new_with_parser (void *data,
+                                  bson_json_reader_cb cb,
+                                  bson_json_destroy_cb dcb,
+                                  bool allow_multiple,
+                                  size_t buf_size,
+                                  bson_json_parser_t parser);
+BSON_EXPORT (bson_json_reader_t *)
 bson_json_reader_new_from_fd (int fd, bool close_on_destroy);
 BSON_EXPORT (bson_json_reader_t *)
 bson_json_reader_new_from_file (const char *filename, bson_error_t *error);
@@ -64,10 +114,59 @@ bson_json_reader_read (bson_json_reader_t *reader,
                        bson_error_t *error);
 BSON_EXPORT (bson_json_reader_t *)
 bson_json_data_reader_new (bool allow_multiple, size_t size);
+BSON_EXPORT (bson_json_reader_t *)
+bson_json_data_reader_new_with_parser (bool allow_multiple,
+                                       size_t size,
+                                       bson_json_parser_t parser);
 BSON_EXPORT (void)
 bson_json_data_reader_ingest (bson_json_reader_t *reader,
                               const uint8_t *data,
                               size_t len);
+BSON_EXPORT (bson_json_writer_t *)
+bson_json_writer_new (void *data,
+                      bson_json_writer_cb cb,
+                      bson_json_destroy_cb dcb,
+                      size_t buf_size);
+BSON_EXPORT (bson_json_writer_t *)
+bson_json_writer_new_from_fd (int fd, bool close_on_destroy);
+BSON_EXPORT (bson_json_writer_t *)
+bson_json_data_writer_new (size_t size);
+BSON_EXPORT (bson_json_writer_t *)
+bson_json_data_writer_new_static (char *buf, size_t len);
+BSON_EXPORT (void)
+bson_json_writer_destroy (bson_json_writer_t *writer);
+BSON_EXPORT (const char *)
+bson_json_writer_get_data (const bson_json_writer_t *writer, size_t *len);
+BSON_EXPORT (void)
+bson_json_writer_reset (bson_json_writer_t *writer);
+BSON_EXPORT (bool)
+bson_json_writer_flush (bson_json_writer_t *writer, bson_error_t *error);
+
+
+/**
+ * bson_as_json_to_writer:
+ * @bson: A bson_t.
+ * @mode: A bson_json_mode_t.
+ * @writer: A bson_json_writer_t.
+ * @error: A location for a bson_error_t, or NULL.
+ *
+ * Writes @bson to @writer as JSON in the format selected by @mode, in one
+ * pass and without building intermediate strings for embedded documents.
+ *
+ * If @writer was created with bson_json_data_writer_new_static() and its
+ * buffer fills up, 0 is returned. Consume the buffer, call
+ * bson_json_writer_reset(), then call this function again with the same
+ * @bson to continue where it stopped. @bson must not be modified or freed
+ * in between.
+ *
+ * Returns: 1 once all of @bson has been written, 0 if the buffer is full,
+ *    or -1 if @bson is corrupt or writing failed and @error is set.
+ */
+BSON_EXPORT (int)
+bson_as_json_to_writer (const bson_t *bson,
+                        bson_json_mode_t mode,
+                        bson_json_writer_t *writer,
+                        bson_error_t *error);
 
 
 BSON_END_DECLS
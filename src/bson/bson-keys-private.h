@@ -0,0 +1,40 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_KEYS_PRIVATE_H
+#define BSON_KEYS_PRIVATE_H
+
+
+#include "bson-macros.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/* room for the digits of any uint32_t and a trailing NUL */
+#define BSON_UINT32_STR_SIZE 11
+
+
+size_t
+_bson_uint32_format (uint32_t value, char *str);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_KEYS_PRIVATE_H */
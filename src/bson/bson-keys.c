@@ -16,8 +16,10 @@
 
 
 #include <stdio.h>
+#include <string.h>
 
 #include "bson-keys.h"
+#include "bson-keys-private.h"
 #include "bson-string.h"
 
 
@@ -115,6 +117,61 @@ static const char *gUint32Strs[] = {
    "990", "991", "992", "993", "994", "995", "996", "997", "998", "999"};
 
 
+static const char gDigitPairs[] =
+   "000102030405060708091011121314151617181920212223242526272829"
+   "303132333435363738394041424344454647484950515253545556575859"
+   "606162636465666768697071727374757677787980818283848586878889"
+   "90919293949596979899";
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_uint32_format --
+ *
+ *       Format @value in decimal into @str, which must have room for
+ *       BSON_UINT32_STR_SIZE bytes, without a lookup table limit and
+ *       without snprintf().
+ *
+ * Returns:
+ *       The number of digits, not counting the trailing NUL.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+_bson_uint32_format (uint32_t value, /* IN */
+                     char *str)      /* OUT */
+{
+   char buf[BSON_UINT32_STR_SIZE];
+   char *p = buf + sizeof buf - 1;
+   size_t len;
+
+   *p = '\0';
+
+   while (value >= 100) {
+      p -= 2;
+      memcpy (p, gDigitPairs + (value % 100) * 2, 2);
+      value /= 100;
+   }
+
+   if (value >= 10) {
+      p -= 2;
+      memcpy (p, gDigitPairs + value * 2, 2);
+   } else {
+      *--p = (char) ('0' + value);
+   }
+
+   len = (size_t) (buf + sizeof buf - 1 - p);
+   memcpy (str, p, len + 1);
+
+   return len;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -125,8 +182,8 @@ static const char *gUint32Strs[] = {
  *       If @value is from 0 to 1000, it will use a constant string in the
  *       data section of the library.
  *
- *       If not, a string will be formatted using @str and snprintf(). This
- *       is much slower, of course and therefore we try to optimize it out.
+ *       If not, a string will be formatted into @str, two digits at a
+ *       time if @str has room for any uint32_t, otherwise with snprintf().
  *
  *       @strptr will always be set. It will either point to @str or a
  *       constant string. You will want to use this as your key.
@@ -134,7 +191,7 @@ static const char *gUint32Strs[] = {
  * Parameters:
  *       @value: A #uint32_t to convert to string.
  *       @strptr: (out): A pointer to the resulting string.
- *       @str: (out): Storage for a string made with snprintf.
+ *       @str: (out): Storage for a formatted string.
  *       @size: Size of @str.
  *
  * Returns:
@@ -166,5 +223,9 @@ bson_uint32_to_string (uint32_t value,      /* IN */
 
    *strptr = str;
 
-   return bson_snprintf (str, size, "%u", value);
+   if (size < BSON_UINT32_STR_SIZE) {
+      return bson_snprintf (str, size, "%u", value);
+   }
+
+   return _bson_uint32_format (value, str);
 }
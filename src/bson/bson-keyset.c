@@ -0,0 +1,372 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson.h"
+#include "bson-hash-private.h"
+#include "bson-keyset.h"
+#include "bson-private.h"
+
+
+#define BSON_KEYSET_MIN_SLOTS 4
+
+
+/*
+ * The paths of a keyset form a tree with one node per path segment. Each
+ * node has a hash table of its children, which are looked up by the keys
+ * of the document or array that the node stands for.
+ */
+typedef struct _bson_keyset_node_t bson_keyset_node_t;
+
+struct _bson_keyset_node_t {
+   char *key;
+   uint32_t key_len;
+   uint32_t hash;
+
+   /* the path that ends at this node, or -1 */
+   ssize_t target;
+
+   /* the number of distinct paths that end below this node */
+   size_t n_targets;
+
+   bson_keyset_node_t *children;
+   uint32_t n_children;
+   uint32_t children_alloc;
+
+   /* open addressing table of child numbers plus one, zero if empty */
+   uint32_t *slots;
+   uint32_t n_slots;
+};
+
+
+struct _bson_keyset_t {
+   bson_keyset_node_t root;
+   size_t n_paths;
+
+   /* for each path, the first path in the set that is identical to it */
+   size_t *first;
+};
+
+
+static void
+_bson_keyset_node_destroy (bson_keyset_node_t *node) /* IN */
+{
+   uint32_t i;
+
+   for (i = 0; i < node->n_children; i++) {
+      _bson_keyset_node_destroy (&node->children[i]);
+   }
+
+   bson_free (node->children);
+   bson_free (node->slots);
+   bson_free (node->key);
+}
+
+
+static bson_keyset_node_t *
+_bson_keyset_node_lookup (const bson_keyset_node_t *node, /* IN */
+                          const char *key,                /* IN */
+                          uint32_t key_len)               /* IN */
+{
+   bson_keyset_node_t *child;
+   uint32_t hash;
+   uint32_t mask;
+   uint32_t pos;
+
+   hash = _bson_hash_key (key, key_len);
+   mask = node->n_slots - 1;
+
+   for (pos = hash & mask; node->slots[pos]; pos = (pos + 1) & mask) {
+      child = &node->children[node->slots[pos] - 1];
+      if (child->hash == hash && child->key_len == key_len &&
+          !memcmp (child->key, key, key_len)) {
+         return child;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ * Find or add the child of @node for the path segment @key. The slots are
+ * built once all paths have been added, until then children are found by
+ * a linear search.
+ */
+static bson_keyset_node_t *
+_bson_keyset_node_child (bson_keyset_node_t *node, /* IN */
+                         const char *key,          /* IN */
+                         uint32_t key_len)         /* IN */
+{
+   bson_keyset_node_t *child;
+   uint32_t i;
+
+   for (i = 0; i < node->n_children; i++) {
+      child = &node->children[i];
+      if (child->key_len == key_len && !memcmp (child->key, key, key_len)) {
+         return child;
+      }
+   }
+
+   if (node->n_children == node->children_alloc) {
+      node->children_alloc = BSON_MAX (4, node->children_alloc * 2);
+      node->children = bson_realloc (
+         node->children, node->children_alloc * sizeof *node->children);
+   }
+
+   child = &node->children[node->n_children++];
+   memset (child, 0, sizeof *child);
+   child->key = bson_strndup (key, key_len);
+   child->key_len = key_len;
+   child->hash = _bson_hash_key (key, key_len);
+   child->target = -1;
+
+   return child;
+}
+
+
+static void
+_bson_keyset_node_build_slots (bson_keyset_node_t *node) /* IN */
+{
+   uint32_t mask;
+   uint32_t pos;
+   uint32_t i;
+
+   node->n_slots = BSON_KEYSET_MIN_SLOTS;
+   while (node->n_slots < node->n_children * 2) {
+      node->n_slots *= 2;
+   }
+
+   node->slots = bson_malloc0 (node->n_slots * sizeof *node->slots);
+   mask = node->n_slots - 1;
+
+   for (i = 0; i < node->n_children; i++) {
+      for (pos = node->children[i].hash & mask; node->slots[pos];
+           pos = (pos + 1) & mask) {
+      }
+
+      node->slots[pos] = i + 1;
+      _bson_keyset_node_build_slots (&node->children[i]);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_keyset_new --
+ *
+ *       Compile the @n_paths keys or dotted paths in @paths into a
+ *       keyset. A path is split at each dot, like the dotkey of
+ *       bson_iter_find_descendant(). The same path may be given more than
+ *       once.
+ *
+ * Returns:
+ *       A newly allocated bson_keyset_t that should be freed with
+ *       bson_keyset_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_keyset_t *
+bson_keyset_new (const char *const *paths, /* IN */
+                 size_t n_paths)           /* IN */
+{
+   bson_keyset_node_t *node;
+   bson_keyset_node_t *ancestor;
+   bson_keyset_t *keyset;
+   const char *segment;
+   const char *dot;
+   size_t len;
+   size_t i;
+
+   BSON_ASSERT (paths || !n_paths);
+
+   keyset = bson_malloc0 (sizeof *keyset);
+   keyset->root.target = -1;
+   keyset->n_paths = n_paths;
+   keyset->first = bson_malloc0 (BSON_MAX (n_paths, 1) * sizeof (size_t));
+
+   for (i = 0; i < n_paths; i++) {
+      BSON_ASSERT (paths[i]);
+
+      node = &keyset->root;
+      for (segment = paths[i];; segment = dot + 1) {
+         dot = strchr (segment, '.');
+         len = dot ? (size_t) (dot - segment) : strlen (segment);
+         BSON_ASSERT (len <= UINT32_MAX);
+         node = _bson_keyset_node_child (node, segment, (uint32_t) len);
+
+         if (!dot) {
+            break;
+         }
+      }
+
+      if (node->target >= 0) {
+         keyset->first[i] = (size_t) node->target;
+         continue;
+      }
+
+      node->target = (ssize_t) i;
+      keyset->first[i] = i;
+
+      /* count the new path in each node above its last segment */
+      ancestor = &keyset->root;
+      for (segment = paths[i];; segment = dot + 1) {
+         ancestor->n_targets++;
+         dot = strchr (segment, '.');
+         if (!dot) {
+            break;
+         }
+
+         len = (size_t) (dot - segment);
+         ancestor =
+            _bson_keyset_node_child (ancestor, segment, (uint32_t) len);
+      }
+   }
+
+   _bson_keyset_node_build_slots (&keyset->root);
+
+   return keyset;
+}
+
+
+void
+bson_keyset_destroy (bson_keyset_t *keyset) /* IN */
+{
+   if (keyset) {
+      _bson_keyset_node_destroy (&keyset->root);
+      bson_free (keyset->first);
+      bson_free (keyset);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_keyset_find --
+ *
+ *       Walk the document or array under @iter and set the element of
+ *       @values for each path that ends at a child of @node. Only the
+ *       first element with a given key is recorded.
+ *
+ * Returns:
+ *       The number of paths found below @node.
+ *
+ * Side effects:
+ *       @iter is advanced.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static size_t
+_bson_keyset_find (const bson_keyset_node_t *node, /* IN */
+                   bson_iter_t *iter,              /* IN */
+                   bson_value_t *values)           /* OUT */
+{
+   const bson_keyset_node_t *child;
+   bson_iter_t child_iter;
+   bson_value_t *value;
+   size_t n_found = 0;
+
+   while (n_found < node->n_targets && bson_iter_next (iter)) {
+      child = _bson_keyset_node_lookup (node,
+                                        (const char *) iter->raw + iter->key,
+                                        _bson_iter_key_len (iter));
+      if (!child) {
+         continue;
+      }
+
+      if (child->target >= 0) {
+         value = &values[child->target];
+         if (value->value_type == BSON_TYPE_EOD) {
+            *value = *bson_iter_value (iter);
+            n_found++;
+         }
+      }
+
+      if (child->n_targets &&
+          (BSON_ITER_HOLDS_DOCUMENT (iter) || BSON_ITER_HOLDS_ARRAY (iter)) &&
+          bson_iter_recurse (iter, &child_iter)) {
+         n_found += _bson_keyset_find (child, &child_iter, values);
+      }
+   }
+
+   return n_found;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_keyset_find --
+ *
+ *       Find the paths of @keyset in @bson with a single walk over its
+ *       fields. For each path found, the element of @values at its index
+ *       is set to the value of the field, as bson_iter_value() would
+ *       return it after bson_iter_find_descendant(). The values refer to
+ *       the contents of @bson and are only valid as long as it is. The
+ *       other elements of @values are set to type BSON_TYPE_EOD.
+ *
+ * Returns:
+ *       The number of paths found.
+ *
+ * Side effects:
+ *       @values is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+size_t
+bson_keyset_find (const bson_keyset_t *keyset, /* IN */
+                  const bson_t *bson,          /* IN */
+                  bson_value_t *values)        /* OUT */
+{
+   bson_iter_t iter;
+   size_t n_found = 0;
+   size_t first;
+   size_t i;
+
+   BSON_ASSERT (keyset);
+   BSON_ASSERT (bson);
+   BSON_ASSERT (values || !keyset->n_paths);
+
+   for (i = 0; i < keyset->n_paths; i++) {
+      values[i].value_type = BSON_TYPE_EOD;
+   }
+
+   if (bson_iter_init (&iter, bson)) {
+      _bson_keyset_find (&keyset->root, &iter, values);
+   }
+
+   /* copy the results of repeated paths, and count all of them */
+   for (i = 0; i < keyset->n_paths; i++) {
+      first = keyset->first[i];
+      if (first != i) {
+         values[i] = values[first];
+      }
+
+      n_found += values[i].value_type != BSON_TYPE_EOD;
+   }
+
+   return n_found;
+}
@@ -0,0 +1,61 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_KEYSET_H
+#define BSON_KEYSET_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-macros.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/**
+ * bson_keyset_t:
+ *
+ * A bson_keyset_t is a compiled set of keys and dotted paths whose values
+ * can be read out of a document with a single walk over its fields, which
+ * stops as soon as every path has been found. Embedded documents and arrays are
+ * only entered if some path descends into them.
+ *
+ * A bson_keyset_t is immutable once created, and may be used from several
+ * threads at once.
+ */
+typedef struct _bson_keyset_t bson_keyset_t;
+
+
+BSON_EXPORT (bson_keyset_t *)
+bson_keyset_new (const char *const *paths, size_t n_paths);
+BSON_EXPORT (void)
+bson_keyset_destroy (bson_keyset_t *keyset);
+BSON_EXPORT (size_t)
+bson_keyset_find (const bson_keyset_t *keyset,
+                  const bson_t *bson,
+                  bson_value_t *values);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_KEYSET_H */
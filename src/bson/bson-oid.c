@@ -171,6 +171,61 @@ bson_oid_init (bson_oid_t *oid,         /* OUT */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_oid_init_many --
+ *
+ *       Generates @n_oids new ObjectIDs into the array @oids, like calling
+ *       bson_oid_init() for each of them, but reads the clock once and
+ *       reserves all of their sequence numbers from @context at once.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       @oids is initialized.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_oid_init_many (bson_oid_t *oids,        /* OUT */
+                    size_t n_oids,           /* IN */
+                    bson_context_t *context) /* IN */
+{
+   uint32_t now = (uint32_t) (time (NULL));
+   bson_oid_t oid;
+   uint32_t seq;
+   uint32_t n;
+   uint32_t i;
+
+   BSON_ASSERT (oids || !n_oids);
+
+   if (!context) {
+      context = bson_context_get_default ();
+   }
+
+   now = BSON_UINT32_TO_BE (now);
+   memcpy (&oid.bytes[0], &now, sizeof (now));
+
+   while (n_oids) {
+      n = (uint32_t) BSON_MIN (n_oids, (size_t) INT32_MAX);
+      seq = _bson_context_get_oid_seq32_many (context, &oid, n);
+
+      for (i = 0; i < n; i++, seq++) {
+         memcpy (oids[i].bytes, oid.bytes, 9);
+         oids[i].bytes[9] = (uint8_t) (seq >> 16);
+         oids[i].bytes[10] = (uint8_t) (seq >> 8);
+         oids[i].bytes[11] = (uint8_t) seq;
+      }
+
+      oids += n;
+      n_oids -= n;
+   }
+}
+
+
 /**
  * bson_oid_init_from_data:
  * @oid: A bson_oid_t to initialize.
@@ -0,0 +1,1043 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson.h"
+#include "bson-patch.h"
+#include "bson-private.h"
+
+
+typedef enum {
+   BSON_PATCH_OP_NONE,
+   BSON_PATCH_OP_SET,
+   BSON_PATCH_OP_UNSET,
+   BSON_PATCH_OP_INC,
+   BSON_PATCH_OP_RENAME,
+} bson_patch_op_t;
+
+
+/*
+ * The operations of a patch form a tree that mirrors the paths they
+ * address. A node without an operation is an embedded document or array
+ * that some operation descends into.
+ */
+typedef struct _bson_patch_node_t bson_patch_node_t;
+
+struct _bson_patch_node_t {
+   char *key;
+   uint32_t key_len;
+   bson_patch_op_t op;
+
+   /* BSON_PATCH_OP_SET, the value's bytes without type and key */
+   bson_type_t value_type;
+   uint8_t *value;
+   uint32_t value_len;
+
+   /* BSON_PATCH_OP_INC */
+   bson_value_t amount;
+
+   /* BSON_PATCH_OP_RENAME */
+   char *new_key;
+   uint32_t new_key_len;
+
+   /* an unset of a rename's destination only happens if the source exists */
+   bson_patch_node_t *rename_source;
+
+   /* BSON_PATCH_OP_NONE, in the order they were added */
+   bson_patch_node_t *children;
+   bson_patch_node_t *last_child;
+   bson_patch_node_t *next;
+
+   /*
+    * Scratch space for bson_patch_apply(). The element of the source this
+    * node matched, the next matched sibling and the first matched child in
+    * document order, and the size of the element or document that replaces
+    * it.
+    */
+   bool found;
+   bool keep;
+   bson_type_t type;
+   uint32_t offset;
+   uint32_t len;
+   bson_value_t current;
+   bson_value_t result;
+   bson_patch_node_t *next_found;
+   bson_patch_node_t *first_found;
+   uint64_t out_len;
+   uint64_t doc_len;
+};
+
+
+struct _bson_patch_t {
+   bson_patch_node_t root;
+};
+
+
+static void
+_bson_patch_node_destroy (bson_patch_node_t *node) /* IN */
+{
+   bson_patch_node_t *child;
+   bson_patch_node_t *next;
+
+   for (child = node->children; child; child = next) {
+      next = child->next;
+      _bson_patch_node_destroy (child);
+      bson_free (child);
+   }
+
+   bson_free (node->key);
+   bson_free (node->value);
+   bson_free (node->new_key);
+}
+
+
+static bson_patch_node_t *
+_bson_patch_node_find (const bson_patch_node_t *parent, /* IN */
+                       const char *key,                 /* IN */
+                       size_t key_len)                  /* IN */
+{
+   bson_patch_node_t *child;
+
+   for (child = parent->children; child; child = child->next) {
+      if (child->key_len == key_len && !memcmp (child->key, key, key_len)) {
+         return child;
+      }
+   }
+
+   return NULL;
+}
+
+
+static bson_patch_node_t *
+_bson_patch_node_add (bson_patch_node_t *parent, /* IN */
+                      const char *key,           /* IN */
+                      size_t key_len)            /* IN */
+{
+   bson_patch_node_t *node;
+
+   node = bson_malloc0 (sizeof *node);
+   node->key = bson_strndup (key, key_len);
+   node->key_len = (uint32_t) key_len;
+
+   if (parent->last_child) {
+      parent->last_child->next = node;
+   } else {
+      parent->children = node;
+   }
+
+   parent->last_child = node;
+
+   return node;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_patch_check --
+ *
+ *       Check that @path is a valid dotted path and that it does not
+ *       overlap the path of an operation already in @patch.
+ *
+ * Returns:
+ *       true if an operation on @path can be added; otherwise false and
+ *       @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_patch_check (const bson_patch_t *patch, /* IN */
+                   const char *path,          /* IN */
+                   bson_error_t *error)       /* OUT */
+{
+   const bson_patch_node_t *parent = &patch->root;
+   bson_patch_node_t *node;
+   const char *segment;
+   const char *dot;
+   size_t len;
+
+   for (segment = path;; segment = dot + 1) {
+      dot = strchr (segment, '.');
+      len = dot ? (size_t) (dot - segment) : strlen (segment);
+
+      if (len == 0 || len > INT32_MAX) {
+         bson_set_error (error,
+                         BSON_ERROR_PATCH,
+                         BSON_PATCH_ERROR_INVALID_PATH,
+                         "Invalid path \"%s\"",
+                         path);
+         return false;
+      }
+
+      node = parent ? _bson_patch_node_find (parent, segment, len) : NULL;
+
+      if (node && (node->op != BSON_PATCH_OP_NONE || !dot)) {
+         bson_set_error (error,
+                         BSON_ERROR_PATCH,
+                         BSON_PATCH_ERROR_CONFLICT,
+                         "Path \"%s\" conflicts with another operation",
+                         path);
+         return false;
+      }
+
+      if (!dot) {
+         return true;
+      }
+
+      parent = node;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_patch_add --
+ *
+ *       Add the node for @path, which has been checked with
+ *       _bson_patch_check(), creating the nodes of the embedded documents
+ *       it descends into.
+ *
+ * Returns:
+ *       The new node.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bson_patch_node_t *
+_bson_patch_add (bson_patch_t *patch, /* IN */
+                 const char *path)    /* IN */
+{
+   bson_patch_node_t *parent = &patch->root;
+   bson_patch_node_t *node;
+   const char *segment;
+   const char *dot;
+   size_t len;
+
+   for (segment = path;; segment = dot + 1) {
+      dot = strchr (segment, '.');
+      len = dot ? (size_t) (dot - segment) : strlen (segment);
+
+      if (!(node = _bson_patch_node_find (parent, segment, len))) {
+         node = _bson_patch_node_add (parent, segment, len);
+      }
+
+      if (!dot) {
+         return node;
+      }
+
+      parent = node;
+   }
+}
+
+
+bson_patch_t *
+bson_patch_new (void)
+{
+   return bson_malloc0 (sizeof (bson_patch_t));
+}
+
+
+void
+bson_patch_destroy (bson_patch_t *patch) /* IN */
+{
+   if (patch) {
+      _bson_patch_node_destroy (&patch->root);
+      bson_free (patch);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_patch_set --
+ *
+ *       Add an operation that sets the field at @path to @value. A field
+ *       that exists keeps its position, otherwise it is appended to its
+ *       document, which is created if it does not exist either.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_patch_set (bson_patch_t *patch,       /* IN */
+                const char *path,          /* IN */
+                const bson_value_t *value, /* IN */
+                bson_error_t *error)       /* OUT */
+{
+   bson_patch_node_t *node;
+   const uint8_t *data;
+   bson_t tmp;
+
+   BSON_ASSERT (patch);
+   BSON_ASSERT (path);
+   BSON_ASSERT (value);
+
+   if (!_bson_patch_check (patch, path, error)) {
+      return false;
+   }
+
+   /* encode the value as the only element of a document with an empty key */
+   bson_init (&tmp);
+   if (!bson_append_value (&tmp, "", 0, value)) {
+      bson_destroy (&tmp);
+      bson_set_error (error,
+                      BSON_ERROR_PATCH,
+                      BSON_PATCH_ERROR_TYPE_MISMATCH,
+                      "Cannot set \"%s\" to a value of type 0x%02x",
+                      path,
+                      (int) value->value_type);
+      return false;
+   }
+
+   node = _bson_patch_add (patch, path);
+   data = bson_get_data (&tmp);
+   node->op = BSON_PATCH_OP_SET;
+   node->value_type = value->value_type;
+   node->value_len = tmp.len - 7;
+   node->value = bson_malloc (node->value_len);
+   memcpy (node->value, data + 6, node->value_len);
+
+   bson_destroy (&tmp);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_patch_unset --
+ *
+ *       Add an operation that removes the field at @path, if it exists. An
+ *       array element is replaced with null so that the keys of the array
+ *       remain consecutive.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_patch_unset (bson_patch_t *patch, /* IN */
+                  const char *path,    /* IN */
+                  bson_error_t *error) /* OUT */
+{
+   BSON_ASSERT (patch);
+   BSON_ASSERT (path);
+
+   if (!_bson_patch_check (patch, path, error)) {
+      return false;
+   }
+
+   _bson_patch_add (patch, path)->op = BSON_PATCH_OP_UNSET;
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_patch_inc --
+ *
+ *       Add an operation that adds @amount, an int32, int64 or double, to
+ *       the number at @path. A field that does not exist is set to
+ *       @amount.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_patch_inc (bson_patch_t *patch,        /* IN */
+                const char *path,           /* IN */
+                const bson_value_t *amount, /* IN */
+                bson_error_t *error)        /* OUT */
+{
+   bson_patch_node_t *node;
+
+   BSON_ASSERT (patch);
+   BSON_ASSERT (path);
+   BSON_ASSERT (amount);
+
+   if (amount->value_type != BSON_TYPE_INT32 &&
+       amount->value_type != BSON_TYPE_INT64 &&
+       amount->value_type != BSON_TYPE_DOUBLE) {
+      bson_set_error (error,
+                      BSON_ERROR_PATCH,
+                      BSON_PATCH_ERROR_TYPE_MISMATCH,
+                      "Cannot increment \"%s\" by a non-numeric value",
+                      path);
+      return false;
+   }
+
+   if (!_bson_patch_check (patch, path, error)) {
+      return false;
+   }
+
+   node = _bson_patch_add (patch, path);
+   node->op = BSON_PATCH_OP_INC;
+   node->amount = *amount;
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_patch_rename --
+ *
+ *       Add an operation that renames the field at @path to @new_key in
+ *       the same document, keeping its position. A field that already
+ *       has the name @new_key is removed.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_patch_rename (bson_patch_t *patch, /* IN */
+                   const char *path,    /* IN */
+                   const char *new_key, /* IN */
+                   bson_error_t *error) /* OUT */
+{
+   bson_patch_node_t *node;
+   bson_patch_node_t *dest;
+   const char *last;
+   char *dest_path;
+   size_t len;
+
+   BSON_ASSERT (patch);
+   BSON_ASSERT (path);
+   BSON_ASSERT (new_key);
+
+   len = strlen (new_key);
+   if (len == 0 || len > INT32_MAX || strchr (new_key, '.')) {
+      bson_set_error (error,
+                      BSON_ERROR_PATCH,
+                      BSON_PATCH_ERROR_INVALID_PATH,
+                      "Invalid new name \"%s\" for \"%s\"",
+                      new_key,
+                      path);
+      return false;
+   }
+
+   /* the destination is a sibling of the source */
+   last = strrchr (path, '.');
+   if (last) {
+      dest_path = bson_strdup_printf (
+         "%.*s.%s", (int) (last - path), path, new_key);
+   } else {
+      dest_path = bson_strdup (new_key);
+   }
+
+   if (!strcmp (path, dest_path)) {
+      bson_set_error (error,
+                      BSON_ERROR_PATCH,
+                      BSON_PATCH_ERROR_CONFLICT,
+                      "Cannot rename \"%s\" to itself",
+                      path);
+      bson_free (dest_path);
+      return false;
+   }
+
+   if (!_bson_patch_check (patch, path, error) ||
+       !_bson_patch_check (patch, dest_path, error)) {
+      bson_free (dest_path);
+      return false;
+   }
+
+   node = _bson_patch_add (patch, path);
+   node->op = BSON_PATCH_OP_RENAME;
+   node->new_key = bson_strdup (new_key);
+   node->new_key_len = (uint32_t) len;
+
+   dest = _bson_patch_add (patch, dest_path);
+   dest->op = BSON_PATCH_OP_UNSET;
+   dest->rename_source = node;
+
+   bson_free (dest_path);
+
+   return true;
+}
+
+
+static bool
+_bson_patch_inc_value (const bson_value_t *current, /* IN */
+                       const bson_value_t *amount,  /* IN */
+                       bson_value_t *result)        /* OUT */
+{
+   int64_t a;
+   int64_t b;
+
+   if (current->value_type == BSON_TYPE_DOUBLE ||
+       amount->value_type == BSON_TYPE_DOUBLE) {
+      result->value_type = BSON_TYPE_DOUBLE;
+      result->value.v_double =
+         (current->value_type == BSON_TYPE_DOUBLE
+             ? current->value.v_double
+             : (current->value_type == BSON_TYPE_INT32
+                   ? (double) current->value.v_int32
+                   : (double) current->value.v_int64)) +
+         (amount->value_type == BSON_TYPE_DOUBLE
+             ? amount->value.v_double
+             : (amount->value_type == BSON_TYPE_INT32
+                   ? (double) amount->value.v_int32
+                   : (double) amount->value.v_int64));
+      return true;
+   }
+
+   a = current->value_type == BSON_TYPE_INT32 ? current->value.v_int32
+                                               : current->value.v_int64;
+   b = amount->value_type == BSON_TYPE_INT32 ? amount->value.v_int32
+                                              : amount->value.v_int64;
+
+   if ((b > 0 && a > INT64_MAX - b) || (b < 0 && a < INT64_MIN - b)) {
+      return false;
+   }
+
+   /* the sum of two int32s is promoted to int64 if it does not fit */
+   if (current->value_type == BSON_TYPE_INT32 &&
+       amount->value_type == BSON_TYPE_INT32 && a + b >= INT32_MIN &&
+       a + b <= INT32_MAX) {
+      result->value_type = BSON_TYPE_INT32;
+      result->value.v_int32 = (int32_t) (a + b);
+   } else {
+      result->value_type = BSON_TYPE_INT64;
+      result->value.v_int64 = a + b;
+   }
+
+   return true;
+}
+
+
+static uint32_t
+_bson_patch_number_size (bson_type_t type) /* IN */
+{
+   return type == BSON_TYPE_INT32 ? 4 : 8;
+}
+
+
+static bool
+_bson_patch_size_doc (bson_patch_node_t *parent,
+                      const uint8_t *data,
+                      uint32_t len,
+                      bool is_array,
+                      bson_error_t *error);
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_patch_size_node --
+ *
+ *       Compute node->out_len, the size of the element that replaces the
+ *       one @node matched, or that is appended if it matched none. The
+ *       element of a found node starts at @data + node->offset.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_patch_size_node (bson_patch_node_t *node, /* IN */
+                       const uint8_t *data,     /* IN */
+                       bool in_array,           /* IN */
+                       bson_error_t *error)     /* OUT */
+{
+   const uint8_t *value;
+   uint32_t header;
+   int32_t doc_len;
+
+   /* type, key and NUL */
+   header = 1 + node->key_len + 1;
+   node->keep = false;
+   node->out_len = 0;
+
+   if (in_array && !node->found &&
+       (node->op == BSON_PATCH_OP_SET || node->op == BSON_PATCH_OP_INC)) {
+      bson_set_error (error,
+                      BSON_ERROR_PATCH,
+                      BSON_PATCH_ERROR_TYPE_MISMATCH,
+                      "Cannot append element \"%s\" to an array",
+                      node->key);
+      return false;
+   }
+
+   switch (node->op) {
+   case BSON_PATCH_OP_SET:
+      node->out_len = header + node->value_len;
+      break;
+   case BSON_PATCH_OP_UNSET:
+      if (node->found && node->rename_source &&
+          !node->rename_source->found) {
+         /* the source of the rename does not exist, keep the destination */
+         node->keep = true;
+         node->out_len = node->len;
+      } else if (node->found && in_array) {
+         node->out_len = header;
+      }
+      break;
+   case BSON_PATCH_OP_INC:
+      if (!node->found) {
+         node->result = node->amount;
+      } else if (node->type != BSON_TYPE_INT32 &&
+                 node->type != BSON_TYPE_INT64 &&
+                 node->type != BSON_TYPE_DOUBLE) {
+         bson_set_error (error,
+                         BSON_ERROR_PATCH,
+                         BSON_PATCH_ERROR_TYPE_MISMATCH,
+                         "Cannot increment non-numeric field \"%s\"",
+                         node->key);
+         return false;
+      } else if (!_bson_patch_inc_value (
+                    &node->current, &node->amount, &node->result)) {
+         bson_set_error (error,
+                         BSON_ERROR_PATCH,
+                         BSON_PATCH_ERROR_OVERFLOW,
+                         "Incrementing \"%s\" overflows int64",
+                         node->key);
+         return false;
+      }
+      node->out_len =
+         header + _bson_patch_number_size (node->result.value_type);
+      break;
+   case BSON_PATCH_OP_RENAME:
+      if (node->found && in_array) {
+         bson_set_error (error,
+                         BSON_ERROR_PATCH,
+                         BSON_PATCH_ERROR_TYPE_MISMATCH,
+                         "Cannot rename array element \"%s\"",
+                         node->key);
+         return false;
+      }
+      if (node->found) {
+         node->out_len = node->len - node->key_len + node->new_key_len;
+      }
+      break;
+   case BSON_PATCH_OP_NONE:
+   default:
+      if (!node->found) {
+         if (!_bson_patch_size_doc (node, NULL, 0, false, error)) {
+            return false;
+         }
+         if (node->doc_len && in_array) {
+            bson_set_error (error,
+                            BSON_ERROR_PATCH,
+                            BSON_PATCH_ERROR_TYPE_MISMATCH,
+                            "Cannot append element \"%s\" to an array",
+                            node->key);
+            return false;
+         }
+         node->type = BSON_TYPE_DOCUMENT;
+      } else if (node->type == BSON_TYPE_DOCUMENT ||
+                 node->type == BSON_TYPE_ARRAY) {
+         value = data + node->offset + header;
+         memcpy (&doc_len, value, sizeof doc_len);
+         doc_len = BSON_UINT32_FROM_LE (doc_len);
+         if (!_bson_patch_size_doc (node,
+                                    value,
+                                    (uint32_t) doc_len,
+                                    node->type == BSON_TYPE_ARRAY,
+                                    error)) {
+            return false;
+         }
+      } else {
+         bson_set_error (error,
+                         BSON_ERROR_PATCH,
+                         BSON_PATCH_ERROR_TYPE_MISMATCH,
+                         "Cannot descend into \"%s\", it is not a document",
+                         node->key);
+         return false;
+      }
+
+      if (node->doc_len) {
+         node->out_len = header + node->doc_len;
+      }
+      break;
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_patch_size_doc --
+ *
+ *       Find the elements addressed by the children of @parent in the
+ *       document @data of @len bytes, or NULL if the document does not
+ *       exist, and compute parent->doc_len, the size of the patched
+ *       document. It is zero for a document that does not exist and that
+ *       no operation adds fields to.
+ *
+ *       This is the only pass over the source document, the elements
+ *       found are linked through next_found in document order so that
+ *       writing the result needs no further iteration.
+ *
+ * Returns:
+ *       true if successful; otherwise false and @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_patch_size_doc (bson_patch_node_t *parent, /* IN */
+                      const uint8_t *data,       /* IN */
+                      uint32_t len,              /* IN */
+                      bool is_array,             /* IN */
+                      bson_error_t *error)       /* OUT */
+{
+   bson_patch_node_t **last_found;
+   bson_patch_node_t *child;
+   uint32_t n_children = 0;
+   uint32_t n_found = 0;
+   bson_iter_t iter;
+   const char *key;
+   uint32_t key_len;
+   uint64_t doc_len;
+   bool adds = false;
+
+   for (child = parent->children; child; child = child->next) {
+      child->found = false;
+      child->next_found = NULL;
+      n_children++;
+   }
+
+   parent->first_found = NULL;
+   last_found = &parent->first_found;
+
+   if (data) {
+      if (!bson_iter_init_from_data (&iter, data, len)) {
+         goto corrupt;
+      }
+
+      while (n_found < n_children && bson_iter_next (&iter)) {
+         key = (const char *) iter.raw + iter.key;
+         key_len = _bson_iter_key_len (&iter);
+         child = _bson_patch_node_find (parent, key, key_len);
+
+         /* only the first of duplicate keys is patched */
+         if (!child || child->found) {
+            continue;
+         }
+
+         child->found = true;
+         child->type = bson_iter_type (&iter);
+         child->offset = iter.off;
+         child->len = iter.next_off - iter.off;
+         if (child->op == BSON_PATCH_OP_INC) {
+            child->current = *bson_iter_value (&iter);
+         }
+
+         *last_found = child;
+         last_found = &child->next_found;
+         n_found++;
+      }
+
+      if (iter.err_off) {
+         goto corrupt;
+      }
+   }
+
+   doc_len = data ? len : 5;
+
+   for (child = parent->children; child; child = child->next) {
+      if (!_bson_patch_size_node (child, data, is_array, error)) {
+         return false;
+      }
+
+      if (child->found) {
+         doc_len = doc_len - child->len + child->out_len;
+      } else if (child->out_len) {
+         doc_len += child->out_len;
+         adds = true;
+      }
+   }
+
+   if (doc_len > INT32_MAX) {
+      bson_set_error (error,
+                      BSON_ERROR_PATCH,
+                      BSON_PATCH_ERROR_OVERFLOW,
+                      "The patched document is too large");
+      return false;
+   }
+
+   parent->doc_len = (data || adds) ? doc_len : 0;
+
+   return true;
+
+corrupt:
+   bson_set_error (error,
+                   BSON_ERROR_PATCH,
+                   BSON_PATCH_ERROR_CORRUPT_BSON,
+                   "Cannot patch corrupt BSON");
+   return false;
+}
+
+
+static uint8_t *
+_bson_patch_write_doc (const bson_patch_node_t *parent,
+                       const uint8_t *data,
+                       uint32_t len,
+                       uint8_t *out);
+
+
+static uint8_t *
+_bson_patch_write_header (uint8_t *out,     /* IN */
+                          bson_type_t type, /* IN */
+                          const char *key,  /* IN */
+                          uint32_t key_len) /* IN */
+{
+   *out++ = (uint8_t) type;
+   memcpy (out, key, key_len);
+   out += key_len;
+   *out++ = '\0';
+
+   return out;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_patch_write_node --
+ *
+ *       Write the node->out_len bytes of the element that replaces the one
+ *       @node matched in @data, or that is appended if it matched none.
+ *
+ * Returns:
+ *       The end of the element written.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static uint8_t *
+_bson_patch_write_node (const bson_patch_node_t *node, /* IN */
+                        const uint8_t *data,           /* IN */
+                        uint8_t *out)                  /* IN */
+{
+   const uint8_t *value;
+   uint32_t header;
+   uint32_t u32;
+   uint64_t u64;
+   double d;
+   int32_t doc_len;
+
+   if (!node->out_len) {
+      return out;
+   }
+
+   if (node->keep) {
+      memcpy (out, data + node->offset, node->len);
+      return out + node->len;
+   }
+
+   header = 1 + node->key_len + 1;
+
+   switch (node->op) {
+   case BSON_PATCH_OP_SET:
+      out = _bson_patch_write_header (
+         out, node->value_type, node->key, node->key_len);
+      memcpy (out, node->value, node->value_len);
+      return out + node->value_len;
+   case BSON_PATCH_OP_UNSET:
+      /* an array element is replaced with null */
+      return _bson_patch_write_header (
+         out, BSON_TYPE_NULL, node->key, node->key_len);
+   case BSON_PATCH_OP_INC:
+      out = _bson_patch_write_header (
+         out, node->result.value_type, node->key, node->key_len);
+      if (node->result.value_type == BSON_TYPE_INT32) {
+         u32 = BSON_UINT32_TO_LE ((uint32_t) node->result.value.v_int32);
+         memcpy (out, &u32, sizeof u32);
+         return out + sizeof u32;
+      } else if (node->result.value_type == BSON_TYPE_INT64) {
+         u64 = BSON_UINT64_TO_LE ((uint64_t) node->result.value.v_int64);
+         memcpy (out, &u64, sizeof u64);
+         return out + sizeof u64;
+      }
+      d = BSON_DOUBLE_TO_LE (node->result.value.v_double);
+      memcpy (out, &d, sizeof d);
+      return out + sizeof d;
+   case BSON_PATCH_OP_RENAME:
+      out = _bson_patch_write_header (
+         out, node->type, node->new_key, node->new_key_len);
+      memcpy (out, data + node->offset + header, node->len - header);
+      return out + node->len - header;
+   case BSON_PATCH_OP_NONE:
+   default:
+      out = _bson_patch_write_header (
+         out, node->type, node->key, node->key_len);
+      if (!node->found) {
+         return _bson_patch_write_doc (node, NULL, 0, out);
+      }
+      value = data + node->offset + header;
+      memcpy (&doc_len, value, sizeof doc_len);
+      doc_len = BSON_UINT32_FROM_LE (doc_len);
+      return _bson_patch_write_doc (node, value, (uint32_t) doc_len, out);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_patch_write_doc --
+ *
+ *       Write the parent->doc_len bytes of the patched copy of @data. The
+ *       runs of elements between those that were found are copied as is.
+ *
+ * Returns:
+ *       The end of the document written.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static uint8_t *
+_bson_patch_write_doc (const bson_patch_node_t *parent, /* IN */
+                       const uint8_t *data,             /* IN */
+                       uint32_t len,                    /* IN */
+                       uint8_t *out)                    /* IN */
+{
+   const bson_patch_node_t *child;
+   uint32_t doc_len;
+   uint32_t pos = 4;
+
+   doc_len = BSON_UINT32_TO_LE ((uint32_t) parent->doc_len);
+   memcpy (out, &doc_len, sizeof doc_len);
+   out += sizeof doc_len;
+
+   if (data) {
+      for (child = parent->first_found; child; child = child->next_found) {
+         memcpy (out, data + pos, child->offset - pos);
+         out += child->offset - pos;
+         out = _bson_patch_write_node (child, data, out);
+         pos = child->offset + child->len;
+      }
+
+      /* the rest of the elements, not the trailing NUL */
+      memcpy (out, data + pos, len - 1 - pos);
+      out += len - 1 - pos;
+   }
+
+   for (child = parent->children; child; child = child->next) {
+      if (!child->found) {
+         out = _bson_patch_write_node (child, NULL, out);
+      }
+   }
+
+   *out++ = '\0';
+
+   return out;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_patch_apply --
+ *
+ *       Initialize @dst with a copy of @src to which the operations of
+ *       @patch have been applied. @src is iterated once and @dst is
+ *       allocated once, at the size of the result.
+ *
+ *       An operation on a field of an embedded document that does not
+ *       exist creates the document, unless the operation is an unset,
+ *       increment or rename that has nothing to do. An operation that
+ *       descends into a field that is neither a document nor an array
+ *       fails.
+ *
+ * Returns:
+ *       true if successful; otherwise false, @error is set and @dst is
+ *       initialized to an empty document.
+ *
+ * Side effects:
+ *       @dst is initialized and must be freed with bson_destroy().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_patch_apply (bson_patch_t *patch, /* IN */
+                  const bson_t *src,   /* IN */
+                  bson_t *dst,         /* OUT */
+                  bson_error_t *error) /* OUT */
+{
+   uint8_t *out;
+
+   BSON_ASSERT (patch);
+   BSON_ASSERT (src);
+   BSON_ASSERT (dst);
+
+   if (!_bson_patch_size_doc (
+          &patch->root, bson_get_data (src), src->len, false, error)) {
+      bson_init (dst);
+      return false;
+   }
+
+   out = _bson_init_with_len (dst, (uint32_t) patch->root.doc_len);
+   _bson_patch_write_doc (&patch->root, bson_get_data (src), src->len, out);
+
+   return true;
+}
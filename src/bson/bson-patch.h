@@ -0,0 +1,88 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_PATCH_H
+#define BSON_PATCH_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-macros.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+typedef enum {
+   BSON_PATCH_ERROR_INVALID_PATH = 1,
+   BSON_PATCH_ERROR_CONFLICT,
+   BSON_PATCH_ERROR_TYPE_MISMATCH,
+   BSON_PATCH_ERROR_OVERFLOW,
+   BSON_PATCH_ERROR_CORRUPT_BSON,
+} bson_patch_error_code_t;
+
+
+/**
+ * bson_patch_t:
+ *
+ * A bson_patch_t is a batch of set, unset, increment and rename operations
+ * on the fields of a document, addressed by dotted paths. Applying it to a
+ * document walks the source once and writes the patched copy into a single
+ * allocation of exactly the right size.
+ *
+ * A bson_patch_t is not thread-safe, it may only be applied to one
+ * document at a time.
+ */
+typedef struct _bson_patch_t bson_patch_t;
+
+
+BSON_EXPORT (bson_patch_t *)
+bson_patch_new (void);
+BSON_EXPORT (void)
+bson_patch_destroy (bson_patch_t *patch);
+BSON_EXPORT (bool)
+bson_patch_set (bson_patch_t *patch,
+                const char *path,
+                const bson_value_t *value,
+                bson_error_t *error);
+BSON_EXPORT (bool)
+bson_patch_unset (bson_patch_t *patch, const char *path, bson_error_t *error);
+BSON_EXPORT (bool)
+bson_patch_inc (bson_patch_t *patch,
+                const char *path,
+                const bson_value_t *amount,
+                bson_error_t *error);
+BSON_EXPORT (bool)
+bson_patch_rename (bson_patch_t *patch,
+                   const char *path,
+                   const char *new_key,
+                   bson_error_t *error);
+BSON_EXPORT (bool)
+bson_patch_apply (bson_patch_t *patch,
+                  const bson_t *src,
+                  bson_t *dst,
+                  bson_error_t *error);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_PATCH_H */
@@ -0,0 +1,45 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_PATH_PRIVATE_H
+#define BSON_PATH_PRIVATE_H
+
+
+#include "bson-path.h"
+
+
+BSON_BEGIN_DECLS
+
+
+typedef struct {
+   const char *key; /* NUL-terminated, points into the path's buffer */
+   uint32_t key_len;
+   uint32_t hash; /* _bson_hash_key() of the key, for bson_index_t lookups */
+} bson_path_segment_t;
+
+
+struct _bson_path_t {
+   bson_path_segment_t *segments;
+   uint32_t n_segments;
+   char *buf;
+};
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_PATH_PRIVATE_H */
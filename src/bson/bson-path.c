@@ -0,0 +1,168 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson.h"
+#include "bson-hash-private.h"
+#include "bson-path-private.h"
+#include "bson-private.h"
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_path_new --
+ *
+ *       Compile the dotted path @dotkey, such as "a.b.0". The path is
+ *       split at each dot like the dotkey of bson_iter_find_descendant(),
+ *       so numeric segments select array elements by their keys.
+ *
+ * Returns:
+ *       A newly allocated bson_path_t that should be freed with
+ *       bson_path_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_path_t *
+bson_path_new (const char *dotkey) /* IN */
+{
+   bson_path_segment_t *segment;
+   bson_path_t *path;
+   char *key;
+   char *dot;
+   size_t len;
+   uint32_t n = 1;
+
+   BSON_ASSERT (dotkey);
+
+   len = strlen (dotkey);
+   BSON_ASSERT (len < UINT32_MAX);
+
+   for (dot = strchr (dotkey, '.'); dot; dot = strchr (dot + 1, '.')) {
+      n++;
+   }
+
+   path = bson_malloc0 (sizeof *path);
+   path->segments = bson_malloc (n * sizeof *path->segments);
+   path->n_segments = n;
+   path->buf = bson_malloc (len + 1);
+   memcpy (path->buf, dotkey, len + 1);
+
+   /* terminate each segment in place so it can be used as a C string */
+   for (key = path->buf, segment = path->segments;; key = dot + 1) {
+      dot = strchr (key, '.');
+      if (dot) {
+         *dot = '\0';
+      }
+
+      segment->key = key;
+      segment->key_len = (uint32_t) (dot ? dot - key : strlen (key));
+      segment->hash = _bson_hash_key (key, segment->key_len);
+      segment++;
+
+      if (!dot) {
+         break;
+      }
+   }
+
+   return path;
+}
+
+
+void
+bson_path_destroy (bson_path_t *path) /* IN */
+{
+   if (path) {
+      bson_free (path->segments);
+      bson_free (path->buf);
+      bson_free (path);
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_iter_find_path --
+ *
+ *       Locates the descendant of @iter named by @path, like
+ *       bson_iter_find_descendant(). Keys are compared by length before
+ *       their bytes, and the path is not parsed again. The hashes of the
+ *       segments are not used: hashing each key of the document would cost
+ *       more than the comparisons they save.
+ *
+ * Returns:
+ *       true if the descendant was found and @descendant was initialized.
+ *
+ * Side effects:
+ *       @iter is advanced. @descendant may be initialized.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_iter_find_path (bson_iter_t *iter,       /* INOUT */
+                     const bson_path_t *path, /* IN */
+                     bson_iter_t *descendant) /* OUT */
+{
+   const bson_path_segment_t *segment;
+   const bson_path_segment_t *end;
+   bson_iter_t child;
+   bson_iter_t tmp;
+
+   BSON_ASSERT (iter);
+   BSON_ASSERT (path);
+   BSON_ASSERT (descendant);
+
+   segment = path->segments;
+   end = segment + path->n_segments;
+
+   for (;;) {
+      if (!segment->key_len) {
+         return false;
+      }
+
+      for (;;) {
+         if (!bson_iter_next (iter)) {
+            return false;
+         }
+
+         if (_bson_iter_key_len (iter) == segment->key_len &&
+             !memcmp (iter->raw + iter->key, segment->key, segment->key_len)) {
+            break;
+         }
+      }
+
+      if (++segment == end) {
+         *descendant = *iter;
+         return true;
+      }
+
+      if (!(BSON_ITER_HOLDS_DOCUMENT (iter) || BSON_ITER_HOLDS_ARRAY (iter)) ||
+          !bson_iter_recurse (iter, &tmp)) {
+         return false;
+      }
+
+      child = tmp;
+      iter = &child;
+   }
+}
@@ -0,0 +1,62 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_PATH_H
+#define BSON_PATH_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-iter.h"
+#include "bson-macros.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/**
+ * bson_path_t:
+ *
+ * A bson_path_t is a dotted path such as "a.b.0", split into its segments
+ * once, so that it can be looked up in many documents without parsing the
+ * string again. bson_iter_find_path() compares each segment's length before
+ * its bytes; bson_index_iter_find_path() also uses the segment's hash, which
+ * is computed once here, to probe the index's hash table.
+ *
+ * A bson_path_t is immutable, it may be used from several threads.
+ */
+typedef struct _bson_path_t bson_path_t;
+
+
+BSON_EXPORT (bson_path_t *)
+bson_path_new (const char *dotkey);
+BSON_EXPORT (void)
+bson_path_destroy (bson_path_t *path);
+BSON_EXPORT (bool)
+bson_iter_find_path (bson_iter_t *iter,
+                     const bson_path_t *path,
+                     bson_iter_t *descendant);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_PATH_H */
@@ -51,9 +51,16 @@ typedef enum {
    BSON_FLAG_CHILD = (1 << 3),
    BSON_FLAG_IN_CHILD = (1 << 4),
    BSON_FLAG_NO_FREE = (1 << 5),
+   BSON_FLAG_GROW_ONE_AND_HALF = (1 << 6),
+   BSON_FLAG_GROW_EXACT = (1 << 7),
 } bson_flags_t;
 
 
+/* the bits of bson_flags_t that hold the bson_growth_policy_t */
+#define BSON_FLAG_GROWTH_MASK \
+   (BSON_FLAG_GROW_ONE_AND_HALF | BSON_FLAG_GROW_EXACT)
+
+
 #define BSON_INLINE_DATA_SIZE 120
 
 BSON_ALIGNED_BEGIN (128)
@@ -73,6 +80,7 @@ typedef struct {
    uint32_t len;              /* length of bson document in bytes */
    bson_t *parent;            /* parent bson if a child */
    uint32_t depth;            /* Subdocument depth. */
+   uint32_t regrows;          /* times the buffer was grown */
    uint8_t **buf;             /* pointer to buffer pointer */
    size_t *buflen;            /* pointer to buffer length */
    size_t offset;             /* our offset inside *buf  */
@@ -88,6 +96,28 @@ BSON_STATIC_ASSERT2 (impl_alloc_t, sizeof (bson_impl_alloc_t) <= 128);
 
 #define BSON_REGEX_OPTIONS_SORTED "ilmsux"
 
+
+/*
+ * The length of the key of the current element of @iter. Types without
+ * data, such as null, leave d1 unset, their key ends before next_off.
+ */
+static BSON_INLINE uint32_t
+_bson_iter_key_len (const bson_iter_t *iter) /* IN */
+{
+   if (iter->d1 == (uint32_t) -1) {
+      return iter->next_off - iter->key - 1;
+   }
+
+   return iter->d1 - iter->key - 1;
+}
+
+
+uint8_t *
+_bson_init_with_len (bson_t *bson, uint32_t len);
+
+uint8_t *
+_bson_append_raw (bson_t *bson, uint32_t n_bytes);
+
 BSON_END_DECLS
 
 
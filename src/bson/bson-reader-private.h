@@ -0,0 +1,35 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_READER_PRIVATE_H
+#define BSON_READER_PRIVATE_H
+
+
+#include "bson-reader.h"
+
+
+BSON_BEGIN_DECLS
+
+
+const uint8_t *
+_bson_reader_get_data (bson_reader_t *reader, size_t *length);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_READER_PRIVATE_H */
@@ -26,17 +26,61 @@
 #include <string.h>
 #include <sys/stat.h>
 #include <sys/types.h>
+#ifdef BSON_OS_UNIX
+#include <poll.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
 
 #include "bson-reader.h"
+#include "bson-reader-private.h"
 #include "bson-memory.h"
+#include "bson-thread-private.h"
+
+
+#define BSON_READER_PREFETCH_BUFFER_SIZE (1024 * 1024)
+#define BSON_READER_PREFETCH_QUEUE_DEPTH 2
 
 
 typedef enum {
    BSON_READER_HANDLE = 1,
    BSON_READER_DATA = 2,
+   BSON_READER_MMAP = 3,
 } bson_reader_type_t;
 
 
+/*
+ * A ring of buffers that a background thread fills from the handle of a
+ * reader while it parses the data already read. The thread owns the
+ * slots after the @n_ready filled ones, the reader owns the filled slots.
+ */
+typedef struct {
+   bson_mutex_t mutex;
+   bson_cond_t cond;
+   bson_thread_t thread;
+   void *handle;
+   bson_reader_read_func_t read_func;
+#ifdef BSON_OS_UNIX
+   /* for readers of a file descriptor, the thread waits until @fd is
+    * readable or a byte is written to @wake[1] by
+    * _bson_reader_prefetch_destroy(), so that a stalled pipe or socket
+    * does not block the reader's destruction */
+   int fd;
+   int wake[2];
+#endif
+   uint8_t **bufs;
+   size_t *lens;
+   size_t buffer_size;
+   uint32_t queue_depth;
+   uint32_t head;
+   uint32_t n_ready;
+   size_t head_offset;
+   bool done;
+   bool failed;
+   bool stop;
+} bson_reader_prefetch_t;
+
+
 typedef struct {
    bson_reader_type_t type;
    void *handle;
@@ -50,6 +94,15 @@ typedef struct {
    uint8_t *data;
    bson_reader_read_func_t read_func;
    bson_reader_destroy_func_t destroy_func;
+   bson_reader_prefetch_t *prefetch;
+
+   /* the buffer does not grow past max_len, if set */
+   size_t max_len;
+
+   /* documents read into their own allocation, see
+    * bson_reader_set_buffer_policy() */
+   size_t large_threshold;
+   uint8_t *large;
 } bson_reader_handle_t;
 
 
@@ -68,6 +121,259 @@ typedef struct {
 } bson_reader_data_t;
 
 
+typedef struct {
+   bson_reader_data_t data; /* data.type is BSON_READER_MMAP */
+   void *map;
+   size_t map_len;
+#ifdef BSON_OS_WIN32
+   HANDLE mapping;
+#endif
+} bson_reader_mmap_t;
+
+
+#ifdef BSON_OS_UNIX
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_reader_prefetch_wait --
+ *
+ *       Wait until the file descriptor of the prefetch thread can be read
+ *       without blocking, or the reader is being destroyed.
+ *
+ * Returns:
+ *       false if the reader is being destroyed, otherwise true.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_reader_prefetch_wait (bson_reader_prefetch_t *prefetch) /* IN */
+{
+   struct pollfd fds[2];
+
+   if (prefetch->fd == -1) {
+      return true;
+   }
+
+   fds[0].fd = prefetch->fd;
+   fds[0].events = POLLIN;
+   fds[1].fd = prefetch->wake[0];
+   fds[1].events = POLLIN;
+
+   for (;;) {
+      fds[0].revents = 0;
+      fds[1].revents = 0;
+
+      if (poll (fds, 2, -1) == -1) {
+         if (errno == EINTR) {
+            continue;
+         }
+
+         /* let the read report the error */
+         return true;
+      }
+
+      if (fds[1].revents) {
+         return false;
+      }
+
+      if (fds[0].revents) {
+         return true;
+      }
+   }
+}
+#endif
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_reader_prefetch_thread --
+ *
+ *       Fill the free slots of the prefetch ring from the handle, in
+ *       order, until the end of the stream, a read failure, or the reader
+ *       is destroyed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void *
+_bson_reader_prefetch_thread (void *data) /* IN */
+{
+   bson_reader_prefetch_t *prefetch = data;
+   uint32_t slot;
+   ssize_t ret;
+
+   for (;;) {
+      bson_mutex_lock (&prefetch->mutex);
+      while (prefetch->n_ready == prefetch->queue_depth && !prefetch->stop) {
+         bson_cond_wait (&prefetch->cond, &prefetch->mutex);
+      }
+
+      if (prefetch->stop) {
+         bson_mutex_unlock (&prefetch->mutex);
+         break;
+      }
+
+      slot = (prefetch->head + prefetch->n_ready) % prefetch->queue_depth;
+      bson_mutex_unlock (&prefetch->mutex);
+
+#ifdef BSON_OS_UNIX
+      if (!_bson_reader_prefetch_wait (prefetch)) {
+         break;
+      }
+#endif
+
+      ret = prefetch->read_func (
+         prefetch->handle, prefetch->bufs[slot], prefetch->buffer_size);
+
+      bson_mutex_lock (&prefetch->mutex);
+      if (ret <= 0) {
+         prefetch->done = true;
+         prefetch->failed = (ret < 0);
+      } else {
+         prefetch->lens[slot] = (size_t) ret;
+         prefetch->n_ready++;
+      }
+
+      bson_cond_broadcast (&prefetch->cond);
+      bson_mutex_unlock (&prefetch->mutex);
+
+      if (ret <= 0) {
+         break;
+      }
+   }
+
+   return NULL;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_reader_prefetch_read --
+ *
+ *       Copy up to @len bytes of prefetched data into @buf, waiting only
+ *       if none is ready. Like a bson_reader_read_func_t.
+ *
+ * Returns:
+ *       -1 for read failure, 0 for end of stream, otherwise the number of
+ *       bytes copied.
+ *
+ * Side effects:
+ *       The slots that were copied entirely are handed back to the thread.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static ssize_t
+_bson_reader_prefetch_read (bson_reader_prefetch_t *prefetch, /* IN */
+                            uint8_t *buf,                     /* OUT */
+                            size_t len)                       /* IN */
+{
+   uint32_t n_ready;
+   size_t copied = 0;
+   size_t n;
+
+   bson_mutex_lock (&prefetch->mutex);
+   while (!prefetch->n_ready && !prefetch->done) {
+      bson_cond_wait (&prefetch->cond, &prefetch->mutex);
+   }
+
+   n_ready = prefetch->n_ready;
+   if (!n_ready) {
+      bson_mutex_unlock (&prefetch->mutex);
+      return prefetch->failed ? -1 : 0;
+   }
+
+   bson_mutex_unlock (&prefetch->mutex);
+
+   /* the ready slots belong to the reader, copy them without the lock */
+   while (copied < len && n_ready) {
+      n = BSON_MIN (len - copied,
+                    prefetch->lens[prefetch->head] - prefetch->head_offset);
+      memcpy (buf + copied,
+              prefetch->bufs[prefetch->head] + prefetch->head_offset,
+              n);
+      copied += n;
+      prefetch->head_offset += n;
+
+      if (prefetch->head_offset == prefetch->lens[prefetch->head]) {
+         bson_mutex_lock (&prefetch->mutex);
+         prefetch->head = (prefetch->head + 1) % prefetch->queue_depth;
+         prefetch->n_ready--;
+         prefetch->head_offset = 0;
+         bson_cond_broadcast (&prefetch->cond);
+         bson_mutex_unlock (&prefetch->mutex);
+         n_ready--;
+      }
+   }
+
+   return (ssize_t) copied;
+}
+
+
+static void
+_bson_reader_prefetch_free (bson_reader_prefetch_t *prefetch) /* IN */
+{
+   uint32_t i;
+
+   for (i = 0; i < prefetch->queue_depth; i++) {
+      bson_free (prefetch->bufs[i]);
+   }
+
+   bson_free (prefetch->bufs);
+   bson_free (prefetch->lens);
+#ifdef BSON_OS_UNIX
+   if (prefetch->wake[0] != -1) {
+      close (prefetch->wake[0]);
+      close (prefetch->wake[1]);
+   }
+#endif
+   bson_cond_destroy (&prefetch->cond);
+   bson_mutex_destroy (&prefetch->mutex);
+   bson_free (prefetch);
+}
+
+
+static void
+_bson_reader_prefetch_destroy (bson_reader_prefetch_t *prefetch) /* IN */
+{
+#ifdef BSON_OS_UNIX
+   const uint8_t wake = 0;
+#endif
+
+   bson_mutex_lock (&prefetch->mutex);
+   prefetch->stop = true;
+   bson_cond_broadcast (&prefetch->cond);
+   bson_mutex_unlock (&prefetch->mutex);
+
+#ifdef BSON_OS_UNIX
+   /* interrupt a wait for a stalled pipe or socket */
+   if (prefetch->wake[1] != -1) {
+      while (write (prefetch->wake[1], &wake, 1) == -1 && errno == EINTR) {
+      }
+   }
+#endif
+
+   bson_thread_join (prefetch->thread);
+   _bson_reader_prefetch_free (prefetch);
+}
+
+
+static ssize_t
+_bson_reader_handle_read_func (bson_reader_handle_t *reader, /* IN */
+                               uint8_t *buf,                 /* OUT */
+                               size_t len)                   /* IN */
+{
+   if (reader->prefetch) {
+      return _bson_reader_prefetch_read (reader->prefetch, buf, len);
+   }
+
+   return reader->read_func (reader->handle, buf, len);
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -95,7 +401,8 @@ _bson_reader_handle_fill_buffer (bson_reader_handle_t *reader) /* IN */
     * Handle first read specially.
     */
    if ((!reader->done) && (!reader->offset) && (!reader->end)) {
-      ret = reader->read_func (reader->handle, &reader->data[0], reader->len);
+      ret = _bson_reader_handle_read_func (
+         reader, &reader->data[0], reader->len);
 
       if (ret <= 0) {
          reader->done = true;
@@ -119,8 +426,8 @@ _bson_reader_handle_fill_buffer (bson_reader_handle_t *reader) /* IN */
    /*
     * Read in data to fill the buffer.
     */
-   ret = reader->read_func (
-      reader->handle, &reader->data[reader->end], reader->len - reader->end);
+   ret = _bson_reader_handle_read_func (
+      reader, &reader->data[reader->end], reader->len - reader->end);
 
    if (ret <= 0) {
       reader->done = true;
@@ -340,6 +647,8 @@ bson_reader_set_read_func (bson_reader_t *reader,        /* IN */
    bson_reader_handle_t *real = (bson_reader_handle_t *) reader;
 
    BSON_ASSERT (reader->type == BSON_READER_HANDLE);
+   /* the prefetch thread calls the read function it was started with */
+   BSON_ASSERT (!real->prefetch);
 
    real->read_func = func;
 }
@@ -376,12 +685,184 @@ bson_reader_set_destroy_func (bson_reader_t *reader,           /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_reader_set_prefetch --
+ *
+ *       Start a background thread that reads ahead from the handle of
+ *       @reader into @queue_depth buffers of @buffer_size bytes each,
+ *       while the documents already read are parsed. Zero selects the
+ *       default of two buffers of 1 MiB.
+ *
+ *       The read function is called from the background thread from then
+ *       on, and must not be changed. bson_reader_destroy() waits for a
+ *       read in progress to return, except for readers of a file
+ *       descriptor on POSIX systems, whose thread only reads once the
+ *       descriptor is readable and is woken up by bson_reader_destroy().
+ *       On Windows, readers of a file descriptor that is not a regular
+ *       file are not prefetched.
+ *
+ * Returns:
+ *       true if successful, false if prefetching is already enabled, is
+ *       not supported for the file descriptor, or the thread could not be
+ *       started. No thread is started if the end of the stream has
+ *       already been reached.
+ *
+ * Side effects:
+ *       The buffer of @reader is grown to @buffer_size bytes.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_reader_set_prefetch (bson_reader_t *reader, /* IN */
+                          size_t buffer_size,    /* IN */
+                          uint32_t queue_depth)  /* IN */
+{
+   bson_reader_handle_t *real = (bson_reader_handle_t *) reader;
+   bson_reader_prefetch_t *prefetch;
+   uint32_t i;
+
+   BSON_ASSERT (reader);
+   BSON_ASSERT (reader->type == BSON_READER_HANDLE);
+
+   if (real->prefetch) {
+      return false;
+   }
+
+   /* the stream has already been read to its end */
+   if (real->done) {
+      return true;
+   }
+
+   if (!buffer_size) {
+      buffer_size = BSON_READER_PREFETCH_BUFFER_SIZE;
+   }
+
+   if (!queue_depth) {
+      queue_depth = BSON_READER_PREFETCH_QUEUE_DEPTH;
+   }
+
+#ifdef BSON_OS_WIN32
+   /* a read of a pipe could not be interrupted by bson_reader_destroy() */
+   if (real->read_func == _bson_reader_handle_fd_read) {
+      struct _stat st;
+      bson_reader_handle_fd_t *fd = real->handle;
+
+      if (_fstat (fd->fd, &st) || !(st.st_mode & _S_IFREG)) {
+         return false;
+      }
+   }
+#endif
+
+   prefetch = bson_malloc0 (sizeof *prefetch);
+   bson_mutex_init (&prefetch->mutex);
+   bson_cond_init (&prefetch->cond);
+   prefetch->handle = real->handle;
+   prefetch->read_func = real->read_func;
+#ifdef BSON_OS_UNIX
+   prefetch->fd = -1;
+   prefetch->wake[0] = -1;
+   prefetch->wake[1] = -1;
+
+   if (real->read_func == _bson_reader_handle_fd_read) {
+      if (pipe (prefetch->wake)) {
+         prefetch->wake[0] = -1;
+         prefetch->wake[1] = -1;
+         bson_cond_destroy (&prefetch->cond);
+         bson_mutex_destroy (&prefetch->mutex);
+         bson_free (prefetch);
+         return false;
+      }
+
+      prefetch->fd = ((bson_reader_handle_fd_t *) real->handle)->fd;
+   }
+#endif
+   prefetch->buffer_size = buffer_size;
+   prefetch->queue_depth = queue_depth;
+   prefetch->bufs = bson_malloc (queue_depth * sizeof (uint8_t *));
+   prefetch->lens = bson_malloc0 (queue_depth * sizeof (size_t));
+   for (i = 0; i < queue_depth; i++) {
+      prefetch->bufs[i] = bson_malloc (buffer_size);
+   }
+
+   if (bson_thread_create (
+          &prefetch->thread, _bson_reader_prefetch_thread, prefetch)) {
+      _bson_reader_prefetch_free (prefetch);
+      return false;
+   }
+
+   real->prefetch = prefetch;
+
+   if (real->len < buffer_size) {
+      real->data = bson_realloc (real->data, buffer_size);
+      real->len = buffer_size;
+   }
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_reader_set_buffer_policy --
+ *
+ *       Set how the buffer of @reader is sized. The buffer is grown to
+ *       @initial_size bytes now, which is best done before the first
+ *       document is read. Later it grows to fit larger documents, up to
+ *       @max_size bytes if that is not zero.
+ *
+ *       A document that does not fit in @max_size bytes, or that is at
+ *       least @large_read_threshold bytes if that is not zero, is not
+ *       read into the buffer unless it is there already. It is read into
+ *       an allocation of its own, of exactly its size, which is freed by
+ *       the next read.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_reader_set_buffer_policy (bson_reader_t *reader,       /* IN */
+                               size_t initial_size,         /* IN */
+                               size_t max_size,             /* IN */
+                               size_t large_read_threshold) /* IN */
+{
+   bson_reader_handle_t *real = (bson_reader_handle_t *) reader;
+
+   BSON_ASSERT (reader);
+   BSON_ASSERT (reader->type == BSON_READER_HANDLE);
+
+   real->max_len = max_size;
+   real->large_threshold = large_read_threshold;
+
+   if (max_size) {
+      initial_size = BSON_MIN (initial_size, max_size);
+   }
+
+   if (initial_size > real->len) {
+      real->data = bson_realloc (real->data, initial_size);
+      real->len = initial_size;
+   }
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
  * _bson_reader_handle_grow_buffer --
  *
- *       Grow the buffer to the next power of two.
+ *       Grow the buffer towards the next power of two that holds @size
+ *       bytes, at most doubling it, and not past the maximum buffer size.
+ *       @size comes from a length prefix that is not validated yet, so the
+ *       buffer only grows as fast as the data read into it.
  *
  * Returns:
  *       None.
@@ -393,16 +874,81 @@ bson_reader_set_destroy_func (bson_reader_t *reader,           /* IN */
  */
 
 static void
-_bson_reader_handle_grow_buffer (bson_reader_handle_t *reader) /* IN */
+_bson_reader_handle_grow_buffer (bson_reader_handle_t *reader, /* IN */
+                                 size_t size)                  /* IN */
 {
-   size_t size;
+   size = BSON_MIN (bson_next_power_of_two (size), reader->len * 2);
+   if (reader->max_len) {
+      size = BSON_MIN (size, BSON_MAX (reader->max_len, reader->len));
+   }
 
-   size = reader->len * 2;
    reader->data = bson_realloc (reader->data, size);
    reader->len = size;
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_reader_handle_read_large --
+ *
+ *       Read the document of @blen bytes at the reader's offset into an
+ *       allocation of its own. The part already in the buffer is copied,
+ *       the rest is read from the handle directly into the allocation.
+ *       Like the buffer, the allocation at most doubles per read, so that
+ *       a corrupt @blen in a short stream does not allocate it all.
+ *
+ * Returns:
+ *       The document, or NULL if the stream ended or could not be read.
+ *
+ * Side effects:
+ *       The buffer is emptied.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static const bson_t *
+_bson_reader_handle_read_large (bson_reader_handle_t *reader, /* IN */
+                                int32_t blen)                 /* IN */
+{
+   size_t alloc;
+   size_t got;
+   ssize_t ret;
+
+   got = reader->end - reader->offset;
+   alloc = BSON_MIN ((size_t) blen, BSON_MAX (got, reader->len) * 2);
+   reader->large = bson_malloc (alloc);
+   memcpy (reader->large, &reader->data[reader->offset], got);
+   reader->offset = reader->end;
+
+   while (got < (size_t) blen) {
+      if (got == alloc) {
+         alloc = BSON_MIN ((size_t) blen, alloc * 2);
+         reader->large = bson_realloc (reader->large, alloc);
+      }
+
+      ret = _bson_reader_handle_read_func (
+         reader, reader->large + got, alloc - got);
+
+      if (ret <= 0) {
+         reader->done = true;
+         reader->failed = (ret < 0);
+         return NULL;
+      }
+
+      reader->bytes_read += ret;
+      got += ret;
+   }
+
+   if (!bson_init_static (
+          &reader->inline_bson, reader->large, (uint32_t) blen)) {
+      return NULL;
+   }
+
+   return &reader->inline_bson;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -456,12 +1002,17 @@ static const bson_t *
 _bson_reader_handle_read (bson_reader_handle_t *reader, /* IN */
                           bool *reached_eof)            /* IN */
 {
+   const bson_t *doc;
    int32_t blen;
 
    if (reached_eof) {
       *reached_eof = false;
    }
 
+   /* the previous document may have had its own allocation */
+   bson_free (reader->large);
+   reader->large = NULL;
+
    while (!reader->done) {
       if ((reader->end - reader->offset) < 4) {
          _bson_reader_handle_fill_buffer (reader);
@@ -476,8 +1027,22 @@ _bson_reader_handle_read (bson_reader_handle_t *reader, /* IN */
       }
 
       if (blen > (int32_t) (reader->end - reader->offset)) {
-         if (blen > (int32_t) reader->len) {
-            _bson_reader_handle_grow_buffer (reader);
+         if ((reader->large_threshold &&
+              (size_t) blen >= reader->large_threshold) ||
+             (reader->max_len && (size_t) blen > reader->max_len &&
+              (size_t) blen > reader->len)) {
+            doc = _bson_reader_handle_read_large (reader, blen);
+            if (!doc && reached_eof) {
+               *reached_eof = reader->done && !reader->failed;
+            }
+
+            return doc;
+         }
+
+         /* grow only once the buffer is full of the document */
+         if (blen > (int32_t) reader->len &&
+             reader->end - reader->offset == reader->len) {
+            _bson_reader_handle_grow_buffer (reader, (size_t) blen);
          }
 
          _bson_reader_handle_fill_buffer (reader);
@@ -503,6 +1068,102 @@ _bson_reader_handle_read (bson_reader_handle_t *reader, /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_reader_handle_read_buffered --
+ *
+ *       Return the next document if it is entirely in the buffer, without
+ *       reading from the underlying handle, so that documents returned
+ *       before it stay in place.
+ *
+ * Returns:
+ *       true if @doc was initialized, false if the next document is not
+ *       buffered or is corrupt.
+ *
+ * Side effects:
+ *       @doc is initialized to point into the buffer.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_reader_handle_read_buffered (bson_reader_handle_t *reader, /* IN */
+                                   bson_t *doc)                  /* OUT */
+{
+   int32_t blen;
+
+   if ((reader->end - reader->offset) < 4) {
+      return false;
+   }
+
+   memcpy (&blen, &reader->data[reader->offset], sizeof blen);
+   blen = BSON_UINT32_FROM_LE (blen);
+
+   if (blen < 5 || blen > (int32_t) (reader->end - reader->offset)) {
+      return false;
+   }
+
+   if (!bson_init_static (
+          doc, &reader->data[reader->offset], (uint32_t) blen)) {
+      return false;
+   }
+
+   reader->offset += blen;
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_reader_handle_read_batch --
+ *
+ *       Read up to @max_docs documents, reading from the underlying handle
+ *       only for the first one. The buffer is refilled once the documents
+ *       in it have all been returned, so each batch is up to a buffer's
+ *       worth of documents.
+ *
+ * Returns:
+ *       false on failure, otherwise true.
+ *
+ * Side effects:
+ *       @docs and @n_docs are set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_reader_handle_read_batch (bson_reader_handle_t *reader, /* IN */
+                                bson_t *docs,                 /* OUT */
+                                size_t max_docs,              /* IN */
+                                size_t *n_docs)               /* OUT */
+{
+   const bson_t *doc;
+   bool reached_eof;
+   size_t n = 0;
+
+   doc = _bson_reader_handle_read (reader, &reached_eof);
+   if (!doc) {
+      *n_docs = 0;
+      return reached_eof;
+   }
+
+   /* a bson_t initialized by bson_init_static refers to itself */
+   bson_init_static (&docs[n++], bson_get_data (doc), doc->len);
+
+   while (n < max_docs &&
+          _bson_reader_handle_read_buffered (reader, &docs[n])) {
+      n++;
+   }
+
+   *n_docs = n;
+
+   return true;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -601,6 +1262,54 @@ _bson_reader_data_read (bson_reader_data_t *reader, /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_reader_data_read_batch --
+ *
+ *       Read up to @max_docs documents from the underlying buffer. A
+ *       corrupt document after the first ends the batch and is reported
+ *       by the next call.
+ *
+ * Returns:
+ *       false on failure, otherwise true.
+ *
+ * Side effects:
+ *       @docs and @n_docs are set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_reader_data_read_batch (bson_reader_data_t *reader, /* IN */
+                              bson_t *docs,               /* OUT */
+                              size_t max_docs,            /* IN */
+                              size_t *n_docs)             /* OUT */
+{
+   const bson_t *doc;
+   bool reached_eof;
+   size_t n = 0;
+
+   while (n < max_docs) {
+      doc = _bson_reader_data_read (reader, &reached_eof);
+      if (!doc) {
+         if (!n && !reached_eof) {
+            *n_docs = 0;
+            return false;
+         }
+
+         break;
+      }
+
+      bson_init_static (&docs[n++], bson_get_data (doc), doc->len);
+   }
+
+   *n_docs = n;
+
+   return true;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -652,14 +1361,32 @@ bson_reader_destroy (bson_reader_t *reader) /* IN */
    case BSON_READER_HANDLE: {
       bson_reader_handle_t *handle = (bson_reader_handle_t *) reader;
 
+      /* stop the thread before the handle it reads from is destroyed */
+      if (handle->prefetch) {
+         _bson_reader_prefetch_destroy (handle->prefetch);
+      }
+
       if (handle->destroy_func) {
          handle->destroy_func (handle->handle);
       }
 
       bson_free (handle->data);
+      bson_free (handle->large);
    } break;
    case BSON_READER_DATA:
       break;
+   case BSON_READER_MMAP: {
+      bson_reader_mmap_t *mmap_reader = (bson_reader_mmap_t *) reader;
+
+      if (mmap_reader->map) {
+#ifdef BSON_OS_WIN32
+         UnmapViewOfFile (mmap_reader->map);
+         CloseHandle (mmap_reader->mapping);
+#else
+         munmap (mmap_reader->map, mmap_reader->map_len);
+#endif
+      }
+   } break;
    default:
       fprintf (stderr, "No such reader type: %02x\n", reader->type);
       break;
@@ -711,6 +1438,7 @@ bson_reader_read (bson_reader_t *reader, /* IN */
                                        reached_eof);
 
    case BSON_READER_DATA:
+   case BSON_READER_MMAP:
       return _bson_reader_data_read ((bson_reader_data_t *) reader,
                                      reached_eof);
 
@@ -723,6 +1451,65 @@ bson_reader_read (bson_reader_t *reader, /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_reader_read_batch --
+ *
+ *       Read up to @max_docs documents into @docs with one call. Unlike
+ *       the document returned by bson_reader_read(), the documents are
+ *       distinct bson_t structures that do not overlap, and all of them
+ *       stay valid until the next call to bson_reader_read_batch(),
+ *       bson_reader_read(), bson_reader_reset() or bson_reader_destroy().
+ *       They may be handed to other threads without copying them.
+ *
+ *       A reader from bson_reader_new_from_handle() reads from its handle
+ *       at most once per batch, and returns the documents that were read
+ *       into its buffer. Data and mmap readers return @max_docs documents
+ *       until the end of the stream.
+ *
+ * Returns:
+ *       true if successful, in which case @n_docs is zero at the end of
+ *       the stream. false if the stream is corrupt or could not be read.
+ *
+ * Side effects:
+ *       @docs and @n_docs are set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_reader_read_batch (bson_reader_t *reader, /* IN */
+                        bson_t *docs,          /* OUT */
+                        size_t max_docs,       /* IN */
+                        size_t *n_docs)        /* OUT */
+{
+   BSON_ASSERT (reader);
+   BSON_ASSERT (docs);
+   BSON_ASSERT (max_docs > 0);
+   BSON_ASSERT (n_docs);
+
+   switch (reader->type) {
+   case BSON_READER_HANDLE:
+      return _bson_reader_handle_read_batch (
+         (bson_reader_handle_t *) reader, docs, max_docs, n_docs);
+
+   case BSON_READER_DATA:
+   case BSON_READER_MMAP:
+      return _bson_reader_data_read_batch (
+         (bson_reader_data_t *) reader, docs, max_docs, n_docs);
+
+   default:
+      fprintf (stderr, "No such reader type: %02x\n", reader->type);
+      break;
+   }
+
+   *n_docs = 0;
+
+   return false;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -750,6 +1537,7 @@ bson_reader_tell (bson_reader_t *reader) /* IN */
       return _bson_reader_handle_tell ((bson_reader_handle_t *) reader);
 
    case BSON_READER_DATA:
+   case BSON_READER_MMAP:
       return _bson_reader_data_tell ((bson_reader_data_t *) reader);
 
    default:
@@ -759,6 +1547,29 @@ bson_reader_tell (bson_reader_t *reader) /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_reader_set_errno_error --
+ *
+ *       Fill @error with the message for @err.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_bson_reader_set_errno_error (int err,             /* IN */
+                              bson_error_t *error) /* OUT */
+{
+   char errmsg_buf[BSON_ERROR_BUFFER_SIZE];
+   char *errmsg;
+
+   errmsg = bson_strerror_r (err, errmsg_buf, sizeof errmsg_buf);
+   bson_set_error (
+      error, BSON_ERROR_READER, BSON_ERROR_READER_BADFD, "%s", errmsg);
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -782,8 +1593,6 @@ bson_reader_t *
 bson_reader_new_from_file (const char *path,    /* IN */
                            bson_error_t *error) /* OUT */
 {
-   char errmsg_buf[BSON_ERROR_BUFFER_SIZE];
-   char *errmsg;
    int fd;
 
    BSON_ASSERT (path);
@@ -797,9 +1606,7 @@ bson_reader_new_from_file (const char *path,    /* IN */
 #endif
 
    if (fd == -1) {
-      errmsg = bson_strerror_r (errno, errmsg_buf, sizeof errmsg_buf);
-      bson_set_error (
-         error, BSON_ERROR_READER, BSON_ERROR_READER_BADFD, "%s", errmsg);
+      _bson_reader_set_errno_error (errno, error);
       return NULL;
    }
 
@@ -807,13 +1614,258 @@ bson_reader_new_from_file (const char *path,    /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_reader_mmap_file --
+ *
+ *       Map the whole of the file at @path read-only into memory. Empty
+ *       files are not mapped, in which case @map is NULL and @map_len is
+ *       zero.
+ *
+ * Returns:
+ *       true if successful, otherwise false and @error is set.
+ *
+ * Side effects:
+ *       @reader's map, map_len and, on Windows, mapping are set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+#ifdef BSON_OS_WIN32
+
+static bool
+_bson_reader_mmap_file (bson_reader_mmap_t *reader,     /* IN */
+                        const char *path,               /* IN */
+                        bson_reader_mmap_flags_t flags, /* IN */
+                        bson_error_t *error)            /* OUT */
+{
+   struct _stati64 st;
+   HANDLE handle;
+   int fd;
+
+   (void) flags;
+
+   if (_sopen_s (&fd, path, (_O_RDONLY | _O_BINARY), _SH_DENYNO, 0) != 0) {
+      _bson_reader_set_errno_error (errno, error);
+      return false;
+   }
+
+   if (_fstati64 (fd, &st) != 0) {
+      _bson_reader_set_errno_error (errno, error);
+      _close (fd);
+      return false;
+   }
+
+   if (st.st_size == 0) {
+      _close (fd);
+      return true;
+   }
+
+   handle = (HANDLE) _get_osfhandle (fd);
+   reader->mapping =
+      CreateFileMapping (handle, NULL, PAGE_READONLY, 0, 0, NULL);
+
+   /* the mapping keeps its own reference to the file */
+   _close (fd);
+
+   if (!reader->mapping) {
+      bson_set_error (error,
+                      BSON_ERROR_READER,
+                      BSON_ERROR_READER_BADFD,
+                      "CreateFileMapping failed: %lu",
+                      (unsigned long) GetLastError ());
+      return false;
+   }
+
+   reader->map = MapViewOfFile (reader->mapping, FILE_MAP_READ, 0, 0, 0);
+   if (!reader->map) {
+      bson_set_error (error,
+                      BSON_ERROR_READER,
+                      BSON_ERROR_READER_BADFD,
+                      "MapViewOfFile failed: %lu",
+                      (unsigned long) GetLastError ());
+      CloseHandle (reader->mapping);
+      return false;
+   }
+
+   reader->map_len = (size_t) st.st_size;
+
+   return true;
+}
+
+#else
+
+static bool
+_bson_reader_mmap_file (bson_reader_mmap_t *reader,     /* IN */
+                        const char *path,               /* IN */
+                        bson_reader_mmap_flags_t flags, /* IN */
+                        bson_error_t *error)            /* OUT */
+{
+   struct stat st;
+   int map_flags = MAP_PRIVATE;
+   void *map;
+   int fd;
+
+   fd = open (path, O_RDONLY);
+   if (fd == -1) {
+      _bson_reader_set_errno_error (errno, error);
+      return false;
+   }
+
+   if (fstat (fd, &st) != 0) {
+      _bson_reader_set_errno_error (errno, error);
+      close (fd);
+      return false;
+   }
+
+   if ((uint64_t) st.st_size > (uint64_t) SIZE_MAX) {
+      bson_set_error (error,
+                      BSON_ERROR_READER,
+                      BSON_ERROR_READER_BADFD,
+                      "File is too large to map into memory");
+      close (fd);
+      return false;
+   }
+
+   if (st.st_size == 0) {
+      close (fd);
+      return true;
+   }
+
+#ifdef MAP_POPULATE
+   if (flags & BSON_READER_MMAP_POPULATE) {
+      map_flags |= MAP_POPULATE;
+   }
+#endif
+
+   map = mmap (NULL, (size_t) st.st_size, PROT_READ, map_flags, fd, 0);
+
+   /* the mapping keeps its own reference to the file */
+   close (fd);
+
+   if (map == MAP_FAILED) {
+      _bson_reader_set_errno_error (errno, error);
+      return false;
+   }
+
+   reader->map = map;
+   reader->map_len = (size_t) st.st_size;
+
+   /* these are only hints, failures are not interesting */
+#ifdef MADV_SEQUENTIAL
+   (void) madvise (map, reader->map_len, MADV_SEQUENTIAL);
+#endif
+#ifdef MADV_HUGEPAGE
+   if (flags & BSON_READER_MMAP_HUGE_PAGES) {
+      (void) madvise (map, reader->map_len, MADV_HUGEPAGE);
+   }
+#endif
+
+   return true;
+}
+
+#endif
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_reader_new_from_mmap --
+ *
+ *       Map the file at @path into memory and read the sequential bson
+ *       documents it contains without copying them. The documents
+ *       returned from bson_reader_read() point directly into the mapping.
+ *
+ *       The kernel is told the mapping will be read sequentially. If
+ *       @flags contains BSON_READER_MMAP_HUGE_PAGES, it is also asked to
+ *       back the mapping with huge pages where supported. With
+ *       BSON_READER_MMAP_POPULATE the whole file is faulted in up front.
+ *
+ * Returns:
+ *       A new bson_reader_t if successful, otherwise NULL and
+ *       @error is set. Free the non-NULL result with
+ *       bson_reader_destroy().
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_reader_t *
+bson_reader_new_from_mmap (const char *path,               /* IN */
+                           bson_reader_mmap_flags_t flags, /* IN */
+                           bson_error_t *error)            /* OUT */
+{
+   static const uint8_t empty[1] = {0};
+   bson_reader_mmap_t *real;
+
+   BSON_ASSERT (path);
+
+   real = (bson_reader_mmap_t *) bson_malloc0 (sizeof *real);
+
+   if (!_bson_reader_mmap_file (real, path, flags, error)) {
+      bson_free (real);
+      return NULL;
+   }
+
+   real->data.type = BSON_READER_MMAP;
+   real->data.data = real->map ? (const uint8_t *) real->map : empty;
+   real->data.length = real->map_len;
+   real->data.offset = 0;
+
+   return (bson_reader_t *) real;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_reader_get_data --
+ *
+ *       Get the whole of the memory that a reader created with
+ *       bson_reader_new_from_data or bson_reader_new_from_mmap reads
+ *       from, regardless of its position.
+ *
+ * Returns:
+ *       The memory, which is valid until @reader is destroyed, or NULL
+ *       for other readers.
+ *
+ * Side effects:
+ *       @length is set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+const uint8_t *
+_bson_reader_get_data (bson_reader_t *reader, /* IN */
+                       size_t *length)        /* OUT */
+{
+   bson_reader_data_t *real = (bson_reader_data_t *) reader;
+
+   BSON_ASSERT (reader);
+   BSON_ASSERT (length);
+
+   if (real->type != BSON_READER_DATA && real->type != BSON_READER_MMAP) {
+      *length = 0;
+      return NULL;
+   }
+
+   *length = real->length;
+
+   return real->data;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
  * bson_reader_reset --
  *
  *       Restore the reader to its initial state. Valid only for readers
- *       created with bson_reader_new_from_data.
+ *       created with bson_reader_new_from_data or
+ *       bson_reader_new_from_mmap.
  *
  *--------------------------------------------------------------------------
  */
@@ -823,7 +1875,7 @@ bson_reader_reset (bson_reader_t *reader)
 {
    bson_reader_data_t *real = (bson_reader_data_t *) reader;
 
-   if (real->type != BSON_READER_DATA) {
+   if (real->type != BSON_READER_DATA && real->type != BSON_READER_MMAP) {
       fprintf (stderr, "Reader type cannot be reset\n");
       return;
    }
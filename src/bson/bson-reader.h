@@ -35,6 +35,23 @@ BSON_BEGIN_DECLS
 #define BSON_ERROR_READER_BADFD 1
 
 
+/**
+ * bson_reader_mmap_flags_t:
+ *
+ * Flags for bson_reader_new_from_mmap().
+ *
+ * %BSON_READER_MMAP_NONE: Map the file with default hints.
+ * %BSON_READER_MMAP_HUGE_PAGES: Ask the kernel to back the mapping with huge
+ *    pages where supported.
+ * %BSON_READER_MMAP_POPULATE: Fault the whole file in when it is mapped.
+ */
+typedef enum {
+   BSON_READER_MMAP_NONE = 0,
+   BSON_READER_MMAP_HUGE_PAGES = (1 << 0),
+   BSON_READER_MMAP_POPULATE = (1 << 1),
+} bson_reader_mmap_flags_t;
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -100,6 +117,10 @@ BSON_EXPORT (bson_reader_t *)
 bson_reader_new_from_file (const char *path, bson_error_t *error);
 BSON_EXPORT (bson_reader_t *)
 bson_reader_new_from_data (const uint8_t *data, size_t length);
+BSON_EXPORT (bson_reader_t *)
+bson_reader_new_from_mmap (const char *path,
+                           bson_reader_mmap_flags_t flags,
+                           bson_error_t *error);
 BSON_EXPORT (void)
 bson_reader_destroy (bson_reader_t *reader);
 BSON_EXPORT (void)
@@ -107,8 +128,22 @@ bson_reader_set_read_func (bson_reader_t *reader, bson_reader_read_func_t func);
 BSON_EXPORT (void)
 bson_reader_set_destroy_func (bson_reader_t *reader,
                               bson_reader_destroy_func_t func);
+BSON_EXPORT (bool)
+bson_reader_set_prefetch (bson_reader_t *reader,
+                          size_t buffer_size,
+                          uint32_t queue_depth);
+BSON_EXPORT (void)
+bson_reader_set_buffer_policy (bson_reader_t *reader,
+                               size_t initial_size,
+                               size_t max_size,
+                               size_t large_read_threshold);
 BSON_EXPORT (const bson_t *)
 bson_reader_read (bson_reader_t *reader, bool *reached_eof);
+BSON_EXPORT (bool)
+bson_reader_read_batch (bson_reader_t *reader,
+                        bson_t *docs,
+                        size_t max_docs,
+                        size_t *n_docs);
 BSON_EXPORT (off_t)
 bson_reader_tell (bson_reader_t *reader);
 BSON_EXPORT (void)
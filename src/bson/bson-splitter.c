@@ -0,0 +1,604 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#ifdef BSON_OS_WIN32
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "bson.h"
+#include "bson-reader-private.h"
+#include "bson-splitter.h"
+
+
+/*
+ * Document lengths are looked up in a file through a window of this size,
+ * so that small documents cost one read() per window rather than one each.
+ * After a document larger than the window, only the next length prefix is
+ * read, as the window would likely hold nothing else.
+ */
+#define BSON_SPLITTER_WINDOW_SIZE (64 * 1024)
+
+
+struct _bson_splitter_t {
+   /* the mmap reader that owns the mapping, if any */
+   bson_reader_t *mmap_reader;
+
+   /* the documents in memory, or NULL to read them from @fd */
+   const uint8_t *data;
+   int fd;
+   bool close_on_destroy;
+   uint64_t length;
+
+   /* shard i is the range from offsets[i] to offsets[i + 1] */
+   uint64_t *offsets;
+   uint32_t n_shards;
+
+   uint8_t *window;
+   uint64_t window_offset;
+   size_t window_len;
+};
+
+
+/* reads the range of a shard of a file */
+typedef struct {
+   int fd;
+   uint64_t offset;
+   uint64_t remaining;
+} bson_splitter_handle_t;
+
+
+static void
+_bson_splitter_set_errno_error (int err,             /* IN */
+                                bson_error_t *error) /* OUT */
+{
+   char errmsg_buf[BSON_ERROR_BUFFER_SIZE];
+   char *errmsg;
+
+   errmsg = bson_strerror_r (err, errmsg_buf, sizeof errmsg_buf);
+   bson_set_error (
+      error, BSON_ERROR_READER, BSON_ERROR_READER_BADFD, "%s", errmsg);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_splitter_pread --
+ *
+ *       Read up to @len bytes at @offset of @fd without moving its file
+ *       position, so that the shards of a file can be read concurrently.
+ *
+ * Returns:
+ *       The number of bytes read, 0 at the end of the file, or -1 on
+ *       failure.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+#ifdef BSON_OS_WIN32
+
+static ssize_t
+_bson_splitter_pread (int fd,          /* IN */
+                      void *buf,       /* OUT */
+                      size_t len,      /* IN */
+                      uint64_t offset) /* IN */
+{
+   OVERLAPPED ov;
+   DWORD n;
+
+   memset (&ov, 0, sizeof ov);
+   ov.Offset = (DWORD) offset;
+   ov.OffsetHigh = (DWORD) (offset >> 32);
+
+   if (!ReadFile ((HANDLE) _get_osfhandle (fd),
+                  buf,
+                  (DWORD) BSON_MIN (len, (size_t) 0x7fffffff),
+                  &n,
+                  &ov)) {
+      return GetLastError () == ERROR_HANDLE_EOF ? 0 : -1;
+   }
+
+   return (ssize_t) n;
+}
+
+#else
+
+static ssize_t
+_bson_splitter_pread (int fd,          /* IN */
+                      void *buf,       /* OUT */
+                      size_t len,      /* IN */
+                      uint64_t offset) /* IN */
+{
+   ssize_t ret;
+
+   do {
+      ret = pread (fd, buf, len, (off_t) offset);
+   } while (ret == -1 && errno == EINTR);
+
+   return ret;
+}
+
+#endif
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_splitter_get_len --
+ *
+ *       Get the length prefix of the document at @offset. If
+ *       @prefix_only is true and it is not in the window, read only the
+ *       prefix rather than a full window.
+ *
+ * Returns:
+ *       true if the length prefix was read, false at the end of the
+ *       stream or if it could not be read.
+ *
+ * Side effects:
+ *       The window of @splitter may be moved.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_splitter_get_len (bson_splitter_t *splitter, /* IN */
+                        uint64_t offset,           /* IN */
+                        bool prefix_only,          /* IN */
+                        int32_t *blen)             /* OUT */
+{
+   size_t want = prefix_only ? 4 : BSON_SPLITTER_WINDOW_SIZE;
+   ssize_t ret;
+
+   if (splitter->length - offset < 4) {
+      return false;
+   }
+
+   if (splitter->data) {
+      memcpy (blen, splitter->data + offset, sizeof *blen);
+      *blen = BSON_UINT32_FROM_LE (*blen);
+      return true;
+   }
+
+   if (offset < splitter->window_offset ||
+       offset + 4 > splitter->window_offset + splitter->window_len) {
+      splitter->window_offset = offset;
+      splitter->window_len = 0;
+
+      while (splitter->window_len < 4) {
+         ret = _bson_splitter_pread (
+            splitter->fd,
+            splitter->window + splitter->window_len,
+            want - splitter->window_len,
+            offset + splitter->window_len);
+
+         if (ret <= 0) {
+            return false;
+         }
+
+         splitter->window_len += (size_t) ret;
+      }
+   }
+
+   memcpy (blen,
+           splitter->window + (size_t) (offset - splitter->window_offset),
+           sizeof *blen);
+   *blen = BSON_UINT32_FROM_LE (*blen);
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_splitter_split --
+ *
+ *       Divide the stream into up to @n_shards shards of about equal
+ *       size. The document boundaries are found by following the length
+ *       prefixes from the start, without reading the documents.
+ *
+ *       Shard i ends at the first boundary at or after (i + 1) / @n_shards
+ *       of the stream. Where documents are larger than a share, fewer
+ *       shards are made. A corrupt length prefix ends the search, and the
+ *       rest of the stream goes to the last shard, whose reader reports
+ *       it.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       @splitter's offsets and n_shards are set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_bson_splitter_split (bson_splitter_t *splitter, /* IN */
+                      uint32_t n_shards)         /* IN */
+{
+   uint64_t offset = 0;
+   uint64_t share;
+   uint64_t target;
+   int32_t blen = 0;
+   uint32_t n = 0;
+
+   BSON_ASSERT (n_shards > 0);
+
+   splitter->offsets =
+      bson_malloc (((size_t) n_shards + 1) * sizeof (uint64_t));
+   splitter->offsets[n++] = 0;
+
+   share = splitter->length / n_shards;
+
+   /* the index of the next share boundary to cut at or after */
+   target = 1;
+
+   while (target < n_shards && share > 0 &&
+          _bson_splitter_get_len (
+             splitter, offset, blen > BSON_SPLITTER_WINDOW_SIZE, &blen)) {
+      if (blen < 5 || (uint64_t) blen > splitter->length - offset) {
+         break;
+      }
+
+      offset += (uint64_t) blen;
+
+      if (offset >= share * target && offset < splitter->length) {
+         splitter->offsets[n++] = offset;
+         /* skip the boundaries within the documents just passed */
+         target = offset / share + 1;
+      }
+   }
+
+   splitter->offsets[n] = splitter->length;
+   splitter->n_shards = n;
+
+   bson_free (splitter->window);
+   splitter->window = NULL;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_splitter_new_from_data --
+ *
+ *       Divide the sequential bson documents in @data into up to
+ *       @n_shards shards. @data must outlive the splitter and the readers
+ *       of its shards.
+ *
+ * Returns:
+ *       A newly allocated bson_splitter_t that should be freed with
+ *       bson_splitter_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_splitter_t *
+bson_splitter_new_from_data (const uint8_t *data, /* IN */
+                             size_t length,       /* IN */
+                             uint32_t n_shards)   /* IN */
+{
+   bson_splitter_t *splitter;
+
+   BSON_ASSERT (data);
+   BSON_ASSERT (n_shards > 0);
+
+   splitter = bson_malloc0 (sizeof *splitter);
+   splitter->data = data;
+   splitter->fd = -1;
+   splitter->length = length;
+   _bson_splitter_split (splitter, n_shards);
+
+   return splitter;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_splitter_new_from_mmap --
+ *
+ *       Map the file at @path into memory, like
+ *       bson_reader_new_from_mmap(), and divide the sequential bson
+ *       documents it contains into up to @n_shards shards.
+ *
+ * Returns:
+ *       A new bson_splitter_t if successful, otherwise NULL and @error is
+ *       set. Free the non-NULL result with bson_splitter_destroy().
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_splitter_t *
+bson_splitter_new_from_mmap (const char *path,               /* IN */
+                             bson_reader_mmap_flags_t flags, /* IN */
+                             uint32_t n_shards,              /* IN */
+                             bson_error_t *error)            /* OUT */
+{
+   bson_splitter_t *splitter;
+   bson_reader_t *reader;
+   const uint8_t *data;
+   size_t length;
+
+   BSON_ASSERT (path);
+   BSON_ASSERT (n_shards > 0);
+
+   reader = bson_reader_new_from_mmap (path, flags, error);
+   if (!reader) {
+      return NULL;
+   }
+
+   data = _bson_reader_get_data (reader, &length);
+   splitter = bson_splitter_new_from_data (data, length, n_shards);
+   splitter->mmap_reader = reader;
+
+   return splitter;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_splitter_new_from_fd --
+ *
+ *       Divide the sequential bson documents in the file @fd into up to
+ *       @n_shards shards. The readers of the shards read their ranges
+ *       with pread(), so they share @fd without moving its position.
+ *       @fd must be a regular file, pipes and sockets are rejected.
+ *
+ *       If @close_on_destroy is true, @fd is closed when the splitter is
+ *       destroyed.
+ *
+ * Returns:
+ *       A new bson_splitter_t if successful, otherwise NULL and @error is
+ *       set. Free the non-NULL result with bson_splitter_destroy().
+ *
+ * Side effects:
+ *       @error may be set.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_splitter_t *
+bson_splitter_new_from_fd (int fd,                /* IN */
+                           bool close_on_destroy, /* IN */
+                           uint32_t n_shards,     /* IN */
+                           bson_error_t *error)   /* OUT */
+{
+   bson_splitter_t *splitter;
+#ifdef BSON_OS_WIN32
+   struct _stati64 st;
+#else
+   struct stat st;
+#endif
+
+   BSON_ASSERT (n_shards > 0);
+
+#ifdef BSON_OS_WIN32
+   if (_fstati64 (fd, &st) != 0) {
+#else
+   if (fstat (fd, &st) != 0) {
+#endif
+      _bson_splitter_set_errno_error (errno, error);
+      return NULL;
+   }
+
+#ifdef BSON_OS_WIN32
+   if ((st.st_mode & _S_IFMT) != _S_IFREG) {
+#else
+   if (!S_ISREG (st.st_mode)) {
+#endif
+      bson_set_error (error,
+                      BSON_ERROR_READER,
+                      BSON_ERROR_READER_BADFD,
+                      "File descriptor %d is not a regular file",
+                      fd);
+      return NULL;
+   }
+
+   splitter = bson_malloc0 (sizeof *splitter);
+   splitter->fd = fd;
+   splitter->close_on_destroy = close_on_destroy;
+   splitter->length = (uint64_t) st.st_size;
+   splitter->window = bson_malloc (BSON_SPLITTER_WINDOW_SIZE);
+   _bson_splitter_split (splitter, n_shards);
+
+   return splitter;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_splitter_destroy --
+ *
+ *       Release the resources of @splitter. The readers of its shards
+ *       must have been destroyed.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_splitter_destroy (bson_splitter_t *splitter) /* IN */
+{
+   if (!splitter) {
+      return;
+   }
+
+   if (splitter->mmap_reader) {
+      bson_reader_destroy (splitter->mmap_reader);
+   }
+
+   if (splitter->close_on_destroy) {
+#ifdef BSON_OS_WIN32
+      _close (splitter->fd);
+#else
+      close (splitter->fd);
+#endif
+   }
+
+   bson_free (splitter->offsets);
+   bson_free (splitter->window);
+   bson_free (splitter);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_splitter_get_n_shards --
+ *
+ *       Get the number of shards, which is at least one and at most the
+ *       number requested. It is less when the stream does not have
+ *       enough document boundaries to divide it evenly.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+uint32_t
+bson_splitter_get_n_shards (const bson_splitter_t *splitter) /* IN */
+{
+   BSON_ASSERT (splitter);
+
+   return splitter->n_shards;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_splitter_get_shard --
+ *
+ *       Get the byte range of a shard in the stream.
+ *
+ * Side effects:
+ *       @offset and @length are set, if not NULL.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+void
+bson_splitter_get_shard (const bson_splitter_t *splitter, /* IN */
+                         uint32_t shard,                  /* IN */
+                         uint64_t *offset,                /* OUT */
+                         uint64_t *length)                /* OUT */
+{
+   BSON_ASSERT (splitter);
+   BSON_ASSERT (shard < splitter->n_shards);
+
+   if (offset) {
+      *offset = splitter->offsets[shard];
+   }
+
+   if (length) {
+      *length = splitter->offsets[shard + 1] - splitter->offsets[shard];
+   }
+}
+
+
+static ssize_t
+_bson_splitter_handle_read (void *handle, /* IN */
+                            void *buf,    /* OUT */
+                            size_t len)   /* IN */
+{
+   bson_splitter_handle_t *h = handle;
+   ssize_t ret;
+
+   if ((uint64_t) len > h->remaining) {
+      len = (size_t) h->remaining;
+   }
+
+   if (!len) {
+      return 0;
+   }
+
+   ret = _bson_splitter_pread (h->fd, buf, len, h->offset);
+   if (ret > 0) {
+      h->offset += (uint64_t) ret;
+      h->remaining -= (uint64_t) ret;
+   }
+
+   return ret;
+}
+
+
+static void
+_bson_splitter_handle_destroy (void *handle) /* IN */
+{
+   bson_free (handle);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_splitter_reader_new --
+ *
+ *       Create a reader for the documents of a shard. Readers of different
+ *       shards may be used from different threads at the same time.
+ *
+ *       bson_reader_tell() on the reader returns offsets from the start of
+ *       the shard.
+ *
+ * Returns:
+ *       A new bson_reader_t that should be freed with
+ *       bson_reader_destroy() before @splitter is destroyed.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_reader_t *
+bson_splitter_reader_new (const bson_splitter_t *splitter, /* IN */
+                          uint32_t shard)                  /* IN */
+{
+   bson_splitter_handle_t *handle;
+   uint64_t offset;
+   uint64_t length;
+
+   bson_splitter_get_shard (splitter, shard, &offset, &length);
+
+   if (splitter->data) {
+      return bson_reader_new_from_data (splitter->data + offset,
+                                        (size_t) length);
+   }
+
+   handle = bson_malloc0 (sizeof *handle);
+   handle->fd = splitter->fd;
+   handle->offset = offset;
+   handle->remaining = length;
+
+   return bson_reader_new_from_handle (
+      handle, _bson_splitter_handle_read, _bson_splitter_handle_destroy);
+}
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_SPLITTER_H
+#define BSON_SPLITTER_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-compat.h"
+#include "bson-macros.h"
+#include "bson-reader.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+/**
+ * bson_splitter_t:
+ *
+ * A bson_splitter_t divides a stream of sequential BSON documents, in
+ * memory or in a file, into byte ranges of about equal size that start and
+ * end on document boundaries. Each range, or shard, can be read by a
+ * bson_reader_t of its own, so that the shards are scanned in parallel.
+ *
+ * The splitter must outlive the readers of its shards.
+ */
+typedef struct _bson_splitter_t bson_splitter_t;
+
+
+BSON_EXPORT (bson_splitter_t *)
+bson_splitter_new_from_data (const uint8_t *data,
+                             size_t length,
+                             uint32_t n_shards);
+BSON_EXPORT (bson_splitter_t *)
+bson_splitter_new_from_mmap (const char *path,
+                             bson_reader_mmap_flags_t flags,
+                             uint32_t n_shards,
+                             bson_error_t *error);
+BSON_EXPORT (bson_splitter_t *)
+bson_splitter_new_from_fd (int fd,
+                           bool close_on_destroy,
+                           uint32_t n_shards,
+                           bson_error_t *error);
+BSON_EXPORT (void)
+bson_splitter_destroy (bson_splitter_t *splitter);
+BSON_EXPORT (uint32_t)
+bson_splitter_get_n_shards (const bson_splitter_t *splitter);
+BSON_EXPORT (void)
+bson_splitter_get_shard (const bson_splitter_t *splitter,
+                         uint32_t shard,
+                         uint64_t *offset,
+                         uint64_t *length);
+BSON_EXPORT (bson_reader_t *)
+bson_splitter_reader_new (const bson_splitter_t *splitter, uint32_t shard);
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_SPLITTER_H */
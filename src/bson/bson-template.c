@@ -0,0 +1,577 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <string.h>
+
+#include "bson.h"
+#include "bson-private.h"
+#include "bson-template.h"
+
+
+/* a field of the prototype whose value is replaced when instantiating */
+typedef struct {
+   char *path;
+   bson_type_t type;
+   uint32_t type_off;
+   uint32_t value_off;
+   uint32_t value_len;
+} bson_template_slot_t;
+
+
+/* a non-empty document or array of the prototype, including the root */
+typedef struct {
+   uint32_t header_off;
+   uint32_t len;
+   uint32_t first_slot;
+   uint32_t end_slot;
+} bson_template_doc_t;
+
+
+struct _bson_template_t {
+   uint8_t *skeleton;
+   uint32_t len;
+
+   bson_template_slot_t *slots;
+   uint32_t n_slots;
+   uint32_t slots_alloc;
+
+   bson_template_doc_t *docs;
+   uint32_t n_docs;
+   uint32_t docs_alloc;
+
+   /* scratch space for bson_template_instantiate */
+   bson_t encoded;
+   uint32_t *encoded_off;
+   uint32_t *new_len;
+   int64_t *growth;
+};
+
+
+static uint32_t
+_bson_template_add_doc (bson_template_t *tmpl, /* IN */
+                        uint32_t header_off)   /* IN */
+{
+   bson_template_doc_t *doc;
+   uint32_t len_le;
+
+   if (tmpl->n_docs == tmpl->docs_alloc) {
+      tmpl->docs_alloc = BSON_MAX (4, tmpl->docs_alloc * 2);
+      tmpl->docs =
+         bson_realloc (tmpl->docs, tmpl->docs_alloc * sizeof *tmpl->docs);
+   }
+
+   memcpy (&len_le, tmpl->skeleton + header_off, sizeof len_le);
+
+   doc = &tmpl->docs[tmpl->n_docs];
+   doc->header_off = header_off;
+   doc->len = BSON_UINT32_FROM_LE (len_le);
+   doc->first_slot = tmpl->n_slots;
+   doc->end_slot = tmpl->n_slots;
+
+   return tmpl->n_docs++;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_template_compile --
+ *
+ *       Add a slot for each field of the document or array under @iter,
+ *       recursing into non-empty documents and arrays. @prefix is the
+ *       dotted path of the document, or NULL for the root.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       @iter is advanced to its end.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_bson_template_compile (bson_template_t *tmpl, /* IN */
+                        bson_iter_t *iter,     /* IN */
+                        const char *prefix)    /* IN */
+{
+   bson_template_slot_t *slot;
+   bson_iter_t child;
+   uint32_t base;
+   uint32_t doc;
+   char *path;
+
+   base = (uint32_t) (iter->raw - tmpl->skeleton);
+
+   while (bson_iter_next (iter)) {
+      if (prefix) {
+         path = bson_strdup_printf ("%s.%s", prefix, bson_iter_key (iter));
+      } else {
+         path = bson_strdup (bson_iter_key (iter));
+      }
+
+      if ((BSON_ITER_HOLDS_DOCUMENT (iter) || BSON_ITER_HOLDS_ARRAY (iter)) &&
+          iter->next_off - iter->d1 > 5) {
+         doc = _bson_template_add_doc (tmpl, base + iter->d1);
+         BSON_ASSERT (bson_iter_recurse (iter, &child));
+         _bson_template_compile (tmpl, &child, path);
+         tmpl->docs[doc].end_slot = tmpl->n_slots;
+         bson_free (path);
+         continue;
+      }
+
+      if (tmpl->n_slots == tmpl->slots_alloc) {
+         tmpl->slots_alloc = BSON_MAX (4, tmpl->slots_alloc * 2);
+         tmpl->slots = bson_realloc (
+            tmpl->slots, tmpl->slots_alloc * sizeof *tmpl->slots);
+      }
+
+      slot = &tmpl->slots[tmpl->n_slots++];
+      slot->path = path;
+      slot->type = bson_iter_type (iter);
+      slot->type_off = base + iter->type;
+      slot->value_off = base + iter->key + _bson_iter_key_len (iter) + 1;
+      slot->value_len = base + iter->next_off - slot->value_off;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_template_new --
+ *
+ *       Compile @prototype into a template. The fields of @prototype
+ *       that are not non-empty documents or arrays become the slots of
+ *       the template, in document order. A slot's value in @prototype is
+ *       used by bson_template_instantiate() when no other value is given.
+ *
+ * Returns:
+ *       A newly allocated bson_template_t that should be freed with
+ *       bson_template_destroy(), or NULL if @prototype is corrupt and
+ *       @error is set.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_template_t *
+bson_template_new (const bson_t *prototype, /* IN */
+                   bson_error_t *error)     /* OUT */
+{
+   bson_template_t *tmpl;
+   bson_iter_t iter;
+   uint32_t n;
+
+   BSON_ASSERT (prototype);
+
+   if (!bson_validate (prototype, BSON_VALIDATE_NONE, NULL)) {
+      bson_set_error (error,
+                      BSON_ERROR_TEMPLATE,
+                      BSON_TEMPLATE_ERROR_CORRUPT_BSON,
+                      "corrupt BSON in the prototype");
+      return NULL;
+   }
+
+   tmpl = bson_malloc0 (sizeof *tmpl);
+   tmpl->len = prototype->len;
+   tmpl->skeleton = bson_malloc (prototype->len);
+   memcpy (tmpl->skeleton, bson_get_data (prototype), prototype->len);
+
+   _bson_template_add_doc (tmpl, 0);
+   BSON_ASSERT (bson_iter_init_from_data (&iter, tmpl->skeleton, tmpl->len));
+   _bson_template_compile (tmpl, &iter, NULL);
+   tmpl->docs[0].end_slot = tmpl->n_slots;
+
+   n = tmpl->n_slots;
+   bson_init (&tmpl->encoded);
+   tmpl->encoded_off = bson_malloc (BSON_MAX (n, 1) * sizeof (uint32_t));
+   tmpl->new_len = bson_malloc (BSON_MAX (n, 1) * sizeof (uint32_t));
+   tmpl->growth = bson_malloc ((n + 1) * sizeof (int64_t));
+
+   return tmpl;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_template_new_from_bcon --
+ *
+ *       Compile a template from a prototype given in BCON, as with
+ *       BCON_NEW(). Use the BSON_TEMPLATE_NEW() macro to call it.
+ *
+ * Returns:
+ *       A newly allocated bson_template_t that should be freed with
+ *       bson_template_destroy().
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bson_template_t *
+bson_template_new_from_bcon (void *unused, /* IN */
+                             ...)
+{
+   bcon_append_ctx_t ctx;
+   bson_template_t *tmpl;
+   bson_t prototype;
+   va_list ap;
+
+   bcon_append_ctx_init (&ctx);
+   bson_init (&prototype);
+
+   va_start (ap, unused);
+   bcon_append_ctx_va (&prototype, &ctx, &ap);
+   va_end (ap);
+
+   tmpl = bson_template_new (&prototype, NULL);
+   BSON_ASSERT (tmpl);
+   bson_destroy (&prototype);
+
+   return tmpl;
+}
+
+
+void
+bson_template_destroy (bson_template_t *tmpl) /* IN */
+{
+   uint32_t i;
+
+   if (tmpl) {
+      for (i = 0; i < tmpl->n_slots; i++) {
+         bson_free (tmpl->slots[i].path);
+      }
+
+      bson_destroy (&tmpl->encoded);
+      bson_free (tmpl->encoded_off);
+      bson_free (tmpl->new_len);
+      bson_free (tmpl->growth);
+      bson_free (tmpl->slots);
+      bson_free (tmpl->docs);
+      bson_free (tmpl->skeleton);
+      bson_free (tmpl);
+   }
+}
+
+
+size_t
+bson_template_n_slots (const bson_template_t *tmpl) /* IN */
+{
+   BSON_ASSERT (tmpl);
+
+   return tmpl->n_slots;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_template_slot --
+ *
+ *       Find the slot for the field at the dotted @path of the
+ *       prototype, like the dotkey of bson_iter_find_descendant().
+ *
+ * Returns:
+ *       The index of the slot, or -1 if @path is not a slot.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+ssize_t
+bson_template_slot (const bson_template_t *tmpl, /* IN */
+                    const char *path)            /* IN */
+{
+   uint32_t i;
+
+   BSON_ASSERT (tmpl);
+   BSON_ASSERT (path);
+
+   for (i = 0; i < tmpl->n_slots; i++) {
+      if (!strcmp (tmpl->slots[i].path, path)) {
+         return (ssize_t) i;
+      }
+   }
+
+   return -1;
+}
+
+
+/*
+ * The length of the encoded values of fixed-width types, or -1 for types
+ * whose length depends on the value.
+ */
+static int
+_bson_template_fixed_len (bson_type_t type) /* IN */
+{
+   switch (type) {
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_MINKEY:
+   case BSON_TYPE_MAXKEY:
+      return 0;
+   case BSON_TYPE_BOOL:
+      return 1;
+   case BSON_TYPE_INT32:
+      return 4;
+   case BSON_TYPE_DOUBLE:
+   case BSON_TYPE_INT64:
+   case BSON_TYPE_DATE_TIME:
+   case BSON_TYPE_TIMESTAMP:
+      return 8;
+   case BSON_TYPE_OID:
+      return 12;
+   case BSON_TYPE_DECIMAL128:
+      return 16;
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_UTF8:
+   case BSON_TYPE_DOCUMENT:
+   case BSON_TYPE_ARRAY:
+   case BSON_TYPE_BINARY:
+   case BSON_TYPE_REGEX:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_SYMBOL:
+   case BSON_TYPE_CODEWSCOPE:
+   default:
+      return -1;
+   }
+}
+
+
+/* Write the encoded @value of slot @i to @out. */
+static void
+_bson_template_write_value (const bson_template_t *tmpl, /* IN */
+                            uint32_t i,                  /* IN */
+                            const bson_value_t *value,   /* IN */
+                            uint8_t *out)                /* OUT */
+{
+   uint64_t u64;
+   uint32_t u32;
+   double d;
+
+   switch (value->value_type) {
+   case BSON_TYPE_NULL:
+   case BSON_TYPE_UNDEFINED:
+   case BSON_TYPE_MINKEY:
+   case BSON_TYPE_MAXKEY:
+      break;
+   case BSON_TYPE_BOOL:
+      out[0] = value->value.v_bool ? 1 : 0;
+      break;
+   case BSON_TYPE_INT32:
+      u32 = BSON_UINT32_TO_LE ((uint32_t) value->value.v_int32);
+      memcpy (out, &u32, sizeof u32);
+      break;
+   case BSON_TYPE_DOUBLE:
+      d = BSON_DOUBLE_TO_LE (value->value.v_double);
+      memcpy (out, &d, sizeof d);
+      break;
+   case BSON_TYPE_INT64:
+      u64 = BSON_UINT64_TO_LE ((uint64_t) value->value.v_int64);
+      memcpy (out, &u64, sizeof u64);
+      break;
+   case BSON_TYPE_DATE_TIME:
+      u64 = BSON_UINT64_TO_LE ((uint64_t) value->value.v_datetime);
+      memcpy (out, &u64, sizeof u64);
+      break;
+   case BSON_TYPE_TIMESTAMP:
+      u64 = ((uint64_t) value->value.v_timestamp.timestamp << 32) |
+            value->value.v_timestamp.increment;
+      u64 = BSON_UINT64_TO_LE (u64);
+      memcpy (out, &u64, sizeof u64);
+      break;
+   case BSON_TYPE_OID:
+      memcpy (out, &value->value.v_oid, 12);
+      break;
+   case BSON_TYPE_DECIMAL128:
+      u64 = BSON_UINT64_TO_LE (value->value.v_decimal128.low);
+      memcpy (out, &u64, sizeof u64);
+      u64 = BSON_UINT64_TO_LE (value->value.v_decimal128.high);
+      memcpy (out + 8, &u64, sizeof u64);
+      break;
+   case BSON_TYPE_EOD:
+   case BSON_TYPE_UTF8:
+   case BSON_TYPE_DOCUMENT:
+   case BSON_TYPE_ARRAY:
+   case BSON_TYPE_BINARY:
+   case BSON_TYPE_REGEX:
+   case BSON_TYPE_DBPOINTER:
+   case BSON_TYPE_CODE:
+   case BSON_TYPE_SYMBOL:
+   case BSON_TYPE_CODEWSCOPE:
+   default:
+      memcpy (out,
+              bson_get_data (&tmpl->encoded) + tmpl->encoded_off[i],
+              tmpl->new_len[i]);
+      break;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_template_instantiate --
+ *
+ *       Initialize @dst with the prototype of @tmpl, in which the value
+ *       of each slot is replaced with the element of @values at its
+ *       index. An element of type BSON_TYPE_EOD keeps the prototype's
+ *       value. A value may be of any type, the element's type is updated.
+ *
+ *       If every value has the fixed-width type of its slot's prototype
+ *       value, the skeleton is copied and the values written over it.
+ *       Otherwise the other values are encoded first, then the skeleton
+ *       is copied around them and the lengths of their documents fixed.
+ *       Either way @dst is allocated once, at the size of the result.
+ *
+ * Returns:
+ *       true if successful; otherwise false, @error is set and @dst is
+ *       initialized to an empty document.
+ *
+ * Side effects:
+ *       @dst is initialized and must be freed with bson_destroy().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_template_instantiate (bson_template_t *tmpl,      /* IN */
+                           const bson_value_t *values, /* IN */
+                           bson_t *dst,                /* OUT */
+                           bson_error_t *error)        /* OUT */
+{
+   const bson_template_slot_t *slot;
+   const bson_template_doc_t *doc;
+   const bson_value_t *value;
+   bool resized = false;
+   int64_t *growth;
+   uint32_t before;
+   uint32_t copied;
+   uint32_t len_le;
+   uint32_t i;
+   uint8_t *out;
+   int len;
+
+   BSON_ASSERT (tmpl);
+   BSON_ASSERT (values || !tmpl->n_slots);
+   BSON_ASSERT (dst);
+
+   growth = tmpl->growth;
+   growth[0] = 0;
+   bson_reinit (&tmpl->encoded);
+
+   /* encode the variable-length values and measure the result */
+   for (i = 0; i < tmpl->n_slots; i++) {
+      slot = &tmpl->slots[i];
+      value = &values[i];
+
+      if (value->value_type == BSON_TYPE_EOD) {
+         tmpl->new_len[i] = slot->value_len;
+      } else if ((len = _bson_template_fixed_len (value->value_type)) >= 0) {
+         tmpl->new_len[i] = (uint32_t) len;
+      } else {
+         before = tmpl->encoded.len;
+         if (!bson_append_value (&tmpl->encoded, "", 0, value)) {
+            bson_set_error (error,
+                            BSON_ERROR_TEMPLATE,
+                            BSON_TEMPLATE_ERROR_INVALID_VALUE,
+                            "cannot encode the value of slot \"%s\"",
+                            slot->path);
+            bson_init (dst);
+            return false;
+         }
+
+         /* skip the type and the empty key */
+         tmpl->encoded_off[i] = before + 1;
+         tmpl->new_len[i] = tmpl->encoded.len - before - 2;
+      }
+
+      growth[i + 1] =
+         growth[i] + (int64_t) tmpl->new_len[i] - (int64_t) slot->value_len;
+      resized |= tmpl->new_len[i] != slot->value_len;
+   }
+
+   if ((int64_t) tmpl->len + growth[tmpl->n_slots] > INT32_MAX) {
+      bson_set_error (error,
+                      BSON_ERROR_TEMPLATE,
+                      BSON_TEMPLATE_ERROR_OVERFLOW,
+                      "the instantiated document is too large");
+      bson_init (dst);
+      return false;
+   }
+
+   out = _bson_init_with_len (
+      dst, (uint32_t) ((int64_t) tmpl->len + growth[tmpl->n_slots]));
+
+   if (!resized) {
+      memcpy (out, tmpl->skeleton, tmpl->len);
+   }
+
+   copied = 0;
+
+   for (i = 0; i < tmpl->n_slots; i++) {
+      slot = &tmpl->slots[i];
+      value = &values[i];
+
+      if (resized) {
+         /* the keys and headers since the last slot, up to this value */
+         memcpy (out + copied + growth[i],
+                 tmpl->skeleton + copied,
+                 slot->value_off - copied);
+         copied = slot->value_off + slot->value_len;
+
+         if (value->value_type == BSON_TYPE_EOD) {
+            memcpy (out + slot->value_off + growth[i],
+                    tmpl->skeleton + slot->value_off,
+                    slot->value_len);
+            continue;
+         }
+      } else if (value->value_type == BSON_TYPE_EOD) {
+         continue;
+      }
+
+      out[slot->type_off + growth[i]] = (uint8_t) value->value_type;
+      _bson_template_write_value (
+         tmpl, i, value, out + slot->value_off + growth[i]);
+   }
+
+   if (resized) {
+      memcpy (out + copied + growth[tmpl->n_slots],
+              tmpl->skeleton + copied,
+              tmpl->len - copied);
+
+      for (i = 0; i < tmpl->n_docs; i++) {
+         doc = &tmpl->docs[i];
+         len_le = BSON_UINT32_TO_LE (
+            (uint32_t) ((int64_t) doc->len + growth[doc->end_slot] -
+                        growth[doc->first_slot]));
+         memcpy (out + doc->header_off + growth[doc->first_slot],
+                 &len_le,
+                 sizeof len_le);
+      }
+   }
+
+   return true;
+}
@@ -0,0 +1,83 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef BSON_TEMPLATE_H
+#define BSON_TEMPLATE_H
+
+
+#if !defined(BSON_INSIDE) && !defined(BSON_COMPILATION)
+#error "Only <bson.h> can be included directly."
+#endif
+
+
+#include "bson-macros.h"
+#include "bson-types.h"
+
+
+BSON_BEGIN_DECLS
+
+
+typedef enum {
+   BSON_TEMPLATE_ERROR_CORRUPT_BSON = 1,
+   BSON_TEMPLATE_ERROR_INVALID_VALUE,
+   BSON_TEMPLATE_ERROR_OVERFLOW,
+} bson_template_error_code_t;
+
+
+/**
+ * bson_template_t:
+ *
+ * A bson_template_t is compiled once from a prototype document and then
+ * instantiated many times with new values for its fields. The encoded
+ * prototype is kept as a skeleton: keys are never encoded again, and
+ * values of the same fixed-width type as the prototype's are patched into
+ * a copy of the skeleton in place.
+ *
+ * Each field of the prototype that is not a non-empty document or array
+ * is a slot, numbered in document order.
+ *
+ * A bson_template_t is not thread-safe, it may only be instantiated once
+ * at a time.
+ */
+typedef struct _bson_template_t bson_template_t;
+
+
+BSON_EXPORT (bson_template_t *)
+bson_template_new (const bson_t *prototype, bson_error_t *error);
+BSON_EXPORT (bson_template_t *)
+bson_template_new_from_bcon (void *unused, ...) BSON_GNUC_NULL_TERMINATED;
+BSON_EXPORT (void)
+bson_template_destroy (bson_template_t *tmpl);
+BSON_EXPORT (size_t)
+bson_template_n_slots (const bson_template_t *tmpl);
+BSON_EXPORT (ssize_t)
+bson_template_slot (const bson_template_t *tmpl, const char *path);
+BSON_EXPORT (bool)
+bson_template_instantiate (bson_template_t *tmpl,
+                           const bson_value_t *values,
+                           bson_t *dst,
+                           bson_error_t *error);
+
+
+#define BSON_TEMPLATE_NEW(...) \
+   bson_template_new_from_bcon (NULL, __VA_ARGS__, (void *) NULL)
+
+
+BSON_END_DECLS
+
+
+#endif /* BSON_TEMPLATE_H */
@@ -39,6 +39,11 @@ BSON_BEGIN_DECLS
 #define bson_mutex_lock pthread_mutex_lock
 #define bson_mutex_unlock pthread_mutex_unlock
 #define bson_mutex_destroy pthread_mutex_destroy
+#define bson_cond_t pthread_cond_t
+#define bson_cond_init(_c) pthread_cond_init ((_c), NULL)
+#define bson_cond_wait pthread_cond_wait
+#define bson_cond_broadcast pthread_cond_broadcast
+#define bson_cond_destroy pthread_cond_destroy
 #define bson_thread_t pthread_t
 #define bson_thread_create(_t, _f, _d) pthread_create ((_t), NULL, (_f), (_d))
 #define bson_thread_join(_n) pthread_join ((_n), NULL)
@@ -60,6 +65,11 @@ BSON_BEGIN_DECLS
 #define bson_mutex_lock EnterCriticalSection
 #define bson_mutex_unlock LeaveCriticalSection
 #define bson_mutex_destroy DeleteCriticalSection
+#define bson_cond_t CONDITION_VARIABLE
+#define bson_cond_init InitializeConditionVariable
+#define bson_cond_wait(_c, _m) SleepConditionVariableCS ((_c), (_m), INFINITE)
+#define bson_cond_broadcast WakeAllConditionVariable
+#define bson_cond_destroy(_c) ((void) (_c))
 #define bson_thread_t HANDLE
 #define bson_thread_create(_t, _f, _d) \
    (!(*(_t) = CreateThread (NULL, 0, (void *) _f, _d, 0, NULL)))
@@ -73,6 +83,21 @@ BSON_BEGIN_DECLS
 #endif
 
 
+/*
+ * Thread-local storage for small variables on hot paths. On ELF platforms
+ * the initial-exec model avoids a call to __tls_get_addr for each access,
+ * at the cost of a few bytes of the static TLS space.
+ */
+#if defined(_MSC_VER)
+#define BSON_THREAD_LOCAL __declspec(thread)
+#elif (defined(__GNUC__) || defined(__clang__)) && defined(__ELF__)
+#define BSON_THREAD_LOCAL \
+   __thread __attribute__ ((tls_model ("initial-exec")))
+#elif defined(__GNUC__) || defined(__clang__)
+#define BSON_THREAD_LOCAL __thread
+#endif
+
+
 BSON_END_DECLS
 
 
@@ -64,6 +64,8 @@ typedef uint32_t bson_unichar_t;
  *   result of getpid() when initializing the context.
  * %BSON_CONTEXT_DISABLE_HOST_CACHE: Call gethostname() instead of caching the
  *   result of gethostname() when initializing the context.
+ * %BSON_CONTEXT_THREAD_LOCAL_SEQ: Context will be called from multiple
+ *   threads, each of which takes a block of sequence numbers at a time.
  */
 typedef enum {
    BSON_CONTEXT_NONE = 0,
@@ -73,6 +75,7 @@ typedef enum {
 #ifdef BSON_HAVE_SYSCALL_TID
    BSON_CONTEXT_USE_TASK_ID = (1 << 3),
 #endif
+   BSON_CONTEXT_THREAD_LOCAL_SEQ = (1 << 4),
 } bson_context_flags_t;
 
 
@@ -90,7 +93,7 @@ typedef enum {
  * If you are using threading, it is suggested that you use a bson_context_t
  * per thread for best performance. Alternatively, you can initialize the
  * bson_context_t with BSON_CONTEXT_THREAD_SAFE, although a performance penalty
- * will be incurred.
+ * will be incurred. BSON_CONTEXT_THREAD_LOCAL_SEQ avoids most of that penalty.
  *
  * Many functions will require that you provide a bson_context_t such as OID
  * generation.
@@ -185,6 +188,24 @@ typedef struct {
 } bson_decimal128_t;
 
 
+/**
+ * bson_growth_policy_t:
+ *
+ * This enumeration selects how the buffer of a bson_t grows when an append
+ * does not fit.
+ *
+ * %BSON_GROWTH_POWER_OF_TWO: Round up to the next power of two (default).
+ * %BSON_GROWTH_ONE_AND_HALF: Grow by half the current size, or to the size
+ *    needed if that is larger.
+ * %BSON_GROWTH_EXACT: Grow to exactly the size needed.
+ */
+typedef enum {
+   BSON_GROWTH_POWER_OF_TWO = 0,
+   BSON_GROWTH_ONE_AND_HALF,
+   BSON_GROWTH_EXACT,
+} bson_growth_policy_t;
+
+
 /**
  * bson_validate_flags_t:
  *
@@ -22,6 +22,21 @@
 #include "bson-utf8.h"
 
 
+#if (defined(__x86_64__) || defined(__i386__)) && \
+   (BSON_GNUC_CHECK_VERSION(4, 9) || defined(__clang__))
+#define BSON_UTF8_HAVE_SIMD
+#define BSON_UTF8_SIMD_MIN_LEN 32
+#include <immintrin.h>
+#include "bson-thread-private.h"
+#endif
+
+
+#define BSON_UTF8_WORD_HIGH_BITS 0x8080808080808080ull
+#define BSON_UTF8_WORD_HAS_ZERO(_w)           \
+   ((((_w) - 0x0101010101010101ull) & ~(_w) & \
+     BSON_UTF8_WORD_HIGH_BITS) != 0)
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -90,20 +105,11 @@ _bson_utf8_get_sequence (const char *utf8,    /* IN */
 /*
  *--------------------------------------------------------------------------
  *
- * bson_utf8_validate --
- *
- *       Validates that @utf8 is a valid UTF-8 string.
- *
- *       If @allow_null is true, then \0 is allowed within @utf8_len bytes
- *       of @utf8.  Generally, this is bad practice since the main point of
- *       UTF-8 strings is that they can be used with strlen() and friends.
- *       However, some languages such as Python can send UTF-8 encoded
- *       strings with NUL's in them.
+ * _bson_utf8_validate_scalar --
  *
- * Parameters:
- *       @utf8: A UTF-8 encoded string.
- *       @utf8_len: The length of @utf8 in bytes.
- *       @allow_null: If \0 is allowed within @utf8, exclusing trailing \0.
+ *       Portable implementation of bson_utf8_validate(). Runs of ASCII are
+ *       checked eight bytes at a time, everything else is decoded one
+ *       sequence at a time.
  *
  * Returns:
  *       true if @utf8 is valid UTF-8. otherwise false.
@@ -114,20 +120,32 @@ _bson_utf8_get_sequence (const char *utf8,    /* IN */
  *--------------------------------------------------------------------------
  */
 
-bool
-bson_utf8_validate (const char *utf8, /* IN */
-                    size_t utf8_len,  /* IN */
-                    bool allow_null)  /* IN */
+static bool
+_bson_utf8_validate_scalar (const char *utf8, /* IN */
+                            size_t utf8_len,  /* IN */
+                            bool allow_null)  /* IN */
 {
    bson_unichar_t c;
    uint8_t first_mask;
    uint8_t seq_length;
+   uint64_t word;
    unsigned i;
    unsigned j;
 
-   BSON_ASSERT (utf8);
-
    for (i = 0; i < utf8_len; i += seq_length) {
+      /*
+       * Skip over runs of ASCII a word at a time. A run of ASCII always
+       * ends on a sequence boundary, so decoding may resume right after it.
+       */
+      if (!(utf8[i] & 0x80) && (utf8_len - i) >= sizeof word) {
+         memcpy (&word, &utf8[i], sizeof word);
+         if (!(word & BSON_UTF8_WORD_HIGH_BITS) &&
+             (allow_null || !BSON_UTF8_WORD_HAS_ZERO (word))) {
+            seq_length = sizeof word;
+            continue;
+         }
+      }
+
       _bson_utf8_get_sequence (&utf8[i], &seq_length, &first_mask);
 
       /*
@@ -162,11 +180,6 @@ bson_utf8_validate (const char *utf8, /* IN */
 
       /*
        * Check for NULL bytes afterwards.
-       *
-       * Hint: if you want to optimize this function, starting here to do
-       * this in the same pass as the data above would probably be a good
-       * idea. You would add a branch into the inner loop, but save possibly
-       * on cache-line bouncing on larger strings. Just a thought.
        */
       if (!allow_null) {
          for (j = 0; j < seq_length; j++) {
@@ -237,6 +250,383 @@ bson_utf8_validate (const char *utf8, /* IN */
 }
 
 
+#ifdef BSON_UTF8_HAVE_SIMD
+
+/*
+ * Vectorized validation following Keiser and Lemire, "Validating UTF-8 In
+ * Less Than One Instruction Per Byte". Each byte is classified by looking up
+ * the high nibble of the previous byte, the low nibble of the previous byte
+ * and the high nibble of the current byte in three 16-entry tables. ANDing
+ * the three lookups leaves a bit set only if the pair of bytes is one of the
+ * error cases below. Continuation bytes required by three and four byte
+ * sequences are checked separately using the bytes two and three back.
+ *
+ * The SIMD path implements strict UTF-8, which rejects the two byte
+ * encoding of NUL (0xC0 0x80) that bson_utf8_validate() accepts when
+ * @allow_null is true. Since that is the only difference, a failure in
+ * that case is confirmed with the scalar implementation.
+ */
+
+#define BSON_UTF8_TOO_SHORT (1 << 0)
+#define BSON_UTF8_TOO_LONG (1 << 1)
+#define BSON_UTF8_OVERLONG_3 (1 << 2)
+#define BSON_UTF8_TOO_LARGE (1 << 3)
+#define BSON_UTF8_SURROGATE (1 << 4)
+#define BSON_UTF8_OVERLONG_2 (1 << 5)
+#define BSON_UTF8_TOO_LARGE_1000 (1 << 6)
+#define BSON_UTF8_OVERLONG_4 (1 << 6)
+#define BSON_UTF8_TWO_CONTS (1 << 7)
+#define BSON_UTF8_CARRY \
+   (BSON_UTF8_TOO_SHORT | BSON_UTF8_TOO_LONG | BSON_UTF8_TWO_CONTS)
+#define BSON_UTF8_LARGE (BSON_UTF8_TOO_LARGE | BSON_UTF8_TOO_LARGE_1000)
+#define BSON_UTF8_CONT (BSON_UTF8_TOO_LONG | BSON_UTF8_OVERLONG_2 | \
+                        BSON_UTF8_TWO_CONTS)
+
+/* indexed by the high nibble of the previous byte */
+static const uint8_t gUtf8Byte1High[16] = {
+   /* 0xxx: ASCII */
+   BSON_UTF8_TOO_LONG,
+   BSON_UTF8_TOO_LONG,
+   BSON_UTF8_TOO_LONG,
+   BSON_UTF8_TOO_LONG,
+   BSON_UTF8_TOO_LONG,
+   BSON_UTF8_TOO_LONG,
+   BSON_UTF8_TOO_LONG,
+   BSON_UTF8_TOO_LONG,
+   /* 10xx: continuation */
+   BSON_UTF8_TWO_CONTS,
+   BSON_UTF8_TWO_CONTS,
+   BSON_UTF8_TWO_CONTS,
+   BSON_UTF8_TWO_CONTS,
+   /* 1100: two byte lead, may be overlong */
+   BSON_UTF8_TOO_SHORT | BSON_UTF8_OVERLONG_2,
+   /* 1101: two byte lead */
+   BSON_UTF8_TOO_SHORT,
+   /* 1110: three byte lead */
+   BSON_UTF8_TOO_SHORT | BSON_UTF8_OVERLONG_3 | BSON_UTF8_SURROGATE,
+   /* 1111: four or more byte lead */
+   BSON_UTF8_TOO_SHORT | BSON_UTF8_LARGE | BSON_UTF8_OVERLONG_4,
+};
+
+/* indexed by the low nibble of the previous byte */
+static const uint8_t gUtf8Byte1Low[16] = {
+   BSON_UTF8_CARRY | BSON_UTF8_OVERLONG_3 | BSON_UTF8_OVERLONG_2 |
+      BSON_UTF8_OVERLONG_4,
+   BSON_UTF8_CARRY | BSON_UTF8_OVERLONG_2,
+   BSON_UTF8_CARRY,
+   BSON_UTF8_CARRY,
+   BSON_UTF8_CARRY | BSON_UTF8_TOO_LARGE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE | BSON_UTF8_SURROGATE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE,
+   BSON_UTF8_CARRY | BSON_UTF8_LARGE,
+};
+
+/* indexed by the high nibble of the current byte */
+static const uint8_t gUtf8Byte2High[16] = {
+   /* 0xxx: ASCII */
+   BSON_UTF8_TOO_SHORT,
+   BSON_UTF8_TOO_SHORT,
+   BSON_UTF8_TOO_SHORT,
+   BSON_UTF8_TOO_SHORT,
+   BSON_UTF8_TOO_SHORT,
+   BSON_UTF8_TOO_SHORT,
+   BSON_UTF8_TOO_SHORT,
+   BSON_UTF8_TOO_SHORT,
+   /* 1000 */
+   BSON_UTF8_CONT | BSON_UTF8_OVERLONG_3 | BSON_UTF8_TOO_LARGE_1000 |
+      BSON_UTF8_OVERLONG_4,
+   /* 1001 */
+   BSON_UTF8_CONT | BSON_UTF8_OVERLONG_3 | BSON_UTF8_TOO_LARGE,
+   /* 101x */
+   BSON_UTF8_CONT | BSON_UTF8_SURROGATE | BSON_UTF8_TOO_LARGE,
+   BSON_UTF8_CONT | BSON_UTF8_SURROGATE | BSON_UTF8_TOO_LARGE,
+   /* 11xx: lead byte */
+   BSON_UTF8_TOO_SHORT,
+   BSON_UTF8_TOO_SHORT,
+   BSON_UTF8_TOO_SHORT,
+   BSON_UTF8_TOO_SHORT,
+};
+
+/*
+ * A block whose final bytes are lead bytes of sequences that are longer
+ * than the bytes remaining in the block must be followed by continuation
+ * bytes. Any byte greater than its entry in the last 16 or 32 bytes of this
+ * table marks such a block.
+ */
+static const uint8_t gUtf8MaxValue[32] = {
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+   0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xEF, 0xDF, 0xBF,
+};
+
+
+#define BSON_UTF8_SSE41 __attribute__ ((target ("sse4.1")))
+#define BSON_UTF8_AVX2 __attribute__ ((target ("avx2")))
+
+
+static BSON_INLINE BSON_UTF8_SSE41 __m128i
+_bson_utf8_check_sse41 (__m128i input, /* IN */
+                        __m128i prev)  /* IN */
+{
+   const __m128i nibble = _mm_set1_epi8 (0x0F);
+   __m128i prev1;
+   __m128i prev2;
+   __m128i prev3;
+   __m128i special;
+   __m128i must23;
+
+   prev1 = _mm_alignr_epi8 (input, prev, 15);
+   prev2 = _mm_alignr_epi8 (input, prev, 14);
+   prev3 = _mm_alignr_epi8 (input, prev, 13);
+
+   special = _mm_and_si128 (
+      _mm_and_si128 (
+         _mm_shuffle_epi8 (
+            _mm_loadu_si128 ((const __m128i *) gUtf8Byte1High),
+            _mm_and_si128 (_mm_srli_epi16 (prev1, 4), nibble)),
+         _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) gUtf8Byte1Low),
+                           _mm_and_si128 (prev1, nibble))),
+      _mm_shuffle_epi8 (_mm_loadu_si128 ((const __m128i *) gUtf8Byte2High),
+                        _mm_and_si128 (_mm_srli_epi16 (input, 4), nibble)));
+
+   /* only 111xxxxx two back and 1111xxxx three back end up >= 0x80 */
+   must23 = _mm_or_si128 (_mm_subs_epu8 (prev2, _mm_set1_epi8 (0x60)),
+                          _mm_subs_epu8 (prev3, _mm_set1_epi8 (0x70)));
+   must23 = _mm_and_si128 (must23, _mm_set1_epi8 ((char) 0x80));
+
+   return _mm_xor_si128 (must23, special);
+}
+
+
+static BSON_UTF8_SSE41 bool
+_bson_utf8_validate_sse41 (const char *utf8, /* IN */
+                           size_t utf8_len,  /* IN */
+                           bool allow_null)  /* IN */
+{
+   const __m128i max_value =
+      _mm_loadu_si128 ((const __m128i *) (gUtf8MaxValue + 16));
+   const __m128i zero = _mm_setzero_si128 ();
+   __m128i error = zero;
+   __m128i nul = zero;
+   __m128i prev = zero;
+   __m128i incomplete = zero;
+   __m128i input;
+   uint8_t tail[16];
+   size_t i;
+
+   for (i = 0; i < utf8_len; i += 16) {
+      if ((utf8_len - i) >= 16) {
+         input = _mm_loadu_si128 ((const __m128i *) (utf8 + i));
+      } else {
+         /* pad the final block with spaces, which are valid and not NUL */
+         memset (tail, ' ', sizeof tail);
+         memcpy (tail, utf8 + i, utf8_len - i);
+         input = _mm_loadu_si128 ((const __m128i *) tail);
+      }
+
+      if (!allow_null) {
+         nul = _mm_or_si128 (nul, _mm_cmpeq_epi8 (input, zero));
+      }
+
+      if (!_mm_movemask_epi8 (input)) {
+         error = _mm_or_si128 (error, incomplete);
+         incomplete = zero;
+      } else {
+         error = _mm_or_si128 (error, _bson_utf8_check_sse41 (input, prev));
+         incomplete = _mm_subs_epu8 (input, max_value);
+      }
+
+      prev = input;
+   }
+
+   error = _mm_or_si128 (error, incomplete);
+
+   if (!_mm_testz_si128 (nul, nul)) {
+      return false;
+   }
+
+   if (!_mm_testz_si128 (error, error)) {
+      return allow_null && _bson_utf8_validate_scalar (utf8, utf8_len, true);
+   }
+
+   return true;
+}
+
+
+static BSON_INLINE BSON_UTF8_AVX2 __m256i
+_bson_utf8_check_avx2 (__m256i input, /* IN */
+                       __m256i prev)  /* IN */
+{
+   const __m256i nibble = _mm256_set1_epi8 (0x0F);
+   __m256i shifted;
+   __m256i prev1;
+   __m256i prev2;
+   __m256i prev3;
+   __m256i special;
+   __m256i must23;
+
+   /* the high lane of @prev followed by the low lane of @input */
+   shifted = _mm256_permute2x128_si256 (prev, input, 0x21);
+   prev1 = _mm256_alignr_epi8 (input, shifted, 15);
+   prev2 = _mm256_alignr_epi8 (input, shifted, 14);
+   prev3 = _mm256_alignr_epi8 (input, shifted, 13);
+
+   special = _mm256_and_si256 (
+      _mm256_and_si256 (
+         _mm256_shuffle_epi8 (
+            _mm256_broadcastsi128_si256 (
+               _mm_loadu_si128 ((const __m128i *) gUtf8Byte1High)),
+            _mm256_and_si256 (_mm256_srli_epi16 (prev1, 4), nibble)),
+         _mm256_shuffle_epi8 (
+            _mm256_broadcastsi128_si256 (
+               _mm_loadu_si128 ((const __m128i *) gUtf8Byte1Low)),
+            _mm256_and_si256 (prev1, nibble))),
+      _mm256_shuffle_epi8 (
+         _mm256_broadcastsi128_si256 (
+            _mm_loadu_si128 ((const __m128i *) gUtf8Byte2High)),
+         _mm256_and_si256 (_mm256_srli_epi16 (input, 4), nibble)));
+
+   must23 = _mm256_or_si256 (_mm256_subs_epu8 (prev2, _mm256_set1_epi8 (0x60)),
+                             _mm256_subs_epu8 (prev3, _mm256_set1_epi8 (0x70)));
+   must23 = _mm256_and_si256 (must23, _mm256_set1_epi8 ((char) 0x80));
+
+   return _mm256_xor_si256 (must23, special);
+}
+
+
+static BSON_UTF8_AVX2 bool
+_bson_utf8_validate_avx2 (const char *utf8, /* IN */
+                          size_t utf8_len,  /* IN */
+                          bool allow_null)  /* IN */
+{
+   const __m256i max_value =
+      _mm256_loadu_si256 ((const __m256i *) gUtf8MaxValue);
+   const __m256i zero = _mm256_setzero_si256 ();
+   __m256i error = zero;
+   __m256i nul = zero;
+   __m256i prev = zero;
+   __m256i incomplete = zero;
+   __m256i input;
+   uint8_t tail[32];
+   size_t i;
+
+   for (i = 0; i < utf8_len; i += 32) {
+      if ((utf8_len - i) >= 32) {
+         input = _mm256_loadu_si256 ((const __m256i *) (utf8 + i));
+      } else {
+         memset (tail, ' ', sizeof tail);
+         memcpy (tail, utf8 + i, utf8_len - i);
+         input = _mm256_loadu_si256 ((const __m256i *) tail);
+      }
+
+      if (!allow_null) {
+         nul = _mm256_or_si256 (nul, _mm256_cmpeq_epi8 (input, zero));
+      }
+
+      if (!_mm256_movemask_epi8 (input)) {
+         error = _mm256_or_si256 (error, incomplete);
+         incomplete = zero;
+      } else {
+         error = _mm256_or_si256 (error, _bson_utf8_check_avx2 (input, prev));
+         incomplete = _mm256_subs_epu8 (input, max_value);
+      }
+
+      prev = input;
+   }
+
+   error = _mm256_or_si256 (error, incomplete);
+
+   if (!_mm256_testz_si256 (nul, nul)) {
+      return false;
+   }
+
+   if (!_mm256_testz_si256 (error, error)) {
+      return allow_null && _bson_utf8_validate_scalar (utf8, utf8_len, true);
+   }
+
+   return true;
+}
+
+
+typedef bool (*bson_utf8_validate_func_t) (const char *utf8,
+                                           size_t utf8_len,
+                                           bool allow_null);
+
+static bson_utf8_validate_func_t gUtf8Validate = _bson_utf8_validate_scalar;
+static bson_once_t gUtf8ValidateOnce = BSON_ONCE_INIT;
+
+
+static BSON_ONCE_FUN (_bson_utf8_validate_init)
+{
+   if (__builtin_cpu_supports ("avx2")) {
+      gUtf8Validate = _bson_utf8_validate_avx2;
+   } else if (__builtin_cpu_supports ("sse4.1")) {
+      gUtf8Validate = _bson_utf8_validate_sse41;
+   }
+
+   BSON_ONCE_RETURN;
+}
+
+#endif /* BSON_UTF8_HAVE_SIMD */
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_utf8_validate --
+ *
+ *       Validates that @utf8 is a valid UTF-8 string.
+ *
+ *       If @allow_null is true, then \0 is allowed within @utf8_len bytes
+ *       of @utf8.  Generally, this is bad practice since the main point of
+ *       UTF-8 strings is that they can be used with strlen() and friends.
+ *       However, some languages such as Python can send UTF-8 encoded
+ *       strings with NUL's in them.
+ *
+ *       On x86 processors supporting SSE4.1 or AVX2 the bulk of the work
+ *       is done with vector instructions, selected at runtime.
+ *
+ * Parameters:
+ *       @utf8: A UTF-8 encoded string.
+ *       @utf8_len: The length of @utf8 in bytes.
+ *       @allow_null: If \0 is allowed within @utf8, exclusing trailing \0.
+ *
+ * Returns:
+ *       true if @utf8 is valid UTF-8. otherwise false.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_utf8_validate (const char *utf8, /* IN */
+                    size_t utf8_len,  /* IN */
+                    bool allow_null)  /* IN */
+{
+   BSON_ASSERT (utf8);
+
+#ifdef BSON_UTF8_HAVE_SIMD
+   /* short strings such as keys are not worth loading into a register */
+   if (utf8_len >= BSON_UTF8_SIMD_MIN_LEN) {
+      bson_once (&gUtf8ValidateOnce, _bson_utf8_validate_init);
+      return gUtf8Validate (utf8, utf8_len, allow_null);
+   }
+#endif
+
+   return _bson_utf8_validate_scalar (utf8, utf8_len, allow_null);
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
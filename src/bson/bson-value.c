@@ -15,19 +15,49 @@
  */
 
 
+#include "bson-arena.h"
 #include "bson-memory.h"
 #include "bson-string.h"
 #include "bson-value.h"
 #include "bson-oid.h"
 
 
-void
-bson_value_copy (const bson_value_t *src, /* IN */
-                 bson_value_t *dst)       /* OUT */
+static BSON_INLINE void *
+_bson_value_alloc (bson_arena_t *arena, /* IN */
+                   size_t num_bytes)    /* IN */
 {
-   BSON_ASSERT (src);
-   BSON_ASSERT (dst);
+   if (arena) {
+      return bson_arena_alloc (arena, num_bytes);
+   }
+
+   return bson_malloc (num_bytes);
+}
+
 
+static char *
+_bson_value_strdup (bson_arena_t *arena, /* IN */
+                    const char *str)     /* IN */
+{
+   size_t len;
+   char *ret;
+
+   if (!arena) {
+      return bson_strdup (str);
+   }
+
+   len = strlen (str);
+   ret = bson_arena_alloc (arena, len + 1);
+   memcpy (ret, str, len + 1);
+
+   return ret;
+}
+
+
+static void
+_bson_value_copy (const bson_value_t *src, /* IN */
+                  bson_value_t *dst,       /* OUT */
+                  bson_arena_t *arena)     /* IN */
+{
    dst->value_type = src->value_type;
 
    switch (src->value_type) {
@@ -36,7 +66,8 @@ bson_value_copy (const bson_value_t *src, /* IN */
       break;
    case BSON_TYPE_UTF8:
       dst->value.v_utf8.len = src->value.v_utf8.len;
-      dst->value.v_utf8.str = bson_malloc (src->value.v_utf8.len + 1);
+      dst->value.v_utf8.str =
+         _bson_value_alloc (arena, src->value.v_utf8.len + 1);
       memcpy (
          dst->value.v_utf8.str, src->value.v_utf8.str, dst->value.v_utf8.len);
       dst->value.v_utf8.str[dst->value.v_utf8.len] = '\0';
@@ -44,7 +75,8 @@ bson_value_copy (const bson_value_t *src, /* IN */
    case BSON_TYPE_DOCUMENT:
    case BSON_TYPE_ARRAY:
       dst->value.v_doc.data_len = src->value.v_doc.data_len;
-      dst->value.v_doc.data = bson_malloc (src->value.v_doc.data_len);
+      dst->value.v_doc.data =
+         _bson_value_alloc (arena, src->value.v_doc.data_len);
       memcpy (dst->value.v_doc.data,
               src->value.v_doc.data,
               dst->value.v_doc.data_len);
@@ -52,7 +84,8 @@ bson_value_copy (const bson_value_t *src, /* IN */
    case BSON_TYPE_BINARY:
       dst->value.v_binary.subtype = src->value.v_binary.subtype;
       dst->value.v_binary.data_len = src->value.v_binary.data_len;
-      dst->value.v_binary.data = bson_malloc (src->value.v_binary.data_len);
+      dst->value.v_binary.data =
+         _bson_value_alloc (arena, src->value.v_binary.data_len);
       memcpy (dst->value.v_binary.data,
               src->value.v_binary.data,
               dst->value.v_binary.data_len);
@@ -67,14 +100,16 @@ bson_value_copy (const bson_value_t *src, /* IN */
       dst->value.v_datetime = src->value.v_datetime;
       break;
    case BSON_TYPE_REGEX:
-      dst->value.v_regex.regex = bson_strdup (src->value.v_regex.regex);
-      dst->value.v_regex.options = bson_strdup (src->value.v_regex.options);
+      dst->value.v_regex.regex =
+         _bson_value_strdup (arena, src->value.v_regex.regex);
+      dst->value.v_regex.options =
+         _bson_value_strdup (arena, src->value.v_regex.options);
       break;
    case BSON_TYPE_DBPOINTER:
       dst->value.v_dbpointer.collection_len =
          src->value.v_dbpointer.collection_len;
       dst->value.v_dbpointer.collection =
-         bson_malloc (src->value.v_dbpointer.collection_len + 1);
+         _bson_value_alloc (arena, src->value.v_dbpointer.collection_len + 1);
       memcpy (dst->value.v_dbpointer.collection,
               src->value.v_dbpointer.collection,
               dst->value.v_dbpointer.collection_len);
@@ -84,7 +119,8 @@ bson_value_copy (const bson_value_t *src, /* IN */
       break;
    case BSON_TYPE_CODE:
       dst->value.v_code.code_len = src->value.v_code.code_len;
-      dst->value.v_code.code = bson_malloc (src->value.v_code.code_len + 1);
+      dst->value.v_code.code =
+         _bson_value_alloc (arena, src->value.v_code.code_len + 1);
       memcpy (dst->value.v_code.code,
               src->value.v_code.code,
               dst->value.v_code.code_len);
@@ -92,7 +128,8 @@ bson_value_copy (const bson_value_t *src, /* IN */
       break;
    case BSON_TYPE_SYMBOL:
       dst->value.v_symbol.len = src->value.v_symbol.len;
-      dst->value.v_symbol.symbol = bson_malloc (src->value.v_symbol.len + 1);
+      dst->value.v_symbol.symbol =
+         _bson_value_alloc (arena, src->value.v_symbol.len + 1);
       memcpy (dst->value.v_symbol.symbol,
               src->value.v_symbol.symbol,
               dst->value.v_symbol.len);
@@ -101,14 +138,14 @@ bson_value_copy (const bson_value_t *src, /* IN */
    case BSON_TYPE_CODEWSCOPE:
       dst->value.v_codewscope.code_len = src->value.v_codewscope.code_len;
       dst->value.v_codewscope.code =
-         bson_malloc (src->value.v_codewscope.code_len + 1);
+         _bson_value_alloc (arena, src->value.v_codewscope.code_len + 1);
       memcpy (dst->value.v_codewscope.code,
               src->value.v_codewscope.code,
               dst->value.v_codewscope.code_len);
       dst->value.v_codewscope.code[dst->value.v_codewscope.code_len] = '\0';
       dst->value.v_codewscope.scope_len = src->value.v_codewscope.scope_len;
       dst->value.v_codewscope.scope_data =
-         bson_malloc (src->value.v_codewscope.scope_len);
+         _bson_value_alloc (arena, src->value.v_codewscope.scope_len);
       memcpy (dst->value.v_codewscope.scope_data,
               src->value.v_codewscope.scope_data,
               dst->value.v_codewscope.scope_len);
@@ -139,6 +176,30 @@ bson_value_copy (const bson_value_t *src, /* IN */
 }
 
 
+void
+bson_value_copy (const bson_value_t *src, /* IN */
+                 bson_value_t *dst)       /* OUT */
+{
+   BSON_ASSERT (src);
+   BSON_ASSERT (dst);
+
+   _bson_value_copy (src, dst, NULL);
+}
+
+
+void
+bson_value_copy_in_arena (const bson_value_t *src, /* IN */
+                          bson_value_t *dst,       /* OUT */
+                          bson_arena_t *arena)     /* IN */
+{
+   BSON_ASSERT (src);
+   BSON_ASSERT (dst);
+   BSON_ASSERT (arena);
+
+   _bson_value_copy (src, dst, arena);
+}
+
+
 void
 bson_value_destroy (bson_value_t *value) /* IN */
 {
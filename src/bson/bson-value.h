@@ -19,6 +19,7 @@
 #define BSON_VALUE_H
 
 
+#include "bson-arena.h"
 #include "bson-macros.h"
 #include "bson-types.h"
 
@@ -29,6 +30,10 @@ BSON_BEGIN_DECLS
 BSON_EXPORT (void)
 bson_value_copy (const bson_value_t *src, bson_value_t *dst);
 BSON_EXPORT (void)
+bson_value_copy_in_arena (const bson_value_t *src,
+                          bson_value_t *dst,
+                          bson_arena_t *arena);
+BSON_EXPORT (void)
 bson_value_destroy (bson_value_t *value);
 
 
@@ -20,7 +20,9 @@
 #include "b64_ntop.h"
 #include "bson-private.h"
 #include "bson-string.h"
+#include "bson-dtoa-private.h"
 #include "bson-iso8601-private.h"
+#include "bson-json-writer-private.h"
 
 #include <string.h>
 #include <math.h>
@@ -43,13 +45,6 @@ typedef enum {
 } bson_validate_phase_t;
 
 
-typedef enum {
-   BSON_JSON_MODE_LEGACY,
-   BSON_JSON_MODE_CANONICAL,
-   BSON_JSON_MODE_RELAXED,
-} bson_json_mode_t;
-
-
 /*
  * Structures.
  */
@@ -68,6 +63,7 @@ typedef struct {
    uint32_t depth;
    bson_string_t *str;
    bson_json_mode_t mode;
+   bson_json_writer_t *writer;
 } bson_json_state_t;
 
 
@@ -84,16 +80,101 @@ _bson_as_json_visit_document (const bson_iter_t *iter,
                               const char *key,
                               const bson_t *v_document,
                               void *data);
-static char *
-_bson_as_json_visit_all (const bson_t *bson,
-                         size_t *length,
-                         bson_json_mode_t mode);
+static bool
+_bson_as_json_visit_child (bson_json_state_t *state,
+                           const bson_t *child,
+                           bool keys,
+                           const char *close);
 
 /*
  * Globals.
  */
 static const uint8_t gZero;
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_grow_size --
+ *
+ *       Compute the new size of a buffer of @alloclen bytes that must
+ *       hold @req bytes, by the growth policy in @flags.
+ *
+ * Returns:
+ *       The new size, or zero if it would exceed INT32_MAX.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static size_t
+_bson_grow_size (uint32_t flags,  /* IN */
+                 size_t alloclen, /* IN */
+                 size_t req)      /* IN */
+{
+   size_t size;
+
+   if (req > INT32_MAX) {
+      return 0;
+   }
+
+   if (flags & BSON_FLAG_GROW_EXACT) {
+      return req;
+   }
+
+   if (flags & BSON_FLAG_GROW_ONE_AND_HALF) {
+      size = BSON_MIN (alloclen + alloclen / 2, (size_t) INT32_MAX);
+      return BSON_MAX (size, req);
+   }
+
+   size = bson_next_power_of_two (req);
+
+   return size <= INT32_MAX ? size : 0;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_impl_inline_to_alloc --
+ *
+ *       Move the data of an inline document to a malloc based buffer of
+ *       @alloclen bytes.
+ *
+ * Returns:
+ *       None.
+ *
+ * Side effects:
+ *       @impl is no longer inline.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static void
+_bson_impl_inline_to_alloc (bson_impl_inline_t *impl, /* IN */
+                            size_t alloclen)          /* IN */
+{
+   bson_impl_alloc_t *alloc = (bson_impl_alloc_t *) impl;
+   uint8_t *data;
+
+   data = bson_malloc (alloclen);
+
+   memcpy (data, impl->data, impl->len);
+   alloc->flags &= ~BSON_FLAG_INLINE;
+   alloc->parent = NULL;
+   alloc->depth = 0;
+   alloc->regrows = 0;
+   alloc->buf = &alloc->alloc;
+   alloc->buflen = &alloc->alloclen;
+   alloc->offset = 0;
+   alloc->alloc = data;
+   alloc->alloclen = alloclen;
+   alloc->realloc = bson_realloc_ctx;
+   alloc->realloc_func_ctx = NULL;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -117,30 +198,18 @@ _bson_impl_inline_grow (bson_impl_inline_t *impl, /* IN */
                         size_t size)              /* IN */
 {
    bson_impl_alloc_t *alloc = (bson_impl_alloc_t *) impl;
-   uint8_t *data;
    size_t req;
 
    if (((size_t) impl->len + size) <= sizeof impl->data) {
       return true;
    }
 
-   req = bson_next_power_of_two (impl->len + size);
-
-   if (req <= INT32_MAX) {
-      data = bson_malloc (req);
-
-      memcpy (data, impl->data, impl->len);
-      alloc->flags &= ~BSON_FLAG_INLINE;
-      alloc->parent = NULL;
-      alloc->depth = 0;
-      alloc->buf = &alloc->alloc;
-      alloc->buflen = &alloc->alloclen;
-      alloc->offset = 0;
-      alloc->alloc = data;
-      alloc->alloclen = req;
-      alloc->realloc = bson_realloc_ctx;
-      alloc->realloc_func_ctx = NULL;
+   req = _bson_grow_size (
+      impl->flags, sizeof impl->data, (size_t) impl->len + size);
 
+   if (req) {
+      _bson_impl_inline_to_alloc (impl, req);
+      alloc->regrows = 1;
       return true;
    }
 
@@ -181,11 +250,18 @@ _bson_impl_alloc_grow (bson_impl_alloc_t *impl, /* IN */
       return true;
    }
 
-   req = bson_next_power_of_two (req);
+   req = _bson_grow_size (impl->flags, *impl->buflen, req);
 
-   if ((req <= INT32_MAX) && impl->realloc) {
+   if (req && impl->realloc) {
       *impl->buf = impl->realloc (*impl->buf, req, impl->realloc_func_ctx);
       *impl->buflen = req;
+
+      /* children share their root's buffer, count the growth there */
+      while (impl->flags & BSON_FLAG_CHILD) {
+         impl = (bson_impl_alloc_t *) impl->parent;
+      }
+
+      impl->regrows++;
       return true;
    }
 
@@ -408,6 +484,48 @@ _bson_append (bson_t *bson,              /* IN */
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_append_raw --
+ *
+ *       Grow @bson by @n_bytes of elements in one step, for callers that
+ *       encode the elements themselves. The length and trailing NUL of
+ *       @bson are updated; the caller must fill in all @n_bytes bytes.
+ *
+ * Returns:
+ *       Where the new elements go, or NULL if @bson would overflow.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+uint8_t *
+_bson_append_raw (bson_t *bson,     /* IN */
+                  uint32_t n_bytes) /* IN */
+{
+   uint8_t *data;
+
+   BSON_ASSERT (bson);
+   BSON_ASSERT (!(bson->flags & BSON_FLAG_IN_CHILD));
+   BSON_ASSERT (!(bson->flags & BSON_FLAG_RDONLY));
+
+   if (BSON_UNLIKELY (n_bytes > (BSON_MAX_SIZE - bson->len)) ||
+       !_bson_grow (bson, n_bytes)) {
+      return NULL;
+   }
+
+   data = _bson_data (bson) + bson->len - 1;
+   bson->len += n_bytes;
+   _bson_data (bson)[bson->len - 1] = '\0';
+   _bson_encode_length (bson);
+
+   return data;
+}
+
+
 /*
  *--------------------------------------------------------------------------
  *
@@ -497,6 +615,8 @@ _bson_append_bson_begin (bson_t *bson,           /* IN */
     * walking up to the parent bson_t.
     */
    achild->flags = (BSON_FLAG_CHILD | BSON_FLAG_NO_FREE | BSON_FLAG_STATIC);
+   achild->flags |= bson->flags & BSON_FLAG_GROWTH_MASK;
+   achild->regrows = 0;
 
    if ((bson->flags & BSON_FLAG_CHILD)) {
       achild->depth = ((bson_impl_alloc_t *) bson)->depth + 1;
@@ -1994,6 +2114,7 @@ bson_init_static (bson_t *bson, const uint8_t *data, size_t length)
    impl->len = (uint32_t) length;
    impl->parent = NULL;
    impl->depth = 0;
+   impl->regrows = 0;
    impl->buf = &impl->alloc;
    impl->buflen = &impl->alloclen;
    impl->offset = 0;
@@ -2006,6 +2127,103 @@ bson_init_static (bson_t *bson, const uint8_t *data, size_t length)
 }
 
 
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_init_with_len --
+ *
+ *       Initialize @bson as a document of @len bytes, stored inline if it
+ *       fits and otherwise in a single allocation of exactly @len bytes.
+ *       The caller must fill in all @len bytes of the returned data.
+ *
+ * Returns:
+ *       The data of @bson.
+ *
+ * Side effects:
+ *       @bson is initialized and must be freed with bson_destroy().
+ *
+ *--------------------------------------------------------------------------
+ */
+
+uint8_t *
+_bson_init_with_len (bson_t *bson, /* OUT */
+                     uint32_t len) /* IN */
+{
+   bson_impl_alloc_t *impl = (bson_impl_alloc_t *) bson;
+
+   BSON_ASSERT (bson);
+   BSON_ASSERT (len >= 5 && len <= INT32_MAX);
+
+   if (len <= BSON_INLINE_DATA_SIZE) {
+      bson_init (bson);
+      bson->len = len;
+      return ((bson_impl_inline_t *) bson)->data;
+   }
+
+   impl->flags = BSON_FLAG_STATIC;
+   impl->len = len;
+   impl->parent = NULL;
+   impl->depth = 0;
+   impl->regrows = 0;
+   impl->buf = &impl->alloc;
+   impl->buflen = &impl->alloclen;
+   impl->offset = 0;
+   impl->alloc = bson_malloc (len);
+   impl->alloclen = len;
+   impl->realloc = bson_realloc_ctx;
+   impl->realloc_func_ctx = NULL;
+
+   return impl->alloc;
+}
+
+
+void
+bson_init_in_arena (bson_t *bson, bson_arena_t *arena)
+{
+   bson_impl_alloc_t *impl = (bson_impl_alloc_t *) bson;
+
+   BSON_ASSERT (bson);
+   BSON_ASSERT (arena);
+
+   /*
+    * The buffer belongs to the arena, so bson_destroy() must never free it.
+    * Growth goes through bson_arena_realloc(), which child documents inherit
+    * from their parent in _bson_append_bson_begin().
+    */
+   impl->flags = BSON_FLAG_STATIC | BSON_FLAG_NO_FREE;
+   impl->len = 5;
+   impl->parent = NULL;
+   impl->depth = 0;
+   impl->regrows = 0;
+   impl->buf = &impl->alloc;
+   impl->buflen = &impl->alloclen;
+   impl->offset = 0;
+   impl->alloclen = sizeof (bson_impl_inline_t);
+   impl->alloc = bson_arena_alloc (arena, impl->alloclen);
+   impl->alloc[0] = 5;
+   impl->alloc[1] = 0;
+   impl->alloc[2] = 0;
+   impl->alloc[3] = 0;
+   impl->alloc[4] = 0;
+   impl->realloc = bson_arena_realloc;
+   impl->realloc_func_ctx = arena;
+}
+
+
+bson_t *
+bson_new_in_arena (bson_arena_t *arena)
+{
+   bson_t *bson;
+
+   BSON_ASSERT (arena);
+
+   bson = bson_arena_alloc (arena, sizeof *bson);
+   bson_init_in_arena (bson, arena);
+
+   return bson;
+}
+
+
 bson_t *
 bson_new (void)
 {
@@ -2046,6 +2264,7 @@ bson_sized_new (size_t size)
       impl_a->len = 5;
       impl_a->parent = NULL;
       impl_a->depth = 0;
+      impl_a->regrows = 0;
       impl_a->buf = &impl_a->alloc;
       impl_a->buflen = &impl_a->alloclen;
       impl_a->offset = 0;
@@ -2064,6 +2283,161 @@ bson_sized_new (size_t size)
 }
 
 
+void
+bson_set_growth_policy (bson_t *bson,                /* IN */
+                        bson_growth_policy_t policy) /* IN */
+{
+   BSON_ASSERT (bson);
+
+   bson->flags &= ~BSON_FLAG_GROWTH_MASK;
+
+   switch (policy) {
+   case BSON_GROWTH_ONE_AND_HALF:
+      bson->flags |= BSON_FLAG_GROW_ONE_AND_HALF;
+      break;
+   case BSON_GROWTH_EXACT:
+      bson->flags |= BSON_FLAG_GROW_EXACT;
+      break;
+   case BSON_GROWTH_POWER_OF_TWO:
+   default:
+      break;
+   }
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_set_size_hint --
+ *
+ *       Grow the buffer of @bson to exactly @size bytes if it is smaller,
+ *       whatever its growth policy. This is not counted as a regrowth.
+ *
+ * Returns:
+ *       true if successful; otherwise false.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_set_size_hint (bson_t *bson, /* IN */
+                    size_t size)  /* IN */
+{
+   bson_impl_alloc_t *impl = (bson_impl_alloc_t *) bson;
+   size_t req;
+
+   BSON_ASSERT (bson);
+
+   if (size > INT32_MAX ||
+       (bson->flags &
+        (BSON_FLAG_RDONLY | BSON_FLAG_CHILD | BSON_FLAG_IN_CHILD))) {
+      return false;
+   }
+
+   if (size <= bson_get_capacity (bson)) {
+      return true;
+   }
+
+   if (bson->flags & BSON_FLAG_INLINE) {
+      _bson_impl_inline_to_alloc ((bson_impl_inline_t *) bson, size);
+      return true;
+   }
+
+   if (!impl->realloc) {
+      return false;
+   }
+
+   req = impl->offset + size + impl->depth;
+   *impl->buf = impl->realloc (*impl->buf, req, impl->realloc_func_ctx);
+   *impl->buflen = req;
+
+   return true;
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * bson_shrink_to_fit --
+ *
+ *       Reallocate the buffer of @bson to the length of the document.
+ *       Inline documents have nothing to give back.
+ *
+ * Returns:
+ *       true if successful or there was nothing to do; false if @bson
+ *       does not own its buffer.
+ *
+ * Side effects:
+ *       None.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+bool
+bson_shrink_to_fit (bson_t *bson) /* IN */
+{
+   bson_impl_alloc_t *impl = (bson_impl_alloc_t *) bson;
+
+   BSON_ASSERT (bson);
+
+   if (bson->flags & BSON_FLAG_INLINE) {
+      return true;
+   }
+
+   if ((bson->flags &
+        (BSON_FLAG_RDONLY | BSON_FLAG_CHILD | BSON_FLAG_IN_CHILD)) ||
+       impl->buf != &impl->alloc || impl->offset || !impl->realloc) {
+      return false;
+   }
+
+   if (impl->alloclen > bson->len) {
+      impl->alloc =
+         impl->realloc (impl->alloc, bson->len, impl->realloc_func_ctx);
+      impl->alloclen = bson->len;
+   }
+
+   return true;
+}
+
+
+size_t
+bson_get_capacity (const bson_t *bson) /* IN */
+{
+   const bson_impl_alloc_t *impl = (const bson_impl_alloc_t *) bson;
+
+   BSON_ASSERT (bson);
+
+   if (bson->flags & BSON_FLAG_INLINE) {
+      return BSON_INLINE_DATA_SIZE;
+   }
+
+   /* the bytes after the offset, less the NULs of open parents */
+   return *impl->buflen - impl->offset - impl->depth;
+}
+
+
+uint32_t
+bson_get_regrow_count (const bson_t *bson) /* IN */
+{
+   const bson_impl_alloc_t *impl = (const bson_impl_alloc_t *) bson;
+
+   BSON_ASSERT (bson);
+
+   if (bson->flags & BSON_FLAG_INLINE) {
+      return 0;
+   }
+
+   while (impl->flags & BSON_FLAG_CHILD) {
+      impl = (const bson_impl_alloc_t *) impl->parent;
+   }
+
+   return impl->regrows;
+}
+
+
 bson_t *
 bson_new_from_data (const uint8_t *data, size_t length)
 {
@@ -2180,6 +2554,7 @@ bson_copy_to (const bson_t *src, bson_t *dst)
    adst->len = src->len;
    adst->parent = NULL;
    adst->depth = 0;
+   adst->regrows = 0;
    adst->buf = &adst->alloc;
    adst->buflen = &adst->alloclen;
    adst->offset = 0;
@@ -2334,6 +2709,7 @@ bson_steal (bson_t *dst, bson_t *src)
       src_inline = (bson_impl_inline_t *) src;
       dst_inline = (bson_impl_inline_t *) dst;
       dst_inline->len = src_inline->len;
+      dst_inline->flags |= src_inline->flags & BSON_FLAG_GROWTH_MASK;
       memcpy (dst_inline->data, src_inline->data, sizeof src_inline->data);
 
       /* for consistency, src is always invalid after steal, even if inline */
@@ -2386,8 +2762,15 @@ bson_destroy_with_steal (bson_t *bson, bool steal, uint32_t *length)
       bson_impl_alloc_t *alloc;
 
       alloc = (bson_impl_alloc_t *) bson;
-      ret = *alloc->buf;
-      *alloc->buf = NULL;
+
+      if (alloc->realloc == bson_arena_realloc) {
+         /* the caller will bson_free() the result, so copy out of the arena */
+         ret = bson_malloc (bson->len);
+         memcpy (ret, _bson_data (bson), bson->len);
+      } else {
+         ret = *alloc->buf;
+         *alloc->buf = NULL;
+      }
    }
 
    bson_destroy (bson);
@@ -2477,6 +2860,33 @@ bson_equal (const bson_t *bson, const bson_t *other)
 }
 
 
+/*
+ * Make room for @len more bytes at the end of @str, so that numbers can be
+ * formatted in place rather than through a temporary string.
+ */
+static BSON_INLINE char *
+_bson_as_json_reserve (bson_string_t *str, uint32_t len)
+{
+   if ((str->alloc - str->len - 1) < len) {
+      str->alloc += len;
+      if (!bson_is_power_of_two (str->alloc)) {
+         str->alloc = (uint32_t) bson_next_power_of_two ((size_t) str->alloc);
+      }
+      str->str = bson_realloc (str->str, str->alloc);
+   }
+
+   return str->str + str->len;
+}
+
+
+static void
+_bson_as_json_append_int64 (bson_string_t *str, int64_t v)
+{
+   str->len += (uint32_t) _bson_i64toa (
+      v, _bson_as_json_reserve (str, BSON_ITOA_BUFFER_SIZE));
+}
+
+
 static bool
 _bson_as_json_visit_utf8 (const bson_iter_t *iter,
                           const char *key,
@@ -2510,10 +2920,11 @@ _bson_as_json_visit_int32 (const bson_iter_t *iter,
    bson_json_state_t *state = data;
 
    if (state->mode == BSON_JSON_MODE_CANONICAL) {
-      bson_string_append_printf (
-         state->str, "{ \"$numberInt\" : \"%" PRId32 "\" }", v_int32);
+      bson_string_append (state->str, "{ \"$numberInt\" : \"");
+      _bson_as_json_append_int64 (state->str, v_int32);
+      bson_string_append (state->str, "\" }");
    } else {
-      bson_string_append_printf (state->str, "%" PRId32, v_int32);
+      _bson_as_json_append_int64 (state->str, v_int32);
    }
 
    return false;
@@ -2529,10 +2940,11 @@ _bson_as_json_visit_int64 (const bson_iter_t *iter,
    bson_json_state_t *state = data;
 
    if (state->mode == BSON_JSON_MODE_CANONICAL) {
-      bson_string_append_printf (
-         state->str, "{ \"$numberLong\" : \"%" PRId64 "\"}", v_int64);
+      bson_string_append (state->str, "{ \"$numberLong\" : \"");
+      _bson_as_json_append_int64 (state->str, v_int64);
+      bson_string_append (state->str, "\"}");
    } else {
-      bson_string_append_printf (state->str, "%" PRId64, v_int64);
+      _bson_as_json_append_int64 (state->str, v_int64);
    }
 
    return false;
@@ -2589,7 +3001,8 @@ _bson_as_json_visit_double (const bson_iter_t *iter,
       }
    } else {
       start_len = str->len;
-      bson_string_append_printf (str, "%.20g", v_double);
+      str->len += (uint32_t) _bson_dtoa (
+         v_double, _bson_as_json_reserve (str, BSON_DTOA_BUFFER_SIZE));
 
       /* ensure trailing ".0" to distinguish "3" from "3.0" */
       if (strspn (&str->str[start_len], "0123456789-") ==
@@ -2710,7 +3123,7 @@ _bson_as_json_visit_date_time (const bson_iter_t *iter,
    if (state->mode == BSON_JSON_MODE_CANONICAL ||
        (state->mode == BSON_JSON_MODE_RELAXED && msec_since_epoch < 0)) {
       bson_string_append (state->str, "{ \"$date\" : { \"$numberLong\" : \"");
-      bson_string_append_printf (state->str, "%" PRId64, msec_since_epoch);
+      _bson_as_json_append_int64 (state->str, msec_since_epoch);
       bson_string_append (state->str, "\" } }");
    } else if (state->mode == BSON_JSON_MODE_RELAXED) {
       bson_string_append (state->str, "{ \"$date\" : \"");
@@ -2718,7 +3131,7 @@ _bson_as_json_visit_date_time (const bson_iter_t *iter,
       bson_string_append (state->str, "\" }");
    } else {
       bson_string_append (state->str, "{ \"$date\" : ");
-      bson_string_append_printf (state->str, "%" PRId64, msec_since_epoch);
+      _bson_as_json_append_int64 (state->str, msec_since_epoch);
       bson_string_append (state->str, " }");
    }
 
@@ -2773,9 +3186,9 @@ _bson_as_json_visit_timestamp (const bson_iter_t *iter,
    bson_json_state_t *state = data;
 
    bson_string_append (state->str, "{ \"$timestamp\" : { \"t\" : ");
-   bson_string_append_printf (state->str, "%u", v_timestamp);
+   _bson_as_json_append_int64 (state->str, v_timestamp);
    bson_string_append (state->str, ", \"i\" : ");
-   bson_string_append_printf (state->str, "%u", v_increment);
+   _bson_as_json_append_int64 (state->str, v_increment);
    bson_string_append (state->str, " } }");
 
    return false;
@@ -2897,6 +3310,33 @@ _bson_as_json_visit_corrupt (const bson_iter_t *iter, void *data)
 }
 
 
+static bool
+_bson_as_json_visit_after (const bson_iter_t *iter,
+                           const char *key,
+                           void *data)
+{
+   bson_json_state_t *state = data;
+   bson_json_writer_t *writer = state->writer;
+
+   if (*state->err_offset != -1) {
+      return true;
+   }
+
+   /* hand output to the writer between elements, and pause if its static
+    * buffer is full */
+   if (!writer || _bson_json_writer_drain (writer, false)) {
+      return false;
+   }
+
+   if (!writer->failed) {
+      writer->paused = true;
+      writer->n_frames = state->depth + 1;
+   }
+
+   return true;
+}
+
+
 static bool
 _bson_as_json_visit_code (const bson_iter_t *iter,
                           const char *key,
@@ -2963,37 +3403,35 @@ _bson_as_json_visit_codewscope (const bson_iter_t *iter,
 {
    bson_json_state_t *state = data;
    char *code_escaped;
-   char *scope;
 
    code_escaped = bson_utf8_escape_for_json (v_code, v_code_len);
    if (!code_escaped) {
       return true;
    }
 
-   /* Encode scope with the same mode */
-   scope = _bson_as_json_visit_all (v_scope, NULL, state->mode);
-
-   if (!scope) {
-      bson_free (code_escaped);
-      return true;
-   }
-
    bson_string_append (state->str, "{ \"$code\" : \"");
    bson_string_append (state->str, code_escaped);
    bson_string_append (state->str, "\", \"$scope\" : ");
-   bson_string_append (state->str, scope);
-   bson_string_append (state->str, " }");
-
    bson_free (code_escaped);
-   bson_free (scope);
 
-   return false;
+   /* Encode scope with the same mode */
+   if (bson_empty (v_scope)) {
+      bson_string_append (state->str, "{ } }");
+      return false;
+   }
+
+   if (state->depth >= BSON_MAX_RECURSION) {
+      bson_string_append (state->str, "{ ... } }");
+      return false;
+   }
+
+   return _bson_as_json_visit_child (state, v_scope, true, " } }");
 }
 
 
 static const bson_visitor_t bson_as_json_visitors = {
    _bson_as_json_visit_before,
-   NULL, /* visit_after */
+   _bson_as_json_visit_after,
    _bson_as_json_visit_corrupt,
    _bson_as_json_visit_double,
    _bson_as_json_visit_utf8,
@@ -3021,37 +3459,60 @@ static const bson_visitor_t bson_as_json_visitors = {
 
 
 static bool
-_bson_as_json_visit_document (const bson_iter_t *iter,
-                              const char *key,
-                              const bson_t *v_document,
-                              void *data)
+_bson_as_json_visit_child (bson_json_state_t *state,
+                           const bson_t *child,
+                           bool keys,
+                           const char *close)
 {
-   bson_json_state_t *state = data;
-   bson_json_state_t child_state = {0, true, state->err_offset};
-   bson_iter_t child;
+   bson_json_state_t child_state = {0, keys, state->err_offset};
+   bson_json_frame_t *frame = NULL;
+   bson_iter_t local;
+   bson_iter_t *iter = &local;
 
-   if (state->depth >= BSON_MAX_RECURSION) {
-      bson_string_append (state->str, "{ ... }");
-      return false;
+   if (state->writer) {
+      frame = &state->writer->frames[state->depth + 1];
+      frame->keys = keys;
+      frame->close = close;
+      iter = &frame->iter;
    }
 
-   if (bson_iter_init (&child, v_document)) {
-      child_state.str = bson_string_new ("{ ");
+   if (bson_iter_init (iter, child)) {
+      child_state.str = state->str;
       child_state.depth = state->depth + 1;
       child_state.mode = state->mode;
-      if (bson_iter_visit_all (&child, &bson_as_json_visitors, &child_state)) {
+      child_state.writer = state->writer;
+      bson_string_append (state->str, keys ? "{ " : "[ ");
+      if (bson_iter_visit_all (iter, &bson_as_json_visitors, &child_state)) {
+         if (frame) {
+            frame->count = child_state.count;
+         }
          return true;
       }
 
-      bson_string_append (child_state.str, " }");
-      bson_string_append (state->str, child_state.str->str);
-      bson_string_free (child_state.str, true);
+      bson_string_append (state->str, close);
    }
 
    return false;
 }
 
 
+static bool
+_bson_as_json_visit_document (const bson_iter_t *iter,
+                              const char *key,
+                              const bson_t *v_document,
+                              void *data)
+{
+   bson_json_state_t *state = data;
+
+   if (state->depth >= BSON_MAX_RECURSION) {
+      bson_string_append (state->str, "{ ... }");
+      return false;
+   }
+
+   return _bson_as_json_visit_child (state, v_document, true, " }");
+}
+
+
 static bool
 _bson_as_json_visit_array (const bson_iter_t *iter,
                            const char *key,
@@ -3059,35 +3520,21 @@ _bson_as_json_visit_array (const bson_iter_t *iter,
                            void *data)
 {
    bson_json_state_t *state = data;
-   bson_json_state_t child_state = {0, false, state->err_offset};
-   bson_iter_t child;
 
    if (state->depth >= BSON_MAX_RECURSION) {
       bson_string_append (state->str, "{ ... }");
       return false;
    }
 
-   if (bson_iter_init (&child, v_array)) {
-      child_state.str = bson_string_new ("[ ");
-      child_state.depth = state->depth + 1;
-      child_state.mode = state->mode;
-      if (bson_iter_visit_all (&child, &bson_as_json_visitors, &child_state)) {
-         return true;
-      }
-
-      bson_string_append (child_state.str, " ]");
-      bson_string_append (state->str, child_state.str->str);
-      bson_string_free (child_state.str, true);
-   }
-
-   return false;
+   return _bson_as_json_visit_child (state, v_array, false, " ]");
 }
 
 
 static char *
 _bson_as_json_visit_all (const bson_t *bson,
                          size_t *length,
-                         bson_json_mode_t mode)
+                         bson_json_mode_t mode,
+                         bool keys)
 {
    bson_json_state_t state;
    bson_iter_t iter;
@@ -3104,7 +3551,7 @@ _bson_as_json_visit_all (const bson_t *bson,
          *length = 3;
       }
 
-      return bson_strdup ("{ }");
+      return bson_strdup (keys ? "{ }" : "[ ]");
    }
 
    if (!bson_iter_init (&iter, bson)) {
@@ -3112,11 +3559,12 @@ _bson_as_json_visit_all (const bson_t *bson,
    }
 
    state.count = 0;
-   state.keys = true;
-   state.str = bson_string_new ("{ ");
+   state.keys = keys;
+   state.str = bson_string_new (keys ? "{ " : "[ ");
    state.depth = 0;
    state.err_offset = &err_offset;
    state.mode = mode;
+   state.writer = NULL;
 
    if (bson_iter_visit_all (&iter, &bson_as_json_visitors, &state) ||
        err_offset != -1) {
@@ -3130,7 +3578,7 @@ _bson_as_json_visit_all (const bson_t *bson,
       return NULL;
    }
 
-   bson_string_append (state.str, " }");
+   bson_string_append (state.str, keys ? " }" : " ]");
 
    if (length) {
       *length = state.str->len;
@@ -3143,76 +3591,195 @@ _bson_as_json_visit_all (const bson_t *bson,
 char *
 bson_as_canonical_extended_json (const bson_t *bson, size_t *length)
 {
-   return _bson_as_json_visit_all (bson, length, BSON_JSON_MODE_CANONICAL);
+   return _bson_as_json_visit_all (
+      bson, length, BSON_JSON_MODE_CANONICAL, true);
 }
 
 
 char *
 bson_as_json (const bson_t *bson, size_t *length)
 {
-   return _bson_as_json_visit_all (bson, length, BSON_JSON_MODE_LEGACY);
+   return _bson_as_json_visit_all (bson, length, BSON_JSON_MODE_LEGACY, true);
 }
 
 
 char *
 bson_as_relaxed_extended_json (const bson_t *bson, size_t *length)
 {
-   return _bson_as_json_visit_all (bson, length, BSON_JSON_MODE_RELAXED);
+   return _bson_as_json_visit_all (bson, length, BSON_JSON_MODE_RELAXED, true);
 }
 
 
 char *
 bson_array_as_json (const bson_t *bson, size_t *length)
 {
+   return _bson_as_json_visit_all (
+      bson, length, BSON_JSON_MODE_LEGACY, false);
+}
+
+
+/*
+ *--------------------------------------------------------------------------
+ *
+ * _bson_as_json_resume --
+ *
+ *       Continue writing the document at level @depth of the writer's
+ *       frames, after writing was paused or when it is first started with
+ *       a single frame. If the pause happened inside an embedded document,
+ *       that document is finished first.
+ *
+ * Returns:
+ *       true if writing stopped again, because the static buffer is full,
+ *       or because of an error; false once this level is complete.
+ *
+ * Side effects:
+ *       @err_offset is set if corrupt BSON is found.
+ *
+ *--------------------------------------------------------------------------
+ */
+
+static bool
+_bson_as_json_resume (bson_json_writer_t *writer, /* IN */
+                      uint32_t depth,             /* IN */
+                      ssize_t *err_offset)        /* OUT */
+{
+   bson_json_frame_t *frame = &writer->frames[depth];
    bson_json_state_t state;
-   bson_iter_t iter;
+
+   state.count = frame->count;
+   state.keys = frame->keys;
+   state.err_offset = err_offset;
+   state.depth = depth;
+   state.str = writer->str;
+   state.mode = writer->mode;
+   state.writer = writer;
+
+   if (depth + 1 < writer->n_frames &&
+       (_bson_as_json_resume (writer, depth + 1, err_offset) ||
+        _bson_as_json_visit_after (&frame->iter, NULL, &state))) {
+      return true;
+   }
+
+   if (bson_iter_visit_all (&frame->iter, &bson_as_json_visitors, &state)) {
+      frame->count = state.count;
+      return true;
+   }
+
+   bson_string_append (writer->str, frame->close);
+
+   return false;
+}
+
+
+int
+bson_as_json_to_writer (const bson_t *bson,         /* IN */
+                        bson_json_mode_t mode,      /* IN */
+                        bson_json_writer_t *writer, /* IN */
+                        bson_error_t *error)        /* OUT */
+{
+   bson_json_frame_t *frame;
    ssize_t err_offset = -1;
+   uint32_t start;
+   bool stopped = false;
 
    BSON_ASSERT (bson);
+   BSON_ASSERT (writer);
 
-   if (length) {
-      *length = 0;
-   }
+   start = writer->str->len;
 
-   if (bson_empty0 (bson)) {
-      if (length) {
-         *length = 3;
+   if (writer->paused) {
+      if (writer->bson != bson || writer->mode != mode) {
+         bson_set_error (error,
+                         BSON_ERROR_JSON,
+                         BSON_JSON_ERROR_WRITE_INVALID_PARAM,
+                         "Another document is partially written");
+         return -1;
       }
 
-      return bson_strdup ("[ ]");
-   }
+      writer->paused = false;
 
-   if (!bson_iter_init (&iter, bson)) {
-      return NULL;
+      if (!_bson_json_writer_drain (writer, false)) {
+         writer->paused = true;
+         return 0;
+      }
+
+      if (writer->n_frames) {
+         stopped = _bson_as_json_resume (writer, 0, &err_offset);
+      }
+   } else if (writer->failed) {
+      bson_set_error (error,
+                      BSON_ERROR_JSON,
+                      BSON_JSON_ERROR_WRITE_CB_FAILURE,
+                      "Failed to write JSON output");
+      return -1;
+   } else if (bson_empty0 (bson)) {
+      writer->bson = bson;
+      writer->mode = mode;
+      bson_string_append (writer->str, "{ }");
+   } else {
+      if (!writer->frames) {
+         writer->frames =
+            bson_malloc ((BSON_MAX_RECURSION + 1) * sizeof *writer->frames);
+      }
+
+      frame = &writer->frames[0];
+      if (!bson_iter_init (&frame->iter, bson)) {
+         bson_set_error (error,
+                         BSON_ERROR_JSON,
+                         BSON_JSON_ERROR_WRITE_CORRUPT_BSON,
+                         "Cannot write corrupt BSON as JSON");
+         return -1;
+      }
+
+      frame->count = 0;
+      frame->keys = true;
+      frame->close = " }";
+      writer->bson = bson;
+      writer->mode = mode;
+      writer->n_frames = 1;
+
+      bson_string_append (writer->str, "{ ");
+      stopped = _bson_as_json_resume (writer, 0, &err_offset);
    }
 
-   state.count = 0;
-   state.keys = false;
-   state.str = bson_string_new ("[ ");
-   state.depth = 0;
-   state.err_offset = &err_offset;
-   state.mode = BSON_JSON_MODE_LEGACY;
-   bson_iter_visit_all (&iter, &bson_as_json_visitors, &state);
+   if (!stopped && err_offset == -1) {
+      writer->n_frames = 0;
 
-   if (bson_iter_visit_all (&iter, &bson_as_json_visitors, &state) ||
-       err_offset != -1) {
-      /*
-       * We were prematurely exited due to corruption or failed visitor.
-       */
-      bson_string_free (state.str, true);
-      if (length) {
-         *length = 0;
+      if (_bson_json_writer_drain (writer, false)) {
+         return 1;
+      }
+
+      if (!writer->failed) {
+         writer->paused = true;
       }
-      return NULL;
    }
 
-   bson_string_append (state.str, " ]");
+   if (writer->paused) {
+      return 0;
+   }
 
-   if (length) {
-      *length = state.str->len;
+   if (writer->failed) {
+      bson_set_error (error,
+                      BSON_ERROR_JSON,
+                      BSON_JSON_ERROR_WRITE_CB_FAILURE,
+                      "Failed to write JSON output");
+   } else {
+      bson_set_error (error,
+                      BSON_ERROR_JSON,
+                      BSON_JSON_ERROR_WRITE_CORRUPT_BSON,
+                      "Cannot write corrupt BSON as JSON");
    }
 
-   return bson_string_free (state.str, false);
+   /* discard what was not delivered, a data writer drops the document */
+   if (writer->type != BSON_JSON_WRITER_DATA) {
+      start = 0;
+   }
+
+   writer->str->len = start;
+   writer->str->str[start] = '\0';
+   writer->n_frames = 0;
+
+   return -1;
 }
 
 
@@ -27,19 +27,31 @@
 
 #include "bson-macros.h"
 #include "bson-config.h"
+#include "bson-arena.h"
+#include "bson-array-builder.h"
+#include "bson-arrow.h"
 #include "bson-atomic.h"
+#include "bson-chain.h"
 #include "bson-context.h"
 #include "bson-clock.h"
+#include "bson-column.h"
 #include "bson-decimal128.h"
 #include "bson-error.h"
+#include "bson-file-index.h"
+#include "bson-index.h"
 #include "bson-iter.h"
 #include "bson-json.h"
 #include "bson-keys.h"
+#include "bson-keyset.h"
 #include "bson-md5.h"
 #include "bson-memory.h"
 #include "bson-oid.h"
+#include "bson-patch.h"
+#include "bson-path.h"
 #include "bson-reader.h"
+#include "bson-splitter.h"
 #include "bson-string.h"
+#include "bson-template.h"
 #include "bson-types.h"
 #include "bson-utf8.h"
 #include "bson-value.h"
@@ -263,6 +275,98 @@ BSON_EXPORT (bson_t *)
 bson_new_from_data (const uint8_t *data, size_t length);
 
 
+/**
+ * bson_init_in_arena:
+ * @bson: A pointer to a bson_t.
+ * @arena: A bson_arena_t.
+ *
+ * Initializes @bson as an empty document whose buffer, and the buffers of
+ * any child documents appended to it, are allocated from @arena. The
+ * memory is released by bson_arena_reset() or bson_arena_destroy();
+ * calling bson_destroy() on @bson is allowed but frees nothing.
+ */
+BSON_EXPORT (void)
+bson_init_in_arena (bson_t *bson, bson_arena_t *arena);
+
+
+/**
+ * bson_new_in_arena:
+ * @arena: A bson_arena_t.
+ *
+ * Like bson_init_in_arena() but the bson_t structure itself is also
+ * allocated from @arena.
+ *
+ * Returns: A bson_t that is valid until @arena is reset or destroyed.
+ */
+BSON_EXPORT (bson_t *)
+bson_new_in_arena (bson_arena_t *arena);
+
+
+/**
+ * bson_set_growth_policy:
+ * @bson: A bson_t.
+ * @policy: A bson_growth_policy_t.
+ *
+ * Sets how the buffer of @bson grows when an append does not fit. Child
+ * documents begun afterwards grow the shared buffer by the same policy.
+ */
+BSON_EXPORT (void)
+bson_set_growth_policy (bson_t *bson, bson_growth_policy_t policy);
+
+
+/**
+ * bson_set_size_hint:
+ * @bson: A bson_t.
+ * @size: The estimated final size of @bson in bytes.
+ *
+ * Grows the buffer of @bson to hold exactly @size bytes, if it is smaller,
+ * so that appends up to that size do not regrow it.
+ *
+ * Returns: true if successful; false if @size is larger than INT32_MAX,
+ *          @bson is read-only, a child document or has a child in
+ *          progress, or its buffer cannot be reallocated.
+ */
+BSON_EXPORT (bool)
+bson_set_size_hint (bson_t *bson, size_t size);
+
+
+/**
+ * bson_shrink_to_fit:
+ * @bson: A bson_t.
+ *
+ * Reallocates the buffer of @bson to the length of the document, to give
+ * back the room left by growth. @bson must own its buffer: it must not be
+ * a child document, have a child in progress, or be read-only.
+ *
+ * Returns: true if successful or there was nothing to do, otherwise false.
+ */
+BSON_EXPORT (bool)
+bson_shrink_to_fit (bson_t *bson);
+
+
+/**
+ * bson_get_capacity:
+ * @bson: A bson_t.
+ *
+ * Returns: The number of bytes @bson can hold without growing, including
+ *          its current length.
+ */
+BSON_EXPORT (size_t)
+bson_get_capacity (const bson_t *bson);
+
+
+/**
+ * bson_get_regrow_count:
+ * @bson: A bson_t.
+ *
+ * Returns: The number of times the buffer of @bson was grown by appending,
+ *          counting the move of an inline document to the heap. Growth
+ *          from appends to child documents is counted in their parent.
+ */
+BSON_EXPORT (uint32_t)
+bson_get_regrow_count (const bson_t *bson);
+
+
 /**
  * bson_new_from_buffer:
  * @buf: A pointer to a buffer containing a serialized bson document.
@@ -0,0 +1,272 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bcon.h>
+#include <bson.h>
+
+#include "TestSuite.h"
+
+
+static void
+test_arena_alloc (void)
+{
+   bson_arena_t *arena;
+   uint8_t *a;
+   uint8_t *b;
+   uint8_t *big;
+
+   arena = bson_arena_new (1024);
+
+   ASSERT (!bson_arena_alloc (arena, 0));
+   ASSERT_CMPSIZE_T (bson_arena_get_size (arena), ==, (size_t) 0);
+
+   a = bson_arena_alloc (arena, 3);
+   b = bson_arena_alloc (arena, 40);
+   ASSERT (a && b);
+   ASSERT_CMPSIZE_T (((size_t) a) % 16, ==, (size_t) 0);
+   ASSERT_CMPSIZE_T (((size_t) b) % 16, ==, (size_t) 0);
+   ASSERT (b >= a + 3);
+   memset (a, 'a', 3);
+   memset (b, 'b', 40);
+
+   /* larger than a chunk, gets its own allocation */
+   big = bson_arena_alloc (arena, 10000);
+   ASSERT (big);
+   memset (big, 'c', 10000);
+   ASSERT_CMPINT (a[2], ==, 'a');
+   ASSERT_CMPINT (b[39], ==, 'b');
+   ASSERT_CMPSIZE_T (bson_arena_get_size (arena), >, (size_t) 10043);
+
+   bson_arena_reset (arena);
+   ASSERT_CMPSIZE_T (bson_arena_get_size (arena), ==, (size_t) 0);
+
+   /* memory is reused from the start of the first chunk */
+   ASSERT (bson_arena_alloc (arena, 3) == a);
+
+   bson_arena_destroy (arena);
+}
+
+
+static void
+test_arena_realloc (void)
+{
+   bson_arena_t *arena;
+   uint8_t *a;
+   uint8_t *b;
+   uint8_t *c;
+   size_t size;
+
+   arena = bson_arena_new (1024);
+
+   a = bson_arena_realloc (NULL, 10, arena);
+   memcpy (a, "0123456789", 10);
+
+   /* the most recent block grows in place */
+   b = bson_arena_realloc (a, 100, arena);
+   ASSERT (a == b);
+   ASSERT_MEMCMP (b, "0123456789", 10);
+
+   /* shrinking is a no-op */
+   ASSERT (bson_arena_realloc (b, 50, arena) == b);
+
+   /* once another block follows, growth must copy */
+   c = bson_arena_alloc (arena, 8);
+   a = bson_arena_realloc (b, 200, arena);
+   ASSERT (a != b);
+   ASSERT (a != c);
+   ASSERT_MEMCMP (a, "0123456789", 10);
+
+   /* freeing the most recent block returns it to the arena */
+   size = bson_arena_get_size (arena);
+   ASSERT (!bson_arena_realloc (a, 0, arena));
+   ASSERT_CMPSIZE_T (bson_arena_get_size (arena), <, size);
+
+   /* growing past the end of the chunk moves to a new chunk */
+   a = bson_arena_alloc (arena, 16);
+   b = bson_arena_realloc (a, 2000, arena);
+   ASSERT (a != b);
+
+   bson_arena_destroy (arena);
+}
+
+
+static void
+test_arena_bson (void)
+{
+   bson_arena_t *arena;
+   bson_t *doc;
+   bson_t child;
+   bson_t local;
+   bson_t *copy;
+   bson_iter_t iter;
+   char key[16];
+   int i;
+   int j;
+
+   arena = bson_arena_new (0);
+
+   for (j = 0; j < 3; j++) {
+      bson_init_in_arena (&local, arena);
+      doc = bson_new_in_arena (arena);
+
+      ASSERT (bson_empty (doc));
+      ASSERT (bson_append_document_begin (doc, "sub", -1, &child));
+      for (i = 0; i < 1000; i++) {
+         bson_snprintf (key, sizeof key, "%d", i);
+         ASSERT (bson_append_int32 (&child, key, -1, i));
+         ASSERT (bson_append_utf8 (&local, key, -1, "value", -1));
+      }
+      ASSERT (bson_append_document_end (doc, &child));
+      ASSERT (bson_append_int32 (doc, "after", -1, 1));
+
+      ASSERT (bson_validate (doc, BSON_VALIDATE_NONE, NULL));
+      ASSERT (bson_validate (&local, BSON_VALIDATE_NONE, NULL));
+      ASSERT_CMPUINT32 (bson_count_keys (&local), ==, (uint32_t) 1000);
+      ASSERT (bson_iter_init_find (&iter, doc, "after"));
+      ASSERT (bson_iter_init (&iter, doc));
+      ASSERT (bson_iter_find_descendant (&iter, "sub.999", &iter));
+      ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 999);
+
+      /* copies leave the arena */
+      copy = bson_copy (doc);
+      ASSERT (bson_equal (copy, doc));
+
+      bson_destroy (&local);
+      bson_destroy (doc);
+      ASSERT (bson_arena_get_size (arena) > 0);
+      bson_arena_reset (arena);
+
+      ASSERT_CMPINT (bson_count_keys (copy), ==, 2);
+      bson_destroy (copy);
+   }
+
+   bson_arena_destroy (arena);
+}
+
+
+static void
+test_arena_bson_steal (void)
+{
+   bson_arena_t *arena;
+   bson_t doc;
+   bson_t stolen;
+   uint8_t *buf;
+   uint32_t len;
+
+   arena = bson_arena_new (0);
+
+   bson_init_in_arena (&doc, arena);
+   BSON_APPEND_UTF8 (&doc, "hello", "world");
+   ASSERT (bson_steal (&stolen, &doc));
+   ASSERT_CMPINT (bson_count_keys (&stolen), ==, 1);
+
+   /* the result is heap memory even though the document lived in the arena */
+   buf = bson_destroy_with_steal (&stolen, true, &len);
+   bson_arena_reset (arena);
+   ASSERT (bson_init_static (&doc, buf, len));
+   ASSERT (bson_has_field (&doc, "hello"));
+   bson_free (buf);
+
+   bson_arena_destroy (arena);
+}
+
+
+static void
+test_arena_value_copy (void)
+{
+   bson_arena_t *arena;
+   bson_value_t value;
+   bson_value_t copy;
+   bson_iter_t iter;
+   bson_t *doc;
+
+   arena = bson_arena_new (0);
+   doc = BCON_NEW ("utf8",
+                   "some text",
+                   "doc",
+                   "{",
+                   "a",
+                   BCON_INT32 (1),
+                   "}",
+                   "regex",
+                   BCON_REGEX ("^abc", "i"));
+
+   ASSERT (bson_iter_init_find (&iter, doc, "utf8"));
+   bson_value_copy_in_arena (bson_iter_value (&iter), &copy, arena);
+   ASSERT_CMPSTR (copy.value.v_utf8.str, "some text");
+   ASSERT_CMPUINT32 (copy.value.v_utf8.len, ==, (uint32_t) 9);
+
+   ASSERT (bson_iter_init_find (&iter, doc, "doc"));
+   bson_value_copy_in_arena (bson_iter_value (&iter), &copy, arena);
+   ASSERT_CMPUINT32 (copy.value.v_doc.data_len, ==, (uint32_t) 12);
+   ASSERT_MEMCMP (
+      copy.value.v_doc.data, iter.raw + iter.d1, copy.value.v_doc.data_len);
+
+   ASSERT (bson_iter_init_find (&iter, doc, "regex"));
+   value = *bson_iter_value (&iter);
+   bson_value_copy_in_arena (&value, &copy, arena);
+   ASSERT_CMPSTR (copy.value.v_regex.regex, "^abc");
+   ASSERT_CMPSTR (copy.value.v_regex.options, "i");
+
+   bson_destroy (doc);
+   bson_arena_destroy (arena);
+}
+
+
+static void
+test_arena_json_reader (void)
+{
+   const char *json = "{\"a\": [1, 2, {\"b\": \"c\"}], \"d\": {\"$oid\": "
+                      "\"000000000000000000000000\"}} {\"e\": 1}";
+   bson_json_reader_t *reader;
+   bson_arena_t *arena;
+   bson_error_t error;
+   bson_t doc;
+   int r;
+
+   arena = bson_arena_new (0);
+   reader = bson_json_data_reader_new (true, 0);
+   bson_json_data_reader_ingest (reader, (const uint8_t *) json, strlen (json));
+
+   bson_init_in_arena (&doc, arena);
+   r = bson_json_reader_read (reader, &doc, &error);
+   ASSERT_OR_PRINT (r == 1, error);
+   ASSERT_CMPJSON (bson_as_json (&doc, NULL),
+                   "{ \"a\" : [ 1, 2, { \"b\" : \"c\" } ], \"d\" : { \"$oid\" "
+                   ": \"000000000000000000000000\" } }");
+   bson_arena_reset (arena);
+
+   bson_init_in_arena (&doc, arena);
+   r = bson_json_reader_read (reader, &doc, &error);
+   ASSERT_OR_PRINT (r == 1, error);
+   ASSERT_CMPJSON (bson_as_json (&doc, NULL), "{ \"e\" : 1 }");
+
+   bson_json_reader_destroy (reader);
+   bson_arena_destroy (arena);
+}
+
+
+void
+test_arena_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/arena/alloc", test_arena_alloc);
+   TestSuite_Add (suite, "/bson/arena/realloc", test_arena_realloc);
+   TestSuite_Add (suite, "/bson/arena/bson", test_arena_bson);
+   TestSuite_Add (suite, "/bson/arena/bson_steal", test_arena_bson_steal);
+   TestSuite_Add (suite, "/bson/arena/value_copy", test_arena_value_copy);
+   TestSuite_Add (suite, "/bson/arena/json_reader", test_arena_json_reader);
+}
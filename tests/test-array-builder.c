@@ -0,0 +1,261 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bcon.h>
+#include <bson.h>
+
+#include "TestSuite.h"
+
+
+
+/* the same array built with bson_append_* and bson_uint32_to_string */
+static void
+_append_expected_int64 (bson_t *expected, uint32_t i, int64_t value)
+{
+   const char *key;
+   char buf[16];
+   size_t len;
+
+   len = bson_uint32_to_string (i, &key, buf, sizeof buf);
+   ASSERT (bson_append_int64 (expected, key, (int) len, value));
+}
+
+
+static void
+test_array_builder_keys (void)
+{
+   bson_array_builder_t *bab;
+   bson_t expected;
+   bson_t array;
+   char *json;
+   uint32_t i;
+
+   bab = bson_array_builder_new ();
+   bson_init (&expected);
+
+   /* past the carries at 9, 99, 999, 9999 */
+   for (i = 0; i < 12000; i++) {
+      ASSERT (bson_array_builder_append_int64 (bab, (int64_t) i * 3));
+      _append_expected_int64 (&expected, i, (int64_t) i * 3);
+   }
+
+   ASSERT_CMPUINT32 (bson_array_builder_length (bab), ==, 12000u);
+   ASSERT (bson_array_builder_build (bab, &array));
+   ASSERT_CMPUINT32 (array.len, ==, expected.len);
+   ASSERT (!memcmp (
+      bson_get_data (&array), bson_get_data (&expected), array.len));
+   bson_destroy (&array);
+
+   /* the builder starts over from "0" */
+   ASSERT_CMPUINT32 (bson_array_builder_length (bab), ==, 0u);
+   ASSERT (bson_array_builder_append_utf8 (bab, "x", -1));
+   ASSERT (bson_array_builder_append_null (bab));
+   ASSERT (bson_array_builder_build (bab, &array));
+   json = bson_as_canonical_extended_json (&array, NULL);
+   ASSERT_CMPSTR (json, "{ \"0\" : \"x\", \"1\" : null }");
+   bson_free (json);
+   bson_destroy (&array);
+
+   bson_array_builder_destroy (bab);
+   bson_destroy (&expected);
+}
+
+
+static void
+test_array_builder_types (void)
+{
+   bson_array_builder_t *bab;
+   bson_value_t value;
+   bson_iter_t iter;
+   bson_oid_t oid;
+   bson_t *doc;
+   bson_t *arr;
+   bson_t array;
+   char *json;
+
+   doc = BCON_NEW ("a", BCON_INT32 (1));
+   arr = BCON_NEW ("0", BCON_INT32 (1));
+   bson_oid_init_from_string (&oid, "0123456789abcdef01234567");
+   value.value_type = BSON_TYPE_INT32;
+   value.value.v_int32 = 7;
+   ASSERT (bson_iter_init_find (&iter, doc, "a"));
+
+   bab = bson_array_builder_new ();
+   ASSERT (bson_array_builder_append_value (bab, &value));
+   ASSERT (bson_array_builder_append_iter (bab, &iter));
+   ASSERT (bson_array_builder_append_document (bab, doc));
+   ASSERT (bson_array_builder_append_array (bab, arr));
+   ASSERT (bson_array_builder_append_int32 (bab, 2));
+   ASSERT (bson_array_builder_append_double (bab, 1.5));
+   ASSERT (bson_array_builder_append_bool (bab, true));
+   ASSERT (bson_array_builder_append_oid (bab, &oid));
+   ASSERT (bson_array_builder_append_date_time (bab, 1000));
+   ASSERT (bson_array_builder_append_utf8 (bab, "abc", 2));
+   ASSERT (bson_array_builder_build (bab, &array));
+
+   json = bson_as_relaxed_extended_json (&array, NULL);
+   ASSERT_CMPSTR (json,
+                  "{ \"0\" : 7, \"1\" : 1, \"2\" : { \"a\" : 1 }, \"3\" : "
+                  "[ 1 ], \"4\" : 2, \"5\" : 1.5, \"6\" : true, \"7\" : { "
+                  "\"$oid\" : \"0123456789abcdef01234567\" }, \"8\" : { "
+                  "\"$date\" : \"1970-01-01T00:00:01Z\" }, \"9\" : \"ab\" }");
+
+   bson_free (json);
+   bson_destroy (&array);
+   bson_array_builder_destroy (bab);
+   bson_destroy (arr);
+   bson_destroy (doc);
+}
+
+
+static void
+test_array_builder_many (void)
+{
+   bson_array_builder_t *bab;
+   bson_iter_t iter;
+   bson_t expected;
+   bson_t array;
+   int64_t *i64;
+   int32_t i32[3] = {-1, 0, 1};
+   double dbl[2] = {0.5, -2.0};
+   uint32_t i;
+
+   i64 = bson_malloc (5000 * sizeof (int64_t));
+   bson_init (&expected);
+
+   bab = bson_array_builder_new ();
+   ASSERT (bson_array_builder_append_int64 (bab, 0));
+   _append_expected_int64 (&expected, 0, 0);
+   ASSERT (bson_array_builder_append_int64_many (bab, NULL, 0));
+
+   /* from index 1, across several key lengths, in a single growth */
+   for (i = 0; i < 5000; i++) {
+      i64[i] = (int64_t) i - 2500;
+      _append_expected_int64 (&expected, i + 1, i64[i]);
+   }
+
+   ASSERT (bson_array_builder_append_int64_many (bab, i64, 5000));
+   ASSERT_CMPUINT32 (bson_array_builder_length (bab), ==, 5001u);
+   ASSERT (bson_array_builder_build (bab, &array));
+   ASSERT_CMPUINT32 (bson_get_regrow_count (&array), ==, 1u);
+   ASSERT_CMPUINT32 (array.len, ==, expected.len);
+   ASSERT (!memcmp (
+      bson_get_data (&array), bson_get_data (&expected), array.len));
+   ASSERT (bson_validate (&array, BSON_VALIDATE_NONE, NULL));
+   bson_destroy (&array);
+
+   ASSERT (bson_array_builder_append_int32_many (bab, i32, 3));
+   ASSERT (bson_array_builder_append_double_many (bab, dbl, 2));
+   ASSERT (bson_array_builder_build (bab, &array));
+   ASSERT (bson_iter_init (&iter, &array));
+   for (i = 0; i < 3; i++) {
+      ASSERT (bson_iter_next (&iter));
+      ASSERT (BSON_ITER_HOLDS_INT32 (&iter));
+      ASSERT_CMPINT (bson_iter_int32 (&iter), ==, i32[i]);
+   }
+
+   for (i = 0; i < 2; i++) {
+      ASSERT (bson_iter_next (&iter));
+      ASSERT_CMPSTR (bson_iter_key (&iter), i ? "4" : "3");
+      ASSERT_CMPDOUBLE (bson_iter_double (&iter), ==, dbl[i]);
+   }
+
+   ASSERT (!bson_iter_next (&iter));
+   bson_destroy (&array);
+
+   bson_array_builder_destroy (bab);
+   bson_destroy (&expected);
+   bson_free (i64);
+}
+
+
+static void
+test_array_builder_embedded (void)
+{
+   bson_array_builder_t *child;
+   bson_t *expected;
+   bson_t array;
+   bson_t doc;
+   int32_t values[2] = {2, 3};
+
+   bson_init (&doc);
+   BSON_APPEND_INT32 (&doc, "a", 0);
+   ASSERT (bson_append_array_builder_begin (&doc, "arr", -1, &child));
+   ASSERT (bson_array_builder_append_int32 (child, 1));
+   ASSERT (bson_array_builder_append_int32_many (child, values, 2));
+
+   /* only a top-level array can be built */
+   ASSERT (!bson_array_builder_build (child, &array));
+   bson_destroy (&array);
+   ASSERT (bson_append_array_builder_end (&doc, child));
+   BSON_APPEND_INT32 (&doc, "b", 4);
+
+   expected = BCON_NEW ("a",
+                        BCON_INT32 (0),
+                        "arr",
+                        "[",
+                        BCON_INT32 (1),
+                        BCON_INT32 (2),
+                        BCON_INT32 (3),
+                        "]",
+                        "b",
+                        BCON_INT32 (4));
+   ASSERT_CMPUINT32 (doc.len, ==, expected->len);
+   ASSERT (!memcmp (bson_get_data (&doc), bson_get_data (expected), doc.len));
+
+   bson_destroy (expected);
+   bson_destroy (&doc);
+}
+
+
+static void
+test_array_builder_uint32_to_string (void)
+{
+   uint32_t values[] = {0, 9, 999, 1000, 1001, 65536, 999999, 4294967295u};
+   const char *key;
+   char expected[16];
+   char buf[16];
+   char small[6];
+   size_t len;
+   size_t i;
+
+   for (i = 0; i < sizeof values / sizeof values[0]; i++) {
+      bson_snprintf (expected, sizeof expected, "%u", values[i]);
+      len = bson_uint32_to_string (values[i], &key, buf, sizeof buf);
+      ASSERT_CMPSIZE_T (len, ==, strlen (expected));
+      ASSERT_CMPSTR (key, expected);
+   }
+
+   /* a buffer too small for any uint32_t is truncated like snprintf */
+   len = bson_uint32_to_string (1234567u, &key, small, sizeof small);
+   ASSERT_CMPSIZE_T (len, ==, (size_t) 7);
+   ASSERT_CMPSTR (key, "12345");
+}
+
+
+void
+test_array_builder_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/array_builder/keys", test_array_builder_keys);
+   TestSuite_Add (suite, "/bson/array_builder/types", test_array_builder_types);
+   TestSuite_Add (suite, "/bson/array_builder/many", test_array_builder_many);
+   TestSuite_Add (
+      suite, "/bson/array_builder/embedded", test_array_builder_embedded);
+   TestSuite_Add (suite,
+                  "/bson/array_builder/uint32_to_string",
+                  test_array_builder_uint32_to_string);
+}
@@ -0,0 +1,417 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bcon.h>
+#include <bson.h>
+
+#include "TestSuite.h"
+
+
+/*
+ * Concatenate documents into one BSON stream. The JSON is written with
+ * single quotes, for readability.
+ */
+static uint8_t *
+_make_stream (const char **json, size_t n, size_t *len)
+{
+   bson_error_t error;
+   uint8_t *buf = NULL;
+   bson_t *doc;
+   char *copy;
+   char *p;
+   size_t i;
+
+   *len = 0;
+
+   for (i = 0; i < n; i++) {
+      copy = bson_strdup (json[i]);
+      for (p = copy; *p; p++) {
+         if (*p == '\'') {
+            *p = '"';
+         }
+      }
+
+      doc = bson_new_from_json ((const uint8_t *) copy, -1, &error);
+      ASSERT_OR_PRINT (doc, error);
+      bson_free (copy);
+      buf = bson_realloc (buf, *len + doc->len);
+      memcpy (buf + *len, bson_get_data (doc), doc->len);
+      *len += doc->len;
+      bson_destroy (doc);
+   }
+
+   return buf;
+}
+
+
+static bool
+_is_valid (const struct ArrowArray *array, int64_t i)
+{
+   const uint8_t *validity = array->buffers[0];
+
+   return (validity[i / 8] >> (i % 8)) & 1;
+}
+
+
+static const struct ArrowSchema *
+_child_schema (const struct ArrowSchema *schema,
+               int64_t i,
+               const char *name,
+               const char *format)
+{
+   ASSERT_CMPINT64 (schema->n_children, >, i);
+   ASSERT_CMPSTR (schema->children[i]->name, name);
+   ASSERT_CMPSTR (schema->children[i]->format, format);
+   ASSERT_CMPINT64 (
+      schema->children[i]->flags, ==, (int64_t) ARROW_FLAG_NULLABLE);
+
+   return schema->children[i];
+}
+
+
+static const char *gDocs[] = {
+   "{'i': 1, 's': 'ab', 'd': {'x': 1.5, 'y': true}, 'l': [1, 2]}",
+   "{'i': {'$numberLong': '10000000000'}, 'l': [], 'o': {'$oid': "
+   "'0123456789abcdef01234567'}}",
+   "{'s': 'cde', 'i': null, 'd': 5, 'l': [3], 'n': null, 'e': []}",
+};
+
+
+static void
+test_arrow_infer (void)
+{
+   const struct ArrowSchema *d;
+   const struct ArrowArray *col;
+   bson_arrow_converter_t *converter;
+   struct ArrowSchema schema;
+   struct ArrowArray array;
+   bson_reader_t *reader;
+   bson_error_t error;
+   const int64_t *i64;
+   const int32_t *offsets;
+   uint8_t *data;
+   size_t len;
+
+   data = _make_stream (gDocs, 3, &len);
+   reader = bson_reader_new_from_data (data, len);
+   converter = bson_arrow_converter_new (reader, 100);
+
+   /* int32 and int64 widen to int64, "n" and "e" have no known type */
+   ASSERT_OR_PRINT (
+      bson_arrow_converter_get_schema (converter, &schema, &error), error);
+   ASSERT_CMPSTR (schema.format, "+s");
+   ASSERT_CMPINT64 (schema.n_children, ==, (int64_t) 5);
+   _child_schema (&schema, 0, "i", "l");
+   _child_schema (&schema, 1, "s", "u");
+   d = _child_schema (&schema, 2, "d", "+s");
+   _child_schema (d, 0, "x", "g");
+   _child_schema (d, 1, "y", "b");
+   d = _child_schema (&schema, 3, "l", "+l");
+   _child_schema (d, 0, "item", "i");
+   _child_schema (&schema, 4, "o", "w:12");
+   schema.release (&schema);
+   ASSERT (!schema.release);
+
+   ASSERT_CMPINT (bson_arrow_converter_next (converter, &array, &error), ==, 1);
+   ASSERT_CMPINT64 (array.length, ==, (int64_t) 3);
+   ASSERT_CMPINT64 (array.null_count, ==, (int64_t) 0);
+   ASSERT_CMPINT64 (array.n_buffers, ==, (int64_t) 1);
+   ASSERT_CMPINT64 (array.n_children, ==, (int64_t) 5);
+
+   /* "i" */
+   col = array.children[0];
+   ASSERT_CMPINT64 (col->length, ==, (int64_t) 3);
+   ASSERT_CMPINT64 (col->null_count, ==, (int64_t) 1);
+   i64 = col->buffers[1];
+   ASSERT_CMPINT64 (i64[0], ==, (int64_t) 1);
+   ASSERT_CMPINT64 (i64[1], ==, (int64_t) 10000000000);
+   ASSERT (_is_valid (col, 1));
+   ASSERT (!_is_valid (col, 2));
+
+   /* "s" */
+   col = array.children[1];
+   ASSERT_CMPINT64 (col->n_buffers, ==, (int64_t) 3);
+   offsets = col->buffers[1];
+   ASSERT_CMPINT (offsets[0], ==, 0);
+   ASSERT_CMPINT (offsets[1], ==, 2);
+   ASSERT_CMPINT (offsets[2], ==, 2);
+   ASSERT_CMPINT (offsets[3], ==, 5);
+   ASSERT (!memcmp (col->buffers[2], "abcde", 5));
+   ASSERT (!_is_valid (col, 1));
+
+   /* "d": the document in row 0 only, the int32 in row 2 is a null */
+   col = array.children[2];
+   ASSERT_CMPINT64 (col->null_count, ==, (int64_t) 2);
+   ASSERT (_is_valid (col, 0));
+   ASSERT_CMPINT64 (col->children[0]->length, ==, (int64_t) 3);
+   ASSERT_CMPDOUBLE (((const double *) col->children[0]->buffers[1])[0],
+                     ==,
+                     1.5);
+   ASSERT_CMPINT (((const uint8_t *) col->children[1]->buffers[1])[0], ==, 1);
+   ASSERT_CMPINT64 (col->children[1]->null_count, ==, (int64_t) 2);
+
+   /* "l" */
+   col = array.children[3];
+   ASSERT_CMPINT64 (col->null_count, ==, (int64_t) 0);
+   offsets = col->buffers[1];
+   ASSERT_CMPINT (offsets[1], ==, 2);
+   ASSERT_CMPINT (offsets[2], ==, 2);
+   ASSERT_CMPINT (offsets[3], ==, 3);
+   ASSERT_CMPINT64 (col->children[0]->length, ==, (int64_t) 3);
+   ASSERT_CMPINT (((const int32_t *) col->children[0]->buffers[1])[2], ==, 3);
+
+   /* "o" */
+   col = array.children[4];
+   ASSERT (_is_valid (col, 1));
+   ASSERT_CMPINT (((const uint8_t *) col->buffers[1])[12], ==, 0x01);
+
+   array.release (&array);
+   ASSERT (!array.release);
+
+   ASSERT_CMPINT (bson_arrow_converter_next (converter, &array, &error), ==, 0);
+
+   bson_arrow_converter_destroy (converter);
+   bson_reader_destroy (reader);
+   bson_free (data);
+}
+
+
+static void
+test_arrow_schema (void)
+{
+   const char *docs[] = {
+      "{'a': 1, 'b': {'$date': {'$numberLong': '1000'}}, 'c': [[1.5], null]}",
+      "{'a': 2.5, 'b': 'x', 'c': [[2, 3]], 'z': 1}",
+   };
+   const struct ArrowArray *col;
+   bson_arrow_converter_t *converter;
+   struct ArrowSchema schema;
+   struct ArrowArray array;
+   bson_reader_t *reader;
+   bson_error_t error;
+   const double *doubles;
+   const int32_t *offsets;
+   bson_t *spec;
+   uint8_t *data;
+   size_t len;
+
+   data = _make_stream (docs, 2, &len);
+   reader = bson_reader_new_from_data (data, len);
+   converter = bson_arrow_converter_new (reader, 100);
+
+   spec = BCON_NEW ("a",
+                    BCON_UTF8 ("int"),
+                    "b",
+                    BCON_UTF8 ("date"),
+                    "c",
+                    "[",
+                    "[",
+                    BCON_UTF8 ("double"),
+                    "]",
+                    "]");
+   ASSERT_OR_PRINT (
+      bson_arrow_converter_set_schema (converter, spec, &error), error);
+   ASSERT (!bson_arrow_converter_set_schema (converter, spec, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_ARROW,
+                          BSON_ARROW_ERROR_INVALID_SCHEMA,
+                          "before the first batch");
+   bson_destroy (spec);
+
+   ASSERT_OR_PRINT (
+      bson_arrow_converter_get_schema (converter, &schema, &error), error);
+   ASSERT_CMPINT64 (schema.n_children, ==, (int64_t) 3);
+   _child_schema (&schema, 1, "b", "tsm:UTC");
+   _child_schema (_child_schema (&schema, 2, "c", "+l"), 0, "item", "+l");
+   schema.release (&schema);
+
+   ASSERT_CMPINT (bson_arrow_converter_next (converter, &array, &error), ==, 1);
+   ASSERT_CMPINT64 (array.n_children, ==, (int64_t) 3);
+
+   /* the double is not converted to an int32 */
+   col = array.children[0];
+   ASSERT (_is_valid (col, 0));
+   ASSERT (!_is_valid (col, 1));
+
+   col = array.children[1];
+   ASSERT_CMPINT64 (((const int64_t *) col->buffers[1])[0], ==, (int64_t) 1000);
+   ASSERT (!_is_valid (col, 1));
+
+   /* [[1.5], null] and [[2, 3]], the int32s are widened to doubles */
+   col = array.children[2]->children[0];
+   ASSERT_CMPINT64 (col->length, ==, (int64_t) 3);
+   ASSERT_CMPINT64 (col->null_count, ==, (int64_t) 1);
+   ASSERT (!_is_valid (col, 1));
+   offsets = col->buffers[1];
+   ASSERT_CMPINT (offsets[3], ==, 3);
+   doubles = col->children[0]->buffers[1];
+   ASSERT_CMPDOUBLE (doubles[0], ==, 1.5);
+   ASSERT_CMPDOUBLE (doubles[2], ==, 3.0);
+
+   array.release (&array);
+   bson_arrow_converter_destroy (converter);
+   bson_reader_destroy (reader);
+   bson_free (data);
+}
+
+
+static void
+test_arrow_invalid_schema (void)
+{
+   bson_arrow_converter_t *converter;
+   bson_reader_t *reader;
+   bson_error_t error;
+   bson_t *spec;
+
+   reader = bson_reader_new_from_data ((const uint8_t *) "", 0);
+   converter = bson_arrow_converter_new (reader, 10);
+
+   spec = BCON_NEW ("a", "{", "b", BCON_UTF8 ("float"), "}");
+   ASSERT (!bson_arrow_converter_set_schema (converter, spec, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_ARROW,
+                          BSON_ARROW_ERROR_INVALID_SCHEMA,
+                          "unknown type \"float\" for field \"b\"");
+   bson_destroy (spec);
+
+   spec = BCON_NEW ("a", "[", BCON_UTF8 ("int"), BCON_UTF8 ("int"), "]");
+   ASSERT (!bson_arrow_converter_set_schema (converter, spec, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_ARROW,
+                          BSON_ARROW_ERROR_INVALID_SCHEMA,
+                          "must have one item type");
+   bson_destroy (spec);
+
+   spec = BCON_NEW ("a", BCON_INT32 (1));
+   ASSERT (!bson_arrow_converter_set_schema (converter, spec, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_ARROW,
+                          BSON_ARROW_ERROR_INVALID_SCHEMA,
+                          "invalid type for field \"a\"");
+   bson_destroy (spec);
+
+   /* a failed schema leaves none behind */
+   spec = BCON_NEW ("a", BCON_UTF8 ("int"));
+   ASSERT_OR_PRINT (
+      bson_arrow_converter_set_schema (converter, spec, &error), error);
+   bson_destroy (spec);
+
+   bson_arrow_converter_destroy (converter);
+   bson_reader_destroy (reader);
+}
+
+
+static void
+test_arrow_batches (void)
+{
+   bson_arrow_converter_t *converter;
+   struct ArrowArray array;
+   bson_reader_t *reader;
+   bson_error_t error;
+   const int32_t *values;
+   int64_t lengths[3] = {4, 4, 2};
+   uint8_t *data = NULL;
+   size_t len = 0;
+   bson_t *doc;
+   int32_t n = 0;
+   int i;
+   int j;
+
+   for (i = 0; i < 10; i++) {
+      doc = BCON_NEW ("n", BCON_INT32 (i));
+      data = bson_realloc (data, len + doc->len);
+      memcpy (data + len, bson_get_data (doc), doc->len);
+      len += doc->len;
+      bson_destroy (doc);
+   }
+
+   reader = bson_reader_new_from_data (data, len);
+   converter = bson_arrow_converter_new (reader, 4);
+
+   for (i = 0; i < 3; i++) {
+      ASSERT_CMPINT (
+         bson_arrow_converter_next (converter, &array, &error), ==, 1);
+      ASSERT_CMPINT64 (array.length, ==, lengths[i]);
+      values = array.children[0]->buffers[1];
+      for (j = 0; j < array.length; j++) {
+         ASSERT_CMPINT (values[j], ==, n++);
+      }
+      array.release (&array);
+   }
+
+   ASSERT_CMPINT (bson_arrow_converter_next (converter, &array, &error), ==, 0);
+   ASSERT_CMPINT (bson_arrow_converter_next (converter, &array, &error), ==, 0);
+
+   bson_arrow_converter_destroy (converter);
+   bson_reader_destroy (reader);
+   bson_free (data);
+}
+
+
+static void
+test_arrow_corrupt (void)
+{
+   /* {"a": 1} then a truncated document */
+   static const uint8_t data[] = {
+      12, 0, 0, 0, 0x10, 'a', 0, 1, 0, 0, 0, 0, 12, 0, 0, 0, 0x10, 'a'};
+   bson_arrow_converter_t *converter;
+   struct ArrowSchema schema;
+   struct ArrowArray array;
+   bson_reader_t *reader;
+   bson_error_t error;
+
+   reader = bson_reader_new_from_data (data, sizeof data);
+   converter = bson_arrow_converter_new (reader, 10);
+
+   ASSERT_CMPINT (
+      bson_arrow_converter_next (converter, &array, &error), ==, -1);
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_ARROW,
+                          BSON_ARROW_ERROR_CORRUPT_BSON,
+                          "corrupt BSON in the input");
+
+   bson_arrow_converter_destroy (converter);
+   bson_reader_destroy (reader);
+
+   /* the schema is requested again after inference failed */
+   reader = bson_reader_new_from_data (data, sizeof data);
+   converter = bson_arrow_converter_new (reader, 10);
+
+   BSON_ASSERT (!bson_arrow_converter_get_schema (converter, &schema, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_ARROW,
+                          BSON_ARROW_ERROR_CORRUPT_BSON,
+                          "corrupt BSON in the input");
+   if (bson_arrow_converter_get_schema (converter, &schema, &error)) {
+      schema.release (&schema);
+   }
+
+   bson_arrow_converter_destroy (converter);
+   bson_reader_destroy (reader);
+}
+
+
+void
+test_arrow_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/arrow/infer", test_arrow_infer);
+   TestSuite_Add (suite, "/bson/arrow/schema", test_arrow_schema);
+   TestSuite_Add (
+      suite, "/bson/arrow/invalid_schema", test_arrow_invalid_schema);
+   TestSuite_Add (suite, "/bson/arrow/batches", test_arrow_batches);
+   TestSuite_Add (suite, "/bson/arrow/corrupt", test_arrow_corrupt);
+}
@@ -92,6 +92,29 @@ is_test_skipped (const char *scenario, const char *description)
 }
 
 
+/* parse extended JSON with the structural-index parser backend */
+static bson_t *
+structural_from_json (const char *json)
+{
+   bson_json_reader_t *reader;
+   bson_error_t error;
+   bson_t *bson;
+   int r;
+
+   reader = bson_json_data_reader_new_with_parser (
+      false, 0, BSON_JSON_PARSER_STRUCTURAL);
+   bson_json_data_reader_ingest (reader, (const uint8_t *) json, strlen (json));
+
+   bson = bson_new ();
+   r = bson_json_reader_read (reader, bson, &error);
+   ASSERT_OR_PRINT (r == 1, error);
+
+   bson_json_reader_destroy (reader);
+
+   return bson;
+}
+
+
 /*
 See:
 github.com/mongodb/specifications/blob/master/source/bson-corpus/bson-corpus.rst
@@ -123,6 +146,7 @@ test_bson_corpus_valid (test_bson_valid_type_t *test)
    bson_t *decode_cE;
    bson_t *decode_dE;
    bson_t *decode_rE;
+   bson_t *structural_cE;
    bson_error_t error;
 
    BSON_ASSERT (test->cB);
@@ -153,6 +177,13 @@ test_bson_corpus_valid (test_bson_valid_type_t *test)
          bson_get_data (decode_cE), decode_cE->len, test->cB, test->cB_len);
    }
 
+   structural_cE = structural_from_json (test->cE);
+   compare_data (bson_get_data (structural_cE),
+                 structural_cE->len,
+                 bson_get_data (decode_cE),
+                 decode_cE->len);
+   bson_destroy (structural_cE);
+
    if (test->dB) {
       BSON_ASSERT (bson_init_static (&dB, test->dB, test->dB_len));
       ASSERT_CMPJSON (bson_as_canonical_extended_json (&dB, NULL), test->cE);
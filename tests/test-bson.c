@@ -2234,6 +2234,147 @@ test_bson_subtype_2 (void)
 }
 
 
+/* append @n int64 fields, two subdocuments of them, to @bson */
+static void
+_append_int64_fields (bson_t *bson, int n)
+{
+   bson_t child;
+   char key[16];
+   int i;
+
+   for (i = 0; i < n; i++) {
+      bson_snprintf (key, sizeof key, "k%d", i);
+      if (i % 100 == 0) {
+         BSON_APPEND_DOCUMENT_BEGIN (bson, key, &child);
+         BSON_APPEND_INT64 (&child, "v", i);
+         bson_append_document_end (bson, &child);
+      } else {
+         BSON_APPEND_INT64 (bson, key, i);
+      }
+   }
+}
+
+
+static void
+test_bson_growth_policy (void)
+{
+   bson_t power;
+   bson_t half;
+   bson_t exact;
+
+   bson_init (&power);
+   bson_init (&half);
+   bson_init (&exact);
+   bson_set_growth_policy (&half, BSON_GROWTH_ONE_AND_HALF);
+   bson_set_growth_policy (&exact, BSON_GROWTH_EXACT);
+
+   ASSERT_CMPSIZE_T (bson_get_capacity (&power), ==, (size_t) 120);
+   ASSERT_CMPUINT32 (bson_get_regrow_count (&power), ==, 0);
+
+   _append_int64_fields (&power, 1000);
+   _append_int64_fields (&half, 1000);
+   _append_int64_fields (&exact, 1000);
+
+   ASSERT (bson_equal (&power, &half));
+   ASSERT (bson_equal (&power, &exact));
+
+   /* the default rounds up to a power of two */
+   ASSERT_CMPSIZE_T (bson_get_capacity (&power),
+                     ==,
+                     bson_next_power_of_two ((size_t) power.len));
+   ASSERT_CMPUINT32 (bson_get_regrow_count (&power), ==, 8);
+
+   /* 1.5x grows more often, and wastes less than half */
+   ASSERT_CMPSIZE_T (
+      (size_t) bson_get_capacity (&half) * 2, <, (size_t) power.len * 3);
+   ASSERT_CMPUINT32 (bson_get_regrow_count (&half), >, 8);
+
+   /* exact growth regrows on each append, counting those from children */
+   ASSERT_CMPSIZE_T (bson_get_capacity (&exact), ==, (size_t) exact.len);
+   ASSERT_CMPUINT32 (bson_get_regrow_count (&exact), >=, 1000);
+
+   bson_destroy (&power);
+   bson_destroy (&half);
+   bson_destroy (&exact);
+}
+
+
+static void
+test_bson_size_hint (void)
+{
+   bson_t *expected;
+   bson_t bson;
+   bson_t child;
+
+   expected = bson_new ();
+   _append_int64_fields (expected, 1000);
+
+   /* a hint of the final size avoids any regrowth */
+   bson_init (&bson);
+   ASSERT (bson_set_size_hint (&bson, expected->len));
+   ASSERT_CMPSIZE_T (bson_get_capacity (&bson), ==, (size_t) expected->len);
+   _append_int64_fields (&bson, 1000);
+   ASSERT (bson_equal (&bson, expected));
+   ASSERT_CMPUINT32 (bson_get_regrow_count (&bson), ==, 0);
+   ASSERT_CMPSIZE_T (bson_get_capacity (&bson), ==, (size_t) expected->len);
+
+   /* a smaller hint does nothing */
+   ASSERT (bson_set_size_hint (&bson, 10));
+   ASSERT_CMPSIZE_T (bson_get_capacity (&bson), ==, (size_t) expected->len);
+
+   /* nor does one on a document with a child in progress */
+   BSON_APPEND_DOCUMENT_BEGIN (&bson, "child", &child);
+   ASSERT (!bson_set_size_hint (&bson, 2 * expected->len));
+   ASSERT (!bson_set_size_hint (&child, 2 * expected->len));
+   bson_append_document_end (&bson, &child);
+
+   ASSERT (!bson_set_size_hint (&bson, (size_t) INT32_MAX + 1));
+   bson_destroy (&bson);
+
+   bson_destroy (expected);
+}
+
+
+static void
+test_bson_shrink_to_fit (void)
+{
+   bson_t *bson;
+   bson_t inline_bson;
+   bson_t child;
+   bson_t static_bson;
+
+   bson = bson_new ();
+   _append_int64_fields (bson, 1000);
+   ASSERT_CMPSIZE_T (bson_get_capacity (bson), >, (size_t) bson->len);
+
+   ASSERT (bson_shrink_to_fit (bson));
+   ASSERT_CMPSIZE_T (bson_get_capacity (bson), ==, (size_t) bson->len);
+   ASSERT (bson_validate (bson, BSON_VALIDATE_NONE, NULL));
+
+   /* the document can still grow */
+   BSON_APPEND_UTF8 (bson, "more", "value");
+   ASSERT (bson_has_field (bson, "more"));
+   ASSERT (bson_has_field (bson, "k999"));
+
+   BSON_APPEND_DOCUMENT_BEGIN (bson, "child", &child);
+   ASSERT (!bson_shrink_to_fit (bson));
+   ASSERT (!bson_shrink_to_fit (&child));
+   bson_append_document_end (bson, &child);
+   bson_destroy (bson);
+
+   /* inline documents have nothing to give back */
+   bson_init (&inline_bson);
+   ASSERT (bson_shrink_to_fit (&inline_bson));
+   ASSERT_CMPSIZE_T (bson_get_capacity (&inline_bson), ==, (size_t) 120);
+   bson_destroy (&inline_bson);
+
+   /* read-only documents do not own their buffer */
+   ASSERT (bson_init_static (
+      &static_bson, (const uint8_t *) "\x05\x00\x00\x00\x00", 5));
+   ASSERT (!bson_shrink_to_fit (&static_bson));
+}
+
+
 void
 test_bson_install (TestSuite *suite)
 {
@@ -2317,5 +2458,8 @@ test_bson_install (TestSuite *suite)
                   "/bson/unsupported_type/empty_key",
                   test_bson_visit_unsupported_type_empty_key);
    TestSuite_Add (suite, "/bson/binary_subtype_2", test_bson_subtype_2);
+   TestSuite_Add (suite, "/bson/growth_policy", test_bson_growth_policy);
+   TestSuite_Add (suite, "/bson/size_hint", test_bson_size_hint);
+   TestSuite_Add (suite, "/bson/shrink_to_fit", test_bson_shrink_to_fit);
    TestSuite_Add (suite, "/util/next_power_of_two", test_next_power_of_two);
 }
@@ -0,0 +1,287 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bcon.h>
+#include <bson.h>
+
+#include "TestSuite.h"
+
+#ifndef _WIN32
+#include <unistd.h>
+#endif
+
+
+/* a document large enough for a chain to refer to rather than copy */
+static bson_t *
+_large_doc (int n)
+{
+   bson_t *doc;
+   char key[16];
+   int i;
+
+   doc = bson_new ();
+   for (i = 0; i < 40; i++) {
+      bson_snprintf (key, sizeof key, "field%d", i);
+      BSON_APPEND_INT64 (doc, key, (int64_t) n * 1000 + i);
+   }
+
+   return doc;
+}
+
+
+/* concatenate the iovecs of @chain and compare them to @expected */
+static void
+_assert_iovecs (bson_chain_t *chain, const bson_t *expected)
+{
+   const bson_iovec_t *iov;
+   size_t n_iov;
+   uint8_t *buf;
+   size_t len = 0;
+   size_t i;
+
+   iov = bson_chain_iovecs (chain, &n_iov);
+   buf = bson_malloc (bson_chain_len (chain));
+
+   for (i = 0; i < n_iov; i++) {
+      ASSERT_CMPSIZE_T (
+         len + iov[i].iov_len, <=, (size_t) bson_chain_len (chain));
+      memcpy (buf + len, iov[i].iov_base, iov[i].iov_len);
+      len += iov[i].iov_len;
+   }
+
+   ASSERT_CMPSIZE_T (len, ==, (size_t) expected->len);
+   ASSERT (!memcmp (buf, bson_get_data (expected), len));
+
+   bson_free (buf);
+}
+
+
+static bool
+_refers_to (bson_chain_t *chain, const uint8_t *data)
+{
+   const bson_iovec_t *iov;
+   size_t n_iov;
+   size_t i;
+
+   iov = bson_chain_iovecs (chain, &n_iov);
+   for (i = 0; i < n_iov; i++) {
+      if ((const uint8_t *) iov[i].iov_base == data) {
+         return true;
+      }
+   }
+
+   return false;
+}
+
+
+static void
+test_chain_envelope (void)
+{
+   bson_t *docs[2];
+   bson_t *small;
+   bson_chain_t *chain;
+   bson_t expected;
+   bson_t cursor;
+   bson_t batch;
+   bson_value_t value;
+   bson_t dst;
+
+   docs[0] = _large_doc (0);
+   docs[1] = _large_doc (1);
+   small = BCON_NEW ("x", BCON_INT32 (1));
+
+   bson_init (&expected);
+   BSON_APPEND_DOCUMENT_BEGIN (&expected, "cursor", &cursor);
+   BSON_APPEND_ARRAY_BEGIN (&cursor, "firstBatch", &batch);
+   BSON_APPEND_DOCUMENT (&batch, "0", docs[0]);
+   BSON_APPEND_DOCUMENT (&batch, "1", docs[1]);
+   BSON_APPEND_DOCUMENT (&batch, "2", small);
+   bson_append_array_end (&cursor, &batch);
+   BSON_APPEND_INT64 (&cursor, "id", 0);
+   BSON_APPEND_UTF8 (&cursor, "ns", "db.coll");
+   bson_append_document_end (&expected, &cursor);
+   BSON_APPEND_DOUBLE (&expected, "ok", 1.0);
+
+   chain = bson_chain_new ();
+   ASSERT (bson_chain_append_document_begin (chain, "cursor", -1));
+   ASSERT (bson_chain_append_array_begin (chain, "firstBatch", -1));
+   ASSERT (bson_chain_append_document (chain, "0", -1, docs[0]));
+   ASSERT (bson_chain_append_document (chain, "1", -1, docs[1]));
+   ASSERT (bson_chain_append_document (chain, "2", -1, small));
+   bson_chain_append_array_end (chain);
+   value.value_type = BSON_TYPE_INT64;
+   value.value.v_int64 = 0;
+   ASSERT (bson_chain_append_value (chain, "id", -1, &value));
+   value.value_type = BSON_TYPE_UTF8;
+   value.value.v_utf8.str = "db.coll";
+   value.value.v_utf8.len = 7;
+   ASSERT (bson_chain_append_value (chain, "ns", 2, &value));
+   bson_chain_append_document_end (chain);
+   value.value_type = BSON_TYPE_DOUBLE;
+   value.value.v_double = 1.0;
+   ASSERT (bson_chain_append_value (chain, "ok", -1, &value));
+
+   ASSERT_CMPUINT32 (bson_chain_len (chain), ==, expected.len);
+   _assert_iovecs (chain, &expected);
+
+   /* the large documents are referenced, the small one is copied */
+   ASSERT (_refers_to (chain, bson_get_data (docs[0])));
+   ASSERT (_refers_to (chain, bson_get_data (docs[1])));
+   ASSERT (!_refers_to (chain, bson_get_data (small)));
+
+   bson_chain_to_bson (chain, &dst);
+   ASSERT (bson_equal (&dst, &expected));
+   ASSERT (bson_validate (&dst, BSON_VALIDATE_NONE, NULL));
+   bson_destroy (&dst);
+
+   /* the chain can be reused */
+   bson_chain_reinit (chain);
+   ASSERT_CMPUINT32 (bson_chain_len (chain), ==, 5);
+   bson_chain_to_bson (chain, &dst);
+   ASSERT (bson_empty (&dst));
+   bson_destroy (&dst);
+
+   bson_chain_destroy (chain);
+   bson_destroy (&expected);
+   bson_destroy (docs[0]);
+   bson_destroy (docs[1]);
+   bson_destroy (small);
+}
+
+
+static void
+test_chain_iter_and_concat (void)
+{
+   bson_t *large;
+   bson_t *src;
+   bson_chain_t *chain;
+   bson_iter_t iter;
+   bson_t expected;
+   bson_t dst;
+   char *str;
+
+   large = _large_doc (2);
+   str = bson_malloc0 (1000);
+   memset (str, 'a', 999);
+
+   src = BCON_NEW ("null",
+                   BCON_NULL,
+                   "str",
+                   BCON_UTF8 (str),
+                   "doc",
+                   BCON_DOCUMENT (large),
+                   "n",
+                   BCON_INT32 (3),
+                   "small",
+                   "{",
+                   "a",
+                   BCON_BOOL (true),
+                   "}");
+
+   bson_init (&expected);
+   chain = bson_chain_new ();
+
+   ASSERT (bson_iter_init (&iter, src));
+   while (bson_iter_next (&iter)) {
+      ASSERT (bson_append_iter (&expected, NULL, 0, &iter));
+      ASSERT (bson_chain_append_iter (chain, NULL, 0, &iter));
+   }
+
+   /* with a new key */
+   ASSERT (bson_iter_init_find (&iter, src, "str"));
+   ASSERT (bson_append_iter (&expected, "renamed", -1, &iter));
+   ASSERT (bson_chain_append_iter (chain, "renamed", -1, &iter));
+
+   ASSERT (bson_concat (&expected, large));
+   ASSERT (bson_chain_concat (chain, large));
+
+   _assert_iovecs (chain, &expected);
+
+   /* the large string is referenced twice, the elements of large once */
+   ASSERT (bson_iter_init_find (&iter, src, "str"));
+   ASSERT (_refers_to (chain, iter.raw + iter.d1));
+   ASSERT (_refers_to (chain, bson_get_data (large) + 4));
+
+   bson_chain_to_bson (chain, &dst);
+   ASSERT (bson_equal (&dst, &expected));
+   bson_destroy (&dst);
+
+   bson_chain_destroy (chain);
+   bson_destroy (&expected);
+   bson_destroy (src);
+   bson_destroy (large);
+   bson_free (str);
+}
+
+
+#ifndef _WIN32
+static void
+test_chain_writev (void)
+{
+   const bson_iovec_t *iov;
+   bson_chain_t *chain;
+   bson_reader_t *reader;
+   const bson_t *read;
+   bson_t *docs[3];
+   size_t n_iov;
+   FILE *file;
+   bool eof;
+   int i;
+
+   chain = bson_chain_new ();
+   for (i = 0; i < 3; i++) {
+      docs[i] = _large_doc (i);
+      ASSERT (bson_chain_append_document (chain, "d", -1, docs[i]));
+   }
+
+   file = tmpfile ();
+   ASSERT (file);
+   iov = bson_chain_iovecs (chain, &n_iov);
+   ASSERT_CMPSSIZE_T (writev (fileno (file), iov, (int) n_iov),
+                      ==,
+                      (ssize_t) bson_chain_len (chain));
+   ASSERT (lseek (fileno (file), 0, SEEK_SET) == 0);
+
+   reader = bson_reader_new_from_fd (fileno (file), false);
+   read = bson_reader_read (reader, &eof);
+   ASSERT (read);
+   ASSERT_CMPUINT32 (read->len, ==, bson_chain_len (chain));
+   ASSERT (bson_validate (read, BSON_VALIDATE_NONE, NULL));
+   ASSERT_CMPUINT32 (bson_count_keys (read), ==, 3);
+   ASSERT (!bson_reader_read (reader, &eof));
+   ASSERT (eof);
+
+   bson_reader_destroy (reader);
+   fclose (file);
+   bson_chain_destroy (chain);
+   for (i = 0; i < 3; i++) {
+      bson_destroy (docs[i]);
+   }
+}
+#endif
+
+
+void
+test_chain_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/chain/envelope", test_chain_envelope);
+   TestSuite_Add (
+      suite, "/bson/chain/iter_and_concat", test_chain_iter_and_concat);
+#ifndef _WIN32
+   TestSuite_Add (suite, "/bson/chain/writev", test_chain_writev);
+#endif
+}
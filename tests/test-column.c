@@ -0,0 +1,236 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bcon.h>
+#include <bson.h>
+
+#include "TestSuite.h"
+
+
+static bool
+_is_valid (const bson_column_t *column, size_t row)
+{
+   return (bson_column_validity (column)[row / 8] >> (row % 8)) & 1;
+}
+
+
+/* {"rows": [{"x": 1.5, "s": "a"}, {"x": 2}, {"s": "bc"}, 3, {"x": null}]} */
+static bson_t *
+_rows_doc (void)
+{
+   return BCON_NEW ("rows",
+                    "[",
+                    "{",
+                    "x",
+                    BCON_DOUBLE (1.5),
+                    "s",
+                    BCON_UTF8 ("a"),
+                    "}",
+                    "{",
+                    "x",
+                    BCON_INT32 (2),
+                    "}",
+                    "{",
+                    "s",
+                    BCON_UTF8 ("bc"),
+                    "}",
+                    BCON_INT32 (3),
+                    "{",
+                    "x",
+                    BCON_NULL,
+                    "}",
+                    "]");
+}
+
+
+static void
+test_column_array (void)
+{
+   const bson_column_utf8_t *strs;
+   bson_column_t *column;
+   const double *doubles;
+   bson_error_t error;
+   bson_iter_t iter;
+   bson_t *doc;
+
+   doc = _rows_doc ();
+   ASSERT (bson_iter_init_find (&iter, doc, "rows"));
+
+   /* without coercion, the int32 is null */
+   column = bson_column_new ("x", BSON_TYPE_DOUBLE, BSON_COLUMN_FLAG_NONE);
+   ASSERT_OR_PRINT (bson_column_append_array (column, &iter, &error), error);
+   ASSERT_CMPSIZE_T (bson_column_length (column), ==, (size_t) 5);
+   ASSERT_CMPSIZE_T (bson_column_null_count (column), ==, (size_t) 4);
+   doubles = bson_column_values (column);
+   ASSERT (_is_valid (column, 0));
+   ASSERT_CMPDOUBLE (doubles[0], ==, 1.5);
+   ASSERT (!_is_valid (column, 1));
+   ASSERT_CMPDOUBLE (doubles[1], ==, 0.0);
+   bson_column_destroy (column);
+
+   column = bson_column_new ("x", BSON_TYPE_DOUBLE, BSON_COLUMN_FLAG_COERCE);
+   ASSERT_OR_PRINT (bson_column_append_array (column, &iter, &error), error);
+   ASSERT_CMPSIZE_T (bson_column_null_count (column), ==, (size_t) 3);
+   doubles = bson_column_values (column);
+   ASSERT (_is_valid (column, 1));
+   ASSERT_CMPDOUBLE (doubles[1], ==, 2.0);
+   ASSERT (!_is_valid (column, 2));
+   ASSERT (!_is_valid (column, 3));
+   ASSERT (!_is_valid (column, 4));
+   bson_column_destroy (column);
+
+   column = bson_column_new ("s", BSON_TYPE_UTF8, BSON_COLUMN_FLAG_NONE);
+   ASSERT_OR_PRINT (bson_column_append_array (column, &iter, &error), error);
+   ASSERT_CMPSIZE_T (bson_column_null_count (column), ==, (size_t) 3);
+   strs = bson_column_values (column);
+   ASSERT_CMPSTR (strs[0].str, "a");
+   ASSERT_CMPUINT32 (strs[0].len, ==, (uint32_t) 1);
+   ASSERT (strs[1].str == NULL);
+   ASSERT_CMPSTR (strs[2].str, "bc");
+   ASSERT_CMPUINT32 (strs[2].len, ==, (uint32_t) 2);
+   bson_column_destroy (column);
+
+   bson_destroy (doc);
+}
+
+
+static void
+test_column_elements (void)
+{
+   bson_column_t *column;
+   const int64_t *ints;
+   bson_error_t error;
+   bson_iter_t iter;
+   bson_t *doc;
+
+   doc = BCON_NEW ("a",
+                   "[",
+                   BCON_INT64 (1),
+                   BCON_INT32 (2),
+                   BCON_DOUBLE (3.9),
+                   BCON_BOOL (true),
+                   BCON_DOUBLE (1e300),
+                   BCON_UTF8 ("6"),
+                   "]");
+   ASSERT (bson_iter_init_find (&iter, doc, "a"));
+
+   /* a NULL path takes the elements themselves */
+   column = bson_column_new (NULL, BSON_TYPE_INT64, BSON_COLUMN_FLAG_COERCE);
+   ASSERT_OR_PRINT (bson_column_append_array (column, &iter, &error), error);
+   ASSERT_CMPSIZE_T (bson_column_length (column), ==, (size_t) 6);
+   ASSERT_CMPSIZE_T (bson_column_null_count (column), ==, (size_t) 2);
+   ints = bson_column_values (column);
+   ASSERT_CMPINT64 (ints[0], ==, (int64_t) 1);
+   ASSERT_CMPINT64 (ints[1], ==, (int64_t) 2);
+   ASSERT_CMPINT64 (ints[2], ==, (int64_t) 3);
+   ASSERT_CMPINT64 (ints[3], ==, (int64_t) 1);
+   ASSERT (!_is_valid (column, 4));
+   ASSERT (!_is_valid (column, 5));
+   bson_column_destroy (column);
+
+   bson_destroy (doc);
+}
+
+
+static void
+test_column_documents (void)
+{
+   bson_t *docs[100];
+   bson_column_t *column;
+   const bson_oid_t *oids;
+   bson_iter_t iter;
+   bson_oid_t oid;
+   size_t i;
+
+   for (i = 0; i < 100; i++) {
+      bson_oid_init (&oid, NULL);
+      if (i % 3) {
+         docs[i] = BCON_NEW ("a", "{", "_id", BCON_OID (&oid), "}");
+      } else {
+         docs[i] = BCON_NEW ("a", "{", "_id", BCON_INT32 (1), "}");
+      }
+   }
+
+   column = bson_column_new ("a._id", BSON_TYPE_OID, BSON_COLUMN_FLAG_COERCE);
+
+   /* appended in two batches, and again after a reset */
+   bson_column_append_documents (column, (const bson_t **) docs, 50);
+   bson_column_append_documents (column, (const bson_t **) docs + 50, 50);
+   ASSERT_CMPSIZE_T (bson_column_length (column), ==, (size_t) 100);
+   ASSERT_CMPSIZE_T (bson_column_null_count (column), ==, (size_t) 34);
+
+   bson_column_reset (column);
+   ASSERT_CMPSIZE_T (bson_column_length (column), ==, (size_t) 0);
+   bson_column_append_documents (column, (const bson_t **) docs + 1, 99);
+   ASSERT_CMPSIZE_T (bson_column_length (column), ==, (size_t) 99);
+   ASSERT_CMPSIZE_T (bson_column_null_count (column), ==, (size_t) 33);
+
+   oids = bson_column_values (column);
+   for (i = 0; i < 99; i++) {
+      ASSERT_CMPINT (_is_valid (column, i), ==, (i + 1) % 3 != 0);
+      if ((i + 1) % 3) {
+         ASSERT (bson_iter_init (&iter, docs[i + 1]));
+         ASSERT (bson_iter_find_descendant (&iter, "a._id", &iter));
+         ASSERT (bson_oid_equal (&oids[i], bson_iter_oid (&iter)));
+      }
+   }
+
+   bson_column_destroy (column);
+
+   for (i = 0; i < 100; i++) {
+      bson_destroy (docs[i]);
+   }
+}
+
+
+static void
+test_column_errors (void)
+{
+   /* {"a": [<truncated string>]} */
+   static const uint8_t data[] = {24, 0, 0, 0,   0x04, 'a', 0, 15, 0, 0, 0,
+                                  0x02, '0', 0, 10, 0, 0, 0, 'x', 0, 0, 0, 0,
+                                  0};
+   bson_column_t *column;
+   bson_error_t error;
+   bson_iter_t iter;
+   bson_t doc;
+
+   ASSERT (!bson_column_new ("a", BSON_TYPE_DOCUMENT, BSON_COLUMN_FLAG_NONE));
+
+   column = bson_column_new (NULL, BSON_TYPE_UTF8, BSON_COLUMN_FLAG_NONE);
+
+   ASSERT (bson_init_static (&doc, data, sizeof data));
+   ASSERT (bson_iter_init_find (&iter, &doc, "a"));
+   ASSERT (!bson_column_append_array (column, &iter, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_COLUMN,
+                          BSON_COLUMN_ERROR_CORRUPT_BSON,
+                          "corrupt BSON in array \"a\"");
+
+   bson_destroy (&doc);
+   bson_column_destroy (column);
+}
+
+
+void
+test_column_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/column/array", test_column_array);
+   TestSuite_Add (suite, "/bson/column/elements", test_column_elements);
+   TestSuite_Add (suite, "/bson/column/documents", test_column_documents);
+   TestSuite_Add (suite, "/bson/column/errors", test_column_errors);
+}
@@ -0,0 +1,471 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bson.h>
+#include <math.h>
+
+#include "TestSuite.h"
+
+
+static void
+_write_file (const char *path, const uint8_t *data, size_t len)
+{
+   FILE *f;
+
+   f = fopen (path, "wb");
+   BSON_ASSERT (f);
+   ASSERT_CMPSIZE_T (fwrite (data, 1, len, f), ==, len);
+   BSON_ASSERT (fclose (f) == 0);
+}
+
+
+/* a file of documents {"i": i, "_id": ..., "a": {"b": ...}} */
+static void
+_write_data_file (const char *path, int n_docs)
+{
+   uint8_t *data = NULL;
+   size_t len = 0;
+   bson_t doc;
+   bson_t child;
+   char str[16];
+   int i;
+
+   for (i = 0; i < n_docs; i++) {
+      bson_init (&doc);
+      BSON_APPEND_INT32 (&doc, "i", i);
+
+      /* _id is an int32, an int64 or a string in turn, in reverse order */
+      switch (i % 3) {
+      case 0:
+         BSON_APPEND_INT32 (&doc, "_id", n_docs - i);
+         break;
+      case 1:
+         BSON_APPEND_INT64 (&doc, "_id", (int64_t) (n_docs - i));
+         break;
+      default:
+         bson_snprintf (str, sizeof str, "id-%05d", n_docs - i);
+         BSON_APPEND_UTF8 (&doc, "_id", str);
+         break;
+      }
+
+      /* every other document has a.b, whose values repeat */
+      if (i % 2 == 0) {
+         BSON_APPEND_DOCUMENT_BEGIN (&doc, "a", &child);
+         BSON_APPEND_DOUBLE (&child, "b", (double) (i % 10) / 2);
+         bson_append_document_end (&doc, &child);
+      }
+
+      data = bson_realloc (data, len + doc.len);
+      memcpy (data + len, bson_get_data (&doc), doc.len);
+      len += doc.len;
+      bson_destroy (&doc);
+   }
+
+   _write_file (path, data ? data : (const uint8_t *) "", len);
+   bson_free (data);
+}
+
+
+static void
+_make_paths (char *data_path, char *index_path, size_t size)
+{
+   int64_t now = bson_get_monotonic_time ();
+
+   bson_snprintf (data_path, size, "test-file-index-%" PRId64 ".bson", now);
+   bson_snprintf (
+      index_path, size, "test-file-index-%" PRId64 ".bson.idx", now);
+}
+
+
+static int32_t
+_get_i (const bson_t *doc)
+{
+   bson_iter_t iter;
+
+   BSON_ASSERT (bson_iter_init_find (&iter, doc, "i"));
+
+   return bson_iter_int32 (&iter);
+}
+
+
+static void
+test_file_index_get (void)
+{
+   bson_file_index_t *index;
+   bson_reader_t *reader;
+   const bson_t *next;
+   bson_error_t error;
+   char data_path[64];
+   char index_path[64];
+   uint64_t offset;
+   uint64_t prev = 0;
+   bson_value_t value;
+   bson_t doc;
+   int i;
+
+   _make_paths (data_path, index_path, sizeof data_path);
+   _write_data_file (data_path, 1000);
+
+   ASSERT_OR_PRINT (
+      bson_file_index_build (data_path, index_path, NULL, &error), error);
+   index = bson_file_index_open (data_path, index_path, &error);
+   ASSERT_OR_PRINT (index, error);
+   ASSERT_CMPUINT64 (bson_file_index_get_n_docs (index), ==, (uint64_t) 1000);
+   BSON_ASSERT (!bson_file_index_get_key (index));
+
+   for (i = 999; i >= 0; i--) {
+      BSON_ASSERT (bson_file_index_get (index, (uint64_t) i, &doc, &offset));
+      ASSERT_CMPINT (_get_i (&doc), ==, i);
+      BSON_ASSERT (i == 999 || offset + doc.len == prev);
+      prev = offset;
+   }
+
+   BSON_ASSERT (!bson_file_index_get (index, 1000, &doc, NULL));
+
+   /* there is no key table */
+   value.value_type = BSON_TYPE_INT32;
+   value.value.v_int32 = 1000;
+   BSON_ASSERT (!bson_file_index_find (index, &value, &doc, NULL));
+
+   /* scan from the 990th document */
+   reader = bson_file_index_reader_new (index, 990);
+   for (i = 990; (next = bson_reader_read (reader, NULL)); i++) {
+      ASSERT_CMPINT (_get_i (next), ==, i);
+   }
+   ASSERT_CMPINT (i, ==, 1000);
+   bson_reader_destroy (reader);
+
+   reader = bson_file_index_reader_new (index, 1000);
+   BSON_ASSERT (!bson_reader_read (reader, NULL));
+   bson_reader_destroy (reader);
+   BSON_ASSERT (!bson_file_index_reader_new (index, 1001));
+
+   bson_file_index_destroy (index);
+   remove (data_path);
+   remove (index_path);
+}
+
+
+static void
+test_file_index_find (void)
+{
+   bson_file_index_t *index;
+   bson_error_t error;
+   char data_path[64];
+   char index_path[64];
+   char str[16];
+   bson_value_t value;
+   uint64_t offset;
+   bson_t doc;
+   bson_t at;
+   int i;
+
+   _make_paths (data_path, index_path, sizeof data_path);
+   _write_data_file (data_path, 1000);
+
+   ASSERT_OR_PRINT (
+      bson_file_index_build (data_path, index_path, "_id", &error), error);
+   index = bson_file_index_open (data_path, index_path, &error);
+   ASSERT_OR_PRINT (index, error);
+   ASSERT_CMPSTR (bson_file_index_get_key (index), "_id");
+
+   for (i = 0; i < 1000; i++) {
+      if (i % 3 == 2) {
+         bson_snprintf (str, sizeof str, "id-%05d", 1000 - i);
+         value.value_type = BSON_TYPE_UTF8;
+         value.value.v_utf8.str = str;
+         value.value.v_utf8.len = (uint32_t) strlen (str);
+      } else if (i % 2) {
+         /* numbers are found whatever their type */
+         value.value_type = BSON_TYPE_INT32;
+         value.value.v_int32 = 1000 - i;
+      } else {
+         value.value_type = BSON_TYPE_DOUBLE;
+         value.value.v_double = (double) (1000 - i);
+      }
+
+      BSON_ASSERT (bson_file_index_find (index, &value, &doc, &offset));
+      ASSERT_CMPINT (_get_i (&doc), ==, i);
+      BSON_ASSERT (bson_file_index_get (index, (uint64_t) i, &at, NULL));
+      BSON_ASSERT (bson_get_data (&at) == bson_get_data (&doc));
+   }
+
+   /* missing values */
+   value.value_type = BSON_TYPE_INT64;
+   value.value.v_int64 = 1000 - 2;
+   BSON_ASSERT (!bson_file_index_find (index, &value, &doc, NULL));
+   value.value.v_int64 = 0;
+   BSON_ASSERT (!bson_file_index_find (index, &value, &doc, NULL));
+   value.value.v_int64 = 5000;
+   BSON_ASSERT (!bson_file_index_find (index, &value, &doc, NULL));
+   value.value_type = BSON_TYPE_UTF8;
+   value.value.v_utf8.str = "id-";
+   value.value.v_utf8.len = 3;
+   BSON_ASSERT (!bson_file_index_find (index, &value, &doc, NULL));
+   value.value_type = BSON_TYPE_NULL;
+   BSON_ASSERT (!bson_file_index_find (index, &value, &doc, NULL));
+
+   bson_file_index_destroy (index);
+
+   /* a nested field with repeated values finds the first document */
+   ASSERT_OR_PRINT (
+      bson_file_index_build (data_path, index_path, "a.b", &error), error);
+   index = bson_file_index_open (data_path, index_path, &error);
+   ASSERT_OR_PRINT (index, error);
+
+   for (i = 0; i < 10; i += 2) {
+      value.value_type = BSON_TYPE_DOUBLE;
+      value.value.v_double = (double) i / 2;
+      BSON_ASSERT (bson_file_index_find (index, &value, &doc, NULL));
+      ASSERT_CMPINT (_get_i (&doc), ==, i);
+   }
+
+   value.value.v_double = 0.25;
+   BSON_ASSERT (!bson_file_index_find (index, &value, &doc, NULL));
+
+   bson_file_index_destroy (index);
+   remove (data_path);
+   remove (index_path);
+}
+
+
+/* keys of types without data: null, undefined, minkey and maxkey */
+static void
+test_file_index_no_data_types (void)
+{
+   bson_file_index_t *index;
+   bson_error_t error;
+   char data_path[64];
+   char index_path[64];
+   bson_value_t value;
+   bson_t *docs[6];
+   uint8_t *data = NULL;
+   size_t len = 0;
+   bson_t doc;
+   int i;
+
+   docs[0] = BCON_NEW ("i", BCON_INT32 (0), "_id", BCON_MAXKEY);
+   docs[1] = BCON_NEW ("i", BCON_INT32 (1), "_id", BCON_INT32 (1));
+   docs[2] = BCON_NEW ("i", BCON_INT32 (2), "_id", BCON_NULL);
+   docs[3] = BCON_NEW ("i", BCON_INT32 (3), "_id", BCON_MINKEY);
+   docs[4] = BCON_NEW ("i", BCON_INT32 (4), "_id", BCON_UTF8 ("a"));
+   docs[5] = BCON_NEW ("i", BCON_INT32 (5), "_id", BCON_UNDEFINED);
+
+   for (i = 0; i < 6; i++) {
+      data = bson_realloc (data, len + docs[i]->len);
+      memcpy (data + len, bson_get_data (docs[i]), docs[i]->len);
+      len += docs[i]->len;
+      bson_destroy (docs[i]);
+   }
+
+   _make_paths (data_path, index_path, sizeof data_path);
+   _write_file (data_path, data, len);
+   bson_free (data);
+
+   ASSERT_OR_PRINT (
+      bson_file_index_build (data_path, index_path, "_id", &error), error);
+   index = bson_file_index_open (data_path, index_path, &error);
+   ASSERT_OR_PRINT (index, error);
+
+   value.value_type = BSON_TYPE_MINKEY;
+   BSON_ASSERT (bson_file_index_find (index, &value, &doc, NULL));
+   ASSERT_CMPINT (_get_i (&doc), ==, 3);
+
+   value.value_type = BSON_TYPE_MAXKEY;
+   BSON_ASSERT (bson_file_index_find (index, &value, &doc, NULL));
+   ASSERT_CMPINT (_get_i (&doc), ==, 0);
+
+   /* null and undefined are equal */
+   value.value_type = BSON_TYPE_NULL;
+   BSON_ASSERT (bson_file_index_find (index, &value, &doc, NULL));
+   ASSERT_CMPINT (_get_i (&doc), ==, 2);
+   value.value_type = BSON_TYPE_UNDEFINED;
+   BSON_ASSERT (bson_file_index_find (index, &value, &doc, NULL));
+   ASSERT_CMPINT (_get_i (&doc), ==, 2);
+
+   /* the values around them are still found */
+   value.value_type = BSON_TYPE_INT32;
+   value.value.v_int32 = 1;
+   BSON_ASSERT (bson_file_index_find (index, &value, &doc, NULL));
+   ASSERT_CMPINT (_get_i (&doc), ==, 1);
+   value.value_type = BSON_TYPE_UTF8;
+   value.value.v_utf8.str = "a";
+   value.value.v_utf8.len = 1;
+   BSON_ASSERT (bson_file_index_find (index, &value, &doc, NULL));
+   ASSERT_CMPINT (_get_i (&doc), ==, 4);
+
+   bson_file_index_destroy (index);
+   remove (data_path);
+   remove (index_path);
+}
+
+
+#if defined(NAN)
+/* NaN is less than every number, and large integers compare exactly */
+static void
+test_file_index_nan (void)
+{
+   bson_file_index_t *index;
+   bson_error_t error;
+   char data_path[64];
+   char index_path[64];
+   bson_value_t value;
+   double keys[] = {5, NAN, 1, 9, NAN, 3, 7, NAN, 2, 8, 4, 6};
+   int n_keys = (int) (sizeof keys / sizeof keys[0]);
+   int64_t big = (INT64_C (1) << 53) + 1;
+   uint8_t *data = NULL;
+   size_t len = 0;
+   bson_t *doc;
+   bson_t found;
+   int i;
+
+   for (i = 0; i < n_keys + 2; i++) {
+      if (i < n_keys) {
+         doc = BCON_NEW ("i", BCON_INT32 (i), "_id", BCON_DOUBLE (keys[i]));
+      } else if (i == n_keys) {
+         /* 2^53 as a double, which rounds 2^53 + 1 down */
+         doc = BCON_NEW (
+            "i", BCON_INT32 (i), "_id", BCON_DOUBLE ((double) (big - 1)));
+      } else {
+         doc = BCON_NEW ("i", BCON_INT32 (i), "_id", BCON_INT64 (big));
+      }
+
+      data = bson_realloc (data, len + doc->len);
+      memcpy (data + len, bson_get_data (doc), doc->len);
+      len += doc->len;
+      bson_destroy (doc);
+   }
+
+   _make_paths (data_path, index_path, sizeof data_path);
+   _write_file (data_path, data, len);
+   bson_free (data);
+
+   ASSERT_OR_PRINT (
+      bson_file_index_build (data_path, index_path, "_id", &error), error);
+   index = bson_file_index_open (data_path, index_path, &error);
+   ASSERT_OR_PRINT (index, error);
+
+   for (i = 0; i < n_keys; i++) {
+      if (keys[i] != keys[i]) {
+         continue;
+      }
+
+      value.value_type = BSON_TYPE_DOUBLE;
+      value.value.v_double = keys[i];
+      BSON_ASSERT (bson_file_index_find (index, &value, &found, NULL));
+      ASSERT_CMPINT (_get_i (&found), ==, i);
+
+      value.value_type = BSON_TYPE_INT32;
+      value.value.v_int32 = (int32_t) keys[i];
+      BSON_ASSERT (bson_file_index_find (index, &value, &found, NULL));
+      ASSERT_CMPINT (_get_i (&found), ==, i);
+   }
+
+   /* NaNs are equal, the first of them is found */
+   value.value_type = BSON_TYPE_DOUBLE;
+   value.value.v_double = NAN;
+   BSON_ASSERT (bson_file_index_find (index, &value, &found, NULL));
+   ASSERT_CMPINT (_get_i (&found), ==, 1);
+
+   value.value.v_double = 0;
+   BSON_ASSERT (!bson_file_index_find (index, &value, &found, NULL));
+
+   /* 2^53 + 1 is not equal to 2^53 */
+   value.value_type = BSON_TYPE_INT64;
+   value.value.v_int64 = big;
+   BSON_ASSERT (bson_file_index_find (index, &value, &found, NULL));
+   ASSERT_CMPINT (_get_i (&found), ==, n_keys + 1);
+   value.value.v_int64 = big - 1;
+   BSON_ASSERT (bson_file_index_find (index, &value, &found, NULL));
+   ASSERT_CMPINT (_get_i (&found), ==, n_keys);
+   value.value.v_int64 = big + 1;
+   BSON_ASSERT (!bson_file_index_find (index, &value, &found, NULL));
+
+   bson_file_index_destroy (index);
+   remove (data_path);
+   remove (index_path);
+}
+#endif
+
+
+static void
+test_file_index_errors (void)
+{
+   bson_file_index_t *index;
+   bson_error_t error;
+   char data_path[64];
+   char index_path[64];
+   uint8_t garbage[64];
+
+   _make_paths (data_path, index_path, sizeof data_path);
+
+   /* an empty file */
+   _write_data_file (data_path, 0);
+   ASSERT_OR_PRINT (
+      bson_file_index_build (data_path, index_path, "_id", &error), error);
+   index = bson_file_index_open (data_path, index_path, &error);
+   ASSERT_OR_PRINT (index, error);
+   ASSERT_CMPUINT64 (bson_file_index_get_n_docs (index), ==, (uint64_t) 0);
+   bson_file_index_destroy (index);
+
+   /* the data file changed after the index was built */
+   _write_data_file (data_path, 10);
+   BSON_ASSERT (!bson_file_index_open (data_path, index_path, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_FILE_INDEX,
+                          BSON_FILE_INDEX_ERROR_STALE_INDEX,
+                          "is an index of a file of 0 bytes");
+
+   /* not an index */
+   memset (garbage, 'x', sizeof garbage);
+   _write_file (index_path, garbage, sizeof garbage);
+   BSON_ASSERT (!bson_file_index_open (data_path, index_path, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_FILE_INDEX,
+                          BSON_FILE_INDEX_ERROR_INVALID_INDEX,
+                          "is not a valid index file");
+
+   /* a corrupt data file */
+   _write_file (data_path, garbage, sizeof garbage);
+   BSON_ASSERT (
+      !bson_file_index_build (data_path, index_path, NULL, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_FILE_INDEX,
+                          BSON_FILE_INDEX_ERROR_CORRUPT_BSON,
+                          "Corrupt document at offset 0");
+
+   remove (data_path);
+   remove (index_path);
+
+   BSON_ASSERT (!bson_file_index_build (data_path, index_path, NULL, &error));
+   ASSERT_CMPUINT32 (error.domain, ==, (uint32_t) BSON_ERROR_READER);
+}
+
+
+void
+test_file_index_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/file_index/get", test_file_index_get);
+   TestSuite_Add (suite, "/bson/file_index/find", test_file_index_find);
+   TestSuite_Add (suite,
+                  "/bson/file_index/no_data_types",
+                  test_file_index_no_data_types);
+#if defined(NAN)
+   TestSuite_Add (suite, "/bson/file_index/nan", test_file_index_nan);
+#endif
+   TestSuite_Add (suite, "/bson/file_index/errors", test_file_index_errors);
+}
@@ -0,0 +1,331 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bcon.h>
+#include <bson.h>
+
+#include "TestSuite.h"
+
+
+static void
+test_index_find (void)
+{
+   bson_index_t *index;
+   bson_iter_t iter;
+   bson_iter_t expected;
+   char key[16];
+   bson_t doc;
+   int i;
+
+   bson_init (&doc);
+   for (i = 0; i < 500; i++) {
+      bson_snprintf (key, sizeof key, "field%d", i);
+      if (i % 2) {
+         BSON_APPEND_INT32 (&doc, key, i);
+      } else {
+         BSON_APPEND_UTF8 (&doc, key, key);
+      }
+   }
+
+   index = bson_index_new (&doc);
+
+   for (i = 499; i >= 0; i--) {
+      bson_snprintf (key, sizeof key, "field%d", i);
+      ASSERT (bson_index_iter_init_find (&iter, index, key));
+      ASSERT (bson_iter_init_find (&expected, &doc, key));
+      ASSERT_CMPSTR (bson_iter_key (&iter), key);
+      ASSERT_CMPUINT32 (iter.off, ==, expected.off);
+      ASSERT (bson_index_has_field (index, key));
+      if (i % 2) {
+         ASSERT_CMPINT (bson_iter_int32 (&iter), ==, i);
+      } else {
+         ASSERT_CMPSTR (bson_iter_utf8 (&iter, NULL), key);
+      }
+
+      /* the iterator continues from the found element */
+      if (i < 499) {
+         ASSERT (bson_iter_next (&iter));
+         bson_snprintf (key, sizeof key, "field%d", i + 1);
+         ASSERT_CMPSTR (bson_iter_key (&iter), key);
+      } else {
+         ASSERT (!bson_iter_next (&iter));
+      }
+   }
+
+   ASSERT (!bson_index_iter_init_find (&iter, index, "field500"));
+   ASSERT (!bson_index_iter_init_find (&iter, index, "field"));
+   ASSERT (!bson_index_iter_init_find (&iter, index, ""));
+   ASSERT (!bson_index_has_field (index, "missing"));
+
+   bson_index_destroy (index);
+   bson_destroy (&doc);
+}
+
+
+static void
+test_index_duplicate_keys (void)
+{
+   bson_index_t *index;
+   bson_iter_t iter;
+   bson_t *doc;
+
+   doc = BCON_NEW ("a", BCON_INT32 (1), "b", BCON_INT32 (2), "a", "{", "}");
+   index = bson_index_new (doc);
+
+   /* like bson_iter_find, the first match wins */
+   ASSERT (bson_index_iter_init_find (&iter, index, "a"));
+   ASSERT (BSON_ITER_HOLDS_INT32 (&iter));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 1);
+   ASSERT (!bson_index_has_field (index, "a.b"));
+
+   bson_index_destroy (index);
+   bson_destroy (doc);
+}
+
+
+static void
+test_index_find_descendant (void)
+{
+   const char *paths[] = {"a",
+                          "a.b",
+                          "a.b.c",
+                          "a.b.c.d",
+                          "a.arr.0",
+                          "a.arr.1",
+                          "a.arr.1.x",
+                          "a.arr.2",
+                          "a.arr.1.y",
+                          "a.b.z",
+                          "a.s",
+                          "a.s.x",
+                          "a.",
+                          ".a",
+                          "z",
+                          "z.0",
+                          NULL};
+   bson_index_t *index;
+   bson_iter_t iter;
+   bson_iter_t descendant;
+   bson_iter_t expected;
+   bool found;
+   bson_t *doc;
+   int i;
+   int j;
+
+   doc = BCON_NEW ("z",
+                   BCON_INT32 (0),
+                   "a",
+                   "{",
+                   "s",
+                   "str",
+                   "b",
+                   "{",
+                   "c",
+                   BCON_INT32 (1),
+                   "}",
+                   "arr",
+                   "[",
+                   BCON_INT32 (2),
+                   "{",
+                   "x",
+                   BCON_INT32 (3),
+                   "}",
+                   "]",
+                   "}");
+
+   index = bson_index_new (doc);
+
+   /* twice, the second time uses indexes of the embedded documents */
+   for (j = 0; j < 2; j++) {
+      for (i = 0; paths[i]; i++) {
+         ASSERT (bson_iter_init (&iter, doc));
+         found = bson_iter_find_descendant (&iter, paths[i], &expected);
+
+         if (found) {
+            ASSERT (bson_index_iter_find_descendant (
+               index, paths[i], &descendant));
+            ASSERT_CMPUINT32 (descendant.off, ==, expected.off);
+            ASSERT (descendant.raw == expected.raw);
+         } else {
+            ASSERT (!bson_index_iter_find_descendant (
+               index, paths[i], &descendant));
+         }
+
+         ASSERT (bson_index_has_field (index, paths[i]) ==
+                 bson_has_field (doc, paths[i]));
+      }
+   }
+
+   ASSERT (bson_index_iter_find_descendant (index, "a.arr.1.x", &descendant));
+   ASSERT_CMPINT (bson_iter_int32 (&descendant), ==, 3);
+
+   bson_index_destroy (index);
+   bson_destroy (doc);
+}
+
+
+static void
+test_index_reset (void)
+{
+   bson_index_t *index;
+   bson_iter_t iter;
+   bson_t *doc1;
+   bson_t *doc2;
+   bson_t *doc3;
+   bson_t *doc4;
+
+   doc1 = BCON_NEW (
+      "name", "a", "sub", "{", "x", BCON_INT32 (1), "}", "n", BCON_INT32 (1));
+   /* same shape, different offsets */
+   doc2 = BCON_NEW ("name",
+                    "a much longer name",
+                    "sub",
+                    "{",
+                    "x",
+                    BCON_INT32 (2),
+                    "}",
+                    "n",
+                    BCON_INT32 (2));
+   /* shares a prefix with doc1 and then differs */
+   doc3 = BCON_NEW ("name", "c", "other", BCON_INT32 (3));
+   /* more fields than doc1 */
+   doc4 = BCON_NEW ("name",
+                    "d",
+                    "sub",
+                    "{",
+                    "x",
+                    BCON_INT32 (4),
+                    "}",
+                    "n",
+                    BCON_INT32 (4),
+                    "extra",
+                    BCON_BOOL (true));
+
+   index = bson_index_new (doc1);
+   ASSERT (bson_index_iter_find_descendant (index, "sub.x", &iter));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 1);
+   ASSERT (bson_index_iter_init_find (&iter, index, "n"));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 1);
+
+   bson_index_reset (index, doc2);
+   ASSERT (bson_index_iter_find_descendant (index, "sub.x", &iter));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 2);
+   ASSERT (bson_index_iter_init_find (&iter, index, "n"));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 2);
+   ASSERT (bson_index_iter_init_find (&iter, index, "name"));
+   ASSERT_CMPSTR (bson_iter_utf8 (&iter, NULL), "a much longer name");
+
+   bson_index_reset (index, doc3);
+   ASSERT (!bson_index_has_field (index, "sub"));
+   ASSERT (!bson_index_has_field (index, "sub.x"));
+   ASSERT (!bson_index_has_field (index, "n"));
+   ASSERT (bson_index_iter_init_find (&iter, index, "other"));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 3);
+   ASSERT (bson_index_iter_init_find (&iter, index, "name"));
+   ASSERT_CMPSTR (bson_iter_utf8 (&iter, NULL), "c");
+
+   bson_index_reset (index, doc4);
+   ASSERT (bson_index_iter_find_descendant (index, "sub.x", &iter));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 4);
+   ASSERT (bson_index_has_field (index, "extra"));
+   ASSERT (!bson_index_has_field (index, "other"));
+
+   bson_index_reset (index, doc1);
+   ASSERT (!bson_index_has_field (index, "extra"));
+   ASSERT (bson_index_iter_find_descendant (index, "sub.x", &iter));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 1);
+
+   bson_index_destroy (index);
+   bson_destroy (doc1);
+   bson_destroy (doc2);
+   bson_destroy (doc3);
+   bson_destroy (doc4);
+}
+
+
+static void
+test_index_no_data_types (void)
+{
+   bson_index_t *index;
+   bson_iter_t iter;
+   bson_t *doc;
+
+   doc = BCON_NEW ("null",
+                   BCON_NULL,
+                   "undefined",
+                   BCON_UNDEFINED,
+                   "minkey",
+                   BCON_MINKEY,
+                   "maxkey",
+                   BCON_MAXKEY,
+                   "last",
+                   BCON_INT32 (1));
+   index = bson_index_new (doc);
+
+   ASSERT (bson_index_iter_init_find (&iter, index, "null"));
+   ASSERT (BSON_ITER_HOLDS_NULL (&iter));
+   ASSERT (bson_index_iter_init_find (&iter, index, "undefined"));
+   ASSERT (BSON_ITER_HOLDS_UNDEFINED (&iter));
+   ASSERT (bson_index_iter_init_find (&iter, index, "minkey"));
+   ASSERT (BSON_ITER_HOLDS_MINKEY (&iter));
+   ASSERT (bson_index_iter_init_find (&iter, index, "maxkey"));
+   ASSERT (BSON_ITER_HOLDS_MAXKEY (&iter));
+   ASSERT (bson_index_iter_init_find (&iter, index, "last"));
+
+   /* the index is reused for the same keys */
+   bson_index_reset (index, doc);
+   ASSERT (bson_index_iter_init_find (&iter, index, "null"));
+
+   bson_index_destroy (index);
+   bson_destroy (doc);
+}
+
+
+static void
+test_index_corrupt (void)
+{
+   /* {"a": 1, "b": <int32 with a truncated value>} */
+   static const uint8_t data[] = {
+      17, 0, 0, 0, 0x10, 'a', 0, 1, 0, 0, 0, 0x10, 'b', 0, 1, 0, 0};
+   bson_index_t *index;
+   bson_iter_t iter;
+   bson_t doc;
+
+   ASSERT (bson_init_static (&doc, data, sizeof data));
+   index = bson_index_new (&doc);
+
+   ASSERT (bson_index_iter_init_find (&iter, index, "a"));
+   ASSERT (!bson_index_has_field (index, "b"));
+   ASSERT (!bson_has_field (&doc, "b"));
+
+   bson_index_destroy (index);
+}
+
+
+void
+test_index_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/index/find", test_index_find);
+   TestSuite_Add (
+      suite, "/bson/index/duplicate_keys", test_index_duplicate_keys);
+   TestSuite_Add (
+      suite, "/bson/index/find_descendant", test_index_find_descendant);
+   TestSuite_Add (suite, "/bson/index/reset", test_index_reset);
+   TestSuite_Add (
+      suite, "/bson/index/no_data_types", test_index_no_data_types);
+   TestSuite_Add (suite, "/bson/index/corrupt", test_index_corrupt);
+}
@@ -594,6 +594,61 @@ test_bson_iter_as_bool (void)
    bson_destroy (&b);
 }
 
+static void
+test_bson_iter_key_lengths (void)
+{
+   char key[41];
+   char upper[41];
+   uint8_t *data;
+   uint32_t len;
+   bson_iter_t iter;
+   bson_t b;
+   int i;
+
+   /* keys on either side of each word boundary */
+   bson_init (&b);
+   for (i = 1; i < (int) sizeof key; i++) {
+      memset (key, 'k', i);
+      key[i] = '\0';
+      BSON_APPEND_INT32 (&b, key, i);
+   }
+
+   for (i = 1; i < (int) sizeof key; i++) {
+      memset (key, 'k', i);
+      key[i] = '\0';
+      ASSERT (bson_iter_init (&iter, &b));
+      ASSERT (bson_iter_find (&iter, key));
+      ASSERT_CMPINT (bson_iter_int32 (&iter), ==, i);
+      ASSERT_CMPSIZE_T (strlen (bson_iter_key (&iter)), ==, (size_t) i);
+
+      memset (upper, 'K', i);
+      upper[i] = '\0';
+      ASSERT (bson_iter_init (&iter, &b));
+      ASSERT (bson_iter_find_case (&iter, upper));
+      ASSERT_CMPINT (bson_iter_int32 (&iter), ==, i);
+   }
+
+   ASSERT (bson_iter_init (&iter, &b));
+   ASSERT (!bson_iter_find (&iter, "kkkkkkkkkx"));
+   bson_destroy (&b);
+
+   /* a key that runs into the document's terminating NUL */
+   for (i = 1; i < (int) sizeof key; i++) {
+      len = 4 + 1 + i + 1;
+      data = bson_malloc (len);
+      data[0] = (uint8_t) len;
+      data[1] = data[2] = data[3] = 0;
+      data[4] = BSON_TYPE_INT32;
+      memset (data + 5, 'k', i);
+      data[len - 1] = '\0';
+
+      ASSERT (bson_iter_init_from_data (&iter, data, len));
+      ASSERT (!bson_iter_next (&iter));
+      bson_free (data);
+   }
+}
+
+
 static void
 test_bson_iter_from_data (void)
 {
@@ -645,4 +700,5 @@ test_iter_install (TestSuite *suite)
    TestSuite_Add (
       suite, "/bson/iter/binary_deprecated", test_bson_iter_binary_deprecated);
    TestSuite_Add (suite, "/bson/iter/from_data", test_bson_iter_from_data);
+   TestSuite_Add (suite, "/bson/iter/key_lengths", test_bson_iter_key_lengths);
 }
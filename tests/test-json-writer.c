@@ -0,0 +1,490 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bcon.h>
+#include <bson.h>
+
+#include "TestSuite.h"
+
+
+static bson_t *
+_all_types_doc (void)
+{
+   bson_decimal128_t dec;
+   bson_oid_t oid;
+   bson_t *scope;
+   bson_t *doc;
+
+   bson_decimal128_from_string ("1.5E+3", &dec);
+   bson_oid_init_from_string (&oid, "0123456789abcdef01234567");
+   scope = BCON_NEW ("x", BCON_INT32 (1), "y", "[", BCON_INT32 (2), "]");
+
+   doc = BCON_NEW ("utf8",
+                   "str\"ing\\\n",
+                   "int32",
+                   BCON_INT32 (-42),
+                   "int64",
+                   BCON_INT64 (1234567890123LL),
+                   "double",
+                   BCON_DOUBLE (3.25),
+                   "double_int",
+                   BCON_DOUBLE (3.0),
+                   "decimal",
+                   BCON_DECIMAL128 (&dec),
+                   "bool",
+                   BCON_BOOL (true),
+                   "null",
+                   BCON_NULL,
+                   "undefined",
+                   BCON_UNDEFINED,
+                   "oid",
+                   BCON_OID (&oid),
+                   "binary",
+                   BCON_BIN (BSON_SUBTYPE_BINARY, (const uint8_t *) "abcd", 4),
+                   "date",
+                   BCON_DATE_TIME (1500000000000LL),
+                   "date_neg",
+                   BCON_DATE_TIME (-1),
+                   "regex",
+                   BCON_REGEX ("^a.*b$", "mi"),
+                   "dbpointer",
+                   BCON_DBPOINTER ("db.coll", &oid),
+                   "code",
+                   BCON_CODE ("function () {}"),
+                   "symbol",
+                   BCON_SYMBOL ("sym"),
+                   "codewscope",
+                   BCON_CODEWSCOPE ("f ()", scope),
+                   "timestamp",
+                   BCON_TIMESTAMP (100, 200),
+                   "minkey",
+                   BCON_MINKEY,
+                   "maxkey",
+                   BCON_MAXKEY,
+                   "empty_doc",
+                   "{",
+                   "}",
+                   "empty_array",
+                   "[",
+                   "]",
+                   "nested",
+                   "{",
+                   "a",
+                   "[",
+                   "{",
+                   "b",
+                   BCON_INT32 (1),
+                   "}",
+                   "[",
+                   BCON_UTF8 ("c"),
+                   "]",
+                   "]",
+                   "d",
+                   BCON_CODEWSCOPE ("g ()", scope),
+                   "}");
+
+   bson_destroy (scope);
+
+   return doc;
+}
+
+
+static bson_t *
+_deep_doc (int depth)
+{
+   bson_t *docs;
+   bson_t *doc;
+   int i;
+
+   docs = bson_malloc0 ((depth + 1) * sizeof (bson_t));
+   bson_init (&docs[0]);
+
+   for (i = 0; i < depth; i++) {
+      BSON_APPEND_INT32 (&docs[i], "i", i);
+      bson_append_document_begin (&docs[i], "child", -1, &docs[i + 1]);
+   }
+
+   BSON_APPEND_UTF8 (&docs[depth], "leaf", "value");
+
+   for (i = depth; i > 0; i--) {
+      bson_append_document_end (&docs[i - 1], &docs[i]);
+   }
+
+   doc = bson_copy (&docs[0]);
+   bson_destroy (&docs[0]);
+   bson_free (docs);
+
+   return doc;
+}
+
+
+static char *
+_as_json (const bson_t *bson, bson_json_mode_t mode)
+{
+   switch (mode) {
+   case BSON_JSON_MODE_CANONICAL:
+      return bson_as_canonical_extended_json (bson, NULL);
+   case BSON_JSON_MODE_RELAXED:
+      return bson_as_relaxed_extended_json (bson, NULL);
+   case BSON_JSON_MODE_LEGACY:
+   default:
+      return bson_as_json (bson, NULL);
+   }
+}
+
+
+static void
+_check_data_writer (const bson_t *bson, bson_json_mode_t mode)
+{
+   bson_json_writer_t *writer;
+   bson_error_t error;
+   const char *data;
+   char *expected;
+   size_t len;
+   int r;
+
+   expected = _as_json (bson, mode);
+   BSON_ASSERT (expected);
+
+   writer = bson_json_data_writer_new (0);
+   r = bson_as_json_to_writer (bson, mode, writer, &error);
+   ASSERT_OR_PRINT (r == 1, error);
+
+   data = bson_json_writer_get_data (writer, &len);
+   ASSERT_CMPSIZE_T (len, ==, strlen (expected));
+   ASSERT_CMPSTR (data, expected);
+
+   bson_json_writer_destroy (writer);
+   bson_free (expected);
+}
+
+
+static void
+_check_static_writer (const bson_t *bson, bson_json_mode_t mode, size_t size)
+{
+   bson_json_writer_t *writer;
+   bson_string_t *out;
+   bson_error_t error;
+   const char *data;
+   char *expected;
+   char *buf;
+   size_t len;
+   int r;
+
+   expected = _as_json (bson, mode);
+   BSON_ASSERT (expected);
+
+   buf = bson_malloc (size);
+   writer = bson_json_data_writer_new_static (buf, size);
+   out = bson_string_new (NULL);
+
+   while ((r = bson_as_json_to_writer (bson, mode, writer, &error)) == 0) {
+      data = bson_json_writer_get_data (writer, &len);
+      ASSERT_CMPSIZE_T (len, ==, size);
+      bson_string_append_printf (out, "%.*s", (int) len, data);
+      bson_json_writer_reset (writer);
+   }
+
+   ASSERT_OR_PRINT (r == 1, error);
+   data = bson_json_writer_get_data (writer, &len);
+   ASSERT_CMPSIZE_T (len, <=, size);
+   bson_string_append_printf (out, "%.*s", (int) len, data);
+
+   ASSERT_CMPSTR (out->str, expected);
+
+   bson_json_writer_destroy (writer);
+   bson_string_free (out, true);
+   bson_free (buf);
+   bson_free (expected);
+}
+
+
+static void
+test_json_writer_data (void)
+{
+   bson_t *docs[4];
+   int i;
+   int mode;
+
+   docs[0] = bson_new ();
+   docs[1] = _all_types_doc ();
+   docs[2] = _deep_doc (50);
+   /* deeper than the recursion limit, truncated with "{ ... }" */
+   docs[3] = _deep_doc (250);
+
+   for (i = 0; i < 4; i++) {
+      for (mode = BSON_JSON_MODE_LEGACY; mode <= BSON_JSON_MODE_RELAXED;
+           mode++) {
+         _check_data_writer (docs[i], (bson_json_mode_t) mode);
+      }
+
+      bson_destroy (docs[i]);
+   }
+}
+
+
+static void
+test_json_writer_data_append (void)
+{
+   bson_json_writer_t *writer;
+   bson_error_t error;
+   const char *data;
+   bson_t *a;
+   bson_t *b;
+
+   a = BCON_NEW ("a", BCON_INT32 (1));
+   b = BCON_NEW ("b", "[", BCON_INT32 (2), "]");
+
+   /* documents are appended until the writer is reset */
+   writer = bson_json_data_writer_new (1);
+   ASSERT (bson_as_json_to_writer (a, BSON_JSON_MODE_LEGACY, writer, &error));
+   ASSERT (bson_as_json_to_writer (b, BSON_JSON_MODE_LEGACY, writer, &error));
+   data = bson_json_writer_get_data (writer, NULL);
+   ASSERT_CMPSTR (data, "{ \"a\" : 1 }{ \"b\" : [ 2 ] }");
+
+   bson_json_writer_reset (writer);
+   ASSERT (
+      bson_as_json_to_writer (a, BSON_JSON_MODE_CANONICAL, writer, &error));
+   data = bson_json_writer_get_data (writer, NULL);
+   ASSERT_CMPSTR (data, "{ \"a\" : { \"$numberInt\" : \"1\" } }");
+
+   bson_json_writer_destroy (writer);
+   bson_destroy (a);
+   bson_destroy (b);
+}
+
+
+static void
+test_json_writer_static (void)
+{
+   size_t sizes[] = {1, 2, 3, 7, 64, 1000, 100000};
+   bson_t *docs[3];
+   size_t i;
+   int j;
+   int mode;
+
+   docs[0] = bson_new ();
+   docs[1] = _all_types_doc ();
+   docs[2] = _deep_doc (250);
+
+   for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+      for (j = 0; j < 3; j++) {
+         for (mode = BSON_JSON_MODE_LEGACY; mode <= BSON_JSON_MODE_RELAXED;
+              mode++) {
+            _check_static_writer (docs[j], (bson_json_mode_t) mode, sizes[i]);
+         }
+      }
+   }
+
+   for (j = 0; j < 3; j++) {
+      bson_destroy (docs[j]);
+   }
+}
+
+
+static void
+test_json_writer_static_other_doc (void)
+{
+   bson_json_writer_t *writer;
+   bson_error_t error;
+   char buf[8];
+   bson_t *a;
+   bson_t *b;
+
+   a = BCON_NEW ("a", "a long enough string");
+   b = BCON_NEW ("b", BCON_INT32 (1));
+
+   writer = bson_json_data_writer_new_static (buf, sizeof buf);
+   ASSERT_CMPINT (
+      bson_as_json_to_writer (a, BSON_JSON_MODE_LEGACY, writer, &error), ==, 0);
+   bson_json_writer_reset (writer);
+
+   ASSERT_CMPINT (
+      bson_as_json_to_writer (b, BSON_JSON_MODE_LEGACY, writer, &error),
+      ==,
+      -1);
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_JSON,
+                          BSON_JSON_ERROR_WRITE_INVALID_PARAM,
+                          "partially written");
+
+   /* the first document can still be finished */
+   while (bson_as_json_to_writer (a, BSON_JSON_MODE_LEGACY, writer, &error) ==
+          0) {
+      bson_json_writer_reset (writer);
+   }
+
+   bson_json_writer_destroy (writer);
+   bson_destroy (a);
+   bson_destroy (b);
+}
+
+
+static ssize_t
+_append_cb (void *handle, const char *buf, size_t count)
+{
+   bson_string_t *str = handle;
+   size_t n;
+
+   /* consume at most 5 bytes at a time to test short writes */
+   n = BSON_MIN (count, 5);
+   bson_string_append_printf (str, "%.*s", (int) n, buf);
+
+   return (ssize_t) n;
+}
+
+
+static void
+_free_cb (void *handle)
+{
+   bson_string_free ((bson_string_t *) handle, true);
+}
+
+
+static void
+test_json_writer_cb (void)
+{
+   bson_json_writer_t *writer;
+   bson_string_t *expected;
+   bson_string_t *out;
+   bson_error_t error;
+   char *json;
+   bson_t *doc;
+   int i;
+
+   doc = _all_types_doc ();
+   out = bson_string_new (NULL);
+   expected = bson_string_new (NULL);
+   writer = bson_json_writer_new (out, _append_cb, NULL, 16);
+
+   for (i = 0; i < 10; i++) {
+      ASSERT_OR_PRINT (
+         bson_as_json_to_writer (doc, BSON_JSON_MODE_RELAXED, writer, &error) ==
+            1,
+         error);
+      json = bson_as_relaxed_extended_json (doc, NULL);
+      bson_string_append (expected, json);
+      bson_free (json);
+   }
+
+   /* output beyond buf_size has been delivered, the rest is buffered */
+   ASSERT_CMPSIZE_T ((size_t) out->len, <, (size_t) expected->len);
+   ASSERT_CMPSIZE_T ((size_t) out->len, >, (size_t) expected->len / 2);
+   ASSERT (!bson_json_writer_get_data (writer, NULL));
+
+   ASSERT_OR_PRINT (bson_json_writer_flush (writer, &error), error);
+   ASSERT_CMPSTR (out->str, expected->str);
+
+   bson_json_writer_destroy (writer);
+   bson_string_free (out, true);
+   bson_string_free (expected, true);
+   bson_destroy (doc);
+}
+
+
+static ssize_t
+_failing_cb (void *handle, const char *buf, size_t count)
+{
+   return -1;
+}
+
+
+static void
+test_json_writer_cb_failure (void)
+{
+   bson_json_writer_t *writer;
+   bson_error_t error;
+   bson_t *doc;
+
+   doc = _deep_doc (10);
+   writer = bson_json_writer_new (
+      bson_string_new (NULL), _failing_cb, _free_cb, 1);
+
+   ASSERT_CMPINT (
+      bson_as_json_to_writer (doc, BSON_JSON_MODE_LEGACY, writer, &error),
+      ==,
+      -1);
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_JSON,
+                          BSON_JSON_ERROR_WRITE_CB_FAILURE,
+                          "Failed to write");
+   ASSERT (!bson_json_writer_flush (writer, &error));
+
+   bson_json_writer_destroy (writer);
+   bson_destroy (doc);
+}
+
+
+static void
+test_json_writer_corrupt (void)
+{
+   /* {"a": "\xff"}, not valid UTF-8 */
+   static const uint8_t bad_utf8[] = {
+      14, 0, 0, 0, 0x02, 'a', 0, 2, 0, 0, 0, 0xff, 0, 0};
+   /* {"a": {}} with a bad length for the embedded document */
+   static const uint8_t bad_length[] = {
+      13, 0, 0, 0, 0x03, 'a', 0, 50, 0, 0, 0, 0, 0};
+   bson_json_writer_t *writer;
+   bson_error_t error;
+   bson_t *good;
+   bson_t doc;
+   size_t len;
+
+   good = BCON_NEW ("x", BCON_INT32 (1));
+   writer = bson_json_data_writer_new (0);
+   ASSERT (bson_as_json_to_writer (good, BSON_JSON_MODE_LEGACY, writer, NULL));
+
+   ASSERT (bson_init_static (&doc, bad_utf8, sizeof bad_utf8));
+   ASSERT_CMPINT (
+      bson_as_json_to_writer (&doc, BSON_JSON_MODE_LEGACY, writer, &error),
+      ==,
+      -1);
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_JSON,
+                          BSON_JSON_ERROR_WRITE_CORRUPT_BSON,
+                          "corrupt BSON");
+
+   ASSERT (bson_init_static (&doc, bad_length, sizeof bad_length));
+   ASSERT_CMPINT (
+      bson_as_json_to_writer (&doc, BSON_JSON_MODE_LEGACY, writer, &error),
+      ==,
+      -1);
+
+   /* the output of the corrupt documents is discarded */
+   ASSERT_CMPSTR (bson_json_writer_get_data (writer, &len), "{ \"x\" : 1 }");
+   ASSERT_CMPSIZE_T (len, ==, (size_t) 11);
+
+   bson_json_writer_destroy (writer);
+   bson_destroy (good);
+}
+
+
+void
+test_json_writer_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/json_writer/data", test_json_writer_data);
+   TestSuite_Add (
+      suite, "/bson/json_writer/data_append", test_json_writer_data_append);
+   TestSuite_Add (suite, "/bson/json_writer/static", test_json_writer_static);
+   TestSuite_Add (suite,
+                  "/bson/json_writer/static_other_doc",
+                  test_json_writer_static_other_doc);
+   TestSuite_Add (suite, "/bson/json_writer/cb", test_json_writer_cb);
+   TestSuite_Add (
+      suite, "/bson/json_writer/cb_failure", test_json_writer_cb_failure);
+   TestSuite_Add (suite, "/bson/json_writer/corrupt", test_json_writer_corrupt);
+}
@@ -369,7 +369,6 @@ test_bson_as_json_double (void)
    size_t len;
    bson_t *b;
    char *str;
-   char *expected;
 
    b = bson_new ();
    BSON_ASSERT (bson_append_double (b, "foo", -1, 123.5));
@@ -377,24 +376,75 @@ test_bson_as_json_double (void)
    BSON_ASSERT (bson_append_double (b, "baz", -1, -1));
    BSON_ASSERT (bson_append_double (b, "quux", -1, 0.03125));
    BSON_ASSERT (bson_append_double (b, "huge", -1, 1e99));
+   BSON_ASSERT (bson_append_double (b, "tenth", -1, 0.1));
+   BSON_ASSERT (bson_append_double (b, "small", -1, -2.5e-5));
+   BSON_ASSERT (bson_append_double (b, "big", -1, 1234567890123456768.0));
+   BSON_ASSERT (bson_append_double (b, "bigger", -1, 1e20));
+   BSON_ASSERT (bson_append_double (b, "neg_zero", -1, -0.0));
    str = bson_as_json (b, &len);
 
-   expected = bson_strdup_printf ("{"
-                                  " \"foo\" : 123.5,"
-                                  " \"bar\" : 3.0,"
-                                  " \"baz\" : -1.0,"
-                                  " \"quux\" : 0.03125,"
-                                  " \"huge\" : %.20g }",
-                                  1e99);
-
-   ASSERT_CMPSTR (str, expected);
+   /* the shortest digits that read back as the same double, but integers
+    * below 1e20 with all their digits */
+   ASSERT_CMPSTR (str,
+                  "{"
+                  " \"foo\" : 123.5,"
+                  " \"bar\" : 3.0,"
+                  " \"baz\" : -1.0,"
+                  " \"quux\" : 0.03125,"
+                  " \"huge\" : 1e+99,"
+                  " \"tenth\" : 0.1,"
+                  " \"small\" : -2.5e-05,"
+                  " \"big\" : 1234567890123456768.0,"
+                  " \"bigger\" : 1e+20,"
+                  " \"neg_zero\" : -0.0 }");
 
-   bson_free (expected);
    bson_free (str);
    bson_destroy (b);
 }
 
 
+static void
+test_bson_as_json_double_round_trip (void)
+{
+   uint64_t bits;
+   bson_error_t error;
+   bson_iter_t iter;
+   bson_t *b;
+   bson_t *r;
+   double d;
+   double v;
+   char *str;
+   int i;
+
+   for (i = 0; i < 10000; i++) {
+      bits = (uint64_t) rand () << 48 ^ (uint64_t) rand () << 32 ^
+             (uint64_t) rand () << 16 ^ (uint64_t) rand ();
+      memcpy (&d, &bits, sizeof d);
+      if (d != d || d * 0 != 0) {
+         continue;
+      }
+
+      b = BCON_NEW ("d", BCON_DOUBLE (d));
+      str = bson_as_json (b, NULL);
+      r = bson_new_from_json ((const uint8_t *) str, -1, &error);
+      ASSERT_OR_PRINT (r, error);
+      BSON_ASSERT (bson_iter_init_find (&iter, r, "d"));
+      BSON_ASSERT (BSON_ITER_HOLDS_DOUBLE (&iter));
+
+      v = bson_iter_double (&iter);
+
+      if (memcmp (&d, &v, sizeof d) != 0) {
+         fprintf (stderr, "%.17g written as %s\n", d, str);
+         abort ();
+      }
+
+      bson_free (str);
+      bson_destroy (r);
+      bson_destroy (b);
+   }
+}
+
+
 #if defined(NAN) && defined(INFINITY)
 static void
 test_bson_as_json_double_nonfinite (void)
@@ -402,7 +452,6 @@ test_bson_as_json_double_nonfinite (void)
    size_t len;
    bson_t *b;
    char *str;
-   char *expected;
 
    b = bson_new ();
    BSON_ASSERT (bson_append_double (b, "nan", -1, NAN));
@@ -410,17 +459,9 @@ test_bson_as_json_double_nonfinite (void)
    BSON_ASSERT (bson_append_double (b, "neg_inf", -1, -INFINITY));
    str = bson_as_json (b, &len);
 
-   expected = bson_strdup_printf ("{"
-                                  " \"nan\" : %.20g,"
-                                  " \"pos_inf\" : %.20g,"
-                                  " \"neg_inf\" : %.20g }",
-                                  NAN,
-                                  INFINITY,
-                                  -INFINITY);
-
-   ASSERT_CMPSTR (str, expected);
+   ASSERT_CMPSTR (str,
+                  "{ \"nan\" : nan, \"pos_inf\" : inf, \"neg_inf\" : -inf }");
 
-   bson_free (expected);
    bson_free (str);
    bson_destroy (b);
 }
@@ -883,6 +924,227 @@ test_bson_json_read_buffering (void)
    bson_destroy (&bson_out);
 }
 
+static int
+_read_with_parser (const char *json,
+                   bson_json_parser_t parser,
+                   size_t buf_size,
+                   bson_t **docs /* OUT */,
+                   int max_docs,
+                   int *n_docs /* OUT */,
+                   bson_error_t *error /* OUT */)
+{
+   bson_json_reader_t *reader;
+   bson_t doc = BSON_INITIALIZER;
+   int r;
+
+   reader = bson_json_data_reader_new_with_parser (true, buf_size, parser);
+   bson_json_data_reader_ingest (reader, (uint8_t *) json, strlen (json));
+
+   *n_docs = 0;
+   while ((r = bson_json_reader_read (reader, &doc, error)) == 1) {
+      ASSERT (*n_docs < max_docs);
+      docs[(*n_docs)++] = bson_copy (&doc);
+      bson_reinit (&doc);
+   }
+
+   bson_json_reader_destroy (reader);
+   bson_destroy (&doc);
+
+   return r;
+}
+
+/* the structural parser produces the same documents and the same success or
+ * failure as the default parser, at any buffer size */
+static void
+test_bson_json_read_structural (void)
+{
+   const char *valid[] = {
+      "",
+      "{}",
+      "{} {} {}",
+      " \n\t{\"a\": 1}\r\n",
+      "{\"a\": -1, \"b\": 0, \"c\": -0, \"d\": 2147483648, \"e\": -2147483649}",
+      "{\"a\": 9223372036854775807, \"b\": -9223372036854775808}",
+      "{\"a\": 1.5, \"b\": -1e10, \"c\": 2.5E-3, \"d\": 1e+2, \"e\": -0.0}",
+      "{\"a\": true, \"b\": false, \"c\": null}",
+      "{\"a\": NaN, \"b\": Infinity, \"c\": -Infinity, \"d\": nan}",
+      "{\"a\": [], \"b\": [[]], \"c\": [1, [2, [3, {}]], {\"d\": [4]}]}",
+      "{\"\": \"\", \"a\\\"b\": \"c\\\\\", \"\\/\": \"\\b\\f\\n\\r\\t\"}",
+      "{\"a\": \"\\u00e9\\u4e2d\\ud83d\\ude00\", \"\\u0062\": \"\xc3\xa9\"}",
+      "{\"a\": \"\\\\\\\\\\\"\", \"b\": \"}{][,:\"}",
+      "{\"$oid\": \"000000000000000000000000\"}",
+      "{\"a\": {\"$oid\": \"0123456789abcdef01234567\"}}",
+      "{\"a\": {\"$date\": \"1970-01-01T00:00:10Z\"},"
+      " \"b\": {\"$date\": {\"$numberLong\": \"-1\"}}}",
+      "{\"a\": {\"$numberDecimal\": \"1.5E+3\"},"
+      " \"b\": {\"$numberInt\": \"4\"}, \"c\": {\"$numberLong\": \"5\"},"
+      " \"d\": {\"$numberDouble\": \"-0.0\"}}",
+      "{\"a\": {\"$binary\": {\"base64\": \"ZGVhZGJlZWY=\", \"subType\": "
+      "\"04\"}}, \"b\": {\"$binary\": \"AQID\", \"$type\": \"80\"}}",
+      "{\"a\": {\"$regularExpression\": {\"pattern\": \"^a\", \"options\": "
+      "\"mi\"}}, \"b\": {\"$regex\": \"x\", \"$options\": \"s\"}}",
+      "{\"a\": {\"$timestamp\": {\"t\": 123, \"i\": 456}}}",
+      "{\"a\": {\"$code\": \"f()\"}, \"b\": {\"$code\": \"g()\", \"$scope\": "
+      "{\"x\": [1]}}, \"c\": {\"$symbol\": \"s\"}}",
+      "{\"a\": {\"$dbPointer\": {\"$ref\": \"c\", \"$id\": {\"$oid\": "
+      "\"000000000000000000000000\"}}}}",
+      "{\"a\": {\"$ref\": \"c\", \"$id\": 1, \"$db\": \"d\", \"x\": {}}}",
+      "{\"a\": {\"$minKey\": 1}, \"b\": {\"$maxKey\": 1}, "
+      "\"c\": {\"$undefined\": true}}",
+      "{\"a\": 1}{\"b\": [2]}\n{\"c\": {\"d\": \"e\"}}",
+      NULL};
+   const char *invalid[] = {
+      " ",
+      "{",
+      "1",
+      "\"a\"",
+      "{\"a\"}",
+      "{\"a\": }",
+      "{\"a\": 1,}",
+      "{\"a\": [1,]}",
+      "{\"a\": [1}",
+      "{\"a\": {]}",
+      "{\"a\" 1}",
+      "{\"a\": 1 \"b\": 2}",
+      "{1: 2}",
+      "{\"a\": 01}",
+      "{\"a\": 1.}",
+      "{\"a\": -}",
+      "{\"a\": 1e}",
+      "{\"a\": tru}",
+      "{\"a\": nulll}",
+      "{\"a\": \"b}",
+      "{\"a\": \"\t\"}",
+      "{\"a\": \"\\x\"}",
+      "{\"a\": \"\\u12\"}",
+      "{\"a\": {\"$oid\": \"123\"}}",
+      "{\"a\": {\"$numberLong\": 1}}",
+      "{\"a\": 1} 2",
+      "{\"a\": 1} [",
+      NULL};
+   size_t buf_sizes[] = {1, 3, 7, 64, 65, 1000, 0};
+   bson_t *expected[8];
+   bson_t *actual[8];
+   bson_error_t error;
+   int n_expected;
+   int n_actual;
+   int r;
+   int i;
+   int j;
+   int k;
+
+   for (i = 0; valid[i]; i++) {
+      r = _read_with_parser (valid[i],
+                             BSON_JSON_PARSER_DEFAULT,
+                             0,
+                             expected,
+                             8,
+                             &n_expected,
+                             &error);
+      ASSERT_OR_PRINT (r == 0, error);
+
+      for (j = 0; j < sizeof buf_sizes / sizeof buf_sizes[0]; j++) {
+         r = _read_with_parser (valid[i],
+                                BSON_JSON_PARSER_STRUCTURAL,
+                                buf_sizes[j],
+                                actual,
+                                8,
+                                &n_actual,
+                                &error);
+         ASSERT_OR_PRINT (r == 0, error);
+         ASSERT_CMPINT (n_actual, ==, n_expected);
+
+         for (k = 0; k < n_actual; k++) {
+            bson_eq_bson (actual[k], expected[k]);
+            bson_destroy (actual[k]);
+         }
+      }
+
+      for (k = 0; k < n_expected; k++) {
+         bson_destroy (expected[k]);
+      }
+   }
+
+   for (i = 0; invalid[i]; i++) {
+      for (j = 0; j < sizeof buf_sizes / sizeof buf_sizes[0]; j++) {
+         r = _read_with_parser (invalid[i],
+                                BSON_JSON_PARSER_STRUCTURAL,
+                                buf_sizes[j],
+                                actual,
+                                8,
+                                &n_actual,
+                                &error);
+         if (r != -1) {
+            fprintf (stderr, "expected error parsing '%s'\n", invalid[i]);
+            abort ();
+         }
+
+         ASSERT_CMPINT (error.domain, ==, BSON_ERROR_JSON);
+
+         for (k = 0; k < n_actual; k++) {
+            bson_destroy (actual[k]);
+         }
+      }
+   }
+}
+
+static void
+test_bson_json_read_structural_depth (void)
+{
+   bson_string_t *json;
+   bson_error_t error;
+   bson_t *docs[1];
+   int n_docs;
+   int i;
+
+   /* the same nesting limit as the default parser */
+   json = bson_string_new ("{\"a\": ");
+   for (i = 0; i < 98; i++) {
+      bson_string_append (json, "[");
+   }
+   for (i = 0; i < 98; i++) {
+      bson_string_append (json, "]");
+   }
+   bson_string_append (json, "}");
+
+   ASSERT_CMPINT (_read_with_parser (json->str,
+                                     BSON_JSON_PARSER_STRUCTURAL,
+                                     0,
+                                     docs,
+                                     1,
+                                     &n_docs,
+                                     &error),
+                  ==,
+                  0);
+   ASSERT_CMPINT (n_docs, ==, 1);
+   bson_destroy (docs[0]);
+   bson_string_free (json, true);
+
+   json = bson_string_new ("{\"a\": ");
+   for (i = 0; i < 99; i++) {
+      bson_string_append (json, "[");
+   }
+   for (i = 0; i < 99; i++) {
+      bson_string_append (json, "]");
+   }
+   bson_string_append (json, "}");
+
+   ASSERT_CMPINT (_read_with_parser (json->str,
+                                     BSON_JSON_PARSER_STRUCTURAL,
+                                     0,
+                                     docs,
+                                     1,
+                                     &n_docs,
+                                     &error),
+                  ==,
+                  -1);
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_JSON,
+                          BSON_JSON_ERROR_READ_CORRUPT_JS,
+                          "LEVELS_EXCEEDED");
+   bson_string_free (json, true);
+}
+
 static void
 _test_bson_json_read_compare (const char *json, int size, ...)
 {
@@ -2883,6 +3145,9 @@ test_json_install (TestSuite *suite)
    TestSuite_Add (suite, "/bson/as_json/int32", test_bson_as_json_int32);
    TestSuite_Add (suite, "/bson/as_json/int64", test_bson_as_json_int64);
    TestSuite_Add (suite, "/bson/as_json/double", test_bson_as_json_double);
+   TestSuite_Add (suite,
+                  "/bson/as_json/double/round_trip",
+                  test_bson_as_json_double_round_trip);
 #if defined(NAN) && defined(INFINITY)
    TestSuite_Add (suite,
                   "/bson/as_json/double/nonfinite",
@@ -2911,6 +3176,11 @@ test_json_install (TestSuite *suite)
       suite, "/bson/json/allow_multiple", test_bson_json_allow_multiple);
    TestSuite_Add (
       suite, "/bson/json/read/buffering", test_bson_json_read_buffering);
+   TestSuite_Add (
+      suite, "/bson/json/read/structural", test_bson_json_read_structural);
+   TestSuite_Add (suite,
+                  "/bson/json/read/structural/depth",
+                  test_bson_json_read_structural_depth);
    TestSuite_Add (suite, "/bson/json/read", test_bson_json_read);
    TestSuite_Add (suite, "/bson/json/inc", test_bson_json_inc);
    TestSuite_Add (suite, "/bson/json/array", test_bson_json_array);
@@ -0,0 +1,219 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bcon.h>
+#include <bson.h>
+
+#include "TestSuite.h"
+
+
+static bson_t *
+_nested_doc (void)
+{
+   return BCON_NEW ("a",
+                    BCON_INT32 (1),
+                    "b",
+                    "{",
+                    "c",
+                    BCON_UTF8 ("c"),
+                    "d",
+                    "{",
+                    "e",
+                    BCON_INT64 (5),
+                    "}",
+                    "}",
+                    "arr",
+                    "[",
+                    BCON_INT32 (10),
+                    "{",
+                    "x",
+                    BCON_BOOL (true),
+                    "}",
+                    "]",
+                    "z",
+                    BCON_DOUBLE (1.5));
+}
+
+
+static void
+test_keyset_find (void)
+{
+   const char *paths[] = {
+      "z", "b.d.e", "arr.1.x", "missing", "b", "b.c", "a.nope", "arr.0", "z"};
+   const size_t n_paths = sizeof paths / sizeof paths[0];
+   bson_value_t values[sizeof paths / sizeof paths[0]];
+   bson_keyset_t *keyset;
+   bson_iter_t iter;
+   bson_t *doc;
+   size_t i;
+
+   doc = _nested_doc ();
+   keyset = bson_keyset_new (paths, n_paths);
+
+   ASSERT_CMPSIZE_T (bson_keyset_find (keyset, doc, values), ==, (size_t) 7);
+
+   /* the same values as bson_iter_find_descendant finds */
+   for (i = 0; i < n_paths; i++) {
+      ASSERT (bson_iter_init (&iter, doc));
+      if (bson_iter_find_descendant (&iter, paths[i], &iter)) {
+         ASSERT_CMPINT (values[i].value_type, ==, bson_iter_type (&iter));
+      } else {
+         ASSERT_CMPINT (values[i].value_type, ==, BSON_TYPE_EOD);
+      }
+   }
+
+   ASSERT_CMPDOUBLE (values[0].value.v_double, ==, 1.5);
+   ASSERT_CMPINT64 (values[1].value.v_int64, ==, (int64_t) 5);
+   ASSERT (values[2].value.v_bool);
+   ASSERT_CMPINT (values[4].value_type, ==, BSON_TYPE_DOCUMENT);
+   ASSERT_CMPSTR (values[5].value.v_utf8.str, "c");
+   ASSERT_CMPINT (values[7].value.v_int32, ==, 10);
+   ASSERT_CMPDOUBLE (values[8].value.v_double, ==, 1.5);
+
+   /* the keyset can be used again, with another document */
+   bson_destroy (doc);
+   doc = BCON_NEW ("z", BCON_UTF8 ("str"), "b", "{", "c", BCON_NULL, "}");
+   ASSERT_CMPSIZE_T (bson_keyset_find (keyset, doc, values), ==, (size_t) 4);
+   ASSERT_CMPINT (values[0].value_type, ==, BSON_TYPE_UTF8);
+   ASSERT_CMPINT (values[1].value_type, ==, BSON_TYPE_EOD);
+   ASSERT_CMPINT (values[4].value_type, ==, BSON_TYPE_DOCUMENT);
+   ASSERT_CMPINT (values[5].value_type, ==, BSON_TYPE_NULL);
+   ASSERT_CMPINT (values[8].value_type, ==, BSON_TYPE_UTF8);
+
+   bson_keyset_destroy (keyset);
+   bson_destroy (doc);
+}
+
+
+static void
+test_keyset_duplicate_keys (void)
+{
+   const char *paths[] = {"a", "b.c"};
+   bson_value_t values[2];
+   bson_keyset_t *keyset;
+   bson_t *doc;
+
+   doc = BCON_NEW ("a",
+                   BCON_INT32 (1),
+                   "b",
+                   BCON_INT32 (2),
+                   "a",
+                   BCON_INT32 (3),
+                   "b",
+                   "{",
+                   "c",
+                   BCON_INT32 (4),
+                   "}");
+   keyset = bson_keyset_new (paths, 2);
+
+   /* the first "a" is found, "b.c" is found in the second "b" */
+   ASSERT_CMPSIZE_T (bson_keyset_find (keyset, doc, values), ==, (size_t) 2);
+   ASSERT_CMPINT (values[0].value.v_int32, ==, 1);
+   ASSERT_CMPINT (values[1].value.v_int32, ==, 4);
+
+   bson_keyset_destroy (keyset);
+   bson_destroy (doc);
+}
+
+
+static void
+test_keyset_stops_early (void)
+{
+   /* {"a": 1, "b": <truncated string>} */
+   static const uint8_t data[] = {
+      22, 0, 0, 0, 0x10, 'a', 0, 1, 0, 0, 0,
+      0x02, 'b', 0, 100, 0, 0, 0, 'x', 'y', 0, 0};
+   const char *paths[] = {"a"};
+   bson_keyset_t *keyset;
+   bson_value_t values[1];
+   bson_t doc;
+
+   ASSERT (bson_init_static (&doc, data, sizeof data));
+   keyset = bson_keyset_new (paths, 1);
+
+   /* the walk stops once "a" is found, before the corrupt element */
+   ASSERT_CMPSIZE_T (bson_keyset_find (keyset, &doc, values), ==, (size_t) 1);
+   ASSERT_CMPINT (values[0].value.v_int32, ==, 1);
+
+   bson_keyset_destroy (keyset);
+}
+
+
+static void
+test_keyset_many (void)
+{
+   char **paths;
+   bson_value_t *values;
+   bson_keyset_t *keyset;
+   bson_t *doc;
+   bson_t child;
+   char key[16];
+   int i;
+
+   doc = bson_new ();
+   for (i = 0; i < 500; i++) {
+      bson_snprintf (key, sizeof key, "k%d", i);
+      bson_append_document_begin (doc, key, -1, &child);
+      BSON_APPEND_INT32 (&child, "v", i);
+      bson_append_document_end (doc, &child);
+   }
+
+   /* every other key, in reverse order */
+   paths = bson_malloc (250 * sizeof (char *));
+   values = bson_malloc (250 * sizeof (bson_value_t));
+   for (i = 0; i < 250; i++) {
+      paths[i] = bson_strdup_printf ("k%d.v", 498 - 2 * i);
+   }
+
+   keyset = bson_keyset_new ((const char *const *) paths, 250);
+   ASSERT_CMPSIZE_T (bson_keyset_find (keyset, doc, values), ==, (size_t) 250);
+   for (i = 0; i < 250; i++) {
+      ASSERT_CMPINT (values[i].value.v_int32, ==, 498 - 2 * i);
+      bson_free (paths[i]);
+   }
+
+   bson_keyset_destroy (keyset);
+   bson_free (values);
+   bson_free (paths);
+   bson_destroy (doc);
+}
+
+
+static void
+test_keyset_empty (void)
+{
+   bson_keyset_t *keyset;
+   bson_t *doc;
+
+   doc = _nested_doc ();
+   keyset = bson_keyset_new (NULL, 0);
+   ASSERT_CMPSIZE_T (bson_keyset_find (keyset, doc, NULL), ==, (size_t) 0);
+   bson_keyset_destroy (keyset);
+   bson_destroy (doc);
+}
+
+
+void
+test_keyset_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/keyset/find", test_keyset_find);
+   TestSuite_Add (
+      suite, "/bson/keyset/duplicate_keys", test_keyset_duplicate_keys);
+   TestSuite_Add (suite, "/bson/keyset/stops_early", test_keyset_stops_early);
+   TestSuite_Add (suite, "/bson/keyset/many", test_keyset_many);
+   TestSuite_Add (suite, "/bson/keyset/empty", test_keyset_empty);
+}
@@ -2,6 +2,12 @@
 #include "bson-config.h"
 
 
+extern void
+test_arena_install (TestSuite *suite);
+extern void
+test_array_builder_install (TestSuite *suite);
+extern void
+test_arrow_install (TestSuite *suite);
 extern void
 test_atomic_install (TestSuite *suite);
 extern void
@@ -13,26 +19,46 @@ test_bcon_extract_install (TestSuite *suite);
 extern void
 test_bson_install (TestSuite *suite);
 extern void
+test_chain_install (TestSuite *suite);
+extern void
 test_clock_install (TestSuite *suite);
 extern void
+test_column_install (TestSuite *suite);
+extern void
 test_decimal128_install (TestSuite *suite);
 extern void
 test_endian_install (TestSuite *suite);
 extern void
 test_error_install (TestSuite *suite);
 extern void
+test_file_index_install (TestSuite *suite);
+extern void
+test_index_install (TestSuite *suite);
+extern void
 test_iso8601_install (TestSuite *suite);
 extern void
 test_iter_install (TestSuite *suite);
 extern void
 test_json_install (TestSuite *suite);
 extern void
+test_json_writer_install (TestSuite *suite);
+extern void
+test_keyset_install (TestSuite *suite);
+extern void
 test_oid_install (TestSuite *suite);
 extern void
+test_patch_install (TestSuite *suite);
+extern void
+test_path_install (TestSuite *suite);
+extern void
 test_reader_install (TestSuite *suite);
 extern void
+test_splitter_install (TestSuite *suite);
+extern void
 test_string_install (TestSuite *suite);
 extern void
+test_template_install (TestSuite *suite);
+extern void
 test_utf8_install (TestSuite *suite);
 extern void
 test_value_install (TestSuite *suite);
@@ -50,20 +76,33 @@ main (int argc, char *argv[])
 
    TestSuite_Init (&suite, "", argc, argv);
 
+   test_arena_install (&suite);
+   test_array_builder_install (&suite);
+   test_arrow_install (&suite);
    test_atomic_install (&suite);
    test_bson_corpus_install (&suite);
    test_bcon_basic_install (&suite);
    test_bcon_extract_install (&suite);
    test_bson_install (&suite);
+   test_chain_install (&suite);
    test_clock_install (&suite);
+   test_column_install (&suite);
    test_error_install (&suite);
+   test_file_index_install (&suite);
    test_endian_install (&suite);
+   test_index_install (&suite);
    test_iso8601_install (&suite);
    test_iter_install (&suite);
    test_json_install (&suite);
+   test_json_writer_install (&suite);
+   test_keyset_install (&suite);
    test_oid_install (&suite);
+   test_patch_install (&suite);
+   test_path_install (&suite);
    test_reader_install (&suite);
+   test_splitter_install (&suite);
    test_string_install (&suite);
+   test_template_install (&suite);
    test_utf8_install (&suite);
    test_value_install (&suite);
    test_version_install (&suite);
@@ -75,6 +75,34 @@ oid_worker (void *data)
    return NULL;
 }
 
+typedef struct {
+   bson_context_t *context;
+   bson_oid_t *oids;
+   int n_oids;
+} oid_block_worker_t;
+
+
+static void *
+oid_block_worker (void *data)
+{
+   oid_block_worker_t *worker = data;
+   int i;
+
+   for (i = 0; i < worker->n_oids; i++) {
+      bson_oid_init (&worker->oids[i], worker->context);
+   }
+
+   return NULL;
+}
+
+
+static int
+oid_cmp (const void *a, const void *b)
+{
+   return bson_oid_compare ((const bson_oid_t *) a, (const bson_oid_t *) b);
+}
+
+
 static void
 test_bson_oid_init_from_string (void)
 {
@@ -335,6 +363,184 @@ test_bson_oid_init_with_threads (void)
    }
 }
 
+
+static void
+test_bson_oid_init_many (void)
+{
+   bson_context_flags_t flags[] = {
+      BSON_CONTEXT_NONE,
+      BSON_CONTEXT_THREAD_SAFE,
+      BSON_CONTEXT_THREAD_LOCAL_SEQ,
+      BSON_CONTEXT_THREAD_LOCAL_SEQ | BSON_CONTEXT_DISABLE_PID_CACHE,
+      BSON_CONTEXT_DISABLE_HOST_CACHE | BSON_CONTEXT_DISABLE_PID_CACHE,
+   };
+   size_t sizes[] = {0, 1, 1000, 5000};
+   bson_context_t *context;
+   bson_oid_t before;
+   bson_oid_t after;
+   bson_oid_t *oids;
+   size_t i;
+   size_t j;
+   size_t k;
+
+   for (i = 0; i < sizeof flags / sizeof flags[0]; i++) {
+      context = bson_context_new (flags[i]);
+
+      for (j = 0; j < sizeof sizes / sizeof sizes[0]; j++) {
+         oids = bson_malloc0 ((sizes[j] + 1) * sizeof (bson_oid_t));
+
+         bson_oid_init (&before, context);
+         bson_oid_init_many (oids, sizes[j], context);
+         bson_oid_init (&after, context);
+
+         /* the same time, host and pid as bson_oid_init, and consecutive
+          * sequence numbers */
+         for (k = 0; k < sizes[j]; k++) {
+            BSON_ASSERT (
+               bson_oid_get_time_t (&oids[k]) >= bson_oid_get_time_t (&before));
+            BSON_ASSERT (!memcmp (&oids[k].bytes[4], &before.bytes[4], 5));
+            BSON_ASSERT (0 < bson_oid_compare (&oids[k], &before));
+            BSON_ASSERT (0 > bson_oid_compare (&oids[k], &after));
+            if (k > 0) {
+               BSON_ASSERT (
+                  ((oids[k - 1].bytes[11] + 1) & 0xff) == oids[k].bytes[11]);
+            }
+         }
+
+         /* nothing written past the end */
+         BSON_ASSERT (bson_oid_get_time_t (&oids[sizes[j]]) == 0);
+
+         bson_free (oids);
+      }
+
+      bson_context_destroy (context);
+   }
+
+   /* the default context */
+   bson_oid_init_many (&before, 1, NULL);
+   bson_oid_init (&after, NULL);
+   BSON_ASSERT (0 > bson_oid_compare (&before, &after));
+}
+
+
+static void
+test_bson_oid_init_thread_local_seq (void)
+{
+   const int n_oids = 50000;
+   oid_block_worker_t workers[N_THREADS];
+   bson_thread_t threads[N_THREADS];
+   bson_context_t *context;
+   bson_oid_t *oids;
+   bson_oid_t oid;
+   int i;
+
+   /* the same ordering as other contexts within one thread */
+   context = bson_context_new (BSON_CONTEXT_THREAD_LOCAL_SEQ);
+   bson_thread_create (&threads[0], oid_worker, context);
+   bson_thread_join (threads[0]);
+
+   oids = bson_malloc (N_THREADS * n_oids * sizeof (bson_oid_t));
+
+   for (i = 0; i < N_THREADS; i++) {
+      workers[i].context = context;
+      workers[i].oids = oids + i * n_oids;
+      workers[i].n_oids = n_oids;
+      bson_thread_create (&threads[i], oid_block_worker, &workers[i]);
+   }
+
+   for (i = 0; i < N_THREADS; i++) {
+      bson_thread_join (threads[i]);
+   }
+
+   /* every thread uses the context's host and pid bytes */
+   bson_oid_init (&oid, context);
+   for (i = 0; i < N_THREADS * n_oids; i++) {
+      BSON_ASSERT (!memcmp (&oids[i].bytes[4], &oid.bytes[4], 5));
+   }
+
+   /* and no two threads get the same sequence numbers */
+   qsort (oids, (size_t) (N_THREADS * n_oids), sizeof (bson_oid_t), oid_cmp);
+   for (i = 1; i < N_THREADS * n_oids; i++) {
+      BSON_ASSERT (!bson_oid_equal (&oids[i - 1], &oids[i]));
+   }
+
+   bson_free (oids);
+   bson_context_destroy (context);
+}
+
+
+static void *
+oid_one_worker (void *data)
+{
+   bson_oid_t oid;
+
+   bson_oid_init (&oid, (bson_context_t *) data);
+
+   return NULL;
+}
+
+
+static uint32_t
+oid_get_seq (const bson_oid_t *oid)
+{
+   return (uint32_t) oid->bytes[9] << 16 | (uint32_t) oid->bytes[10] << 8 |
+          (uint32_t) oid->bytes[11];
+}
+
+
+/* threads and context switches use up few sequence numbers they don't use,
+ * so the 24-bit sequence doesn't wrap around within a second */
+static void
+test_bson_oid_init_thread_local_seq_unused (void)
+{
+   const int n_oids = 20000;
+   const int n_threads = 200;
+   bson_context_t *context;
+   bson_context_t *other;
+   bson_thread_t thread;
+   bson_oid_t *oids;
+   bson_oid_t oid;
+   uint32_t span;
+   int i;
+
+   context = bson_context_new (BSON_CONTEXT_THREAD_LOCAL_SEQ);
+   other = bson_context_new (BSON_CONTEXT_THREAD_LOCAL_SEQ);
+   oids = bson_malloc (n_oids * sizeof (bson_oid_t));
+
+   /* switch contexts before each ObjectID */
+   for (i = 0; i < n_oids; i++) {
+      bson_oid_init (&oids[i], context);
+      bson_oid_init (&oid, other);
+   }
+
+   span = (oid_get_seq (&oids[n_oids - 1]) - oid_get_seq (&oids[0])) &
+          0xffffff;
+   ASSERT_CMPUINT32 (span, <, (uint32_t) (2 * n_oids));
+
+   qsort (oids, (size_t) n_oids, sizeof (bson_oid_t), oid_cmp);
+   for (i = 1; i < n_oids; i++) {
+      BSON_ASSERT (!bson_oid_equal (&oids[i - 1], &oids[i]));
+   }
+
+   /* short-lived threads that each generate one ObjectID */
+   bson_oid_init (&oids[0], context);
+
+   for (i = 0; i < n_threads; i++) {
+      bson_thread_create (&thread, oid_one_worker, context);
+      bson_thread_join (thread);
+   }
+
+   bson_oid_init (&oid, other);
+   bson_oid_init (&oids[1], context);
+   span = (oid_get_seq (&oids[1]) - oid_get_seq (&oids[0])) & 0xffffff;
+   ASSERT_CMPUINT32 (span, <, (uint32_t) (2 * (n_threads + 1)));
+
+   bson_free (oids);
+   bson_context_destroy (other);
+   bson_context_destroy (context);
+}
+
+
 void
 test_oid_install (TestSuite *suite)
 {
@@ -353,6 +559,13 @@ test_oid_install (TestSuite *suite)
 #endif
    TestSuite_Add (
       suite, "/bson/oid/init_with_threads", test_bson_oid_init_with_threads);
+   TestSuite_Add (suite, "/bson/oid/init_many", test_bson_oid_init_many);
+   TestSuite_Add (suite,
+                  "/bson/oid/init_thread_local_seq",
+                  test_bson_oid_init_thread_local_seq);
+   TestSuite_Add (suite,
+                  "/bson/oid/init_thread_local_seq_unused",
+                  test_bson_oid_init_thread_local_seq_unused);
    TestSuite_Add (suite, "/bson/oid/hash", test_bson_oid_hash);
    TestSuite_Add (suite, "/bson/oid/compare", test_bson_oid_compare);
    TestSuite_Add (suite, "/bson/oid/copy", test_bson_oid_copy);
@@ -0,0 +1,481 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bson.h>
+
+#include "TestSuite.h"
+
+
+/* parse JSON written with single quotes, for readability */
+static bson_t *
+_doc (const char *json)
+{
+   bson_error_t error;
+   bson_t *doc;
+   char *copy;
+   char *p;
+
+   copy = bson_strdup (json);
+   for (p = copy; *p; p++) {
+      if (*p == '\'') {
+         *p = '"';
+      }
+   }
+
+   doc = bson_new_from_json ((const uint8_t *) copy, -1, &error);
+   ASSERT_OR_PRINT (doc, error);
+   bson_free (copy);
+
+   return doc;
+}
+
+
+static void
+_check_patch (bson_patch_t *patch, const char *src_json, const char *json)
+{
+   bson_error_t error;
+   bson_t *expected;
+   bson_t *src;
+   char *actual_json;
+   char *expected_json;
+   bson_t dst;
+   size_t offset;
+
+   src = _doc (src_json);
+   expected = _doc (json);
+
+   ASSERT_OR_PRINT (bson_patch_apply (patch, src, &dst, &error), error);
+   ASSERT (bson_validate (&dst, BSON_VALIDATE_NONE, &offset));
+
+   actual_json = bson_as_canonical_extended_json (&dst, NULL);
+   expected_json = bson_as_canonical_extended_json (expected, NULL);
+   ASSERT_CMPSTR (actual_json, expected_json);
+
+   bson_free (actual_json);
+   bson_free (expected_json);
+   bson_destroy (&dst);
+   bson_destroy (expected);
+   bson_destroy (src);
+}
+
+
+static void
+_set_utf8 (bson_patch_t *patch, const char *path, const char *str)
+{
+   bson_error_t error;
+   bson_value_t value;
+
+   value.value_type = BSON_TYPE_UTF8;
+   value.value.v_utf8.str = (char *) str;
+   value.value.v_utf8.len = (uint32_t) strlen (str);
+   ASSERT_OR_PRINT (bson_patch_set (patch, path, &value, &error), error);
+}
+
+
+static void
+_inc_int32 (bson_patch_t *patch, const char *path, int32_t amount)
+{
+   bson_error_t error;
+   bson_value_t value;
+
+   value.value_type = BSON_TYPE_INT32;
+   value.value.v_int32 = amount;
+   ASSERT_OR_PRINT (bson_patch_inc (patch, path, &value, &error), error);
+}
+
+
+static void
+test_patch_set (void)
+{
+   bson_patch_t *patch;
+   bson_error_t error;
+   bson_value_t value;
+   bson_t *sub;
+
+   /* a longer and a shorter string, in place */
+   patch = bson_patch_new ();
+   _set_utf8 (patch, "a", "a much longer string");
+   _set_utf8 (patch, "c.d", "x");
+   _check_patch (patch,
+                 "{'a': 'short', 'b': 1, 'c': {'d': 'long string', 'e': 2}}",
+                 "{'a': 'a much longer string', 'b': 1,"
+                 " 'c': {'d': 'x', 'e': 2}}");
+   bson_patch_destroy (patch);
+
+   /* a change of type, and a document value */
+   sub = _doc ("{'y': [1, 2, 3]}");
+   patch = bson_patch_new ();
+   value.value_type = BSON_TYPE_DOCUMENT;
+   value.value.v_doc.data = (uint8_t *) bson_get_data (sub);
+   value.value.v_doc.data_len = sub->len;
+   ASSERT_OR_PRINT (bson_patch_set (patch, "b", &value, &error), error);
+   value.value_type = BSON_TYPE_BOOL;
+   value.value.v_bool = true;
+   ASSERT_OR_PRINT (bson_patch_set (patch, "arr.1", &value, &error), error);
+   _check_patch (patch,
+                 "{'a': 1, 'b': 'str', 'arr': [1, 2, 3]}",
+                 "{'a': 1, 'b': {'y': [1, 2, 3]}, 'arr': [1, true, 3]}");
+   bson_patch_destroy (patch);
+   bson_destroy (sub);
+
+   /* missing fields and documents are appended in the order added */
+   patch = bson_patch_new ();
+   _set_utf8 (patch, "z", "z");
+   _set_utf8 (patch, "x.y.z", "deep");
+   _set_utf8 (patch, "a.new", "new");
+   _check_patch (patch,
+                 "{'a': {'old': 1}}",
+                 "{'a': {'old': 1, 'new': 'new'}, 'z': 'z',"
+                 " 'x': {'y': {'z': 'deep'}}}");
+   _check_patch (patch,
+                 "{}",
+                 "{'z': 'z', 'x': {'y': {'z': 'deep'}}, 'a': {'new': 'new'}}");
+   bson_patch_destroy (patch);
+}
+
+
+static void
+test_patch_unset (void)
+{
+   bson_patch_t *patch;
+   bson_error_t error;
+
+   patch = bson_patch_new ();
+   ASSERT_OR_PRINT (bson_patch_unset (patch, "a", &error), error);
+   ASSERT_OR_PRINT (bson_patch_unset (patch, "b.c", &error), error);
+   ASSERT_OR_PRINT (bson_patch_unset (patch, "b.missing", &error), error);
+   ASSERT_OR_PRINT (bson_patch_unset (patch, "arr.0", &error), error);
+   ASSERT_OR_PRINT (bson_patch_unset (patch, "none.x", &error), error);
+   _check_patch (patch,
+                 "{'a': 'x', 'b': {'c': 1, 'd': 2}, 'arr': [1, 2], 'e': 3}",
+                 "{'b': {'d': 2}, 'arr': [null, 2], 'e': 3}");
+
+   /* fields of types without data */
+   _check_patch (patch,
+                 "{'b': {'c': null}, 'a': {'$minKey': 1}, 'arr': [null]}",
+                 "{'b': {}, 'arr': [null]}");
+
+   /* nothing to unset, no document is created */
+   _check_patch (patch, "{'e': 3}", "{'e': 3}");
+   bson_patch_destroy (patch);
+}
+
+
+static void
+test_patch_inc (void)
+{
+   bson_patch_t *patch;
+   bson_error_t error;
+   bson_value_t value;
+
+   patch = bson_patch_new ();
+   _inc_int32 (patch, "i", 5);
+   _inc_int32 (patch, "l", -5);
+   _inc_int32 (patch, "d", 1);
+   _inc_int32 (patch, "sub.missing", 7);
+   _check_patch (patch,
+                 "{'i': 1, 'l': {'$numberLong': '10'}, 'd': 1.5}",
+                 "{'i': 6, 'l': {'$numberLong': '5'}, 'd': 2.5,"
+                 " 'sub': {'missing': 7}}");
+
+   /* int32 overflow is promoted to int64 */
+   _check_patch (patch,
+                 "{'i': 2147483647, 'l': 0, 'd': 0}",
+                 "{'i': {'$numberLong': '2147483652'}, 'l': -5, 'd': 1,"
+                 " 'sub': {'missing': 7}}");
+   bson_patch_destroy (patch);
+
+   patch = bson_patch_new ();
+   value.value_type = BSON_TYPE_DOUBLE;
+   value.value.v_double = 0.25;
+   ASSERT_OR_PRINT (bson_patch_inc (patch, "i", &value, &error), error);
+   _check_patch (patch, "{'i': 1}", "{'i': 1.25}");
+   bson_patch_destroy (patch);
+
+   value.value_type = BSON_TYPE_UTF8;
+   value.value.v_utf8.str = "1";
+   value.value.v_utf8.len = 1;
+   patch = bson_patch_new ();
+   ASSERT (!bson_patch_inc (patch, "i", &value, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_PATCH,
+                          BSON_PATCH_ERROR_TYPE_MISMATCH,
+                          "non-numeric value");
+   bson_patch_destroy (patch);
+}
+
+
+static void
+test_patch_rename (void)
+{
+   bson_patch_t *patch;
+   bson_error_t error;
+
+   patch = bson_patch_new ();
+   ASSERT_OR_PRINT (bson_patch_rename (patch, "a", "alpha", &error), error);
+   ASSERT_OR_PRINT (bson_patch_rename (patch, "b.c", "gamma", &error), error);
+   _check_patch (patch,
+                 "{'a': [1], 'b': {'c': {'x': 1}, 'd': 2}}",
+                 "{'alpha': [1], 'b': {'gamma': {'x': 1}, 'd': 2}}");
+
+   /* the destination is replaced */
+   _check_patch (patch,
+                 "{'alpha': 0, 'a': 1, 'b': {'gamma': 1, 'c': 2}}",
+                 "{'alpha': 1, 'b': {'gamma': 2}}");
+
+   /* nothing to rename, the destination is kept */
+   _check_patch (patch, "{'alpha': 0}", "{'alpha': 0}");
+   bson_patch_destroy (patch);
+}
+
+
+static void
+test_patch_many (void)
+{
+   bson_patch_t *patch;
+   bson_error_t error;
+   bson_t *src;
+   bson_t dst;
+   bson_iter_t iter;
+   char key[16];
+   int i;
+
+   src = bson_new ();
+   for (i = 0; i < 100; i++) {
+      bson_snprintf (key, sizeof key, "k%d", i);
+      BSON_APPEND_INT32 (src, key, i);
+   }
+
+   BSON_APPEND_UTF8 (src, "str", "value");
+
+   patch = bson_patch_new ();
+   _set_utf8 (patch, "k50", "fifty");
+   _inc_int32 (patch, "k99", 1);
+   _inc_int32 (patch, "k0", 1);
+   ASSERT_OR_PRINT (bson_patch_unset (patch, "k10", &error), error);
+   ASSERT_OR_PRINT (bson_patch_rename (patch, "str", "s", &error), error);
+   _set_utf8 (patch, "new.path", "value");
+
+   ASSERT_OR_PRINT (bson_patch_apply (patch, src, &dst, &error), error);
+
+   ASSERT (bson_iter_init_find (&iter, &dst, "k0"));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 1);
+   ASSERT (bson_iter_next (&iter));
+   ASSERT_CMPSTR (bson_iter_key (&iter), "k1");
+   ASSERT (!bson_iter_init_find (&iter, &dst, "k10"));
+   ASSERT (bson_iter_init_find (&iter, &dst, "k50"));
+   ASSERT_CMPSTR (bson_iter_utf8 (&iter, NULL), "fifty");
+   ASSERT (bson_iter_init_find (&iter, &dst, "k99"));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 100);
+   ASSERT (bson_iter_init_find (&iter, &dst, "s"));
+   ASSERT_CMPSTR (bson_iter_utf8 (&iter, NULL), "value");
+   ASSERT (!bson_iter_init_find (&iter, &dst, "str"));
+   ASSERT (bson_iter_init (&iter, &dst));
+   ASSERT (bson_iter_find_descendant (&iter, "new.path", &iter));
+   ASSERT_CMPSTR (bson_iter_utf8 (&iter, NULL), "value");
+
+   /* the result is an ordinary document that can grow */
+   ASSERT (BSON_APPEND_UTF8 (&dst, "appended", "yes"));
+   ASSERT (bson_iter_init_find (&iter, &dst, "appended"));
+
+   bson_destroy (&dst);
+   bson_patch_destroy (patch);
+   bson_destroy (src);
+}
+
+
+static void
+test_patch_duplicate_keys (void)
+{
+   bson_patch_t *patch;
+   bson_error_t error;
+   bson_iter_t iter;
+   bson_t *src;
+   bson_t dst;
+
+   src = bson_new ();
+   BSON_APPEND_INT32 (src, "a", 1);
+   BSON_APPEND_INT32 (src, "a", 2);
+
+   /* only the first of duplicate keys is patched */
+   patch = bson_patch_new ();
+   _inc_int32 (patch, "a", 10);
+   ASSERT_OR_PRINT (bson_patch_apply (patch, src, &dst, &error), error);
+   ASSERT (bson_iter_init (&iter, &dst));
+   ASSERT (bson_iter_next (&iter));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 11);
+   ASSERT (bson_iter_next (&iter));
+   ASSERT_CMPINT (bson_iter_int32 (&iter), ==, 2);
+   ASSERT (!bson_iter_next (&iter));
+
+   bson_destroy (&dst);
+   bson_patch_destroy (patch);
+   bson_destroy (src);
+}
+
+
+static void
+test_patch_conflict (void)
+{
+   bson_patch_t *patch;
+   bson_error_t error;
+
+   patch = bson_patch_new ();
+   ASSERT_OR_PRINT (bson_patch_unset (patch, "a.b", &error), error);
+
+   ASSERT (!bson_patch_unset (patch, "a.b", &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_PATCH,
+                          BSON_PATCH_ERROR_CONFLICT,
+                          "Path \"a.b\" conflicts with another operation");
+   ASSERT (!bson_patch_unset (patch, "a", &error));
+   ASSERT_ERROR_CONTAINS (
+      error, BSON_ERROR_PATCH, BSON_PATCH_ERROR_CONFLICT, "conflicts");
+   ASSERT (!bson_patch_unset (patch, "a.b.c", &error));
+   ASSERT_ERROR_CONTAINS (
+      error, BSON_ERROR_PATCH, BSON_PATCH_ERROR_CONFLICT, "conflicts");
+
+   /* the destination of a rename conflicts too, and nothing is added */
+   ASSERT (!bson_patch_rename (patch, "a.c", "b", &error));
+   ASSERT_ERROR_CONTAINS (
+      error, BSON_ERROR_PATCH, BSON_PATCH_ERROR_CONFLICT, "conflicts");
+   ASSERT_OR_PRINT (bson_patch_unset (patch, "a.c", &error), error);
+   ASSERT (!bson_patch_rename (patch, "x", "x", &error));
+   ASSERT_ERROR_CONTAINS (
+      error, BSON_ERROR_PATCH, BSON_PATCH_ERROR_CONFLICT, "itself");
+
+   ASSERT (!bson_patch_unset (patch, "", &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_PATCH,
+                          BSON_PATCH_ERROR_INVALID_PATH,
+                          "Invalid path \"\"");
+   ASSERT (!bson_patch_unset (patch, "x..y", &error));
+   ASSERT_ERROR_CONTAINS (
+      error, BSON_ERROR_PATCH, BSON_PATCH_ERROR_INVALID_PATH, "Invalid path");
+   ASSERT (!bson_patch_unset (patch, "x.", &error));
+   ASSERT_ERROR_CONTAINS (
+      error, BSON_ERROR_PATCH, BSON_PATCH_ERROR_INVALID_PATH, "Invalid path");
+   ASSERT (!bson_patch_rename (patch, "x", "y.z", &error));
+   ASSERT_ERROR_CONTAINS (
+      error, BSON_ERROR_PATCH, BSON_PATCH_ERROR_INVALID_PATH, "new name");
+
+   _check_patch (patch, "{'a': {'b': 1, 'c': 2, 'd': 3}}", "{'a': {'d': 3}}");
+   bson_patch_destroy (patch);
+}
+
+
+static void
+_check_apply_error (bson_patch_t *patch,
+                    const char *src_json,
+                    uint32_t code,
+                    const char *message)
+{
+   bson_error_t error;
+   bson_t *src;
+   bson_t dst;
+
+   src = _doc (src_json);
+   ASSERT (!bson_patch_apply (patch, src, &dst, &error));
+   ASSERT_ERROR_CONTAINS (error, BSON_ERROR_PATCH, code, message);
+   ASSERT (bson_empty (&dst));
+   bson_destroy (&dst);
+   bson_destroy (src);
+}
+
+
+static void
+test_patch_apply_error (void)
+{
+   bson_patch_t *patch;
+   bson_error_t error;
+   bson_value_t value;
+
+   patch = bson_patch_new ();
+   _inc_int32 (patch, "a.b", 1);
+   _check_apply_error (patch,
+                       "{'a': 1}",
+                       BSON_PATCH_ERROR_TYPE_MISMATCH,
+                       "Cannot descend into \"a\"");
+   _check_apply_error (patch,
+                       "{'a': {'b': 'str'}}",
+                       BSON_PATCH_ERROR_TYPE_MISMATCH,
+                       "Cannot increment non-numeric field \"b\"");
+   _check_apply_error (patch,
+                       "{'a': []}",
+                       BSON_PATCH_ERROR_TYPE_MISMATCH,
+                       "Cannot append element \"b\" to an array");
+   bson_patch_destroy (patch);
+
+   patch = bson_patch_new ();
+   value.value_type = BSON_TYPE_INT64;
+   value.value.v_int64 = 1;
+   ASSERT_OR_PRINT (bson_patch_inc (patch, "a", &value, &error), error);
+   _check_apply_error (patch,
+                       "{'a': {'$numberLong': '9223372036854775807'}}",
+                       BSON_PATCH_ERROR_OVERFLOW,
+                       "overflows int64");
+   bson_patch_destroy (patch);
+
+   patch = bson_patch_new ();
+   ASSERT_OR_PRINT (bson_patch_rename (patch, "a.0", "x", &error), error);
+   _check_apply_error (patch,
+                       "{'a': [1]}",
+                       BSON_PATCH_ERROR_TYPE_MISMATCH,
+                       "Cannot rename array element \"0\"");
+   bson_patch_destroy (patch);
+}
+
+
+static void
+test_patch_corrupt (void)
+{
+   /* {"a": {}} with a bad length for the embedded document */
+   static const uint8_t bad_length[] = {
+      13, 0, 0, 0, 0x03, 'a', 0, 50, 0, 0, 0, 0, 0};
+   bson_patch_t *patch;
+   bson_error_t error;
+   bson_t doc;
+   bson_t dst;
+
+   ASSERT (bson_init_static (&doc, bad_length, sizeof bad_length));
+
+   patch = bson_patch_new ();
+   _inc_int32 (patch, "b", 1);
+   ASSERT (!bson_patch_apply (patch, &doc, &dst, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_PATCH,
+                          BSON_PATCH_ERROR_CORRUPT_BSON,
+                          "corrupt BSON");
+   bson_destroy (&dst);
+   bson_patch_destroy (patch);
+}
+
+
+void
+test_patch_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/patch/set", test_patch_set);
+   TestSuite_Add (suite, "/bson/patch/unset", test_patch_unset);
+   TestSuite_Add (suite, "/bson/patch/inc", test_patch_inc);
+   TestSuite_Add (suite, "/bson/patch/rename", test_patch_rename);
+   TestSuite_Add (suite, "/bson/patch/many", test_patch_many);
+   TestSuite_Add (
+      suite, "/bson/patch/duplicate_keys", test_patch_duplicate_keys);
+   TestSuite_Add (suite, "/bson/patch/conflict", test_patch_conflict);
+   TestSuite_Add (suite, "/bson/patch/apply_error", test_patch_apply_error);
+   TestSuite_Add (suite, "/bson/patch/corrupt", test_patch_corrupt);
+}
@@ -0,0 +1,224 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bcon.h>
+#include <bson.h>
+
+#include "TestSuite.h"
+
+
+static const char *gPaths[] = {"a",
+                               "b",
+                               "b.c",
+                               "b.d.e",
+                               "b.d.e.f",
+                               "b.nope",
+                               "arr",
+                               "arr.0",
+                               "arr.1.x",
+                               "arr.2",
+                               "arr.01",
+                               "n",
+                               "n.x",
+                               "a.b",
+                               "",
+                               ".",
+                               "b.",
+                               ".b",
+                               "b..c",
+                               "bb",
+                               "z"};
+
+
+static bson_t *
+_nested_doc (void)
+{
+   return BCON_NEW ("a",
+                    BCON_INT32 (1),
+                    "b",
+                    "{",
+                    "c",
+                    BCON_UTF8 ("c"),
+                    "d",
+                    "{",
+                    "e",
+                    BCON_INT64 (5),
+                    "}",
+                    "}",
+                    "arr",
+                    "[",
+                    BCON_INT32 (10),
+                    "{",
+                    "x",
+                    BCON_BOOL (true),
+                    "}",
+                    "]",
+                    "n",
+                    BCON_NULL,
+                    "b",
+                    BCON_INT32 (2),
+                    "z",
+                    BCON_DOUBLE (1.5));
+}
+
+
+/* compare the results of bson_iter_find_descendant and a compiled path */
+static void
+_check_path (const bson_t *doc, const char *dotkey)
+{
+   bson_path_t *path;
+   bson_iter_t iter;
+   bson_iter_t expected;
+   bson_iter_t actual;
+   bool found;
+
+   path = bson_path_new (dotkey);
+
+   ASSERT (bson_iter_init (&iter, doc));
+   found = bson_iter_find_descendant (&iter, dotkey, &expected);
+
+   ASSERT (bson_iter_init (&iter, doc));
+   if (found != bson_iter_find_path (&iter, path, &actual)) {
+      fprintf (stderr, "path \"%s\": expected found=%d\n", dotkey, found);
+      abort ();
+   }
+
+   if (found) {
+      ASSERT_CMPUINT32 (actual.off, ==, expected.off);
+      ASSERT (actual.raw == expected.raw);
+   }
+
+   bson_path_destroy (path);
+}
+
+
+static void
+test_path_find (void)
+{
+   bson_t *doc;
+   size_t i;
+
+   doc = _nested_doc ();
+
+   for (i = 0; i < sizeof gPaths / sizeof gPaths[0]; i++) {
+      _check_path (doc, gPaths[i]);
+   }
+
+   bson_destroy (doc);
+}
+
+
+static void
+test_path_reuse (void)
+{
+   bson_path_t *path;
+   bson_iter_t iter;
+   bson_iter_t child;
+   bson_t *doc;
+   int i;
+
+   path = bson_path_new ("a.1.v");
+
+   for (i = 0; i < 3; i++) {
+      doc = BCON_NEW ("a",
+                      "[",
+                      "{",
+                      "v",
+                      BCON_INT32 (i),
+                      "}",
+                      "{",
+                      "v",
+                      BCON_INT32 (i * 10),
+                      "}",
+                      "]");
+      ASSERT (bson_iter_init (&iter, doc));
+      ASSERT (bson_iter_find_path (&iter, path, &child));
+      ASSERT_CMPINT (bson_iter_int32 (&child), ==, i * 10);
+      bson_destroy (doc);
+   }
+
+   bson_path_destroy (path);
+}
+
+
+static void
+test_path_from_current (void)
+{
+   bson_path_t *path;
+   bson_iter_t iter;
+   bson_iter_t child;
+   bson_t *doc;
+
+   doc = _nested_doc ();
+   path = bson_path_new ("b");
+
+   /* like bson_iter_find_descendant, the search starts after @iter */
+   ASSERT (bson_iter_init (&iter, doc));
+   ASSERT (bson_iter_find_path (&iter, path, &child));
+   ASSERT (BSON_ITER_HOLDS_DOCUMENT (&child));
+   ASSERT (bson_iter_find_path (&iter, path, &child));
+   ASSERT_CMPINT (bson_iter_int32 (&child), ==, 2);
+   ASSERT (!bson_iter_find_path (&iter, path, &child));
+
+   bson_path_destroy (path);
+   bson_destroy (doc);
+}
+
+
+static void
+test_path_index (void)
+{
+   bson_index_t *index;
+   bson_path_t *path;
+   bson_iter_t expected;
+   bson_iter_t actual;
+   bson_t *doc;
+   bool found;
+   size_t i;
+
+   doc = _nested_doc ();
+   index = bson_index_new (doc);
+
+   for (i = 0; i < sizeof gPaths / sizeof gPaths[0]; i++) {
+      path = bson_path_new (gPaths[i]);
+      found = bson_index_iter_find_descendant (index, gPaths[i], &expected);
+      if (found != bson_index_iter_find_path (index, path, &actual)) {
+         fprintf (
+            stderr, "path \"%s\": expected found=%d\n", gPaths[i], found);
+         abort ();
+      }
+
+      if (found) {
+         ASSERT_CMPUINT32 (actual.off, ==, expected.off);
+      }
+
+      bson_path_destroy (path);
+   }
+
+   bson_index_destroy (index);
+   bson_destroy (doc);
+}
+
+
+void
+test_path_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/path/find", test_path_find);
+   TestSuite_Add (suite, "/bson/path/reuse", test_path_reuse);
+   TestSuite_Add (suite, "/bson/path/from_current", test_path_from_current);
+   TestSuite_Add (suite, "/bson/path/index", test_path_index);
+}
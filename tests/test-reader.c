@@ -312,6 +312,626 @@ test_reader_reset (void)
 }
 
 
+static void
+test_reader_from_mmap (void)
+{
+   bson_reader_t *reader;
+   bson_error_t error;
+   const bson_t *b;
+   const uint8_t *prev = NULL;
+   bson_iter_t iter;
+   uint32_t i;
+   bool eof;
+
+   reader = bson_reader_new_from_mmap (
+      BINARY_DIR "/stream.bson", BSON_READER_MMAP_NONE, &error);
+   ASSERT_OR_PRINT (reader, error);
+
+   for (i = 0; i < 1000; i++) {
+      BSON_ASSERT_CMPINT (5 * i, ==, bson_reader_tell (reader));
+      eof = false;
+      b = bson_reader_read (reader, &eof);
+      BSON_ASSERT (b);
+      BSON_ASSERT (bson_iter_init (&iter, b));
+      BSON_ASSERT (!bson_iter_next (&iter));
+
+      /* documents point straight into the mapped file */
+      if (prev) {
+         BSON_ASSERT (bson_get_data (b) == prev + 5);
+      }
+      prev = bson_get_data (b);
+   }
+
+   BSON_ASSERT_CMPINT (eof, ==, false);
+   b = bson_reader_read (reader, &eof);
+   BSON_ASSERT (!b);
+   BSON_ASSERT_CMPINT (eof, ==, true);
+   BSON_ASSERT_CMPINT (5000, ==, bson_reader_tell (reader));
+
+   bson_reader_reset (reader);
+   BSON_ASSERT_CMPINT (0, ==, bson_reader_tell (reader));
+   BSON_ASSERT (bson_reader_read (reader, &eof));
+
+   bson_reader_destroy (reader);
+}
+
+
+static void
+test_reader_from_mmap_flags (void)
+{
+   bson_reader_t *reader;
+   bson_error_t error;
+   const bson_t *b;
+   bool eof = false;
+
+   reader = bson_reader_new_from_mmap (
+      BINARY_DIR "/readergrow.bson",
+      BSON_READER_MMAP_HUGE_PAGES | BSON_READER_MMAP_POPULATE,
+      &error);
+   ASSERT_OR_PRINT (reader, error);
+
+   b = bson_reader_read (reader, &eof);
+   BSON_ASSERT (b);
+   BSON_ASSERT (!eof);
+
+   b = bson_reader_read (reader, &eof);
+   BSON_ASSERT (!b);
+   BSON_ASSERT (eof);
+
+   bson_reader_destroy (reader);
+}
+
+
+static void
+test_reader_from_mmap_corrupt (void)
+{
+   bson_reader_t *reader;
+   bson_error_t error;
+   const bson_t *b;
+   uint32_t i;
+   bool eof;
+
+   reader = bson_reader_new_from_mmap (
+      BINARY_DIR "/stream_corrupt.bson", BSON_READER_MMAP_NONE, &error);
+   ASSERT_OR_PRINT (reader, error);
+
+   for (i = 0; i < 1000; i++) {
+      b = bson_reader_read (reader, &eof);
+      BSON_ASSERT (b);
+   }
+
+   b = bson_reader_read (reader, &eof);
+   BSON_ASSERT (!b);
+   BSON_ASSERT (!eof);
+   bson_reader_destroy (reader);
+
+   reader = bson_reader_new_from_mmap (
+      BINARY_DIR "/does-not-exist.bson", BSON_READER_MMAP_NONE, &error);
+   BSON_ASSERT (!reader);
+   BSON_ASSERT_CMPINT (error.domain, ==, BSON_ERROR_READER);
+   BSON_ASSERT_CMPINT (error.code, ==, BSON_ERROR_READER_BADFD);
+
+#ifdef BSON_OS_UNIX
+   /* empty files cannot be mapped, but are a valid empty stream */
+   reader =
+      bson_reader_new_from_mmap ("/dev/null", BSON_READER_MMAP_NONE, &error);
+   ASSERT_OR_PRINT (reader, error);
+   BSON_ASSERT (!bson_reader_read (reader, &eof));
+   BSON_ASSERT (eof);
+   bson_reader_destroy (reader);
+#endif
+}
+
+
+/* a stream of {"i": 0}, {"i": 1}, ... with strings of varying length */
+static uint8_t *
+_make_batch_stream (int n_docs, size_t *len)
+{
+   uint8_t *data = NULL;
+   bson_t doc;
+   char str[64];
+   int i;
+
+   *len = 0;
+
+   for (i = 0; i < n_docs; i++) {
+      bson_init (&doc);
+      BSON_APPEND_INT32 (&doc, "i", i);
+      memset (str, 'x', sizeof str);
+      BSON_ASSERT (bson_append_utf8 (&doc, "s", -1, str, i % 64));
+      data = bson_realloc (data, *len + doc.len);
+      memcpy (data + *len, bson_get_data (&doc), doc.len);
+      *len += doc.len;
+      bson_destroy (&doc);
+   }
+
+   return data;
+}
+
+
+/* check a batch, and that its documents do not overlap */
+static void
+_check_batch (const bson_t *docs, size_t n_docs, int *next)
+{
+   bson_iter_t iter;
+   size_t i;
+
+   for (i = 0; i < n_docs; i++) {
+      BSON_ASSERT (bson_iter_init_find (&iter, &docs[i], "i"));
+      ASSERT_CMPINT (bson_iter_int32 (&iter), ==, (*next)++);
+
+      if (i) {
+         BSON_ASSERT (bson_get_data (&docs[i - 1]) + docs[i - 1].len <=
+                      bson_get_data (&docs[i]));
+      }
+   }
+}
+
+
+typedef struct {
+   const uint8_t *data;
+   size_t len;
+   size_t offset;
+   size_t chunk;
+   int n_reads;
+   size_t max_request;
+} chunked_handle_t;
+
+
+static ssize_t
+_chunked_handle_read (void *handle, void *buf, size_t len)
+{
+   chunked_handle_t *h = handle;
+
+   h->n_reads++;
+   h->max_request = BSON_MAX (h->max_request, len);
+   len = BSON_MIN (len, BSON_MIN (h->chunk, h->len - h->offset));
+   memcpy (buf, h->data + h->offset, len);
+   h->offset += len;
+
+   return (ssize_t) len;
+}
+
+
+static void
+test_reader_read_batch_data (void)
+{
+   bson_reader_t *reader;
+   bson_t docs[7];
+   size_t n_docs;
+   uint8_t *data;
+   size_t len;
+   int next = 0;
+   int n_batches = 0;
+
+   data = _make_batch_stream (100, &len);
+   reader = bson_reader_new_from_data (data, len);
+
+   for (;;) {
+      BSON_ASSERT (bson_reader_read_batch (reader, docs, 7, &n_docs));
+      if (!n_docs) {
+         break;
+      }
+
+      ASSERT_CMPSIZE_T (n_docs, ==, (size_t) (n_batches < 14 ? 7 : 2));
+      _check_batch (docs, n_docs, &next);
+      n_batches++;
+   }
+
+   ASSERT_CMPINT (next, ==, 100);
+   ASSERT_CMPINT (n_batches, ==, 15);
+   BSON_ASSERT (bson_reader_read_batch (reader, docs, 7, &n_docs));
+   ASSERT_CMPSIZE_T (n_docs, ==, (size_t) 0);
+
+   bson_reader_destroy (reader);
+   bson_free (data);
+}
+
+
+static void
+test_reader_read_batch_handle (void)
+{
+   chunked_handle_t handle;
+   bson_reader_t *reader;
+   bson_t docs[1000];
+   bool reached_eof;
+   size_t n_docs;
+   uint8_t *data;
+   size_t len;
+   int next = 0;
+
+   data = _make_batch_stream (1000, &len);
+   memset (&handle, 0, sizeof handle);
+   handle.data = data;
+   handle.len = len;
+   handle.offset = 0;
+   handle.chunk = 300;
+
+   reader = bson_reader_new_from_handle (&handle, _chunked_handle_read, NULL);
+
+   /* mixed with bson_reader_read */
+   BSON_ASSERT (bson_reader_read (reader, &reached_eof));
+   next++;
+
+   for (;;) {
+      BSON_ASSERT (bson_reader_read_batch (reader, docs, 1000, &n_docs));
+      if (!n_docs) {
+         break;
+      }
+
+      /* no more than was read into the buffer */
+      ASSERT_CMPSIZE_T (n_docs, <, (size_t) 1000);
+      _check_batch (docs, n_docs, &next);
+   }
+
+   ASSERT_CMPINT (next, ==, 1000);
+   ASSERT_CMPINT ((int) bson_reader_tell (reader), ==, (int) len);
+
+   bson_reader_destroy (reader);
+   bson_free (data);
+}
+
+
+static void
+test_reader_read_batch_corrupt (void)
+{
+   chunked_handle_t handle;
+   bson_reader_t *reader;
+   bson_t docs[10];
+   size_t n_docs;
+   uint8_t *data;
+   size_t len;
+   int next = 0;
+   int i;
+
+   /* three documents, then a length that is too small */
+   data = _make_batch_stream (3, &len);
+   data = bson_realloc (data, len + 5);
+   memcpy (data + len, "\x04\x00\x00\x00\x00", 5);
+   len += 5;
+
+   for (i = 0; i < 2; i++) {
+      if (i == 0) {
+         reader = bson_reader_new_from_data (data, len);
+      } else {
+         memset (&handle, 0, sizeof handle);
+         handle.data = data;
+         handle.len = len;
+         handle.offset = 0;
+         handle.chunk = len;
+         reader =
+            bson_reader_new_from_handle (&handle, _chunked_handle_read, NULL);
+      }
+
+      BSON_ASSERT (bson_reader_read_batch (reader, docs, 10, &n_docs));
+      ASSERT_CMPSIZE_T (n_docs, ==, (size_t) 3);
+      next = 0;
+      _check_batch (docs, n_docs, &next);
+
+      BSON_ASSERT (!bson_reader_read_batch (reader, docs, 10, &n_docs));
+      ASSERT_CMPSIZE_T (n_docs, ==, (size_t) 0);
+
+      bson_reader_destroy (reader);
+   }
+
+   bson_free (data);
+}
+
+
+static void
+test_reader_prefetch (void)
+{
+   chunked_handle_t handle;
+   bson_reader_t *reader;
+   const bson_t *doc;
+   bson_t docs[16];
+   bool reached_eof;
+   size_t n_docs;
+   uint8_t *data;
+   size_t len;
+   int next;
+   int i;
+
+   data = _make_batch_stream (1000, &len);
+
+   /* small buffers, so that documents span them */
+   for (i = 0; i < 3; i++) {
+      memset (&handle, 0, sizeof handle);
+      handle.data = data;
+      handle.len = len;
+      handle.offset = 0;
+      handle.chunk = 100;
+      reader =
+         bson_reader_new_from_handle (&handle, _chunked_handle_read, NULL);
+      BSON_ASSERT (bson_reader_set_prefetch (reader, 64 + 1000 * i, 1 + i));
+      BSON_ASSERT (!bson_reader_set_prefetch (reader, 0, 0));
+
+      next = 0;
+      if (i < 2) {
+         while ((doc = bson_reader_read (reader, &reached_eof))) {
+            _check_batch (doc, 1, &next);
+         }
+
+         BSON_ASSERT (reached_eof);
+      } else {
+         while (bson_reader_read_batch (reader, docs, 16, &n_docs) &&
+                n_docs) {
+            _check_batch (docs, n_docs, &next);
+         }
+      }
+
+      ASSERT_CMPINT (next, ==, 1000);
+      ASSERT_CMPINT ((int) bson_reader_tell (reader), ==, (int) len);
+      bson_reader_destroy (reader);
+   }
+
+   /* destroyed before the end, with the thread waiting for a free slot */
+   handle.offset = 0;
+   reader = bson_reader_new_from_handle (&handle, _chunked_handle_read, NULL);
+   BSON_ASSERT (bson_reader_set_prefetch (reader, 64, 2));
+   BSON_ASSERT (bson_reader_read (reader, &reached_eof));
+   bson_reader_destroy (reader);
+
+   /* the stream was read to its end, no thread is started */
+   handle.len = 0;
+   handle.offset = 0;
+   reader = bson_reader_new_from_handle (&handle, _chunked_handle_read, NULL);
+   BSON_ASSERT (bson_reader_set_prefetch (reader, 0, 0));
+   BSON_ASSERT (!bson_reader_read (reader, &reached_eof));
+   BSON_ASSERT (reached_eof);
+   bson_reader_destroy (reader);
+
+   bson_free (data);
+}
+
+
+static void
+test_reader_prefetch_fd (void)
+{
+   bson_reader_t *reader;
+   const bson_t *b;
+   bson_error_t error;
+   uint32_t i;
+   bool eof;
+
+   reader = bson_reader_new_from_file (BINARY_DIR "/stream.bson", &error);
+   ASSERT_OR_PRINT (reader, error);
+   BSON_ASSERT (bson_reader_set_prefetch (reader, 0, 0));
+
+   for (i = 0; i < 1000; i++) {
+      b = bson_reader_read (reader, &eof);
+      BSON_ASSERT (b);
+      ASSERT_CMPUINT32 (b->len, ==, 5u);
+   }
+
+   BSON_ASSERT (!bson_reader_read (reader, &eof));
+   BSON_ASSERT (eof);
+   bson_reader_destroy (reader);
+}
+
+
+#ifdef BSON_OS_UNIX
+/* the writer of a pipe stalls, destroying the reader must not wait for it */
+static void
+test_reader_prefetch_stalled_pipe (void)
+{
+   bson_reader_t *reader;
+   bson_t *doc;
+   bool eof;
+   int fds[2];
+
+   BSON_ASSERT (!pipe (fds));
+
+   doc = BCON_NEW ("a", BCON_INT32 (1));
+   BSON_ASSERT (write (fds[1], bson_get_data (doc), doc->len) ==
+                (ssize_t) doc->len);
+
+   reader = bson_reader_new_from_fd (fds[0], true);
+   BSON_ASSERT (bson_reader_set_prefetch (reader, 0, 0));
+   BSON_ASSERT (bson_reader_read (reader, &eof));
+
+   /* give the thread time to wait for more data */
+   usleep (100 * 1000);
+   bson_reader_destroy (reader);
+
+   close (fds[1]);
+   bson_destroy (doc);
+}
+#endif
+
+
+/* a small document, a document of @large_len bytes, a small document */
+static uint8_t *
+_make_large_stream (size_t large_len, size_t *len)
+{
+   uint8_t *data = NULL;
+   bson_t doc;
+   char *str;
+   int i;
+
+   *len = 0;
+   str = bson_malloc (large_len);
+   memset (str, 'x', large_len);
+
+   for (i = 0; i < 3; i++) {
+      bson_init (&doc);
+      BSON_APPEND_INT32 (&doc, "i", i);
+      if (i == 1) {
+         /* {"i": 1, "s": "xxx..."} */
+         BSON_ASSERT (
+            bson_append_utf8 (&doc, "s", -1, str, (int) large_len - 20));
+         ASSERT_CMPUINT32 (doc.len, ==, (uint32_t) large_len);
+      }
+
+      data = bson_realloc (data, *len + doc.len);
+      memcpy (data + *len, bson_get_data (&doc), doc.len);
+      *len += doc.len;
+      bson_destroy (&doc);
+   }
+
+   bson_free (str);
+
+   return data;
+}
+
+
+static void
+_read_large_stream (bson_reader_t *reader, size_t large_len)
+{
+   const bson_t *doc;
+   bool reached_eof;
+   int next = 0;
+   int i;
+
+   for (i = 0; i < 3; i++) {
+      doc = bson_reader_read (reader, &reached_eof);
+      BSON_ASSERT (doc);
+      BSON_ASSERT (bson_validate (doc, BSON_VALIDATE_UTF8, NULL));
+      ASSERT_CMPUINT32 (doc->len, ==, i == 1 ? (uint32_t) large_len : 12u);
+      _check_batch (doc, 1, &next);
+   }
+
+   BSON_ASSERT (!bson_reader_read (reader, &reached_eof));
+   BSON_ASSERT (reached_eof);
+}
+
+
+static void
+test_reader_grow_to_fit (void)
+{
+   chunked_handle_t handle;
+   bson_reader_t *reader;
+   uint8_t *data;
+   size_t len;
+
+   data = _make_large_stream (1000000, &len);
+   memset (&handle, 0, sizeof handle);
+   handle.data = data;
+   handle.len = len;
+   handle.chunk = len;
+
+   /* the buffer doubles until the large document fits, and no further */
+   reader = bson_reader_new_from_handle (&handle, _chunked_handle_read, NULL);
+   _read_large_stream (reader, 1000000);
+   ASSERT_CMPINT (handle.n_reads, <=, 13);
+   ASSERT_CMPSIZE_T (handle.max_request, <=, (size_t) 1024 * 1024);
+   bson_reader_destroy (reader);
+
+   bson_free (data);
+}
+
+
+static void
+test_reader_buffer_policy (void)
+{
+   chunked_handle_t handle;
+   bson_reader_t *reader;
+   bson_t docs[3];
+   size_t n_docs;
+   bool reached_eof;
+   uint8_t *data;
+   size_t len;
+   int next = 0;
+   int i;
+
+   data = _make_large_stream (100000, &len);
+
+   for (i = 0; i < 2; i++) {
+      memset (&handle, 0, sizeof handle);
+      handle.data = data;
+      handle.len = len;
+      handle.chunk = len;
+
+      reader =
+         bson_reader_new_from_handle (&handle, _chunked_handle_read, NULL);
+      if (i == 0) {
+         /* the document does not fit in the maximum buffer size */
+         bson_reader_set_buffer_policy (reader, 2048, 4096, 0);
+      } else {
+         bson_reader_set_buffer_policy (reader, 0, 0, 50000);
+      }
+
+      _read_large_stream (reader, 100000);
+      ASSERT_CMPINT ((int) bson_reader_tell (reader), ==, (int) len);
+      bson_reader_destroy (reader);
+
+      /* the rest of the large document was read into its allocation,
+       * which at most doubled per read */
+      ASSERT_CMPSIZE_T (handle.max_request, >, (size_t) 30000);
+      ASSERT_CMPSIZE_T (handle.max_request, <, (size_t) 50000);
+      ASSERT_CMPINT (handle.n_reads, <=, 10);
+   }
+
+   /* a batch starting with a large document */
+   memset (&handle, 0, sizeof handle);
+   handle.data = data;
+   handle.len = len;
+   handle.chunk = len;
+   reader = bson_reader_new_from_handle (&handle, _chunked_handle_read, NULL);
+   bson_reader_set_buffer_policy (reader, 0, 1024, 0);
+   BSON_ASSERT (bson_reader_read (reader, &reached_eof));
+   next = 1;
+   BSON_ASSERT (bson_reader_read_batch (reader, docs, 3, &n_docs));
+   ASSERT_CMPSIZE_T (n_docs, ==, (size_t) 1);
+   _check_batch (docs, n_docs, &next);
+   BSON_ASSERT (bson_reader_read_batch (reader, docs, 3, &n_docs));
+   ASSERT_CMPSIZE_T (n_docs, ==, (size_t) 1);
+   _check_batch (docs, n_docs, &next);
+   bson_reader_destroy (reader);
+
+   /* a large document cut short */
+   memset (&handle, 0, sizeof handle);
+   handle.data = data;
+   handle.len = 50000;
+   handle.chunk = len;
+   reader = bson_reader_new_from_handle (&handle, _chunked_handle_read, NULL);
+   bson_reader_set_buffer_policy (reader, 0, 0, 1);
+   BSON_ASSERT (bson_reader_read (reader, &reached_eof));
+   BSON_ASSERT (!bson_reader_read (reader, &reached_eof));
+   BSON_ASSERT (reached_eof);
+   bson_reader_destroy (reader);
+
+   bson_free (data);
+}
+
+
+/* a length prefix near INT32_MAX in a short stream */
+static void
+test_reader_bogus_length (void)
+{
+   chunked_handle_t handle;
+   bson_reader_t *reader;
+   uint8_t data[1004];
+   int32_t blen = BSON_UINT32_TO_LE (INT32_MAX - 16);
+   bool reached_eof;
+   int i;
+
+   memcpy (data, &blen, sizeof blen);
+   memset (data + 4, 'x', sizeof data - 4);
+
+   for (i = 0; i < 3; i++) {
+      memset (&handle, 0, sizeof handle);
+      handle.data = data;
+      handle.len = sizeof data;
+      handle.chunk = 100;
+
+      reader =
+         bson_reader_new_from_handle (&handle, _chunked_handle_read, NULL);
+      if (i == 1) {
+         bson_reader_set_buffer_policy (reader, 0, 0, 1);
+      } else if (i == 2) {
+         bson_reader_set_buffer_policy (reader, 0, 4096, 0);
+      }
+
+      BSON_ASSERT (!bson_reader_read (reader, &reached_eof));
+
+      /* the buffer grew no larger than the data read */
+      ASSERT_CMPSIZE_T (handle.max_request, <=, (size_t) 4096);
+      bson_reader_destroy (reader);
+   }
+}
+
+
 void
 test_reader_install (TestSuite *suite)
 {
@@ -333,4 +953,28 @@ test_reader_install (TestSuite *suite)
                   test_reader_from_handle_corrupt);
    TestSuite_Add (suite, "/bson/reader/grow_buffer", test_reader_grow_buffer);
    TestSuite_Add (suite, "/bson/reader/reset", test_reader_reset);
+   TestSuite_Add (
+      suite, "/bson/reader/read_batch/data", test_reader_read_batch_data);
+   TestSuite_Add (
+      suite, "/bson/reader/read_batch/handle", test_reader_read_batch_handle);
+   TestSuite_Add (suite,
+                  "/bson/reader/read_batch/corrupt",
+                  test_reader_read_batch_corrupt);
+   TestSuite_Add (suite, "/bson/reader/grow_to_fit", test_reader_grow_to_fit);
+   TestSuite_Add (
+      suite, "/bson/reader/buffer_policy", test_reader_buffer_policy);
+   TestSuite_Add (suite, "/bson/reader/bogus_length", test_reader_bogus_length);
+   TestSuite_Add (suite, "/bson/reader/prefetch", test_reader_prefetch);
+   TestSuite_Add (suite, "/bson/reader/prefetch/fd", test_reader_prefetch_fd);
+#ifdef BSON_OS_UNIX
+   TestSuite_Add (suite,
+                  "/bson/reader/prefetch/stalled_pipe",
+                  test_reader_prefetch_stalled_pipe);
+#endif
+   TestSuite_Add (suite, "/bson/reader/new_from_mmap", test_reader_from_mmap);
+   TestSuite_Add (
+      suite, "/bson/reader/new_from_mmap/flags", test_reader_from_mmap_flags);
+   TestSuite_Add (suite,
+                  "/bson/reader/new_from_mmap/corrupt",
+                  test_reader_from_mmap_corrupt);
 }
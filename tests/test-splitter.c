@@ -0,0 +1,389 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <fcntl.h>
+#include <bson.h>
+
+#include "bson-tests.h"
+#include "TestSuite.h"
+
+
+/* documents {"i": i, "s": "xxx..."} of 20 to 219 bytes */
+static uint8_t *
+_make_stream (int n_docs, size_t *len)
+{
+   uint8_t *data = NULL;
+   bson_t doc;
+   char str[200];
+   int i;
+
+   *len = 0;
+   memset (str, 'x', sizeof str);
+
+   for (i = 0; i < n_docs; i++) {
+      bson_init (&doc);
+      BSON_APPEND_INT32 (&doc, "i", i);
+      BSON_ASSERT (bson_append_utf8 (&doc, "s", -1, str, (i * 7) % 200));
+      data = bson_realloc (data, *len + doc.len);
+      memcpy (data + *len, bson_get_data (&doc), doc.len);
+      *len += doc.len;
+      bson_destroy (&doc);
+   }
+
+   return data;
+}
+
+
+/* read every shard in turn, checking they hold documents 0 to n_docs */
+static void
+_check_shards (const bson_splitter_t *splitter, uint64_t len, int n_docs)
+{
+   bson_reader_t *reader;
+   const bson_t *doc;
+   bson_iter_t iter;
+   uint64_t offset;
+   uint64_t shard_len;
+   uint64_t end = 0;
+   bool reached_eof;
+   int next = 0;
+   uint32_t i;
+
+   for (i = 0; i < bson_splitter_get_n_shards (splitter); i++) {
+      bson_splitter_get_shard (splitter, i, &offset, &shard_len);
+      ASSERT_CMPUINT64 (offset, ==, end);
+      BSON_ASSERT (shard_len > 0 || len == 0);
+      end = offset + shard_len;
+
+      reader = bson_splitter_reader_new (splitter, i);
+      while ((doc = bson_reader_read (reader, &reached_eof))) {
+         BSON_ASSERT (bson_iter_init_find (&iter, doc, "i"));
+         ASSERT_CMPINT (bson_iter_int32 (&iter), ==, next++);
+      }
+
+      BSON_ASSERT (reached_eof);
+      ASSERT_CMPUINT64 ((uint64_t) bson_reader_tell (reader), ==, shard_len);
+      bson_reader_destroy (reader);
+   }
+
+   ASSERT_CMPUINT64 (end, ==, len);
+   ASSERT_CMPINT (next, ==, n_docs);
+}
+
+
+static void
+test_splitter_data (void)
+{
+   uint32_t n_shards[] = {1, 2, 3, 7, 64, 999, 1000, 5000};
+   bson_splitter_t *splitter;
+   uint64_t shard_len;
+   uint8_t *data;
+   size_t len;
+   size_t i;
+   uint32_t j;
+   uint32_t n;
+
+   data = _make_stream (1000, &len);
+
+   for (i = 0; i < sizeof n_shards / sizeof n_shards[0]; i++) {
+      splitter = bson_splitter_new_from_data (data, len, n_shards[i]);
+      n = bson_splitter_get_n_shards (splitter);
+      ASSERT_CMPUINT32 (n, <=, BSON_MIN (n_shards[i], 1000));
+      _check_shards (splitter, len, 1000);
+
+      /* each shard but the last is within a document of its share */
+      if (n_shards[i] < 100) {
+         ASSERT_CMPUINT32 (n, ==, n_shards[i]);
+
+         for (j = 0; j + 1 < n_shards[i]; j++) {
+            bson_splitter_get_shard (splitter, j, NULL, &shard_len);
+            ASSERT_CMPUINT64 (shard_len + 219, >, len / n_shards[i]);
+            ASSERT_CMPUINT64 (shard_len, <, len / n_shards[i] + 2 * 219);
+         }
+      }
+
+      bson_splitter_destroy (splitter);
+   }
+
+   /* an empty stream */
+   splitter = bson_splitter_new_from_data (data, 0, 4);
+   ASSERT_CMPUINT32 (bson_splitter_get_n_shards (splitter), ==, 1u);
+   _check_shards (splitter, 0, 0);
+   bson_splitter_destroy (splitter);
+
+   bson_free (data);
+}
+
+
+static void
+test_splitter_large_docs (void)
+{
+   bson_splitter_t *splitter;
+   uint64_t offset;
+   bson_t doc;
+   char *str;
+   uint8_t *data;
+   uint8_t *small;
+   size_t small_len;
+   size_t len;
+
+   /* a document of over half the stream, then 100 small ones */
+   str = bson_malloc (10000);
+   memset (str, 'x', 10000);
+   bson_init (&doc);
+   BSON_APPEND_INT32 (&doc, "i", 0);
+   BSON_ASSERT (bson_append_utf8 (&doc, "s", -1, str, 10000));
+   len = doc.len;
+   data = bson_malloc (len);
+   memcpy (data, bson_get_data (&doc), len);
+   bson_destroy (&doc);
+   bson_free (str);
+
+   small = _make_stream (101, &small_len);
+   data = bson_realloc (data, len + small_len - 20);
+   memcpy (data + len, small + 20, small_len - 20);
+   len += small_len - 20;
+   bson_free (small);
+
+   /* the boundaries within the large document are skipped */
+   splitter = bson_splitter_new_from_data (data, len, 8);
+   ASSERT_CMPUINT32 (bson_splitter_get_n_shards (splitter), ==, 6u);
+   bson_splitter_get_shard (splitter, 1, &offset, NULL);
+   ASSERT_CMPUINT64 (offset, ==, (uint64_t) 10020);
+   _check_shards (splitter, len, 101);
+   bson_splitter_destroy (splitter);
+
+   bson_free (data);
+}
+
+
+static void
+test_splitter_corrupt (void)
+{
+   bson_splitter_t *splitter;
+   bson_reader_t *reader;
+   uint32_t n;
+   uint64_t offset;
+   uint64_t shard_offset;
+   uint64_t shard_len;
+   bool reached_eof;
+   uint8_t *data;
+   size_t len;
+   int32_t bad = BSON_UINT32_TO_LE (1);
+   int n_docs = 0;
+
+   data = _make_stream (1000, &len);
+
+   /* the length of the document at about 1/4 of the stream is corrupt */
+   splitter = bson_splitter_new_from_data (data, len, 4);
+   bson_splitter_get_shard (splitter, 1, &offset, NULL);
+   bson_splitter_destroy (splitter);
+   memcpy (data + offset, &bad, sizeof bad);
+
+   /* the documents before it are split, the rest is the last shard */
+   splitter = bson_splitter_new_from_data (data, len, 4);
+   n = bson_splitter_get_n_shards (splitter);
+   ASSERT_CMPUINT32 (n, ==, 2u);
+   bson_splitter_get_shard (splitter, 1, &shard_offset, &shard_len);
+   ASSERT_CMPUINT64 (shard_offset, ==, offset);
+   ASSERT_CMPUINT64 (shard_len, ==, len - offset);
+
+   reader = bson_splitter_reader_new (splitter, 0);
+   while (bson_reader_read (reader, &reached_eof)) {
+      n_docs++;
+   }
+
+   BSON_ASSERT (reached_eof);
+   BSON_ASSERT (n_docs > 0);
+   bson_reader_destroy (reader);
+
+   reader = bson_splitter_reader_new (splitter, 1);
+   BSON_ASSERT (!bson_reader_read (reader, &reached_eof));
+   BSON_ASSERT (!reached_eof);
+   bson_reader_destroy (reader);
+   bson_splitter_destroy (splitter);
+
+   bson_free (data);
+}
+
+
+static void
+test_splitter_file (void)
+{
+   bson_splitter_t *mmap_splitter;
+   bson_splitter_t *fd_splitter;
+   bson_error_t error;
+   uint64_t mmap_offset;
+   uint64_t mmap_len;
+   uint64_t fd_offset;
+   uint64_t fd_len;
+   uint32_t i;
+   int fd;
+
+   /* 1000 empty documents */
+   mmap_splitter = bson_splitter_new_from_mmap (
+      BINARY_DIR "/stream.bson", BSON_READER_MMAP_NONE, 6, &error);
+   ASSERT_OR_PRINT (mmap_splitter, error);
+
+   fd = bson_open (BINARY_DIR "/stream.bson", O_RDONLY);
+   BSON_ASSERT (-1 != fd);
+   fd_splitter = bson_splitter_new_from_fd (fd, true, 6, &error);
+   ASSERT_OR_PRINT (fd_splitter, error);
+
+   ASSERT_CMPUINT32 (bson_splitter_get_n_shards (mmap_splitter), ==, 6u);
+   ASSERT_CMPUINT32 (bson_splitter_get_n_shards (fd_splitter), ==, 6u);
+
+   for (i = 0; i < 6; i++) {
+      bson_splitter_get_shard (mmap_splitter, i, &mmap_offset, &mmap_len);
+      bson_splitter_get_shard (fd_splitter, i, &fd_offset, &fd_len);
+      ASSERT_CMPUINT64 (mmap_offset, ==, fd_offset);
+      ASSERT_CMPUINT64 (mmap_len, ==, fd_len);
+      ASSERT_CMPUINT64 (mmap_offset % 5, ==, (uint64_t) 0);
+   }
+
+   bson_splitter_destroy (mmap_splitter);
+   bson_splitter_destroy (fd_splitter);
+
+   mmap_splitter = bson_splitter_new_from_mmap (
+      BINARY_DIR "/does-not-exist.bson", BSON_READER_MMAP_NONE, 6, &error);
+   BSON_ASSERT (!mmap_splitter);
+   ASSERT_CMPUINT32 (error.domain, ==, (uint32_t) BSON_ERROR_READER);
+}
+
+
+static void
+test_splitter_fd_read (void)
+{
+   bson_splitter_t *splitter;
+   bson_error_t error;
+   char path[64];
+   FILE *f;
+   uint8_t *data;
+   size_t len;
+   int fd;
+
+   /* larger than the window used to look up document lengths */
+   data = _make_stream (3000, &len);
+   BSON_ASSERT (len > 64 * 1024 * 4);
+
+   bson_snprintf (path,
+                  sizeof path,
+                  "test-splitter-%d.bson",
+                  (int) bson_get_monotonic_time ());
+   f = fopen (path, "wb");
+   BSON_ASSERT (f);
+   ASSERT_CMPSIZE_T (fwrite (data, 1, len, f), ==, len);
+   fclose (f);
+
+   fd = bson_open (path, O_RDONLY);
+   BSON_ASSERT (-1 != fd);
+
+   splitter = bson_splitter_new_from_fd (fd, true, 4, &error);
+   ASSERT_OR_PRINT (splitter, error);
+   ASSERT_CMPUINT32 (bson_splitter_get_n_shards (splitter), ==, 4u);
+   _check_shards (splitter, len, 3000);
+   bson_splitter_destroy (splitter);
+
+   remove (path);
+   bson_free (data);
+}
+
+
+/* documents larger than the window, then small ones */
+static void
+test_splitter_fd_large_docs (void)
+{
+   bson_splitter_t *splitter;
+   bson_error_t error;
+   char path[64];
+   char *str;
+   FILE *f;
+   bson_t doc;
+   uint64_t len = 0;
+   int fd;
+   int i;
+
+   bson_snprintf (path,
+                  sizeof path,
+                  "test-splitter-large-%d.bson",
+                  (int) bson_get_monotonic_time ());
+   f = fopen (path, "wb");
+   BSON_ASSERT (f);
+
+   str = bson_malloc (100000);
+   memset (str, 'x', 100000);
+
+   for (i = 0; i < 120; i++) {
+      bson_init (&doc);
+      BSON_APPEND_INT32 (&doc, "i", i);
+      BSON_ASSERT (
+         bson_append_utf8 (&doc, "s", -1, str, i < 20 ? 100000 : i % 50));
+      ASSERT_CMPSIZE_T (
+         fwrite (bson_get_data (&doc), 1, doc.len, f), ==, (size_t) doc.len);
+      len += doc.len;
+      bson_destroy (&doc);
+   }
+
+   BSON_ASSERT (fclose (f) == 0);
+
+   fd = bson_open (path, O_RDONLY);
+   BSON_ASSERT (-1 != fd);
+
+   splitter = bson_splitter_new_from_fd (fd, true, 8, &error);
+   ASSERT_OR_PRINT (splitter, error);
+   ASSERT_CMPUINT32 (bson_splitter_get_n_shards (splitter), ==, 8u);
+   _check_shards (splitter, len, 120);
+   bson_splitter_destroy (splitter);
+
+   remove (path);
+   bson_free (str);
+}
+
+
+#ifdef BSON_OS_UNIX
+static void
+test_splitter_fd_not_regular (void)
+{
+   bson_error_t error;
+   int fds[2];
+
+   BSON_ASSERT (!pipe (fds));
+   BSON_ASSERT (!bson_splitter_new_from_fd (fds[0], false, 4, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_READER,
+                          BSON_ERROR_READER_BADFD,
+                          "is not a regular file");
+   close (fds[0]);
+   close (fds[1]);
+}
+#endif
+
+
+void
+test_splitter_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/splitter/data", test_splitter_data);
+   TestSuite_Add (suite, "/bson/splitter/large_docs", test_splitter_large_docs);
+   TestSuite_Add (suite, "/bson/splitter/corrupt", test_splitter_corrupt);
+   TestSuite_Add (suite, "/bson/splitter/file", test_splitter_file);
+   TestSuite_Add (suite, "/bson/splitter/fd_read", test_splitter_fd_read);
+   TestSuite_Add (
+      suite, "/bson/splitter/fd_large_docs", test_splitter_fd_large_docs);
+#ifdef BSON_OS_UNIX
+   TestSuite_Add (
+      suite, "/bson/splitter/fd_not_regular", test_splitter_fd_not_regular);
+#endif
+}
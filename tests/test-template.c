@@ -0,0 +1,371 @@
+/*
+ * Copyright 2018 MongoDB, Inc.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *   http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <bcon.h>
+#include <bson.h>
+
+#include "TestSuite.h"
+
+
+static void
+_assert_instance (bson_template_t *tmpl,
+                  const bson_value_t *values,
+                  const bson_t *expected)
+{
+   bson_error_t error;
+   bson_t dst;
+
+   ASSERT_OR_PRINT (bson_template_instantiate (tmpl, values, &dst, &error),
+                    error);
+   ASSERT (bson_validate (&dst, BSON_VALIDATE_NONE, NULL));
+   if (!bson_equal (&dst, expected)) {
+      fprintf (stderr,
+               "expected %s\ngot %s\n",
+               bson_as_canonical_extended_json (expected, NULL),
+               bson_as_canonical_extended_json (&dst, NULL));
+      abort ();
+   }
+
+   bson_destroy (&dst);
+}
+
+
+static bson_template_t *
+_nested_template (void)
+{
+   return BSON_TEMPLATE_NEW ("n",
+                             BCON_INT32 (1),
+                             "sub",
+                             "{",
+                             "x",
+                             BCON_DOUBLE (1.5),
+                             "name",
+                             BCON_UTF8 ("abc"),
+                             "}",
+                             "arr",
+                             "[",
+                             BCON_INT64 (2),
+                             BCON_BOOL (false),
+                             "]",
+                             "empty",
+                             "[",
+                             "]",
+                             "t",
+                             BCON_DATE_TIME (3));
+}
+
+
+static void
+test_template_slots (void)
+{
+   bson_template_t *tmpl;
+
+   tmpl = _nested_template ();
+
+   ASSERT_CMPSIZE_T (bson_template_n_slots (tmpl), ==, (size_t) 7);
+   ASSERT_CMPSSIZE_T (bson_template_slot (tmpl, "n"), ==, (ssize_t) 0);
+   ASSERT_CMPSSIZE_T (bson_template_slot (tmpl, "sub.x"), ==, (ssize_t) 1);
+   ASSERT_CMPSSIZE_T (bson_template_slot (tmpl, "sub.name"), ==, (ssize_t) 2);
+   ASSERT_CMPSSIZE_T (bson_template_slot (tmpl, "arr.0"), ==, (ssize_t) 3);
+   ASSERT_CMPSSIZE_T (bson_template_slot (tmpl, "arr.1"), ==, (ssize_t) 4);
+   ASSERT_CMPSSIZE_T (bson_template_slot (tmpl, "empty"), ==, (ssize_t) 5);
+   ASSERT_CMPSSIZE_T (bson_template_slot (tmpl, "t"), ==, (ssize_t) 6);
+
+   /* non-empty documents and arrays are not slots */
+   ASSERT_CMPSSIZE_T (bson_template_slot (tmpl, "sub"), ==, (ssize_t) -1);
+   ASSERT_CMPSSIZE_T (bson_template_slot (tmpl, "arr"), ==, (ssize_t) -1);
+   ASSERT_CMPSSIZE_T (bson_template_slot (tmpl, "missing"), ==, (ssize_t) -1);
+
+   bson_template_destroy (tmpl);
+}
+
+
+static void
+test_template_fixed_width (void)
+{
+   bson_value_t values[7] = {{0}};
+   bson_template_t *tmpl;
+   bson_t *expected;
+
+   tmpl = _nested_template ();
+
+   values[0].value_type = BSON_TYPE_INT32;
+   values[0].value.v_int32 = -7;
+   values[1].value_type = BSON_TYPE_DOUBLE;
+   values[1].value.v_double = 2.25;
+   values[3].value_type = BSON_TYPE_INT64;
+   values[3].value.v_int64 = INT64_MAX;
+   values[4].value_type = BSON_TYPE_BOOL;
+   values[4].value.v_bool = true;
+   values[6].value_type = BSON_TYPE_DATE_TIME;
+   values[6].value.v_datetime = 1234567890123;
+
+   expected = BCON_NEW ("n",
+                        BCON_INT32 (-7),
+                        "sub",
+                        "{",
+                        "x",
+                        BCON_DOUBLE (2.25),
+                        "name",
+                        BCON_UTF8 ("abc"),
+                        "}",
+                        "arr",
+                        "[",
+                        BCON_INT64 (INT64_MAX),
+                        BCON_BOOL (true),
+                        "]",
+                        "empty",
+                        "[",
+                        "]",
+                        "t",
+                        BCON_DATE_TIME (1234567890123));
+
+   _assert_instance (tmpl, values, expected);
+
+   /* the template is reusable, and unset values keep the prototype's */
+   bson_destroy (expected);
+   memset (values, 0, sizeof values);
+   values[1].value_type = BSON_TYPE_NULL;
+
+   expected = BCON_NEW ("n",
+                        BCON_INT32 (1),
+                        "sub",
+                        "{",
+                        "x",
+                        BCON_NULL,
+                        "name",
+                        BCON_UTF8 ("abc"),
+                        "}",
+                        "arr",
+                        "[",
+                        BCON_INT64 (2),
+                        BCON_BOOL (false),
+                        "]",
+                        "empty",
+                        "[",
+                        "]",
+                        "t",
+                        BCON_DATE_TIME (3));
+
+   _assert_instance (tmpl, values, expected);
+
+   bson_destroy (expected);
+   bson_template_destroy (tmpl);
+}
+
+
+static void
+test_template_resized (void)
+{
+   const char *long_name = "a name that no longer fits inline in the bson_t";
+   bson_value_t values[7] = {{0}};
+   bson_template_t *tmpl;
+   bson_t *expected;
+   bson_t *items;
+
+   tmpl = _nested_template ();
+   items = BCON_NEW ("0", BCON_UTF8 ("x"), "1", BCON_UTF8 ("y"));
+
+   /* a longer string, a change of type, and an array in the empty slot */
+   values[0].value_type = BSON_TYPE_UTF8;
+   values[0].value.v_utf8.str = "one";
+   values[0].value.v_utf8.len = 3;
+   values[2].value_type = BSON_TYPE_UTF8;
+   values[2].value.v_utf8.str = (char *) long_name;
+   values[2].value.v_utf8.len = (uint32_t) strlen (long_name);
+   values[3].value_type = BSON_TYPE_INT32;
+   values[3].value.v_int32 = 4;
+   values[5].value_type = BSON_TYPE_ARRAY;
+   values[5].value.v_doc.data = (uint8_t *) bson_get_data (items);
+   values[5].value.v_doc.data_len = items->len;
+
+   expected = BCON_NEW ("n",
+                        BCON_UTF8 ("one"),
+                        "sub",
+                        "{",
+                        "x",
+                        BCON_DOUBLE (1.5),
+                        "name",
+                        BCON_UTF8 (long_name),
+                        "}",
+                        "arr",
+                        "[",
+                        BCON_INT32 (4),
+                        BCON_BOOL (false),
+                        "]",
+                        "empty",
+                        "[",
+                        BCON_UTF8 ("x"),
+                        BCON_UTF8 ("y"),
+                        "]",
+                        "t",
+                        BCON_DATE_TIME (3));
+
+   _assert_instance (tmpl, values, expected);
+   bson_destroy (expected);
+
+   /* a shorter string and a value without data */
+   memset (values, 0, sizeof values);
+   values[2].value_type = BSON_TYPE_UTF8;
+   values[2].value.v_utf8.str = "";
+   values[2].value.v_utf8.len = 0;
+   values[6].value_type = BSON_TYPE_MAXKEY;
+
+   expected = BCON_NEW ("n",
+                        BCON_INT32 (1),
+                        "sub",
+                        "{",
+                        "x",
+                        BCON_DOUBLE (1.5),
+                        "name",
+                        BCON_UTF8 (""),
+                        "}",
+                        "arr",
+                        "[",
+                        BCON_INT64 (2),
+                        BCON_BOOL (false),
+                        "]",
+                        "empty",
+                        "[",
+                        "]",
+                        "t",
+                        BCON_MAXKEY);
+
+   _assert_instance (tmpl, values, expected);
+
+   bson_destroy (expected);
+   bson_destroy (items);
+   bson_template_destroy (tmpl);
+}
+
+
+static void
+test_template_all_types (void)
+{
+   bson_value_t values[16] = {{0}};
+   bson_template_t *tmpl;
+   bson_decimal128_t dec;
+   bson_iter_t iter;
+   bson_oid_t oid;
+   bson_t expected;
+   size_t i;
+
+   tmpl = BSON_TEMPLATE_NEW ("a",
+                             BCON_NULL,
+                             "b",
+                             BCON_NULL,
+                             "c",
+                             BCON_NULL,
+                             "d",
+                             BCON_NULL,
+                             "e",
+                             BCON_NULL,
+                             "f",
+                             BCON_NULL,
+                             "g",
+                             BCON_NULL,
+                             "h",
+                             BCON_NULL);
+   ASSERT_CMPSIZE_T (bson_template_n_slots (tmpl), ==, (size_t) 8);
+
+   bson_oid_init_from_string (&oid, "0123456789abcdef01234567");
+   bson_decimal128_from_string ("1.5E+3", &dec);
+
+   bson_init (&expected);
+   BSON_APPEND_OID (&expected, "a", &oid);
+   BSON_APPEND_DECIMAL128 (&expected, "b", &dec);
+   BSON_APPEND_TIMESTAMP (&expected, "c", 1234, 5678);
+   BSON_APPEND_REGEX (&expected, "d", "^a", "i");
+   BSON_APPEND_BINARY (
+      &expected, "e", BSON_SUBTYPE_BINARY, (const uint8_t *) "xyz", 3);
+   BSON_APPEND_CODE (&expected, "f", "function () {}");
+   BSON_APPEND_MINKEY (&expected, "g");
+   BSON_APPEND_UNDEFINED (&expected, "h");
+
+   ASSERT (bson_iter_init (&iter, &expected));
+   for (i = 0; bson_iter_next (&iter); i++) {
+      bson_value_copy (bson_iter_value (&iter), &values[i]);
+   }
+
+   _assert_instance (tmpl, values, &expected);
+
+   for (i = 0; i < 8; i++) {
+      bson_value_destroy (&values[i]);
+   }
+
+   bson_destroy (&expected);
+   bson_template_destroy (tmpl);
+}
+
+
+static void
+test_template_empty (void)
+{
+   bson_template_t *tmpl;
+   bson_t empty = BSON_INITIALIZER;
+
+   tmpl = bson_template_new (&empty, NULL);
+   ASSERT_CMPSIZE_T (bson_template_n_slots (tmpl), ==, (size_t) 0);
+   _assert_instance (tmpl, NULL, &empty);
+   bson_template_destroy (tmpl);
+}
+
+
+static void
+test_template_errors (void)
+{
+   /* {"a": <truncated string>} */
+   static const uint8_t data[] = {
+      15, 0, 0, 0, 0x02, 'a', 0, 100, 0, 0, 0, 'x', 'y', 0, 0};
+   bson_value_t values[1] = {{0}};
+   bson_template_t *tmpl;
+   bson_error_t error;
+   bson_t prototype;
+   bson_t dst;
+
+   ASSERT (bson_init_static (&prototype, data, sizeof data));
+   ASSERT (!bson_template_new (&prototype, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_TEMPLATE,
+                          BSON_TEMPLATE_ERROR_CORRUPT_BSON,
+                          "corrupt BSON in the prototype");
+
+   tmpl = BSON_TEMPLATE_NEW ("a", BCON_INT32 (1));
+   values[0].value_type = (bson_type_t) 0x42;
+   ASSERT (!bson_template_instantiate (tmpl, values, &dst, &error));
+   ASSERT_ERROR_CONTAINS (error,
+                          BSON_ERROR_TEMPLATE,
+                          BSON_TEMPLATE_ERROR_INVALID_VALUE,
+                          "cannot encode the value of slot \"a\"");
+   ASSERT (bson_empty (&dst));
+
+   bson_destroy (&dst);
+   bson_template_destroy (tmpl);
+}
+
+
+void
+test_template_install (TestSuite *suite)
+{
+   TestSuite_Add (suite, "/bson/template/slots", test_template_slots);
+   TestSuite_Add (
+      suite, "/bson/template/fixed_width", test_template_fixed_width);
+   TestSuite_Add (suite, "/bson/template/resized", test_template_resized);
+   TestSuite_Add (suite, "/bson/template/all_types", test_template_all_types);
+   TestSuite_Add (suite, "/bson/template/empty", test_template_empty);
+   TestSuite_Add (suite, "/bson/template/errors", test_template_errors);
+}
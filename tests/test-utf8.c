@@ -243,6 +243,184 @@ test_bson_utf8_non_shortest (void)
 }
 
 
+/* a straightforward reference for bson_utf8_validate's rules */
+static bool
+_utf8_validate_reference (const uint8_t *s, size_t len, bool allow_null)
+{
+   uint32_t c;
+   size_t i = 0;
+   size_t n;
+   size_t j;
+
+   while (i < len) {
+      if (s[i] < 0x80) {
+         if (!s[i] && !allow_null) {
+            return false;
+         }
+         i++;
+         continue;
+      } else if (s[i] >= 0xC2 && s[i] <= 0xDF) {
+         n = 2;
+         c = s[i] & 0x1F;
+      } else if (s[i] >= 0xE0 && s[i] <= 0xEF) {
+         n = 3;
+         c = s[i] & 0x0F;
+      } else if (s[i] >= 0xF0 && s[i] <= 0xF4) {
+         n = 4;
+         c = s[i] & 0x07;
+      } else if (s[i] == 0xC0 && allow_null && i + 1 < len &&
+                 s[i + 1] == 0x80) {
+         /* two byte encoding of NUL */
+         i += 2;
+         continue;
+      } else {
+         return false;
+      }
+
+      if (len - i < n) {
+         return false;
+      }
+
+      for (j = 1; j < n; j++) {
+         if ((s[i + j] & 0xC0) != 0x80) {
+            return false;
+         }
+         c = (c << 6) | (s[i + j] & 0x3F);
+      }
+
+      if ((n == 3 && c < 0x800) || (n == 4 && c < 0x10000) || c > 0x10FFFF ||
+          (c >= 0xD800 && c <= 0xDFFF)) {
+         return false;
+      }
+
+      i += n;
+   }
+
+   return true;
+}
+
+
+static void
+test_bson_utf8_validate_offsets (void)
+{
+   static const char *seqs[] = {
+      "\xC3\xBF",         /* valid two byte */
+      "\xE2\x82\xAC",     /* valid three byte */
+      "\xF0\x9F\x98\x80", /* valid four byte */
+      "\xF4\x8F\xBF\xBF", /* U+10FFFF */
+      "\xC0\x80",         /* two byte NUL */
+      "\x80",             /* lone continuation */
+      "\xC3",             /* truncated two byte */
+      "\xE2\x82",         /* truncated three byte */
+      "\xF0\x9F\x98",     /* truncated four byte */
+      "\xC1\xBF",         /* overlong two byte */
+      "\xE0\x9F\xBF",     /* overlong three byte */
+      "\xF0\x8F\xBF\xBF", /* overlong four byte */
+      "\xED\xA0\x80",     /* surrogate */
+      "\xF4\x90\x80\x80", /* too large */
+      "\xF8\x88\x80\x80\x80",
+      "\xFF",
+      "\xE2\x82\xAC\x80", /* extra continuation */
+      NULL};
+   char buf[160];
+   size_t len;
+   size_t off;
+   size_t seq_len;
+   bool expected;
+   int allow_null;
+   int i;
+
+   /* place each sequence at every offset around the 16 and 32 byte blocks */
+   for (i = 0; seqs[i]; i++) {
+      seq_len = strlen (seqs[i]);
+
+      for (len = seq_len; len < sizeof buf; len += 7) {
+         for (off = 0; off + seq_len <= len; off++) {
+            memset (buf, 'a', len);
+            memcpy (buf + off, seqs[i], seq_len);
+
+            for (allow_null = 0; allow_null < 2; allow_null++) {
+               expected = _utf8_validate_reference (
+                  (const uint8_t *) buf, len, allow_null == 1);
+               if (bson_utf8_validate (buf, len, allow_null == 1) !=
+                   expected) {
+                  fprintf (stderr,
+                           "sequence %d at %d of %d, allow_null %d\n",
+                           i,
+                           (int) off,
+                           (int) len,
+                           allow_null);
+                  BSON_ASSERT (false);
+               }
+            }
+         }
+      }
+   }
+
+   /* a NUL byte anywhere */
+   for (len = 1; len < sizeof buf; len += 5) {
+      for (off = 0; off < len; off++) {
+         memset (buf, 'a', len);
+         buf[off] = '\0';
+         BSON_ASSERT (!bson_utf8_validate (buf, len, false));
+         BSON_ASSERT (bson_utf8_validate (buf, len, true));
+      }
+   }
+}
+
+
+static void
+test_bson_utf8_validate_random (void)
+{
+   static const uint8_t bytes[] = {
+      0x00, 0x01, 'a',  0x7F, 0x80, 0x8F, 0x90, 0x9F, 0xA0, 0xBF, 0xC0,
+      0xC1, 0xC2, 0xDF, 0xE0, 0xE1, 0xED, 0xEF, 0xF0, 0xF1, 0xF4, 0xF5,
+      0xF8, 0xFF};
+   uint8_t buf[200];
+   char seq[6];
+   uint32_t cp;
+   uint32_t n;
+   size_t len;
+   size_t i;
+   int iter;
+   bool allow_null;
+
+   for (iter = 0; iter < 20000; iter++) {
+      len = (size_t) (rand () % (int) sizeof buf);
+
+      for (i = 0; i < len;) {
+         if (rand () % 4) {
+            /* mostly valid code points, so errors land anywhere */
+            do {
+               cp = (uint32_t) rand () % ((rand () % 3) ? 0x800 : 0x110000);
+            } while (cp >= 0xD800 && cp <= 0xDFFF);
+            bson_utf8_from_unichar (cp, seq, &n);
+            if (i + n > len) {
+               break;
+            }
+            memcpy (buf + i, seq, n);
+            i += n;
+         } else {
+            buf[i++] = bytes[rand () % (int) sizeof bytes];
+         }
+      }
+
+      len = i;
+      allow_null = rand () % 2;
+
+      if (bson_utf8_validate ((const char *) buf, len, allow_null) !=
+          _utf8_validate_reference (buf, len, allow_null)) {
+         fprintf (stderr, "mismatch, allow_null %d:", (int) allow_null);
+         for (i = 0; i < len; i++) {
+            fprintf (stderr, " %02x", buf[i]);
+         }
+         fprintf (stderr, "\n");
+         BSON_ASSERT (false);
+      }
+   }
+}
+
+
 void
 test_utf8_install (TestSuite *suite)
 {
@@ -257,4 +435,8 @@ test_utf8_install (TestSuite *suite)
       suite, "/bson/utf8/from_unichar", test_bson_utf8_from_unichar);
    TestSuite_Add (
       suite, "/bson/utf8/non_shortest", test_bson_utf8_non_shortest);
+   TestSuite_Add (
+      suite, "/bson/utf8/validate_offsets", test_bson_utf8_validate_offsets);
+   TestSuite_Add (
+      suite, "/bson/utf8/validate_random", test_bson_utf8_validate_random);
 }